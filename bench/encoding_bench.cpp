@@ -0,0 +1,198 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Benchmarks for the encoding conversion path: ConvertOutput(),
+// ConvertOutputTo(), ConvertText(), EncodingConverter and the code page
+// lookups.
+//
+// Build it like the unit tests, with the console code page forced to 850, so
+// the results don't depend on the machine's console:
+//  g++ -std=c++11 -O2 -DPCBLUESY_UNIT_TEST -DPCBLUESY_ALL_FULLHEADER -I src
+//      bench/encoding_bench.cpp src/ms_windows/*.cpp
+//      -lboost_locale -licuuc -licudata -lpthread -o encoding_bench
+//
+// Usage: encoding_bench [filter [min_ms]]
+// Runs the benchmarks whose name contains filter (all, by default), each for
+// at least min_ms milliseconds (200, by default), and reports ns per call and
+// MB/s of input. Must run under a UTF-8 locale, since that's what char input
+// is taken to be in.
+
+#include "ms_windows/code_page.h"
+#include "ms_windows/encoding_converter.h"
+#include "ms_windows/win_console_out.h"
+namespace mw = pt::pcaetano::bluesy::ms_windows;
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+using std::string;
+using std::wstring;
+
+namespace
+{
+
+// Everything the benchmarks produce goes here, so the compiler can't drop it.
+std::size_t volatile sink;
+
+struct Result
+{
+    double nsPerCall;
+    double mbPerSec;
+};
+
+// Calls fn in batches, doubling the batch until a batch takes at least minMs.
+Result Measure(std::function<std::size_t()> const& fn, std::size_t bytesPerCall, long minMs)
+{
+    using clock = std::chrono::steady_clock;
+    std::size_t acc = 0;
+
+    for (unsigned long iterations = 1; ; iterations *= 2)
+    {
+        auto start = clock::now();
+        for (unsigned long i = 0; i < iterations; ++i)
+        {
+            acc += fn();
+        }
+        double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+        if (ns >= minMs * 1e6)
+        {
+            sink = acc;
+            double perCall = ns / iterations;
+            return Result{perCall, (bytesPerCall * 1e3) / perCall};
+        }
+    }
+}
+
+class Runner
+{
+public:
+    Runner(char const* filter, long minMs) : filter{filter}, minMs{minMs}
+    {
+        std::printf("%-56s %12s %10s\n", "benchmark", "ns/call", "MB/s");
+    }
+
+    void Run(string const& name, std::size_t bytesPerCall, std::function<std::size_t()> const& fn)
+    {
+        if (name.find(filter) == string::npos)
+        {
+            return;
+        }
+
+        Result r = Measure(fn, bytesPerCall, minMs);
+        std::printf("%-56s %12.1f %10.1f\n", name.c_str(), r.nsPerCall, r.mbPerSec);
+    }
+private:
+    string filter;
+    long minMs;
+};
+
+// Text samples. Accented text is valid UTF-8, which is what char input is
+// taken to be in, with the locale we require.
+string const shortAscii{"Processing file 12 of 40\n"};
+string const shortAccented{"Opera\xC3\xA7\xC3\xA3o conclu\xC3\xAD" "da com \xC3\xAAxito\n"};
+wstring const shortAsciiW{L"Processing file 12 of 40\n"};
+wstring const shortAccentedW{L"Operação concluída com êxito\n"};
+
+template <typename String>
+String Repeat(String const& s, std::size_t minLen)
+{
+    String r;
+    while (r.size() < minLen)
+    {
+        r += s;
+    }
+    return r;
+}
+
+std::size_t const longLen = 64 * 1024;
+
+template <typename CharT>
+void RunTextCases(Runner& r, string const& label, std::basic_string<CharT> const& s)
+{
+    std::size_t bytes = s.size() * sizeof(CharT);
+    CharT const* p = s.c_str();
+
+    // The console's converter, cached per thread.
+    r.Run("ConvertOutput/" + label, bytes, [p] { return mw::ConvertOutput(p).size(); });
+
+    // Straight to wchar_t, e.g., for WriteConsoleW().
+    auto wide = std::make_shared<wstring>();
+    r.Run("ConvertOutputTo<wstring>/" + label, bytes,
+        [p, wide] { wide->clear(); mw::ConvertOutputTo(p, *wide); return wide->size(); });
+
+    // Resolves the encodings and creates its converters on every call.
+    r.Run("ConvertText/" + label, bytes, [p] { return mw::ConvertText(p, "cp850", "UTF-8").size(); });
+
+    // Converters created once, reused on every call.
+    auto conv = std::make_shared<mw::EncodingConverter>("cp850", "UTF-8");
+    r.Run("EncodingConverter::Convert/" + label, bytes,
+        [conv, &s] { return conv->Convert(s.data(), s.size()).size(); });
+
+    // Reused converter and output buffer; no allocation in the steady state.
+    auto out = std::make_shared<string>();
+    r.Run("EncodingConverter::ConvertAppend/" + label, bytes,
+        [conv, out, &s] { out->clear(); conv->ConvertAppend(s.data(), s.size(), *out); return out->size(); });
+}
+
+} // unnamed namespace
+
+
+int main(int argc, char* argv[])
+{
+    char const* filter = (argc > 1) ? argv[1] : "";
+    long minMs = (argc > 2) ? std::atol(argv[2]) : 200;
+    Runner r{filter, (minMs > 0) ? minMs : 200};
+
+    r.Run("GetEncoding(850)", 0, [] { return mw::GetEncoding(850).size(); });
+    r.Run("GetCodePage(\"Windows-1252\")", 0,
+        [] { return static_cast<std::size_t>(mw::GetCodePage("Windows-1252")); });
+    r.Run("FindEncoding(1252)", 0, [] { return static_cast<std::size_t>(*mw::FindEncoding(1252)); });
+
+    string const longAscii = Repeat(shortAscii, longLen);
+    string const longAccented = Repeat(shortAccented, longLen);
+    wstring const longAsciiW = Repeat(shortAsciiW, longLen / sizeof(wchar_t));
+    wstring const longAccentedW = Repeat(shortAccentedW, longLen / sizeof(wchar_t));
+
+    RunTextCases(r, "short/ascii/char", shortAscii);
+    RunTextCases(r, "short/accented/char", shortAccented);
+    RunTextCases(r, "short/ascii/wchar_t", shortAsciiW);
+    RunTextCases(r, "short/accented/wchar_t", shortAccentedW);
+    RunTextCases(r, "long/ascii/char", longAscii);
+    RunTextCases(r, "long/accented/char", longAccented);
+    RunTextCases(r, "long/ascii/wchar_t", longAsciiW);
+    RunTextCases(r, "long/accented/wchar_t", longAccentedW);
+
+    // A multibyte code page, which goes through ICU.
+    auto icu = std::make_shared<mw::EncodingConverter>("cp932", "UTF-8");
+    r.Run("EncodingConverter::Convert/long/accented/char/cp932", longAccented.size(),
+        [icu, &longAccented] { return icu->Convert(longAccented.data(), longAccented.size()).size(); });
+}
@@ -0,0 +1,150 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Converts a (possibly huge) text file from one encoding to another, e.g.,
+// legacy cp850/cp1252 logs to UTF-8, using every core:
+//  bulk_transcode -i app.log -o app.utf8.log -f cp850
+//
+// Needs bulk_transcoder.cpp, encoding_converter.cpp and native_codec.cpp, plus
+// converting_streambuf.cpp and win_console_out.cpp (for AppOptions' help
+// output), and linking with Boost Program Options, Boost Locale and ICU.
+
+#define PCBLUESY_MSWINDCON_FULLHEADER
+#include "app_config/prog_options.h"
+using pt::pcaetano::bluesy::config::AppOptions;
+using pt::pcaetano::bluesy::config::ConfigInvalidOption;
+using pt::pcaetano::bluesy::config::error_message;
+#include "ms_windows/bulk_transcoder.h"
+using pt::pcaetano::bluesy::ms_windows::BulkTranscoder;
+using pt::pcaetano::bluesy::ms_windows::BulkTranscodeStats;
+
+#include "boost/exception/diagnostic_information.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+using std::cerr;
+using std::cout;
+#include <string>
+using std::string;
+
+class BulkTranscodeOptions
+{
+public:
+    void DefineOptions(po::options_description& desc);
+    std::string GetHelpOption() const { return "help"; }
+    void Validate();
+
+    string const& GetInputFile() const { return inputFile; }
+    string const& GetOutputFile() const { return outputFile; }
+    string const& GetEncodingFrom() const { return encFrom; }
+    string const& GetEncodingTo() const { return encTo; }
+    unsigned GetThreadCount() const { return threads; }
+    std::size_t GetChunkSize() const { return chunkSizeMiB * 1024 * 1024; }
+    bool WantsPreallocation() const { return !noPrealloc; }
+private:
+    friend std::ostream& operator<<(std::ostream& os, BulkTranscodeOptions const& obj);
+
+    string inputFile;
+    string outputFile;
+    string encFrom;
+    string encTo;
+    unsigned threads = 0;
+    std::size_t chunkSizeMiB = 0;
+    bool noPrealloc = false;
+};
+
+void BulkTranscodeOptions::DefineOptions(po::options_description& desc)
+{
+    desc.add_options()
+        ("help,h", "Show this help message")
+        ("input,i", po::value<string>(&inputFile)->required(), "File to convert")
+        ("output,o", po::value<string>(&outputFile)->required(), "Converted file (replaced, if it exists)")
+        ("from,f", po::value<string>(&encFrom)->default_value("cp850"), "Encoding of the input file")
+        ("to,t", po::value<string>(&encTo)->default_value("UTF-8"), "Encoding of the output file")
+        ("threads,j", po::value<unsigned>(&threads)->default_value(0), "Worker threads (0 - one per core)")
+        ("chunk,c", po::value<std::size_t>(&chunkSizeMiB)->default_value(
+            BulkTranscoder::defaultChunkSize / (1024 * 1024)), "Chunk size, in MiB")
+        ("no-prealloc", po::bool_switch(&noPrealloc)->default_value(false),
+            "Don't preallocate the output file")
+    ;
+}
+
+void BulkTranscodeOptions::Validate()
+{
+    if (chunkSizeMiB == 0)
+    {
+        BOOST_THROW_EXCEPTION(ConfigInvalidOption() << error_message("Chunk size must be at least 1 MiB"));
+    }
+
+    if (inputFile == outputFile)
+    {
+        BOOST_THROW_EXCEPTION(ConfigInvalidOption() << error_message("Input and output must be different files"));
+    }
+}
+
+std::ostream& operator<<(std::ostream& os, BulkTranscodeOptions const& obj)
+{
+    os << obj.inputFile << " (" << obj.encFrom << ") -> " << obj.outputFile << " (" << obj.encTo << ")";
+
+    return os;
+}
+
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        AppOptions<BulkTranscodeOptions> ao(argc, argv, "bulk_transcode options");
+
+        if (ao.HaveShownHelp())
+        {
+            return 0;
+        }
+
+        BulkTranscodeOptions const& opt = ao.GetOptions();
+        BulkTranscoder bt{opt.GetEncodingTo(), opt.GetEncodingFrom()};
+        bt.SetThreadCount(opt.GetThreadCount());
+        bt.SetChunkSize(opt.GetChunkSize());
+        bt.SetPreallocate(opt.WantsPreallocation());
+
+        auto start = std::chrono::steady_clock::now();
+        BulkTranscodeStats stats = bt.Transcode(opt.GetInputFile(), opt.GetOutputFile());
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        cout << ao << "\n"
+            << stats.bytesRead << " bytes read, " << stats.bytesWritten << " bytes written, "
+            << stats.chunks << " chunks, " << stats.threads << " threads, " << secs << " s ("
+            << ((secs > 0) ? stats.bytesRead / secs / (1024 * 1024) : 0) << " MiB/s)\n";
+    }
+    catch (std::exception const& e)
+    {
+        cerr << boost::diagnostic_information(e) << "\n";
+        return 1;
+    }
+}
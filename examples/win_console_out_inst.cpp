@@ -36,5 +36,22 @@ template std::string ConvertOutput(std::basic_string<char> const& s);
 template std::string ConvertOutput(wchar_t const* s);
 template std::string ConvertOutput(std::basic_string<wchar_t> const& s);
 
+template std::string ConvertOutputTo<std::string>(char const* s);
+template std::string ConvertOutputTo<std::string>(wchar_t const* s);
+template std::wstring ConvertOutputTo<std::wstring>(char const* s);
+template std::wstring ConvertOutputTo<std::wstring>(wchar_t const* s);
+template std::string ConvertOutputTo<std::string>(std::basic_string<char> const& s);
+template std::string ConvertOutputTo<std::string>(std::basic_string<wchar_t> const& s);
+template std::wstring ConvertOutputTo<std::wstring>(std::basic_string<char> const& s);
+template std::wstring ConvertOutputTo<std::wstring>(std::basic_string<wchar_t> const& s);
+template void ConvertOutputTo(char const* s, std::string& converted);
+template void ConvertOutputTo(wchar_t const* s, std::string& converted);
+template void ConvertOutputTo(char const* s, std::wstring& converted);
+template void ConvertOutputTo(wchar_t const* s, std::wstring& converted);
+template void ConvertOutputTo(std::basic_string<char> const& s, std::string& converted);
+template void ConvertOutputTo(std::basic_string<wchar_t> const& s, std::string& converted);
+template void ConvertOutputTo(std::basic_string<char> const& s, std::wstring& converted);
+template void ConvertOutputTo(std::basic_string<wchar_t> const& s, std::wstring& converted);
+
 } // namespace ms_windows
 }}}
@@ -0,0 +1,368 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef OPTIONS_SNAPSHOT_H
+#define OPTIONS_SNAPSHOT_H
+
+// Binary snapshots of a parsed config file, so AppOptions can skip parsing it
+// when nothing changed since the last run. The options are still stored,
+// notified and validated, as with any other source.
+//
+// A snapshot holds the options po::parse_config_file() got from the file,
+// i.e., names and unconverted values, along with a key. The key hashes
+// everything the stored options depend on: the options' definitions, the
+// options from the other sources (command line, environment), and the config
+// file's size, modification time and contents. If any of these changes, the
+// snapshot is ignored, and rewritten after the options are validated.
+//
+// Snapshots are meant for the same build of the same app on the same machine:
+// they're in the platform's byte order, and have no portability guarantees.
+// A snapshot that can't be read, or is corrupt, is treated as a miss; failing
+// to write one is not an error, either - it's just a cache.
+
+#include "appconfigexception.h"
+#include "base/temp_name.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/streams/bufferstream.hpp>
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+#pragma GCC diagnostic pop
+
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace config
+{
+
+// 64-bit FNV-1a. Strings and containers are prefixed with their size, so
+// that, e.g., {"ab", "c"} and {"a", "bc"} hash differently.
+class OptionsHash
+{
+public:
+    void Add(void const* data, std::size_t len)
+    {
+        unsigned char const* p = static_cast<unsigned char const*>(data);
+
+        for (std::size_t i = 0; i < len; ++i)
+        {
+            hash = (hash ^ p[i]) * 1099511628211ull;
+        }
+    }
+
+    void Add(std::uint64_t v) { Add(&v, sizeof(v)); }
+
+    void Add(std::string const& s)
+    {
+        Add(static_cast<std::uint64_t>(s.size()));
+        Add(s.data(), s.size());
+    }
+
+    // The options' definitions, including default values.
+    void Add(po::options_description const& desc)
+    {
+        Add(static_cast<std::uint64_t>(desc.options().size()));
+
+        for (auto const& o : desc.options())
+        {
+            Add(o->long_name());
+            Add(o->format_parameter());
+            Add(static_cast<std::uint64_t>(o->semantic()->is_required()));
+        }
+    }
+
+    void Add(po::parsed_options const& parsed)
+    {
+        Add(static_cast<std::uint64_t>(parsed.options.size()));
+
+        for (auto const& o : parsed.options)
+        {
+            Add(o.string_key);
+            Add(static_cast<std::uint64_t>(o.value.size()));
+            for (auto const& v : o.value)
+            {
+                Add(v);
+            }
+        }
+    }
+
+    std::uint64_t Get() const { return hash; }
+private:
+    std::uint64_t hash = 14695981039346656037ull;
+};
+
+
+// A config file, mapped into memory. The mapping is used both to hash the
+// file and to parse it, so it's read only once.
+class MappedConfigFile
+{
+public:
+    // Throws ConfigOpenFileError if the file can't be opened.
+    explicit MappedConfigFile(std::string const& fileName);
+
+    // Size, modification time and contents.
+    void AddIdentity(OptionsHash& h) const
+    {
+        h.Add(static_cast<std::uint64_t>(size));
+        h.Add(static_cast<std::uint64_t>(modTime));
+        h.Add(GetData(), size);
+    }
+
+    po::parsed_options Parse(po::options_description const& desc) const
+    {
+        boost::interprocess::ibufferstream in{GetData(), size};
+        return po::parse_config_file(in, desc);
+    }
+private:
+    char const* GetData() const
+    { return (size == 0) ? "" : static_cast<char const*>(region.get_address()); }
+
+    std::size_t size = 0;
+    std::int64_t modTime = 0;
+    boost::interprocess::mapped_region region;
+};
+
+inline MappedConfigFile::MappedConfigFile(std::string const& fileName)
+{
+    struct stat st;
+
+    if (stat(fileName.c_str(), &st) != 0)
+    {
+        BOOST_THROW_EXCEPTION(ConfigOpenFileError() << error_message("Error opening config file " + fileName));
+    }
+
+    size = static_cast<std::size_t>(st.st_size);
+    modTime = static_cast<std::int64_t>(st.st_mtime);
+
+    // Can't map an empty file.
+    if (size == 0)
+    {
+        return;
+    }
+
+    try
+    {
+        boost::interprocess::file_mapping file{fileName.c_str(), boost::interprocess::read_only};
+        boost::interprocess::mapped_region{file, boost::interprocess::read_only}.swap(region);
+        size = region.get_size();
+    }
+    catch (boost::interprocess::interprocess_exception const&)
+    {
+        BOOST_THROW_EXCEPTION(ConfigOpenFileError() << error_message("Error opening config file " + fileName));
+    }
+}
+
+
+namespace detail
+{
+
+char const snapshotMagic[8] = {'P', 'C', 'B', 'O', 'P', 'T', 'S', '1'};
+
+// Bounds-checked reads from the mapped snapshot. Any read past the end
+// fails, and so do all the ones after it.
+class SnapshotReader
+{
+public:
+    SnapshotReader(char const* data, std::size_t size) : p{data}, end{data + size} { }
+
+    bool Read(void* out, std::size_t len)
+    {
+        if (static_cast<std::size_t>(end - p) < len)
+        {
+            p = end;
+            ok = false;
+            return false;
+        }
+
+        std::memcpy(out, p, len);
+        p += len;
+        return true;
+    }
+
+    bool Read(std::uint64_t& v) { return Read(&v, sizeof(v)); }
+
+    bool Read(std::string& s)
+    {
+        std::uint64_t len = 0;
+        if (!Read(len) || (len > static_cast<std::uint64_t>(end - p)))
+        {
+            ok = false;
+            return false;
+        }
+
+        s.assign(p, static_cast<std::size_t>(len));
+        p += len;
+        return true;
+    }
+
+    bool AtEnd() const { return ok && (p == end); }
+private:
+    char const* p;
+    char const* end;
+    bool ok = true;
+};
+
+inline void WriteSnapshotValue(std::ostream& out, std::uint64_t v)
+{
+    out.write(reinterpret_cast<char const*>(&v), sizeof(v));
+}
+
+inline void WriteSnapshotValue(std::ostream& out, std::string const& s)
+{
+    WriteSnapshotValue(out, static_cast<std::uint64_t>(s.size()));
+    out.write(s.data(), static_cast<std::streamsize>(s.size()));
+}
+
+} // namespace detail
+
+
+// Loads the snapshot in fileName, with a single mapping, into parsed.
+// Returns false (leaving parsed as it was) if there's no snapshot, it was
+// taken with a different key, or it's corrupt.
+inline bool LoadOptionsSnapshot(std::string const& fileName, std::uint64_t key, po::parsed_options& parsed)
+{
+    namespace bip = boost::interprocess;
+
+    try
+    {
+        bip::file_mapping file{fileName.c_str(), bip::read_only};
+        bip::mapped_region region{file, bip::read_only};
+        detail::SnapshotReader in{static_cast<char const*>(region.get_address()), region.get_size()};
+
+        char magic[sizeof(detail::snapshotMagic)];
+        std::uint64_t snapshotKey = 0;
+        std::uint64_t count = 0;
+
+        if (!in.Read(magic, sizeof(magic)) ||
+            (std::memcmp(magic, detail::snapshotMagic, sizeof(magic)) != 0) ||
+            !in.Read(snapshotKey) || (snapshotKey != key) || !in.Read(count))
+        {
+            return false;
+        }
+
+        std::vector<po::option> options;
+        for (std::uint64_t i = 0; i < count; ++i)
+        {
+            po::option o;
+            std::uint64_t values = 0;
+
+            if (!in.Read(o.string_key) || !in.Read(values))
+            {
+                return false;
+            }
+
+            for (std::uint64_t v = 0; v < values; ++v)
+            {
+                o.value.emplace_back();
+                if (!in.Read(o.value.back()))
+                {
+                    return false;
+                }
+            }
+
+            options.push_back(std::move(o));
+        }
+
+        if (!in.AtEnd())
+        {
+            return false;
+        }
+
+        parsed.options.insert(parsed.options.end(), options.begin(), options.end());
+        return true;
+    }
+    catch (bip::interprocess_exception const&)
+    {
+        return false;
+    }
+}
+
+// Saves parsed (the options read from the config file) in fileName. The
+// snapshot is written to a temporary file, unique to this call, and renamed,
+// so no process ever maps a partial snapshot, and processes saving at the
+// same time don't write over each other's. Failures are ignored.
+inline void SaveOptionsSnapshot(std::string const& fileName, std::uint64_t key,
+    po::parsed_options const& parsed) noexcept
+{
+    try
+    {
+        std::string tmpName = base::UniqueTempName(fileName);
+        {
+            std::ofstream out{tmpName, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary};
+
+            out.write(detail::snapshotMagic, sizeof(detail::snapshotMagic));
+            detail::WriteSnapshotValue(out, key);
+            detail::WriteSnapshotValue(out, static_cast<std::uint64_t>(parsed.options.size()));
+
+            for (auto const& o : parsed.options)
+            {
+                detail::WriteSnapshotValue(out, o.string_key);
+                detail::WriteSnapshotValue(out, static_cast<std::uint64_t>(o.value.size()));
+                for (auto const& v : o.value)
+                {
+                    detail::WriteSnapshotValue(out, v);
+                }
+            }
+
+            if (!out.flush())
+            {
+                std::remove(tmpName.c_str());
+                return;
+            }
+        }
+
+#ifdef _WIN32
+        // On Windows, rename() won't replace an existing file.
+        std::remove(fileName.c_str());
+#endif
+        if (std::rename(tmpName.c_str(), fileName.c_str()) != 0)
+        {
+            std::remove(tmpName.c_str());
+        }
+    }
+    catch (...)
+    {
+    }
+}
+
+} // namespace config
+}}}
+
+#endif // OPTIONS_SNAPSHOT_H
@@ -0,0 +1,143 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef OPTIONS_STORE_H
+#define OPTIONS_STORE_H
+
+// Stores parsed options in a variables_map, like po::store(), in linear time.
+//
+// po::store() finds each option with a linear search of the whole
+// options_description (which also tries to match abbreviations, etc.), so
+// storing n options of a description with n options is O(n^2). With a few
+// thousand options (e.g., per-tenant settings in a config file), this takes
+// more than a second, i.e., far longer than parsing the file.
+//
+// OptionsStore indexes the description by long name, and stores each option
+// through po::store(), with a description holding only that option. So, the
+// semantics are po::store()'s - precedence between sources, composing
+// options, defaults, required options - without the search.
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+#pragma GCC diagnostic pop
+#include <boost/shared_ptr.hpp>
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace config
+{
+
+// Thread safety: Immutable after construction, can be shared.
+class OptionsStore
+{
+public:
+    // desc must outlive the OptionsStore.
+    explicit OptionsStore(po::options_description const& desc) : desc(desc)
+    {
+        for (auto const& o : desc.options())
+        {
+            if (!o->long_name().empty())
+            {
+                index.emplace(o->long_name(), o);
+            }
+        }
+    }
+
+    OptionsStore(OptionsStore const&) = delete;
+    OptionsStore& operator=(OptionsStore const&) = delete;
+
+    // Is there an option with this long name?
+    bool HasOption(std::string const& name) const { return index.count(name) != 0; }
+
+    // Same as po::store(parsed, vm), except for the default values. Call
+    // StoreDefaults() once all the sources have been stored.
+    void Store(po::parsed_options const& parsed, po::variables_map& vm) const;
+
+    // Stores the defaults of the options that weren't given in any source,
+    // and takes note of the required options, for po::notify().
+    void StoreDefaults(po::variables_map& vm, int optionsPrefix) const
+    {
+        po::store(po::parsed_options{&desc, optionsPrefix}, vm);
+    }
+private:
+    po::options_description const& desc;
+    std::unordered_map<std::string, boost::shared_ptr<po::option_description>> index;
+};
+
+
+inline void OptionsStore::Store(po::parsed_options const& parsed, po::variables_map& vm) const
+{
+    // All the occurrences of an option must be stored at once: after storing
+    // a (non-composing) option, po::store() ignores it in later calls.
+    // Options are stored in the order in which they first appear.
+    std::vector<std::string const*> order;
+    std::unordered_map<std::string, std::vector<po::option const*>> occurrences;
+
+    for (auto const& o : parsed.options)
+    {
+        auto ins = occurrences.emplace(o.string_key, std::vector<po::option const*>{});
+        if (ins.second)
+        {
+            order.push_back(&ins.first->first);
+        }
+        ins.first->second.push_back(&o);
+    }
+
+    for (auto key : order)
+    {
+        auto it = index.find(*key);
+        po::options_description single;
+        // Unknown, unregistered, positional, etc. po::store() takes care of them.
+        po::options_description const* optDesc = &desc;
+
+        if (it != index.end())
+        {
+            single.add(it->second);
+            optDesc = &single;
+        }
+
+        po::parsed_options one{optDesc, parsed.m_options_prefix};
+        for (auto o : occurrences[*key])
+        {
+            one.options.push_back(*o);
+        }
+
+        po::store(one, vm);
+    }
+}
+
+} // namespace config
+}}}
+
+#endif // OPTIONS_STORE_H
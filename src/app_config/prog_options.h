@@ -30,6 +30,9 @@
 #define PROG_OPTIONS_H
 
 #include "appconfigexception.h"
+#include "options_snapshot.h"
+#include "options_store.h"
+#include "ms_windows/converting_streambuf.h"
 #include "ms_windows/win_console_out.h"
 
 #pragma GCC diagnostic push
@@ -39,12 +42,36 @@ namespace po = boost::program_options;
 #pragma GCC diagnostic pop
 
 #include <cassert>
+#include <cctype>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <string>
 
 namespace pt { namespace pcaetano { namespace bluesy {
 namespace config
 {
 
+// Where AppOptions gets options from, besides the command line.
+// When an option is given in more than one source, the command line wins
+// over the environment, which wins over the config file.
+struct OptionSources
+{
+    // Config file, in the format read by po::parse_config_file() (name=value
+    // lines, [sections] prefix names with "section."). Empty for none.
+    std::string configFile;
+    // Environment variables are taken as options if they're named envPrefix
+    // plus the option's name, in upper case, with '-' and '.' as '_' (e.g.,
+    // MYAPP_LOG_LEVEL, for log-level, with envPrefix "MYAPP_"). Variables
+    // that don't match any option are ignored. Empty for none.
+    std::string envPrefix;
+    // Snapshot of the parsed config file (see options_snapshot.h). When it's
+    // up to date, the config file isn't parsed, and the options aren't
+    // validated. Needs configFile. Empty for none.
+    std::string snapshotFile;
+};
+
+
 // The AppOptions class template abstracts the generic part of setting up
 // Boost Program Options.
 //
@@ -77,6 +104,13 @@ public:
     AppOptions(int argc, char const* const argv[], const char* opTitle,
         std::basic_ostream<CharT>& os = std::cout, bool wantConvert = true);
 
+    // Same as above, also reading options from sources. Throws
+    // ConfigOpenFileError if there's a config file and it can't be opened,
+    // and ConfigInvalidOption if it can't be parsed.
+    template <typename CharT = char>
+    AppOptions(int argc, char const* const argv[], const char* opTitle, OptionSources const& sources,
+        std::basic_ostream<CharT>& os = std::cout, bool wantConvert = true);
+
     // Prints the options description, aka, the "help message".
     // TODO: wantConvert should be true by default only on MS Windows.
     template <typename CharT = char>
@@ -94,6 +128,9 @@ public:
     // exiting. Thus, after creating an instance of AppOptions, the app
     // should call HaveShownHelp(), to determine what to do next.
     bool HaveShownHelp() const { return shownHelp; }
+
+    // Were the config file's options loaded from an up to date snapshot?
+    bool UsedSnapshot() const { return usedSnapshot; }
 private:
     template <typename SpecOpt, typename CharT>
     friend std::basic_ostream<CharT>&
@@ -102,7 +139,16 @@ private:
     bool GotRequestForHelp(po::variables_map const& vm, SpecificOptions const& so) const
         { return vm.count(so.GetHelpOption()); }
 
+    po::parsed_options ParseEnvironment(std::string const& envPrefix, OptionsStore const& store) const;
+    void StoreConfigFile(OptionSources const& sources, OptionsStore const& store,
+        po::parsed_options const& cmdLine, po::parsed_options const& env, po::variables_map& vm);
+
     bool shownHelp;
+    bool usedSnapshot = false;
+    // Set when the config file's options should be saved as a snapshot,
+    // once they're validated.
+    std::unique_ptr<po::parsed_options> toSnapshot;
+    std::uint64_t snapshotKey = 0;
     po::options_description desc;
     SpecificOptions so;
 };
@@ -111,13 +157,25 @@ template <typename SpecificOptions>
 template <typename CharT>
 AppOptions<SpecificOptions>::AppOptions(int argc, const char* const argv[], char const* optTitle,
     std::basic_ostream<CharT>& os, bool wantConvert) :
+    AppOptions(argc, argv, optTitle, OptionSources{}, os, wantConvert)
+{
+}
+
+template <typename SpecificOptions>
+template <typename CharT>
+AppOptions<SpecificOptions>::AppOptions(int argc, const char* const argv[], char const* optTitle,
+    OptionSources const& sources, std::basic_ostream<CharT>& os, bool wantConvert) :
     shownHelp{false}, desc{optTitle}
 {
     assert(optTitle != nullptr);
 
     so.DefineOptions(desc);
+    OptionsStore store{desc};
     po::variables_map vm;
-    po::store(po::parse_command_line(argc, argv, desc), vm);
+    // Stored values are never replaced, so we store the sources in order of
+    // precedence.
+    po::parsed_options cmdLine = po::parse_command_line(argc, argv, desc);
+    store.Store(cmdLine, vm);
 
     // Idea from:
     // http://stackoverflow.com/questions/5395503/required-and-optional-arguments-using-boost-library-program-options
@@ -134,6 +192,16 @@ AppOptions<SpecificOptions>::AppOptions(int argc, const char* const argv[], char
     {
         try
         {
+            po::parsed_options env = ParseEnvironment(sources.envPrefix, store);
+            store.Store(env, vm);
+
+            if (!sources.configFile.empty())
+            {
+                StoreConfigFile(sources, store, cmdLine, env, vm);
+            }
+
+            store.StoreDefaults(vm, cmdLine.m_options_prefix);
+
             // notify() will perform the basic option validation - required
             // options missing, incompatible types, etc.
             po::notify(vm);
@@ -150,6 +218,12 @@ AppOptions<SpecificOptions>::AppOptions(int argc, const char* const argv[], char
             //    Actually, boost's example that shows this (real.cpp) also
             //    puts this validation outside of the notify() call.
             so.Validate();
+
+            if (toSnapshot)
+            {
+                SaveOptionsSnapshot(sources.snapshotFile, snapshotKey, *toSnapshot);
+                toSnapshot.reset();
+            }
         }
         catch (po::required_option& ro)
         {
@@ -160,15 +234,100 @@ AppOptions<SpecificOptions>::AppOptions(int argc, const char* const argv[], char
     }
 }
 
+template <typename SpecificOptions>
+po::parsed_options AppOptions<SpecificOptions>::ParseEnvironment(std::string const& envPrefix,
+    OptionsStore const& store) const
+{
+    if (envPrefix.empty())
+    {
+        return po::parsed_options{&desc};
+    }
+
+    // Maps the variable's name to the option's, or to "" if there's no such option.
+    auto toOptionName = [&envPrefix, &store](std::string const& var) -> std::string
+    {
+        if ((var.size() <= envPrefix.size()) || (var.compare(0, envPrefix.size(), envPrefix) != 0))
+        {
+            return std::string{};
+        }
+
+        std::string name = var.substr(envPrefix.size());
+        for (auto& c : name)
+        {
+            c = (c == '_') ? '-' : static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+
+        if (store.HasOption(name))
+        {
+            return name;
+        }
+
+        // Sections in config files become dotted names, e.g., log.level.
+        for (auto& c : name)
+        {
+            c = (c == '-') ? '.' : c;
+        }
+
+        return store.HasOption(name) ? name : std::string{};
+    };
+
+    return po::parse_environment(desc, toOptionName);
+}
+
+// The snapshot key covers everything the validated result depends on, so a
+// snapshot with the same key gives us the same options, already validated.
+template <typename SpecificOptions>
+void AppOptions<SpecificOptions>::StoreConfigFile(OptionSources const& sources, OptionsStore const& store,
+    po::parsed_options const& cmdLine, po::parsed_options const& env, po::variables_map& vm)
+{
+    MappedConfigFile file{sources.configFile};
+    po::parsed_options fileOptions{&desc};
+
+    if (!sources.snapshotFile.empty())
+    {
+        OptionsHash h;
+        h.Add(desc);
+        h.Add(cmdLine);
+        h.Add(env);
+        file.AddIdentity(h);
+        snapshotKey = h.Get();
+
+        usedSnapshot = LoadOptionsSnapshot(sources.snapshotFile, snapshotKey, fileOptions);
+    }
+
+    if (!usedSnapshot)
+    {
+        try
+        {
+            fileOptions = file.Parse(desc);
+        }
+        catch (po::error const& e)
+        {
+            BOOST_THROW_EXCEPTION(ConfigInvalidOption() <<
+                error_message("Error in config file " + sources.configFile + ": " + e.what()));
+        }
+
+        if (!sources.snapshotFile.empty())
+        {
+            toSnapshot.reset(new po::parsed_options(fileOptions));
+        }
+    }
+
+    store.Store(fileOptions, vm);
+}
+
 // When we're on MS Windows and we're outputting to cout, we
 // probably want to convert the output to the console code page.
+// The conversion is done as desc is written, instead of formatting
+// it to a string first.
 template <typename SpecificOptions>
 template <typename CharT>
 void AppOptions<SpecificOptions>::ShowHelp(std::basic_ostream<CharT>& os, bool wantConvert) const
 {
     if (wantConvert)
     {
-        os << ms_windows::ConvertOutput(desc);
+        ms_windows::ConvertingOutput co{os};
+        os << desc;
     }
     else
     {
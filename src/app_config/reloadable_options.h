@@ -0,0 +1,456 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef RELOADABLE_OPTIONS_H
+#define RELOADABLE_OPTIONS_H
+
+// AppOptions for long running processes, which can reload their options
+// without restarting.
+//
+// Each reload parses all the sources again into a new AppOptions (so
+// SpecificOptions::Validate() runs on a new SpecificOptions instance), and
+// publishes it atomically. If parsing or validation fail, the current options
+// stay in place.
+//
+// Readers get a snapshot of the current options with GetOptions(), which is
+// wait-free, and takes no locks. Each thread uses its own slot in a few
+// counter arrays (one cache line per slot, so threads don't contend):
+//  - While it loads the current version, it holds a counter in the grace
+//      array, in the phase it read, as in SRCU. A reload publishes the new
+//      version and then, twice, flips the phase and waits for the previous
+//      phase's counters to drop to zero; after that, no reader can get to the
+//      old version. The wait is short, since readers hold these counters for
+//      a few instructions.
+//  - The snapshot then holds a counter in the version it got, and releases it
+//      when it goes away. Retired versions are deleted once none of their
+//      counters are held, on a later reload (or ReloadIfChanged()).
+// So, snapshots may be kept for as long as needed, but each one keeps its
+// version alive; they're meant to be short-lived (e.g., one per request).
+
+#include "prog_options.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#ifdef PCBLUESY_UNIT_TEST
+#include <functional>
+#endif
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace config
+{
+
+namespace detail
+{
+
+// Each thread gets a slot number on first use, round robin.
+inline unsigned ThisThreadReaderSlot()
+{
+    static std::atomic<unsigned> nextSlot{0};
+    thread_local unsigned const slot = nextSlot.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+}
+
+// C++11's operator new only aligns to alignof(std::max_align_t), so types
+// with cache line aligned members allocate through these.
+inline void* AlignedNew(std::size_t size, std::size_t alignment)
+{
+    void* raw = ::operator new(size + alignment + sizeof(void*));
+    std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*) + alignment - 1) &
+        ~static_cast<std::uintptr_t>(alignment - 1);
+    reinterpret_cast<void**>(aligned)[-1] = raw;
+    return reinterpret_cast<void*>(aligned);
+}
+
+inline void AlignedDelete(void* p)
+{
+    if (p != nullptr)
+    {
+        ::operator delete(static_cast<void**>(p)[-1]);
+    }
+}
+
+} // namespace detail
+
+
+// Thread safety: GetOptions() and RequestReload() can be called from any
+// thread; the reload functions are serialized internally.
+template <typename SpecificOptions>
+class ReloadableAppOptions
+{
+    struct Version;
+public:
+    // Keeps a version of the options alive.
+    class Snapshot
+    {
+    public:
+        Snapshot(Snapshot&& other) noexcept : version{other.version}, hold{other.hold}
+        {
+            other.hold = nullptr;
+        }
+
+        ~Snapshot()
+        {
+            if (hold != nullptr)
+            {
+                hold->fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        Snapshot(Snapshot const&) = delete;
+        Snapshot& operator=(Snapshot const&) = delete;
+        Snapshot& operator=(Snapshot&&) = delete;
+
+        SpecificOptions const& operator*() const { return version->options->GetOptions(); }
+        SpecificOptions const* operator->() const { return &version->options->GetOptions(); }
+    private:
+        friend class ReloadableAppOptions;
+
+        Snapshot(Version const* version, std::atomic<long>* hold) : version{version}, hold{hold} { }
+
+        Version const* version;
+        std::atomic<long>* hold;
+    };
+
+    // Same arguments as AppOptions. The command line is copied, since it's
+    // parsed again on every reload.
+    ReloadableAppOptions(int argc, char const* const argv[], const char* opTitle,
+        OptionSources const& sources, std::ostream& os = std::cout, bool wantConvert = true);
+    ~ReloadableAppOptions();
+
+    ReloadableAppOptions(ReloadableAppOptions const&) = delete;
+    ReloadableAppOptions& operator=(ReloadableAppOptions const&) = delete;
+
+    static void* operator new(std::size_t size) { return detail::AlignedNew(size, cacheLine); }
+    static void operator delete(void* p) { detail::AlignedDelete(p); }
+
+    // Wait-free, lock-free.
+    Snapshot GetOptions() const;
+
+    bool HaveShownHelp() const { return shownHelp; }
+
+    // Async-signal-safe, e.g., for a SIGHUP handler. The reload itself
+    // happens on the next ReloadIfChanged().
+    void RequestReload() { reloadRequested.store(true, std::memory_order_relaxed); }
+
+    // Reloads if RequestReload() was called, or if the config file changed
+    // (size or modification time) since the last load. Returns true if it
+    // reloaded. Meant to be called periodically, e.g., from a housekeeping
+    // thread. A file that failed to load isn't tried again until it changes
+    // (or RequestReload() is called), so it throws once, not on every call.
+    bool ReloadIfChanged();
+
+    // Parses the sources again, and publishes the new options. Throws the
+    // same exceptions as AppOptions' constructor, leaving the current options
+    // in place.
+    void Reload();
+
+    // How many times the options were reloaded.
+    unsigned long GetReloadCount() const { return reloads.load(std::memory_order_relaxed); }
+    // Versions replaced by a reload, but still held by a snapshot.
+    std::size_t GetRetiredCount() const;
+
+#ifdef PCBLUESY_UNIT_TEST
+    // Unit tests only. Called by GetOptions() after it reads the phase (0),
+    // and after it loads the current version (1), so a test can stall a
+    // reader there.
+    std::function<void(int)> readerPause;
+#endif
+private:
+    static_assert(ATOMIC_BOOL_LOCK_FREE == 2, "RequestReload() must be async-signal-safe");
+
+    static constexpr std::size_t readerSlots = 64;
+    static constexpr std::size_t cacheLine = 64;
+
+    // One cache line per slot.
+    struct alignas(cacheLine) ReaderSlot
+    {
+        std::atomic<long> count[2];
+
+        ReaderSlot()
+        {
+            count[0].store(0, std::memory_order_relaxed);
+            count[1].store(0, std::memory_order_relaxed);
+        }
+    };
+
+    struct Version
+    {
+        explicit Version(AppOptions<SpecificOptions>* options) : options{options} { }
+        bool IsHeld() const;
+
+        static void* operator new(std::size_t size) { return detail::AlignedNew(size, cacheLine); }
+        static void operator delete(void* p) { detail::AlignedDelete(p); }
+
+        std::unique_ptr<AppOptions<SpecificOptions>> options;
+        // Only count[0] is used.
+        mutable ReaderSlot holds[readerSlots];
+    };
+
+    struct FileState
+    {
+        bool exists = false;
+        std::int64_t size = 0;
+        std::int64_t modTime = 0;
+
+        bool operator!=(FileState const& other) const
+        {
+            return (exists != other.exists) || (size != other.size) || (modTime != other.modTime);
+        }
+    };
+
+    FileState GetConfigFileState() const;
+    AppOptions<SpecificOptions>* Parse(std::ostream& help) const;
+    void ReloadLocked();
+    void Publish(std::unique_ptr<Version> newVersion);
+    void WaitForPhase(unsigned p) const;
+    void DeleteUnheld();
+
+    std::vector<std::string> args;
+    std::vector<char const*> argPtrs;
+    std::string title;
+    OptionSources sources;
+    bool wantConvert;
+    bool shownHelp = false;
+
+    // Readers only touch these.
+    mutable ReaderSlot grace[readerSlots];
+    std::atomic<unsigned> phase{0};
+    std::atomic<Version*> current{nullptr};
+
+    std::atomic<bool> reloadRequested{false};
+    std::atomic<unsigned long> reloads{0};
+
+    // Only for reloads.
+    mutable std::mutex reloadMutex;
+    FileState loadedFile;
+    std::vector<std::unique_ptr<Version>> retired;
+};
+
+
+template <typename SpecificOptions>
+ReloadableAppOptions<SpecificOptions>::ReloadableAppOptions(int argc, char const* const argv[],
+    const char* opTitle, OptionSources const& sources, std::ostream& os, bool wantConvert) :
+    args(argv, argv + argc), title{opTitle}, sources(sources), wantConvert{wantConvert}
+{
+    for (auto const& a : args)
+    {
+        argPtrs.push_back(a.c_str());
+    }
+
+    loadedFile = GetConfigFileState();
+    std::unique_ptr<Version> first{new Version{Parse(os)}};
+    shownHelp = first->options->HaveShownHelp();
+    current.store(first.release(), std::memory_order_release);
+}
+
+template <typename SpecificOptions>
+ReloadableAppOptions<SpecificOptions>::~ReloadableAppOptions()
+{
+    // No one can be reading any more.
+    delete current.load(std::memory_order_relaxed);
+}
+
+// The grace counter must be seq_cst: a reload must see our increment, or we
+// must see the version it published (see Publish()).
+template <typename SpecificOptions>
+typename ReloadableAppOptions<SpecificOptions>::Snapshot ReloadableAppOptions<SpecificOptions>::GetOptions() const
+{
+    std::size_t slot = detail::ThisThreadReaderSlot() % readerSlots;
+    std::atomic<long>& inGrace = grace[slot].count[phase.load()];
+#ifdef PCBLUESY_UNIT_TEST
+    if (readerPause) { readerPause(0); }
+#endif
+
+    inGrace.fetch_add(1);
+    Version* v = current.load();
+#ifdef PCBLUESY_UNIT_TEST
+    if (readerPause) { readerPause(1); }
+#endif
+    std::atomic<long>& hold = v->holds[slot].count[0];
+    hold.fetch_add(1, std::memory_order_relaxed);
+    inGrace.fetch_sub(1, std::memory_order_release);
+
+    return Snapshot{v, &hold};
+}
+
+template <typename SpecificOptions>
+bool ReloadableAppOptions<SpecificOptions>::ReloadIfChanged()
+{
+    bool requested = reloadRequested.exchange(false, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock{reloadMutex};
+
+    if (!requested && (sources.configFile.empty() || !(GetConfigFileState() != loadedFile)))
+    {
+        DeleteUnheld();
+        return false;
+    }
+
+    ReloadLocked();
+    return true;
+}
+
+template <typename SpecificOptions>
+void ReloadableAppOptions<SpecificOptions>::Reload()
+{
+    std::lock_guard<std::mutex> lock{reloadMutex};
+    ReloadLocked();
+}
+
+// Called with reloadMutex held.
+template <typename SpecificOptions>
+void ReloadableAppOptions<SpecificOptions>::ReloadLocked()
+{
+    // Taken before parsing, so that a change while we parse triggers another reload.
+    FileState file = GetConfigFileState();
+    // Nothing to show on a reload, but AppOptions wants somewhere to show it.
+    std::ostringstream help;
+    std::unique_ptr<Version> newVersion;
+
+    try
+    {
+        newVersion.reset(new Version{Parse(help)});
+    }
+    catch (...)
+    {
+        // This file's been tried; the next try is when it changes.
+        loadedFile = file;
+        throw;
+    }
+
+    Publish(std::move(newVersion));
+
+    loadedFile = file;
+    reloads.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename SpecificOptions>
+std::size_t ReloadableAppOptions<SpecificOptions>::GetRetiredCount() const
+{
+    std::lock_guard<std::mutex> lock{reloadMutex};
+    return retired.size();
+}
+
+template <typename SpecificOptions>
+AppOptions<SpecificOptions>* ReloadableAppOptions<SpecificOptions>::Parse(std::ostream& help) const
+{
+    return new AppOptions<SpecificOptions>(static_cast<int>(argPtrs.size()), argPtrs.data(),
+        title.c_str(), sources, help, wantConvert);
+}
+
+// Readers take the phase, increment its grace counter, and then load current;
+// all seq_cst. We replace current, and then wait for both phases' counters to
+// drain. A reader that loaded the old version incremented its counter before
+// we replaced current, so whichever phase it read (however long ago), we wait
+// for it; a reader that increments a counter after we find it drained loads
+// current after we replaced it, and never sees the old version.
+// Waiting on one phase isn't enough: a reader may read the phase and stall
+// before incrementing; by then, back to back reloads may have flipped the
+// phase twice, and the only phase the next reload waits on isn't the one it
+// increments. Flipping before each wait keeps new readers off the counters
+// we're waiting on, so the wait ends.
+template <typename SpecificOptions>
+void ReloadableAppOptions<SpecificOptions>::Publish(std::unique_ptr<Version> newVersion)
+{
+    retired.emplace_back(current.exchange(newVersion.release()));
+
+    for (int i = 0; i < 2; ++i)
+    {
+        unsigned oldPhase = phase.load();
+        phase.store(oldPhase ^ 1);
+        WaitForPhase(oldPhase);
+    }
+
+    DeleteUnheld();
+}
+
+template <typename SpecificOptions>
+void ReloadableAppOptions<SpecificOptions>::WaitForPhase(unsigned p) const
+{
+    for (auto const& g : grace)
+    {
+        while (g.count[p].load() != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// After the grace period, the holds on a retired version can only go down.
+template <typename SpecificOptions>
+void ReloadableAppOptions<SpecificOptions>::DeleteUnheld()
+{
+    retired.erase(std::remove_if(retired.begin(), retired.end(),
+        [](std::unique_ptr<Version> const& v) { return !v->IsHeld(); }), retired.end());
+}
+
+template <typename SpecificOptions>
+bool ReloadableAppOptions<SpecificOptions>::Version::IsHeld() const
+{
+    for (auto const& h : holds)
+    {
+        if (h.count[0].load(std::memory_order_acquire) != 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template <typename SpecificOptions>
+typename ReloadableAppOptions<SpecificOptions>::FileState
+ReloadableAppOptions<SpecificOptions>::GetConfigFileState() const
+{
+    FileState fs;
+    struct stat st;
+
+    if (!sources.configFile.empty() && (stat(sources.configFile.c_str(), &st) == 0))
+    {
+        fs.exists = true;
+        fs.size = static_cast<std::int64_t>(st.st_size);
+        fs.modTime = static_cast<std::int64_t>(st.st_mtime);
+    }
+
+    return fs;
+}
+
+} // namespace config
+}}}
+
+#endif // RELOADABLE_OPTIONS_H
@@ -0,0 +1,651 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef STATIC_OPTIONS_H
+#define STATIC_OPTIONS_H
+
+// A lighter alternative to AppOptions, for short-lived tools, where parsing
+// the command line with Boost Program Options shows up in startup time.
+//
+// SpecificOptions declares its options in a constexpr table of StaticOption.
+// The table is checked at compile time (duplicate names, at most one help
+// option), and StaticAppOptions parses the command line straight into
+// SpecificOptions' members: there's no options_description, no
+// variables_map, no boost::any, and nothing is allocated besides what the
+// members themselves need (e.g., a std::string's contents). The help text is
+// only formatted when it's shown.
+//
+// The command line syntax is the same as AppOptions' (po's default style):
+// --name value, --name=value, -n value, -nvalue, and grouped switches
+// (-abc). A multitoken option also takes the arguments that follow it, up
+// to the next option. There are no positional options, and no config file or
+// environment sources; for these, use AppOptions.
+//
+// Values are parsed by the ParseOptionValue() overloads below: std::string,
+// bool, integral and floating point types, and std::vector of any of these.
+
+#include "appconfigexception.h"
+#include "ms_windows/converting_streambuf.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace config
+{
+
+enum class StaticOptionKind : unsigned char
+{
+    // Shows the help message; no validation takes place.
+    Help,
+    // Takes no value; stored with a null value.
+    Switch,
+    // Takes one value, and can only be given once.
+    Value,
+    // Takes one or more values, and can be given more than once.
+    MultiToken
+};
+
+template <typename SpecificOptions>
+struct StaticOption
+{
+    using StoreFn = bool (*)(SpecificOptions&, char const* value);
+
+    static constexpr StaticOption Help(char const* name, char shortName, char const* description)
+    {
+        return StaticOption{name, shortName, description, StaticOptionKind::Help, false, nullptr};
+    }
+
+    static constexpr StaticOption Switch(char const* name, char shortName, char const* description,
+        StoreFn store)
+    {
+        return StaticOption{name, shortName, description, StaticOptionKind::Switch, false, store};
+    }
+
+    static constexpr StaticOption Value(char const* name, char shortName, char const* description,
+        StoreFn store, bool required = false)
+    {
+        return StaticOption{name, shortName, description, StaticOptionKind::Value, required, store};
+    }
+
+    static constexpr StaticOption MultiToken(char const* name, char shortName, char const* description,
+        StoreFn store, bool required = false)
+    {
+        return StaticOption{name, shortName, description, StaticOptionKind::MultiToken, required, store};
+    }
+
+    // Long name; may be empty, if there's a short name.
+    char const* name;
+    // '\0' if there's none.
+    char shortName;
+    char const* description;
+    StaticOptionKind kind;
+    bool required;
+    // Returns false if the value is invalid.
+    StoreFn store;
+};
+
+
+inline bool ParseOptionValue(char const* value, std::string& out)
+{
+    out.assign(value);
+    return true;
+}
+
+// A null value comes from a switch.
+inline bool ParseOptionValue(char const* value, bool& out)
+{
+    static char const* const trueValues[] = { "true", "1", "yes", "on" };
+    static char const* const falseValues[] = { "false", "0", "no", "off" };
+
+    if (value == nullptr)
+    {
+        out = true;
+        return true;
+    }
+
+    for (std::size_t i = 0; i < 4; ++i)
+    {
+        if (std::strcmp(value, trueValues[i]) == 0)
+        {
+            out = true;
+            return true;
+        }
+        if (std::strcmp(value, falseValues[i]) == 0)
+        {
+            out = false;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, bool>::type
+ParseOptionValue(char const* value, T& out)
+{
+    char* end;
+    errno = 0;
+    long long v = std::strtoll(value, &end, 10);
+
+    if ((end == value) || (*end != '\0') || (errno == ERANGE) ||
+        (v < std::numeric_limits<T>::min()) || (v > std::numeric_limits<T>::max()))
+    {
+        return false;
+    }
+
+    out = static_cast<T>(v);
+    return true;
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value &&
+    !std::is_same<T, bool>::value, bool>::type
+ParseOptionValue(char const* value, T& out)
+{
+    char* end;
+    errno = 0;
+    // strtoull() accepts, and negates, negative numbers.
+    unsigned long long v = std::strtoull(value, &end, 10);
+
+    if ((end == value) || (*end != '\0') || (errno == ERANGE) || (std::strchr(value, '-') != nullptr) ||
+        (v > std::numeric_limits<T>::max()))
+    {
+        return false;
+    }
+
+    out = static_cast<T>(v);
+    return true;
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+ParseOptionValue(char const* value, T& out)
+{
+    char* end;
+    errno = 0;
+    long double v = std::strtold(value, &end);
+
+    if ((end == value) || (*end != '\0') || (errno == ERANGE))
+    {
+        return false;
+    }
+
+    out = static_cast<T>(v);
+    return true;
+}
+
+template <typename T>
+bool ParseOptionValue(char const* value, std::vector<T>& out)
+{
+    T v{};
+
+    if (!ParseOptionValue(value, v))
+    {
+        return false;
+    }
+
+    out.push_back(std::move(v));
+    return true;
+}
+
+// StaticOption::StoreFn for a member of SpecificOptions, e.g.,
+// &StoreMember<MyOptions, std::string, &MyOptions::fileName>.
+template <typename SpecificOptions, typename T, T SpecificOptions::*Member>
+bool StoreMember(SpecificOptions& so, char const* value)
+{
+    return ParseOptionValue(value, so.*Member);
+}
+
+
+namespace detail
+{
+
+constexpr bool StaticNamesEqual(char const* n1, char const* n2)
+{
+    return (*n1 == *n2) && ((*n1 == '\0') || StaticNamesEqual(n1 + 1, n2 + 1));
+}
+
+template <typename Option>
+constexpr bool StaticOptionsClash(Option const& o1, Option const& o2)
+{
+    return ((*o1.name != '\0') && StaticNamesEqual(o1.name, o2.name)) ||
+        ((o1.shortName != '\0') && (o1.shortName == o2.shortName)) ||
+        ((o1.kind == StaticOptionKind::Help) && (o2.kind == StaticOptionKind::Help));
+}
+
+template <typename Option, std::size_t N>
+constexpr bool StaticOptionClashesAfter(Option const (&options)[N], std::size_t i, std::size_t j)
+{
+    return (j < N) && (StaticOptionsClash(options[i], options[j]) || StaticOptionClashesAfter(options, i, j + 1));
+}
+
+template <typename Option, std::size_t N>
+constexpr bool StaticOptionsAreUnique(Option const (&options)[N], std::size_t i = 0)
+{
+    return (i >= N) || (!StaticOptionClashesAfter(options, i, i + 1) && StaticOptionsAreUnique(options, i + 1));
+}
+
+template <typename Option, std::size_t N>
+constexpr bool StaticOptionsAreNamed(Option const (&options)[N], std::size_t i = 0)
+{
+    return (i >= N) || (((*options[i].name != '\0') || (options[i].shortName != '\0')) &&
+        ((options[i].kind == StaticOptionKind::Help) || (options[i].store != nullptr)) &&
+        StaticOptionsAreNamed(options, i + 1));
+}
+
+} // namespace detail
+
+
+// The StaticAppOptions class template is an alternative to AppOptions, with
+// the same interface, for options declared in a constexpr table.
+//
+// SpecificOptions requirements:
+// - default ctor. Members not given on the command line keep their initial
+//      values, so that's where defaults go.
+// - static constexpr StaticOption<SpecificOptions> options[], defined
+//      out of the class, too (C++11 requires it, since we take its address).
+// - void Validate(). Should throw an exception in case of error.
+// - std::ostream& operator<<(std::ostream& os, SpecificOptions const& obj)
+template <typename SpecificOptions>
+class StaticAppOptions
+{
+public:
+    using Option = StaticOption<SpecificOptions>;
+    static constexpr std::size_t optionCount =
+        sizeof(SpecificOptions::options) / sizeof(SpecificOptions::options[0]);
+
+    static_assert(detail::StaticOptionsAreNamed(SpecificOptions::options),
+        "Every option needs a name, and a store function (except for help)");
+    static_assert(detail::StaticOptionsAreUnique(SpecificOptions::options),
+        "Options must have unique names, and there can only be one help option");
+
+    StaticAppOptions() = delete;
+
+    // Same as AppOptions. Throws ConfigInvalidOption for unknown options and
+    // invalid values, and ConfigRequiredOptionMissing for missing options.
+    template <typename CharT = char>
+    StaticAppOptions(int argc, char const* const argv[], const char* opTitle,
+        std::basic_ostream<CharT>& os = std::cout, bool wantConvert = true);
+
+    // Formats the help message; only here, since most runs never show it.
+    template <typename CharT = char>
+    void ShowHelp(std::basic_ostream<CharT>& os = std::cout, bool wantConvert = true) const;
+
+    const SpecificOptions& GetOptions() const { return so; }
+
+    bool HaveShownHelp() const { return shownHelp; }
+private:
+    template <typename SpecOpt, typename CharT>
+    friend std::basic_ostream<CharT>&
+    operator<<(std::basic_ostream<CharT>& os, StaticAppOptions<SpecOpt> const& obj);
+
+    // Return optionCount if there's no such option.
+    static std::size_t FindLong(char const* name, std::size_t len);
+    static std::size_t FindShort(char name);
+    static std::string DisplayName(Option const& o);
+
+    void Store(std::size_t opt, char const* value, char const* given);
+
+    template <typename CharT>
+    void WriteHelp(std::basic_ostream<CharT>& os) const;
+
+    char const* title;
+    bool shownHelp = false;
+    std::bitset<optionCount> seen;
+    SpecificOptions so;
+};
+
+
+template <typename SpecificOptions>
+constexpr std::size_t StaticAppOptions<SpecificOptions>::optionCount;
+
+template <typename SpecificOptions>
+template <typename CharT>
+StaticAppOptions<SpecificOptions>::StaticAppOptions(int argc, char const* const argv[], const char* opTitle,
+    std::basic_ostream<CharT>& os, bool wantConvert) :
+    title{opTitle}
+{
+    assert(opTitle != nullptr);
+
+    Option const* options = SpecificOptions::options;
+    // The multitoken option taking the arguments that follow it, if any.
+    std::size_t collecting = optionCount;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        char const* arg = argv[i];
+
+        if ((arg[0] != '-') || (arg[1] == '\0'))
+        {
+            if (collecting == optionCount)
+            {
+                BOOST_THROW_EXCEPTION(ConfigInvalidOption() <<
+                    error_message(std::string{"Unexpected argument: "} + arg));
+            }
+
+            Store(collecting, arg, arg);
+            continue;
+        }
+
+        collecting = optionCount;
+        std::size_t opt;
+        char const* value = nullptr;
+
+        if (arg[1] == '-')
+        {
+            char const* name = arg + 2;
+            char const* eq = std::strchr(name, '=');
+            opt = FindLong(name, (eq == nullptr) ? std::strlen(name) : static_cast<std::size_t>(eq - name));
+
+            if (opt == optionCount)
+            {
+                BOOST_THROW_EXCEPTION(ConfigInvalidOption() <<
+                    error_message(std::string{"Unrecognised option: "} + arg));
+            }
+
+            if (eq != nullptr)
+            {
+                value = eq + 1;
+            }
+        }
+        else
+        {
+            // Switches can be grouped, and the last option in the group may
+            // take the rest of the argument as its value.
+            for (char const* c = arg + 1; ; ++c)
+            {
+                opt = FindShort(*c);
+
+                if (opt == optionCount)
+                {
+                    BOOST_THROW_EXCEPTION(ConfigInvalidOption() <<
+                        error_message(std::string{"Unrecognised option: -"} + *c + " in " + arg));
+                }
+
+                bool takesValue = (options[opt].kind == StaticOptionKind::Value) ||
+                    (options[opt].kind == StaticOptionKind::MultiToken);
+
+                if (takesValue && (c[1] != '\0'))
+                {
+                    value = c + 1;
+                    break;
+                }
+
+                if (takesValue || (c[1] == '\0'))
+                {
+                    break;
+                }
+
+                Store(opt, nullptr, arg);
+            }
+        }
+
+        switch (options[opt].kind)
+        {
+        case StaticOptionKind::Help:
+        case StaticOptionKind::Switch:
+            if (value != nullptr)
+            {
+                BOOST_THROW_EXCEPTION(ConfigInvalidOption() <<
+                    error_message("Option " + DisplayName(options[opt]) + " takes no value"));
+            }
+            break;
+        case StaticOptionKind::Value:
+        case StaticOptionKind::MultiToken:
+            if (value == nullptr)
+            {
+                if ((i + 1 >= argc) || ((argv[i + 1][0] == '-') && (argv[i + 1][1] != '\0')))
+                {
+                    BOOST_THROW_EXCEPTION(ConfigInvalidOption() <<
+                        error_message("Option " + DisplayName(options[opt]) + " requires a value"));
+                }
+                value = argv[++i];
+            }
+
+            if (options[opt].kind == StaticOptionKind::MultiToken)
+            {
+                collecting = opt;
+            }
+            break;
+        }
+
+        Store(opt, value, arg);
+    }
+
+    // As in AppOptions, asking for help skips the required options and
+    // validation.
+    for (std::size_t o = 0; o < optionCount; ++o)
+    {
+        if (seen[o] && (options[o].kind == StaticOptionKind::Help))
+        {
+            shownHelp = true;
+            ShowHelp(os, wantConvert);
+            return;
+        }
+    }
+
+    for (std::size_t o = 0; o < optionCount; ++o)
+    {
+        if (options[o].required && !seen[o])
+        {
+            BOOST_THROW_EXCEPTION(ConfigRequiredOptionMissing() <<
+                error_message("Required option missing: " + DisplayName(options[o])));
+        }
+    }
+
+    so.Validate();
+}
+
+template <typename SpecificOptions>
+void StaticAppOptions<SpecificOptions>::Store(std::size_t opt, char const* value, char const* given)
+{
+    Option const& o = SpecificOptions::options[opt];
+
+    if (seen[opt] && (o.kind == StaticOptionKind::Value))
+    {
+        BOOST_THROW_EXCEPTION(ConfigInvalidOption() <<
+            error_message("Option " + DisplayName(o) + " cannot be specified more than once"));
+    }
+
+    seen[opt] = true;
+
+    if ((o.kind != StaticOptionKind::Help) && !o.store(so, value))
+    {
+        BOOST_THROW_EXCEPTION(ConfigInvalidOption() <<
+            error_message("Invalid value for option " + DisplayName(o) + ": " +
+                ((value != nullptr) ? value : given)));
+    }
+}
+
+template <typename SpecificOptions>
+std::size_t StaticAppOptions<SpecificOptions>::FindLong(char const* name, std::size_t len)
+{
+    for (std::size_t o = 0; o < optionCount; ++o)
+    {
+        char const* n = SpecificOptions::options[o].name;
+
+        if ((std::strncmp(n, name, len) == 0) && (n[len] == '\0') && (len != 0))
+        {
+            return o;
+        }
+    }
+
+    return optionCount;
+}
+
+template <typename SpecificOptions>
+std::size_t StaticAppOptions<SpecificOptions>::FindShort(char name)
+{
+    for (std::size_t o = 0; o < optionCount; ++o)
+    {
+        if ((name != '\0') && (SpecificOptions::options[o].shortName == name))
+        {
+            return o;
+        }
+    }
+
+    return optionCount;
+}
+
+template <typename SpecificOptions>
+std::string StaticAppOptions<SpecificOptions>::DisplayName(Option const& o)
+{
+    return (*o.name != '\0') ? std::string{"--"} + o.name : std::string{"-"} + o.shortName;
+}
+
+// Same as po's help message, with the default line length (80): the
+// descriptions begin on the same column (at least 24), and are wrapped.
+template <typename SpecificOptions>
+template <typename CharT>
+void StaticAppOptions<SpecificOptions>::WriteHelp(std::basic_ostream<CharT>& os) const
+{
+    std::size_t const lineLength = 80;
+    std::size_t const minDescLength = 40;
+    std::vector<std::string> names;
+    std::size_t column = 23;
+
+    names.reserve(optionCount);
+    for (Option const& o : SpecificOptions::options)
+    {
+        std::string n{"  "};
+
+        if (o.shortName != '\0')
+        {
+            n += '-';
+            n += o.shortName;
+            n += (*o.name != '\0') ? std::string{" [ --"} + o.name + " ]" : std::string{};
+        }
+        else
+        {
+            n += std::string{"--"} + o.name;
+        }
+
+        // po leaves a space between the name and the (empty) parameter.
+        bool takesValue = (o.kind == StaticOptionKind::Value) || (o.kind == StaticOptionKind::MultiToken);
+        n += takesValue ? " arg" : "";
+
+        column = std::max(column, n.size() + (takesValue ? 0 : 1));
+        names.push_back(std::move(n));
+    }
+    column = std::min(column, lineLength - minDescLength - 1) + 1;
+
+    os << title << ":\n";
+
+    for (std::size_t o = 0; o < optionCount; ++o)
+    {
+        std::string const& n = names[o];
+        os << n.c_str();
+
+        // Names that don't fit get the description on the next line.
+        std::size_t pos = n.size();
+        if (pos >= column)
+        {
+            os << '\n';
+            pos = 0;
+        }
+
+        char const* desc = SpecificOptions::options[o].description;
+        std::size_t len = std::strlen(desc);
+        std::size_t width = lineLength - column;
+
+        while (len > 0)
+        {
+            os << std::string(column - pos, ' ').c_str();
+
+            std::size_t take = len;
+            if (take > width)
+            {
+                take = width;
+                while ((take > 0) && (desc[take] != ' '))
+                {
+                    --take;
+                }
+                take = (take == 0) ? width : take;
+            }
+
+            os << std::string(desc, take).c_str() << '\n';
+            desc += take;
+            len -= take;
+            while ((len > 0) && (*desc == ' '))
+            {
+                ++desc;
+                --len;
+            }
+            pos = 0;
+        }
+
+        if (pos != 0)
+        {
+            os << '\n';
+        }
+    }
+}
+
+// As in AppOptions, the conversion is done as the help is written.
+template <typename SpecificOptions>
+template <typename CharT>
+void StaticAppOptions<SpecificOptions>::ShowHelp(std::basic_ostream<CharT>& os, bool wantConvert) const
+{
+    if (wantConvert)
+    {
+        ms_windows::ConvertingOutput co{os};
+        WriteHelp(os);
+    }
+    else
+    {
+        WriteHelp(os);
+    }
+}
+
+
+template <typename SpecificOptions, typename CharT>
+std::basic_ostream<CharT>&
+operator<<(std::basic_ostream<CharT>& os, StaticAppOptions<SpecificOptions> const& obj)
+{
+    os << obj.so;
+
+    return os;
+}
+
+} // namespace config
+}}}
+
+#endif // STATIC_OPTIONS_H
@@ -0,0 +1,185 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BASE_BREADCRUMBS_H
+#define BASE_BREADCRUMBS_H
+
+// Per-thread ring of breadcrumbs, i.e., fixed-size records of where errors
+// were thrown and rethrown (see PCBLUESY_THROW/PCBLUESY_RETHROW, in
+// exception.h).
+//
+// Recording a breadcrumb allocates nothing, and takes a fixed amount of
+// memory per thread, no matter how many errors we get; messages are
+// truncated to fit. The breadcrumbs are only formatted into a trace when the
+// exception is reported (see PCBBaseException::what()).
+//
+// Breadcrumbs belong to a chain, which begins at a throw; rethrows add to the
+// same chain. When a chain is longer than the ring, or other errors happen
+// before it's reported, its oldest breadcrumbs are lost.
+
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace base
+{
+
+struct Breadcrumb
+{
+    static constexpr std::size_t kMessageSize = 96;
+
+    // Sequence number of the chain's first breadcrumb.
+    std::uint64_t chain;
+    unsigned long key;
+    char const* file;
+    char const* function;
+    int line;
+    char message[kMessageSize];
+};
+
+
+// No ctor, so that it's zero-initialized, with no dynamic initialization
+// for each thread.
+struct BreadcrumbRing
+{
+    static constexpr std::size_t kCapacity = 32;
+
+    // Sequence number of the last breadcrumb recorded (the first is 1).
+    std::uint64_t last;
+    // Unique for each thread, assigned on first use. Addresses of thread
+    // locals are reused by new threads, so we can't rely on them.
+    std::uint64_t id;
+    Breadcrumb crumbs[kCapacity];
+};
+
+
+inline BreadcrumbRing& ThisThreadBreadcrumbs()
+{
+    static thread_local BreadcrumbRing ring;
+    static std::atomic<std::uint64_t> nextId{1};
+
+    if (ring.id == 0)
+    {
+        ring.id = nextId.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return ring;
+}
+
+
+// Records a breadcrumb on this thread's ring, with a printf-style message,
+// and returns its chain. A chain of 0 begins a new chain.
+#if defined(__GNUC__)
+__attribute__((format(printf, 6, 7)))
+#endif
+inline std::uint64_t RecordBreadcrumb(std::uint64_t chain, unsigned long key, char const* file, int line,
+    char const* function, char const* format, ...)
+{
+    BreadcrumbRing& ring = ThisThreadBreadcrumbs();
+    std::uint64_t seq = ++ring.last;
+    Breadcrumb& b = ring.crumbs[seq % BreadcrumbRing::kCapacity];
+
+    b.chain = (chain != 0) ? chain : seq;
+    b.key = key;
+    b.file = file;
+    b.function = function;
+    b.line = line;
+
+    // vsnprintf() truncates, and always terminates the message.
+    va_list args;
+    va_start(args, format);
+    if (std::vsnprintf(b.message, Breadcrumb::kMessageSize, format, args) < 0)
+    {
+        b.message[0] = '\0';
+    }
+    va_end(args);
+
+    return b.chain;
+}
+
+
+// Formats a chain's breadcrumbs, oldest first, one per line. Only what's
+// still in the ring.
+inline std::string FormatBreadcrumbs(BreadcrumbRing const& ring, std::uint64_t chain)
+{
+    std::string trace;
+
+    if ((chain == 0) || (chain > ring.last))
+    {
+        return trace;
+    }
+
+    std::uint64_t first = chain;
+    if (ring.last - chain >= BreadcrumbRing::kCapacity)
+    {
+        first = ring.last - BreadcrumbRing::kCapacity + 1;
+        trace += "(older breadcrumbs lost)\n";
+    }
+
+    // Big enough for an unsigned long; std::to_string() isn't available
+    // everywhere (e.g., mingw 4.x).
+    char number[24];
+
+    for (std::uint64_t seq = first; seq <= ring.last; ++seq)
+    {
+        Breadcrumb const& b = ring.crumbs[seq % BreadcrumbRing::kCapacity];
+
+        if (b.chain != chain)
+        {
+            continue;
+        }
+
+        trace += b.file;
+        trace += '(';
+        std::snprintf(number, sizeof(number), "%d", b.line);
+        trace += number;
+        trace += "): ";
+        trace += b.function;
+        if (b.key != 0)
+        {
+            trace += " [";
+            std::snprintf(number, sizeof(number), "%lu", b.key);
+            trace += number;
+            trace += ']';
+        }
+        trace += ": ";
+        trace += b.message;
+        trace += '\n';
+    }
+
+    return trace;
+}
+
+} // namespace base
+}}}
+
+#endif // BASE_BREADCRUMBS_H
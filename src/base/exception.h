@@ -36,6 +36,13 @@
 #include <boost/exception/all.hpp>
 #pragma GCC diagnostic pop
 #pragma warning(pop)
+#include <boost/current_function.hpp>
+
+#include "base/breadcrumbs.h"
+
+#include <cstdint>
+#include <exception>
+#include <string>
 
 namespace pt { namespace pcaetano { namespace bluesy {
 namespace base
@@ -52,10 +59,135 @@ using error_message = boost::error_info<struct tag_error_message, std::string>;
 
 // We'll be using nested exceptions to implement a very basic stack trace. It' won't be a real
 // stack trace, since it has nothing outside of our own code.
+// Each level allocates, though, which is not what we want when errors come in storms.
 using nested_exception = boost::error_info<struct tag_nested_exception, boost::exception_ptr>;
 
-struct PCBBaseException : virtual std::exception, virtual boost::exception { };
+// Where an exception's breadcrumbs are: the chain, on the ring of the thread
+// that recorded it, and the trace formatted so far. Kept as error info, so
+// that copies (e.g., by boost::current_exception()) carry it; the virtual
+// bases aren't copied.
+struct BreadcrumbState
+{
+    std::uint64_t chain;
+    std::uint64_t ring_id;
+    std::string trace;
+};
+
+using breadcrumb_state = boost::error_info<struct tag_breadcrumb_state, BreadcrumbState>;
+
+// boost::diagnostic_information() shows the trace through what(); this keeps
+// it from showing it twice.
+inline std::string to_string(breadcrumb_state const&)
+{
+    return std::string{};
+}
+
+// Breadcrumbs (see breadcrumbs.h) are a cheaper alternative: PCBLUESY_THROW and
+// PCBLUESY_RETHROW record where the error went through, without formatting
+// anything, and the trace is only formatted when the exception is reported, by
+// what() (which is what boost::diagnostic_information() shows).
+struct PCBBaseException : virtual std::exception, virtual boost::exception
+{
+    // Moves the breadcrumbs from this thread's ring into the exception. Must
+    // be called on the thread that threw, before the exception goes to
+    // another thread (e.g., through an exception_ptr); what() does it, too.
+    void CaptureBreadcrumbs() const
+    {
+        BreadcrumbState const* state = boost::get_error_info<breadcrumb_state>(*this);
+
+        if ((state == nullptr) || (state->chain == 0))
+        {
+            return;
+        }
+
+        try
+        {
+            BreadcrumbState captured{0, 0, state->trace};
+            if (state->ring_id == ThisThreadBreadcrumbs().id)
+            {
+                captured.trace += FormatBreadcrumbs(ThisThreadBreadcrumbs(), state->chain);
+            }
+            *this << breadcrumb_state(captured);
+        }
+        catch (...)
+        {
+            // Nothing we can do.
+        }
+    }
+
+    // The breadcrumb trace, if there is one.
+    char const* what() const BOOST_NOEXCEPT_OR_NOTHROW override
+    {
+        CaptureBreadcrumbs();
+        BreadcrumbState const* state = boost::get_error_info<breadcrumb_state>(*this);
+        return ((state == nullptr) || state->trace.empty()) ? std::exception::what() : state->trace.c_str();
+    }
+};
+
+
+namespace detail
+{
+
+template <typename Exception>
+void ThrowWithBreadcrumb(Exception ex, std::uint64_t chain, char const* function, char const* file, int line)
+{
+    // The throw location, as BOOST_THROW_EXCEPTION sets it.
+    ex << boost::throw_function(function) << boost::throw_file(file) << boost::throw_line(line) <<
+        breadcrumb_state(BreadcrumbState{chain, ThisThreadBreadcrumbs().id, std::string{}});
+
+    // Wrapped, as boost::throw_exception() does, so boost::current_exception()
+    // can copy it.
+    throw boost::enable_current_exception(ex);
+}
+
+// The chain a rethrow adds to. Breadcrumbs recorded on another thread are
+// out of reach, so a rethrow there begins a new chain.
+inline std::uint64_t RethrowChain(PCBBaseException const& ex)
+{
+    BreadcrumbState const* state = boost::get_error_info<breadcrumb_state>(ex);
+
+    if ((state != nullptr) && (state->ring_id != ThisThreadBreadcrumbs().id))
+    {
+        ex.CaptureBreadcrumbs();
+        state = boost::get_error_info<breadcrumb_state>(ex);
+    }
+
+    return (state != nullptr) ? state->chain : 0;
+}
+
+inline void ContinueBreadcrumbs(PCBBaseException const& ex, std::uint64_t chain)
+{
+    BreadcrumbState const* state = boost::get_error_info<breadcrumb_state>(ex);
+
+    ex << breadcrumb_state(BreadcrumbState{chain, ThisThreadBreadcrumbs().id,
+        (state != nullptr) ? state->trace : std::string{}});
+}
+
+} // namespace detail
 
 } // namespace base
 }}}
+
+
+// Throws ex, a PCBBaseException, recording a breadcrumb with the key (an
+// error_key-style ID, or 0) and a printf-style message, instead of adding an
+// error_message.
+#define PCBLUESY_THROW(ex, key, ...) \
+    ::pt::pcaetano::bluesy::base::detail::ThrowWithBreadcrumb((ex), \
+        ::pt::pcaetano::bluesy::base::RecordBreadcrumb(0, (key), __FILE__, __LINE__, \
+            BOOST_CURRENT_FUNCTION, __VA_ARGS__), \
+        BOOST_CURRENT_FUNCTION, __FILE__, __LINE__)
+
+// In a catch block, rethrows ex, the exception caught, adding a breadcrumb
+// to its chain.
+#define PCBLUESY_RETHROW(ex, key, ...) \
+    do \
+    { \
+        ::pt::pcaetano::bluesy::base::detail::ContinueBreadcrumbs((ex), \
+            ::pt::pcaetano::bluesy::base::RecordBreadcrumb( \
+                ::pt::pcaetano::bluesy::base::detail::RethrowChain(ex), (key), __FILE__, __LINE__, \
+                BOOST_CURRENT_FUNCTION, __VA_ARGS__)); \
+        throw; \
+    } while (false)
+
 #endif // BASE_EXCEPTION_H
@@ -0,0 +1,75 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BASE_TEMP_NAME_H
+#define BASE_TEMP_NAME_H
+
+// Names for temporary files that are written and then renamed over a target
+// (e.g., an index, or a snapshot), so that readers never see a partial file.
+//
+// The name is in the target's directory, so the rename doesn't cross file
+// systems, and is unique to this process and call, so that writers of the
+// same target, in this process or in others, don't write over each other's
+// temporary file; the last rename wins.
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace base
+{
+
+// Returns fileName, followed by ".<pid>.<counter>.tmp".
+inline std::string UniqueTempName(std::string const& fileName)
+{
+    static std::atomic<unsigned long> counter{0};
+
+#ifdef _WIN32
+    unsigned long pid = static_cast<unsigned long>(_getpid());
+#else
+    unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+    // Big enough for two unsigned longs.
+    char suffix[48];
+    std::snprintf(suffix, sizeof(suffix), ".%lu.%lu.tmp", pid,
+        counter.fetch_add(1, std::memory_order_relaxed));
+
+    return fileName + suffix;
+}
+
+} // namespace base
+}}}
+
+#endif // BASE_TEMP_NAME_H
@@ -0,0 +1,445 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "bulk_transcoder.h"
+#include "encoding_converter.h"
+#include "win_exception.h"
+#include "utils/exception.h"
+#include "utils/file_chunks.h"
+#include "utils/file_line_reader.h"
+
+#ifdef _WIN32
+#include "windows.h"
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace ms_windows {
+
+namespace
+{
+
+using utils::error_message;
+using utils::FileOpenException;
+using utils::FileReadException;
+using utils::FileWriteException;
+
+// Whether both names refer to the same existing file (through links, other
+// paths, etc.), by its identity, not its name.
+#ifdef _WIN32
+
+bool GetFileIdentity(std::string const& fileName, BY_HANDLE_FILE_INFORMATION& info)
+{
+    HANDLE file = CreateFileA(fileName.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    bool ok = (GetFileInformationByHandle(file, &info) != 0);
+    CloseHandle(file);
+    return ok;
+}
+
+bool IsSameFile(std::string const& fileName1, std::string const& fileName2)
+{
+    BY_HANDLE_FILE_INFORMATION info1;
+    BY_HANDLE_FILE_INFORMATION info2;
+
+    return GetFileIdentity(fileName1, info1) && GetFileIdentity(fileName2, info2) &&
+        (info1.dwVolumeSerialNumber == info2.dwVolumeSerialNumber) &&
+        (info1.nFileIndexHigh == info2.nFileIndexHigh) && (info1.nFileIndexLow == info2.nFileIndexLow);
+}
+
+#else
+
+bool IsSameFile(std::string const& fileName1, std::string const& fileName2)
+{
+    struct stat st1;
+    struct stat st2;
+
+    return (stat(fileName1.c_str(), &st1) == 0) && (stat(fileName2.c_str(), &st2) == 0) &&
+        (st1.st_dev == st2.st_dev) && (st1.st_ino == st2.st_ino);
+}
+
+#endif
+
+// Output file that takes positioned writes, which can be issued from any
+// number of threads, with no shared file pointer.
+class OutputFile
+{
+public:
+    explicit OutputFile(std::string const& fileName);
+    ~OutputFile();
+
+    OutputFile(OutputFile const&) = delete;
+    OutputFile& operator=(OutputFile const&) = delete;
+
+    // Best effort - if the filesystem can't do it, we just don't preallocate.
+    void Preallocate(unsigned long long size);
+    void WriteAt(char const* data, std::size_t len, unsigned long long offset);
+    void Truncate(unsigned long long size);
+private:
+    [[noreturn]] void ThrowWriteError() const
+    {
+        BOOST_THROW_EXCEPTION(FileWriteException() << error_message("Error writing file " + fileName));
+    }
+
+    std::string fileName;
+#ifdef _WIN32
+    HANDLE file;
+#else
+    int fd;
+#endif
+};
+
+#ifdef _WIN32
+
+OutputFile::OutputFile(std::string const& fileName) :
+    fileName{fileName},
+    file{CreateFileA(fileName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr)}
+{
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        BOOST_THROW_EXCEPTION(FileOpenException() << error_message("Error opening file " + fileName));
+    }
+}
+
+OutputFile::~OutputFile()
+{
+    CloseHandle(file);
+}
+
+void OutputFile::Preallocate(unsigned long long size)
+{
+    // Setting the end of file allocates the space; Truncate() sets it to the
+    // actual size at the end.
+    Truncate(size);
+}
+
+void OutputFile::WriteAt(char const* data, std::size_t len, unsigned long long offset)
+{
+    while (len > 0)
+    {
+        // WriteFile() takes a DWORD, so we write at most 1 GiB at a time.
+        DWORD toWrite = static_cast<DWORD>(std::min<std::size_t>(len, 1u << 30));
+        DWORD written = 0;
+        OVERLAPPED ov = {};
+        ov.Offset = static_cast<DWORD>(offset);
+        ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        if (!WriteFile(file, data, toWrite, &written, &ov) || (written == 0))
+        {
+            ThrowWriteError();
+        }
+
+        data += written;
+        len -= written;
+        offset += written;
+    }
+}
+
+void OutputFile::Truncate(unsigned long long size)
+{
+    LARGE_INTEGER pos;
+    pos.QuadPart = static_cast<LONGLONG>(size);
+
+    if (!SetFilePointerEx(file, pos, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+    {
+        ThrowWriteError();
+    }
+}
+
+#else
+
+OutputFile::OutputFile(std::string const& fileName) :
+    fileName{fileName}, fd{open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666)}
+{
+    if (fd == -1)
+    {
+        BOOST_THROW_EXCEPTION(FileOpenException() << error_message("Error opening file " + fileName));
+    }
+}
+
+OutputFile::~OutputFile()
+{
+    close(fd);
+}
+
+void OutputFile::Preallocate(unsigned long long size)
+{
+#if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
+    // Unlike ftruncate(), this actually allocates the blocks.
+    posix_fallocate(fd, 0, static_cast<off_t>(size));
+#else
+    static_cast<void>(size);
+#endif
+}
+
+void OutputFile::WriteAt(char const* data, std::size_t len, unsigned long long offset)
+{
+    while (len > 0)
+    {
+        ssize_t written = pwrite(fd, data, len, static_cast<off_t>(offset));
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            ThrowWriteError();
+        }
+
+        data += written;
+        len -= static_cast<std::size_t>(written);
+        offset += static_cast<unsigned long long>(written);
+    }
+}
+
+void OutputFile::Truncate(unsigned long long size)
+{
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        ThrowWriteError();
+    }
+}
+
+#endif
+
+
+// State shared by the workers of one Transcode() call.
+// Workers take chunks in file order. Once a chunk is converted, its worker
+// waits for the chunk before it to be placed (i.e., to get its offset), and
+// then places its own; this is the only point where workers wait for each
+// other, and only for as long as it takes to convert one chunk.
+class TranscodeJob
+{
+public:
+    TranscodeJob(std::string const& inFile, std::vector<utils::FileChunk> const& chunks,
+        OutputFile& out) :
+        inFile(inFile), chunks(chunks), out(out)
+    {
+    }
+
+    void Run(std::string const& encTo, std::string const& encFrom);
+
+    // Stops the other workers, and keeps the first error, to be rethrown.
+    void Fail(std::exception_ptr e)
+    {
+        std::lock_guard<std::mutex> lock{m};
+
+        if (!failed)
+        {
+            failed = true;
+            error = e;
+        }
+        placed.notify_all();
+    }
+
+    std::exception_ptr GetError() const { return error; }
+    unsigned long long GetOutputSize() const { return outSize; }
+private:
+    // Returns the offset for chunk i, and false if we should stop.
+    bool Place(std::size_t i, std::size_t size, unsigned long long& offset)
+    {
+        std::unique_lock<std::mutex> lock{m};
+
+        placed.wait(lock, [this, i] { return failed || (nextToPlace == i); });
+        if (failed)
+        {
+            return false;
+        }
+
+        offset = outSize;
+        outSize += size;
+        ++nextToPlace;
+        placed.notify_all();
+
+        return true;
+    }
+
+    std::string const& inFile;
+    std::vector<utils::FileChunk> const& chunks;
+    OutputFile& out;
+
+    std::atomic<std::size_t> nextChunk{0};
+
+    std::mutex m;
+    std::condition_variable placed;
+    std::size_t nextToPlace = 0;
+    unsigned long long outSize = 0;
+    bool failed = false;
+    std::exception_ptr error;
+};
+
+void TranscodeJob::Run(std::string const& encTo, std::string const& encFrom)
+{
+    try
+    {
+        EncodingConverter conv{encTo, encFrom};
+        std::ifstream in{inFile, std::ios_base::in | std::ios_base::binary};
+
+        if (!in)
+        {
+            PCBLUESY_THROW(FileOpenException(), 0, "Error opening file %s", inFile.c_str());
+        }
+
+        std::string buf;
+        std::string converted;
+
+        for (std::size_t i = nextChunk++; i < chunks.size(); i = nextChunk++)
+        {
+            if (!utils::ReadFileChunk(in, chunks[i], buf))
+            {
+                PCBLUESY_THROW(FileReadException(), 0, "Error reading file %s", inFile.c_str());
+            }
+
+            converted.clear();
+            conv.ConvertAppend(buf.data(), buf.size(), converted);
+
+            unsigned long long offset = 0;
+            if (!Place(i, converted.size(), offset))
+            {
+                return;
+            }
+
+            out.WriteAt(converted.data(), converted.size(), offset);
+        }
+    }
+    catch (base::PCBBaseException const& e)
+    {
+        // The breadcrumbs stay with this thread.
+        e.CaptureBreadcrumbs();
+        Fail(std::current_exception());
+    }
+    catch (...)
+    {
+        Fail(std::current_exception());
+    }
+}
+
+} // unnamed namespace
+
+
+constexpr std::size_t BulkTranscoder::defaultChunkSize;
+
+BulkTranscoder::BulkTranscoder(std::string const& encTo, std::string const& encFrom) :
+    encTo{encTo}, encFrom{encFrom}
+{
+    // Fail here, rather than in every worker.
+    EncodingConverter{encTo, encFrom};
+}
+
+void BulkTranscoder::SetChunkSize(std::size_t size)
+{
+    assert(size > 0);
+    chunkSize = size;
+}
+
+BulkTranscodeStats BulkTranscoder::Transcode(std::string const& inFile, std::string const& outFile) const
+{
+    // Opening the output truncates it, so this must be checked first.
+    if (IsSameFile(inFile, outFile))
+    {
+        BOOST_THROW_EXCEPTION(FileOpenException() <<
+            error_message("Error opening file " + outFile + ": it's the same file as " + inFile));
+    }
+
+    BulkTranscodeStats stats;
+    std::vector<utils::FileChunk> chunks;
+    {
+        utils::FileLineReader<> flr{inFile};
+        stats.bytesRead = static_cast<unsigned long long>(flr.GetFileSize());
+        chunks = utils::SplitLineChunks(flr, static_cast<std::streamoff>(chunkSize));
+    }
+
+    OutputFile out{outFile};
+    if (preallocate && (stats.bytesRead > 0))
+    {
+        out.Preallocate(stats.bytesRead);
+    }
+
+    unsigned threads = (threadCount > 0) ? threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+    threads = static_cast<unsigned>(std::min<std::size_t>(threads, chunks.size()));
+
+    TranscodeJob job{inFile, chunks, out};
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+
+    try
+    {
+        for (unsigned i = 0; i < threads; ++i)
+        {
+            workers.emplace_back(&TranscodeJob::Run, &job, std::cref(encTo), std::cref(encFrom));
+        }
+    }
+    catch (...)
+    {
+        // Couldn't start a thread. The ones that did start must be stopped
+        // before we leave, since they're using job.
+        job.Fail(std::current_exception());
+    }
+
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+
+    if (job.GetError())
+    {
+        std::rethrow_exception(job.GetError());
+    }
+
+    out.Truncate(job.GetOutputSize());
+
+    stats.bytesWritten = job.GetOutputSize();
+    stats.chunks = chunks.size();
+    stats.threads = threads;
+    return stats;
+}
+
+} // namespace ms_windows
+}}}
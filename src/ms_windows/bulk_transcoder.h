@@ -0,0 +1,106 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BULK_TRANSCODER_H
+#define BULK_TRANSCODER_H
+
+// Transcodes whole files, e.g., gigabytes of cp850/cp1252 logs to UTF-8.
+//
+// The input is split into newline-aligned chunks (see utils/file_chunks.h),
+// which worker threads read and convert concurrently, each with its own
+// EncodingConverter. The chunks' output offsets are handed out in file order,
+// as soon as each chunk is converted, so the workers can then write their
+// output with positioned writes, in parallel, without waiting for all the
+// chunks before theirs to be written. The output file is preallocated with
+// the size of the input (the exact size, for single-byte to single-byte),
+// and truncated to the actual size at the end.
+//
+// Memory use is about 2 * threads * chunk size, plus the expansion of the
+// converted text.
+//
+// Splitting on '\n' requires that no character in the source encoding
+// contains the byte 0x0A, and that the encoding keeps no state between lines.
+// This holds for UTF-8, single-byte code pages, and most multibyte code
+// pages, but not for UTF-16/32 or ISO-2022.
+//
+// Requires ICU (icuuc), for the encodings that aren't converted natively.
+
+#include "win_exception.h"
+
+#include <cstddef>
+#include <string>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace ms_windows {
+
+struct BulkTranscodeStats
+{
+    unsigned long long bytesRead = 0;
+    unsigned long long bytesWritten = 0;
+    std::size_t chunks = 0;
+    unsigned threads = 0;
+};
+
+
+// Thread safety: None, but Transcode() may be called on different
+// instances concurrently.
+class BulkTranscoder
+{
+public:
+    static constexpr std::size_t defaultChunkSize = 8 * 1024 * 1024;
+
+    // Converts from encFrom to encTo. Throws EncodingNotFoundException if ICU
+    // doesn't know either encoding.
+    BulkTranscoder(std::string const& encTo, std::string const& encFrom);
+
+    // 0 (the default) means one thread per core.
+    void SetThreadCount(unsigned threads) { threadCount = threads; }
+    void SetChunkSize(std::size_t size);
+    // On by default. Preallocation avoids fragmentation, and lets the
+    // filesystem allocate the whole file at once.
+    void SetPreallocate(bool prealloc) { preallocate = prealloc; }
+
+    // Converts inFile into outFile, replacing it if it exists.
+    // Throws utils::FileOpenException if either file can't be opened, or if
+    // both are the same file (which is checked before outFile is opened), and
+    // utils::FileWriteException if we can't write to outFile. If a worker
+    // fails, the others stop after their current chunk, and its exception is
+    // rethrown; outFile is left incomplete.
+    BulkTranscodeStats Transcode(std::string const& inFile, std::string const& outFile) const;
+private:
+    std::string encTo;
+    std::string encFrom;
+    unsigned threadCount = 0;
+    std::size_t chunkSize = defaultChunkSize;
+    bool preallocate = true;
+};
+
+} // namespace ms_windows
+}}}
+
+#endif // BULK_TRANSCODER_H
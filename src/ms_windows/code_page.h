@@ -0,0 +1,57 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CODE_PAGE_H
+#define CODE_PAGE_H
+
+// Lookups between Windows code pages and encoding names, defined in
+// win_console_out.cpp.
+
+#include "win_exception.h"
+
+#include <string>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace ms_windows {
+
+// These return nullptr/0 if there's no match.
+char const* FindEncoding(UINT codePage) noexcept;
+UINT FindCodePage(char const* encoding) noexcept;
+
+// True for every encoding FindCodePage() knows - they all have ASCII as a
+// subset.
+bool IsAsciiCompatible(char const* encoding) noexcept;
+
+// These throw EncodingNotFoundException if there's no match.
+std::string GetEncoding(UINT codePage);
+UINT GetCodePage(char const* encoding);
+
+} // namespace ms_windows
+}}}
+
+#endif // CODE_PAGE_H
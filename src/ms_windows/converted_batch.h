@@ -0,0 +1,136 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONVERTED_BATCH_H
+#define CONVERTED_BATCH_H
+
+// Batch conversion, for many short strings.
+//
+// Instead of one std::string per converted string, a ConvertedBatch stores
+// all of them back to back in a single buffer, with an array of offsets,
+// and converts them all with the same EncodingConverter. Clear() keeps the
+// buffers' capacity, so a batch that's reused doesn't allocate once it has
+// grown to the size of the largest batch.
+//
+// E.g.:
+//  ConvertedBatch batch;
+//  ConvertAll(lines.begin(), lines.end(), batch);
+//  for (std::size_t i = 0; i < batch.Size(); ++i) { cout << batch[i] << '\n'; }
+// Or, if the strings are only needed together:
+//  cout << batch.GetBuffer();
+
+#include "encoding_converter.h"
+
+#include <boost/utility/string_ref.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace ms_windows {
+
+// Thread safety: None.
+class ConvertedBatch
+{
+public:
+    // Converts to the console's code page.
+    ConvertedBatch();
+    explicit ConvertedBatch(std::shared_ptr<EncodingConverter> conv);
+
+    void Append(char const* s, std::size_t len)
+    {
+        conv->ConvertAppend(s, len, buffer);
+        offsets.push_back(buffer.size());
+    }
+
+    void Append(wchar_t const* s, std::size_t len)
+    {
+        conv->ConvertAppend(s, len, buffer);
+        offsets.push_back(buffer.size());
+    }
+
+    template <typename CharT>
+    void Append(std::basic_string<CharT> const& s) { Append(s.data(), s.size()); }
+
+    void Append(boost::string_ref s) { Append(s.data(), s.size()); }
+
+    template <typename CharT>
+    void Append(CharT const* s) { Append(s, std::char_traits<CharT>::length(s)); }
+
+    // Reserves space for count strings, with a total of bytes converted bytes.
+    void Reserve(std::size_t count, std::size_t bytes)
+    {
+        offsets.reserve(count + 1);
+        buffer.reserve(bytes);
+    }
+
+    void Clear()
+    {
+        buffer.clear();
+        offsets.resize(1);
+    }
+
+    std::size_t Size() const { return offsets.size() - 1; }
+    bool Empty() const { return Size() == 0; }
+
+    boost::string_ref operator[](std::size_t i) const
+    {
+        assert(i < Size());
+        return boost::string_ref{buffer.data() + offsets[i], offsets[i + 1] - offsets[i]};
+    }
+
+    // All the converted strings, back to back.
+    std::string const& GetBuffer() const { return buffer; }
+    // String i is [GetOffsets()[i], GetOffsets()[i + 1]). There's always
+    // one more offset than there are strings.
+    std::vector<std::size_t> const& GetOffsets() const { return offsets; }
+private:
+    std::shared_ptr<EncodingConverter> conv;
+    std::string buffer;
+    std::vector<std::size_t> offsets;
+};
+
+
+// Converts [first, last) into batch. The elements can be anything
+// ConvertedBatch::Append() accepts.
+template <typename InputIt>
+void ConvertAll(InputIt first, InputIt last, ConvertedBatch& batch)
+{
+    for (; first != last; ++first)
+    {
+        batch.Append(*first);
+    }
+}
+
+} // namespace ms_windows
+}}}
+
+#endif // CONVERTED_BATCH_H
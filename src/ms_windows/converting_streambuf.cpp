@@ -0,0 +1,157 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "converting_streambuf.h"
+#include "code_page.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <string>
+using std::string;
+#include <utility>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace ms_windows {
+
+constexpr std::size_t ConvertingStreamBuf::defaultBufferSize;
+
+namespace
+{
+
+// Length of the UTF-8 sequence that s ends with, if it's incomplete;
+// 0 otherwise.
+std::size_t IncompleteUtf8Tail(char const* s, std::size_t len)
+{
+    for (std::size_t back = 1; (back <= 4) && (back <= len); ++back)
+    {
+        unsigned char c = static_cast<unsigned char>(s[len - back]);
+
+        if ((c & 0xC0) == 0x80)
+        {
+            // Continuation byte, keep going back.
+            continue;
+        }
+
+        std::size_t seqLen = ((c & 0xE0) == 0xC0) ? 2 : ((c & 0xF0) == 0xE0) ? 3 : ((c & 0xF8) == 0xF0) ? 4 : 1;
+        return (seqLen > back) ? back : 0;
+    }
+
+    return 0;
+}
+
+} // unnamed namespace
+
+
+ConvertingStreamBuf::ConvertingStreamBuf(std::streambuf* target, std::shared_ptr<EncodingConverter> conv,
+    std::size_t bufferSize) :
+    target{target}, conv{std::move(conv)}, buffer(std::max<std::size_t>(bufferSize, 16)),
+    sourceIsUtf8{FindCodePage(this->conv->GetSourceEncoding().c_str()) == 65001}
+{
+    assert(target != nullptr);
+    setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+ConvertingStreamBuf::~ConvertingStreamBuf()
+{
+    try
+    {
+        WriteConverted(true);
+        target->pubsync();
+    }
+    catch (...)
+    {
+    }
+}
+
+ConvertingStreamBuf::int_type ConvertingStreamBuf::overflow(int_type ch)
+{
+    if (!WriteConverted(false))
+    {
+        return traits_type::eof();
+    }
+
+    if (!traits_type::eq_int_type(ch, traits_type::eof()))
+    {
+        // There's always room, WriteConverted() keeps 3 bytes, at most.
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(ch);
+}
+
+int ConvertingStreamBuf::sync()
+{
+    if (!WriteConverted(false))
+    {
+        return -1;
+    }
+
+    return target->pubsync();
+}
+
+bool ConvertingStreamBuf::WriteConverted(bool all)
+{
+    std::size_t len = pptr() - pbase();
+    std::size_t keep = (sourceIsUtf8 && !all) ? IncompleteUtf8Tail(pbase(), len) : 0;
+
+    string converted = conv->Convert(pbase(), len - keep);
+    std::streamsize written = target->sputn(converted.data(), static_cast<std::streamsize>(converted.size()));
+
+    std::memmove(buffer.data(), pbase() + len - keep, keep);
+    setp(buffer.data(), buffer.data() + buffer.size());
+    pbump(static_cast<int>(keep));
+
+    return (written == static_cast<std::streamsize>(converted.size()));
+}
+
+
+ConvertingOutput::ConvertingOutput(std::ostream& os) :
+    ConvertingOutput(os, GetConsoleConverter())
+{
+}
+
+ConvertingOutput::ConvertingOutput(std::ostream& os, std::shared_ptr<EncodingConverter> conv) :
+    os(os), prev{os.rdbuf()}, buf{prev, std::move(conv)}
+{
+    // rdbuf() clears the stream's state.
+    std::ios_base::iostate state = os.rdstate();
+    os.rdbuf(&buf);
+    os.clear(state);
+}
+
+ConvertingOutput::~ConvertingOutput()
+{
+    std::ios_base::iostate state = os.rdstate();
+    os.rdbuf(prev);
+    os.clear(state);
+}
+
+} // namespace ms_windows
+}}}
@@ -0,0 +1,109 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CONVERTING_STREAMBUF_H
+#define CONVERTING_STREAMBUF_H
+
+// Converting output, without building the whole output in memory first.
+//
+// ConvertingStreamBuf collects what's written to it in a fixed size buffer,
+// and, whenever the buffer fills up or the stream is flushed, converts it
+// with an EncodingConverter and writes the result to another streambuf.
+// A UTF-8 sequence split at the end of the buffer is kept for the next
+// round. Memory use is bounded by the buffer size, whatever the size of the
+// output.
+//
+// ConvertingOutput installs a ConvertingStreamBuf on an existing stream for
+// its lifetime, e.g.:
+//
+//  {
+//      ConvertingOutput co{cout};
+//      cout << bigReport;
+//  }
+
+#include "encoding_converter.h"
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace ms_windows {
+
+// Thread safety: None, like the EncodingConverter it uses.
+class ConvertingStreamBuf : public std::streambuf
+{
+public:
+    static constexpr std::size_t defaultBufferSize = 64 * 1024;
+
+    ConvertingStreamBuf(std::streambuf* target, std::shared_ptr<EncodingConverter> conv,
+        std::size_t bufferSize = defaultBufferSize);
+    // Converts and writes whatever's left. Errors are ignored.
+    ~ConvertingStreamBuf();
+
+    ConvertingStreamBuf(ConvertingStreamBuf const&) = delete;
+    ConvertingStreamBuf& operator=(ConvertingStreamBuf const&) = delete;
+protected:
+    int_type overflow(int_type ch) override;
+    int sync() override;
+private:
+    // Converts and writes the buffer's contents, except for an incomplete
+    // UTF-8 sequence at the end, unless all is true.
+    bool WriteConverted(bool all);
+
+    std::streambuf* target;
+    std::shared_ptr<EncodingConverter> conv;
+    std::vector<char> buffer;
+    bool sourceIsUtf8;
+};
+
+
+// Installs a ConvertingStreamBuf on os, and restores os's own streambuf on
+// destruction. The stream's state is preserved in both cases.
+class ConvertingOutput
+{
+public:
+    // Converts to the console's code page.
+    explicit ConvertingOutput(std::ostream& os);
+    ConvertingOutput(std::ostream& os, std::shared_ptr<EncodingConverter> conv);
+    ~ConvertingOutput();
+
+    ConvertingOutput(ConvertingOutput const&) = delete;
+    ConvertingOutput& operator=(ConvertingOutput const&) = delete;
+private:
+    std::ostream& os;
+    std::streambuf* prev;
+    ConvertingStreamBuf buf;
+};
+
+} // namespace ms_windows
+}}}
+
+#endif // CONVERTING_STREAMBUF_H
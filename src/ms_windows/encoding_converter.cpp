@@ -0,0 +1,257 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "encoding_converter.h"
+#include "code_page.h"
+#include "native_codec.h"
+#include "win_exception.h"
+#include "utils/text_validation.h"
+
+#include <unicode/ucnv.h>
+#include <unicode/utypes.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cwchar>
+#include <string>
+using std::string;
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace ms_windows {
+
+namespace
+{
+
+// ICU's aliases for UTF-16/UTF-32 in the platform's byte order.
+char const* const wideEncoding = (sizeof(wchar_t) == 2) ? "UTF16_PlatformEndian" : "UTF32_PlatformEndian";
+
+// Opens a converter that skips whatever it can't convert, like Boost Locale's
+// default method_type (skip).
+UConverter* OpenConverter(string const& enc)
+{
+    UErrorCode err = U_ZERO_ERROR;
+    UConverter* conv = ucnv_open(enc.c_str(), &err);
+
+    if (U_FAILURE(err))
+    {
+        BOOST_THROW_EXCEPTION(EncodingNotFoundException()
+            << error_message("Could not open converter for encoding " + enc));
+    }
+
+    ucnv_setToUCallBack(conv, UCNV_TO_U_CALLBACK_SKIP, nullptr, nullptr, nullptr, &err);
+    ucnv_setFromUCallBack(conv, UCNV_FROM_U_CALLBACK_SKIP, nullptr, nullptr, nullptr, &err);
+
+    return conv;
+}
+
+} // unnamed namespace
+
+
+EncodingConverter::EncodingConverter(string const& encTo, string const& encFrom) :
+    encTo{encTo}, encFrom{encFrom},
+    nativeTo{NativeCodec::Find(encTo.c_str())}, nativeFrom{NativeCodec::Find(encFrom.c_str())},
+    asciiCopyWide{IsAsciiCompatible(encTo.c_str())}, asciiCopyToWide{IsAsciiCompatible(encFrom.c_str())}
+{
+    asciiCopyNarrow = asciiCopyWide && IsAsciiCompatible(encFrom.c_str());
+
+    bool narrowNeedsIcu = (nativeTo == nullptr) || (nativeFrom == nullptr);
+    bool wideNeedsIcu = (nativeTo == nullptr);
+
+    // If one of these throws, the destructor won't run.
+    try
+    {
+        if (narrowNeedsIcu || wideNeedsIcu)
+        {
+            to = OpenConverter(encTo);
+        }
+        if (narrowNeedsIcu)
+        {
+            fromNarrow = OpenConverter(encFrom);
+        }
+        if (wideNeedsIcu)
+        {
+            wide = OpenConverter(wideEncoding);
+        }
+    }
+    catch (...)
+    {
+        ucnv_close(fromNarrow);
+        ucnv_close(to);
+        throw;
+    }
+}
+
+EncodingConverter::~EncodingConverter()
+{
+    ucnv_close(wide);
+    ucnv_close(fromNarrow);
+    ucnv_close(to);
+}
+
+string EncodingConverter::Convert(char const* strToConv)
+{
+    assert(strToConv != nullptr);
+    return Convert(strToConv, std::char_traits<char>::length(strToConv));
+}
+
+string EncodingConverter::Convert(char const* strToConv, std::size_t len)
+{
+    string converted;
+    ConvertAppend(strToConv, len, converted);
+    return converted;
+}
+
+string EncodingConverter::Convert(wchar_t const* strToConv)
+{
+    assert(strToConv != nullptr);
+    return Convert(strToConv, std::char_traits<wchar_t>::length(strToConv));
+}
+
+string EncodingConverter::Convert(wchar_t const* strToConv, std::size_t len)
+{
+    string converted;
+    ConvertAppend(strToConv, len, converted);
+    return converted;
+}
+
+void EncodingConverter::ConvertAppend(char const* strToConv, std::size_t len, string& converted)
+{
+    if (asciiCopyNarrow && utils::IsAscii(strToConv, len))
+    {
+        converted.append(strToConv, len);
+    }
+    else if (fromNarrow == nullptr)
+    {
+        TranscodeAppend(strToConv, len, *nativeTo, *nativeFrom, converted);
+    }
+    else
+    {
+        ConvertAppend(to, fromNarrow, strToConv, strToConv + len, converted);
+    }
+}
+
+void EncodingConverter::ConvertAppend(wchar_t const* strToConv, std::size_t len, string& converted)
+{
+    if (asciiCopyWide && utils::IsAscii(strToConv, len))
+    {
+        converted.append(strToConv, strToConv + len);
+    }
+    else if (wide == nullptr)
+    {
+        TranscodeAppend(strToConv, len, *nativeTo, converted);
+    }
+    else
+    {
+        ConvertAppend(to, wide, reinterpret_cast<char const*>(strToConv),
+            reinterpret_cast<char const*>(strToConv + len), converted);
+    }
+}
+
+void EncodingConverter::ConvertAppend(char const* strToConv, std::size_t len, std::wstring& converted)
+{
+    if (asciiCopyToWide && utils::IsAscii(strToConv, len))
+    {
+        AppendAsciiWide(strToConv, len, converted);
+    }
+    else if (nativeFrom != nullptr)
+    {
+        TranscodeAppend(strToConv, len, *nativeFrom, converted);
+    }
+    else
+    {
+        ConvertAppend(GetWideConverter(), fromNarrow, strToConv, strToConv + len, converted);
+    }
+}
+
+void EncodingConverter::ConvertAppend(wchar_t const* strToConv, std::size_t len, std::wstring& converted)
+{
+    converted.append(strToConv, len);
+}
+
+// Only needed here if encTo isn't native, so we open it on first use.
+UConverter* EncodingConverter::GetWideConverter()
+{
+    if (wide == nullptr)
+    {
+        wide = OpenConverter(wideEncoding);
+    }
+
+    return wide;
+}
+
+// Converts through ICU's UTF-16 pivot, in a single pass, writing straight
+// into converted. The output grows by the source length (in OutCharT), which
+// is enough for the usual cases - converting UTF-8 to a single-byte code
+// page, or to wchar_t - and grows further if we run out of space.
+template <typename OutCharT>
+void EncodingConverter::ConvertAppend(UConverter* toConv, UConverter* fromConv, char const* src,
+    char const* srcLimit, std::basic_string<OutCharT>& converted)
+{
+    UChar pivot[1024];
+    UChar* pivotSource = pivot;
+    UChar* pivotTarget = pivot;
+
+    std::size_t start = converted.size();
+    converted.resize(start + std::max<std::size_t>(srcLimit - src, 16));
+    char* base = reinterpret_cast<char*>(&converted[0]);
+    char* target = base + start * sizeof(OutCharT);
+    UBool reset = true;
+
+    for (;;)
+    {
+        UErrorCode err = U_ZERO_ERROR;
+        ucnv_convertEx(toConv, fromConv, &target, base + converted.size() * sizeof(OutCharT), &src, srcLimit,
+            pivot, &pivotSource, &pivotTarget, pivot + sizeof(pivot) / sizeof(pivot[0]),
+            reset, true, &err);
+        reset = false;
+
+        if (err == U_BUFFER_OVERFLOW_ERROR)
+        {
+            std::size_t used = target - base;
+            converted.resize(converted.size() * 2);
+            base = reinterpret_cast<char*>(&converted[0]);
+            target = base + used;
+            continue;
+        }
+
+        if (U_FAILURE(err))
+        {
+            converted.resize(start);
+            UErrorCode nameErr = U_ZERO_ERROR;
+            BOOST_THROW_EXCEPTION(EncodingConversionException()
+                << error_message(string{"Error converting to "} + ucnv_getName(toConv, &nameErr) + ": "
+                    + u_errorName(err)));
+        }
+
+        converted.resize((target - base) / sizeof(OutCharT));
+        return;
+    }
+}
+
+} // namespace ms_windows
+}}}
@@ -0,0 +1,130 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef ENCODING_CONVERTER_H
+#define ENCODING_CONVERTER_H
+
+// Reusable encoding converter.
+//
+// ConvertText() resolves both encodings and creates its converters on each
+// call, which is fine for the occasional message, but not for tools that
+// output many lines. An EncodingConverter resolves the encodings and opens
+// the ICU converters once, on construction, and reuses them on every call.
+//
+// Like ConvertText(), ASCII text is copied as is, conversions between UTF-8 and single-byte code pages
+// are done natively (see native_codec.h), and characters that can't be
+// converted are skipped. The ICU converters are opened only if needed.
+//
+// Requires ICU (icuuc).
+
+#include "win_exception.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+struct UConverter;
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace ms_windows {
+class NativeCodec;
+} // namespace ms_windows
+}}}
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace ms_windows {
+
+// Thread safety: None. ICU converters keep state between calls, so each
+// thread must have its own EncodingConverter.
+class EncodingConverter
+{
+public:
+    // Converts to encTo; char input is taken to be in encFrom, wchar_t input
+    // is taken to be UTF-16/UTF-32, according to the size of wchar_t.
+    // Throws EncodingNotFoundException if ICU doesn't know either encoding.
+    EncodingConverter(std::string const& encTo, std::string const& encFrom);
+    ~EncodingConverter();
+
+    EncodingConverter(EncodingConverter const&) = delete;
+    EncodingConverter& operator=(EncodingConverter const&) = delete;
+
+    std::string Convert(char const* strToConv);
+    std::string Convert(char const* strToConv, std::size_t len);
+    std::string Convert(wchar_t const* strToConv);
+    std::string Convert(wchar_t const* strToConv, std::size_t len);
+
+    // These append to converted, instead of returning a new string, so the
+    // same buffer can be reused for many conversions.
+    void ConvertAppend(char const* strToConv, std::size_t len, std::string& converted);
+    void ConvertAppend(wchar_t const* strToConv, std::size_t len, std::string& converted);
+
+    // Same as above, but converting to wchar_t (UTF-16/UTF-32, according to
+    // the size of wchar_t), e.g., for WriteConsoleW(). char input goes
+    // straight from encFrom to wchar_t, with no narrow string in between;
+    // wchar_t input is just copied. encTo plays no part in these.
+    void ConvertAppend(char const* strToConv, std::size_t len, std::wstring& converted);
+    void ConvertAppend(wchar_t const* strToConv, std::size_t len, std::wstring& converted);
+
+    std::string const& GetTargetEncoding() const { return encTo; }
+    std::string const& GetSourceEncoding() const { return encFrom; }
+private:
+    template <typename OutCharT>
+    void ConvertAppend(UConverter* toConv, UConverter* fromConv, char const* src, char const* srcLimit,
+        std::basic_string<OutCharT>& converted);
+    UConverter* GetWideConverter();
+
+    std::string encTo;
+    std::string encFrom;
+    UConverter* to = nullptr;
+    UConverter* fromNarrow = nullptr;
+    // Converts from wchar_t and, when decoding to wchar_t, to it.
+    UConverter* wide = nullptr;
+    NativeCodec const* nativeTo = nullptr;
+    NativeCodec const* nativeFrom = nullptr;
+    // ASCII text can just be copied.
+    bool asciiCopyNarrow = false;
+    bool asciiCopyWide = false;
+    bool asciiCopyToWide = false;
+};
+
+
+// Converters for console output, defined in win_console_out.cpp.
+
+// The console's code page. Unit test builds (PCBLUESY_UNIT_TEST) always get
+// 850; outside Windows, it's always 65001 (UTF-8).
+UINT GetConsoleCodePage();
+
+// This thread's converter from the locale's encoding to codePage's (or,
+// with no arguments, the console's).
+std::shared_ptr<EncodingConverter> const& GetConsoleConverter(UINT codePage);
+std::shared_ptr<EncodingConverter> const& GetConsoleConverter();
+
+} // namespace ms_windows
+}}}
+
+#endif // ENCODING_CONVERTER_H
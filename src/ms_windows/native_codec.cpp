@@ -0,0 +1,394 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "native_codec.h"
+#include "code_page.h"
+#include "single_byte_tables.h"
+#include "utils/text_validation.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <string>
+using std::string;
+using std::wstring;
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace ms_windows {
+
+constexpr char32_t NativeCodec::unmappedChar;
+
+namespace
+{
+
+constexpr UINT utf8CodePage = 65001;
+
+// Not a code point. Marks input we skip.
+constexpr char32_t invalidChar = 0xFFFFFFFF;
+
+// Decodes the sequence at s[i], and moves i past it. Invalid sequences
+// (truncated, overlong, surrogates, etc.) are skipped one byte at a time.
+char32_t DecodeUtf8(unsigned char const* s, std::size_t len, std::size_t& i)
+{
+    unsigned char c = s[i];
+
+    if (c < 0x80)
+    {
+        ++i;
+        return c;
+    }
+
+    std::size_t trail;
+    char32_t cp;
+    char32_t min;
+
+    if ((c & 0xE0) == 0xC0)
+    {
+        trail = 1;
+        cp = c & 0x1F;
+        min = 0x80;
+    }
+    else if ((c & 0xF0) == 0xE0)
+    {
+        trail = 2;
+        cp = c & 0x0F;
+        min = 0x800;
+    }
+    else if ((c & 0xF8) == 0xF0)
+    {
+        trail = 3;
+        cp = c & 0x07;
+        min = 0x10000;
+    }
+    else
+    {
+        ++i;
+        return invalidChar;
+    }
+
+    if (len - i <= trail)
+    {
+        ++i;
+        return invalidChar;
+    }
+
+    for (std::size_t k = 1; k <= trail; ++k)
+    {
+        if ((s[i + k] & 0xC0) != 0x80)
+        {
+            ++i;
+            return invalidChar;
+        }
+        cp = (cp << 6) | (s[i + k] & 0x3F);
+    }
+
+    if ((cp < min) || (cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF)))
+    {
+        ++i;
+        return invalidChar;
+    }
+
+    i += trail + 1;
+    return cp;
+}
+
+void AppendUtf8(string& out, char32_t cp)
+{
+    if (cp < 0x80)
+    {
+        out.push_back(static_cast<char>(cp));
+    }
+    else if (cp < 0x800)
+    {
+        out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+    else if (cp < 0x10000)
+    {
+        out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+    else
+    {
+        out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+}
+
+void AppendWide(wstring& out, char32_t cp)
+{
+    if ((sizeof(wchar_t) == 2) && (cp >= 0x10000))
+    {
+        cp -= 0x10000;
+        out.push_back(static_cast<wchar_t>(0xD800 + (cp >> 10)));
+        out.push_back(static_cast<wchar_t>(0xDC00 + (cp & 0x3FF)));
+    }
+    else
+    {
+        out.push_back(static_cast<wchar_t>(cp));
+    }
+}
+
+void Append(string& out, char32_t cp, NativeCodec const& to)
+{
+    if (to.IsUtf8())
+    {
+        AppendUtf8(out, cp);
+        return;
+    }
+
+    int b = to.Encode(cp);
+    if (b >= 0)
+    {
+        out.push_back(static_cast<char>(b));
+    }
+}
+
+} // unnamed namespace
+
+
+NativeCodec::NativeCodec(UINT codePage, std::uint16_t const* toUnicode) :
+    codePage{codePage}, toUnicode{toUnicode}, pages(256, 0)
+{
+    std::fill(std::begin(pageIndex), std::end(pageIndex), 0);
+
+    if (toUnicode == nullptr)
+    {
+        return;
+    }
+
+    for (unsigned int b = 0; b < 256; ++b)
+    {
+        char32_t cp = toUnicode[b];
+
+        if ((b < 0x80) && (cp != b))
+        {
+            asciiIdentity = false;
+        }
+
+        if (cp == unmappedChar)
+        {
+            continue;
+        }
+
+        std::uint8_t& page = pageIndex[cp >> 8];
+        if (page == 0)
+        {
+            page = static_cast<std::uint8_t>(pages.size() / 256);
+            pages.resize(pages.size() + 256, 0);
+        }
+
+        // If two bytes decode to the same code point, the first one wins.
+        std::uint8_t& e = pages[(page << 8) | (cp & 0xFF)];
+        if (e == 0)
+        {
+            e = static_cast<std::uint8_t>(b);
+        }
+    }
+}
+
+std::vector<NativeCodec> NativeCodec::BuildAll()
+{
+    std::vector<NativeCodec> codecs;
+
+    for (auto const& t : single_byte_tables::all_tables)
+    {
+        assert(codecs.empty() || (codecs.back().codePage < t.codePage));
+        codecs.push_back(NativeCodec{t.codePage, t.toUnicode});
+    }
+
+    assert(codecs.back().codePage < utf8CodePage);
+    codecs.push_back(NativeCodec{utf8CodePage, nullptr});
+
+    return codecs;
+}
+
+NativeCodec const* NativeCodec::Find(UINT codePage) noexcept
+{
+    // The encode tables are built on first use, for all codecs at once.
+    static std::vector<NativeCodec> const codecs = BuildAll();
+
+    auto it = std::lower_bound(codecs.begin(), codecs.end(), codePage,
+        [](NativeCodec const& nc, UINT cp) { return nc.codePage < cp; });
+
+    return ((it != codecs.end()) && (it->codePage == codePage)) ? &*it : nullptr;
+}
+
+NativeCodec const* NativeCodec::Find(char const* encoding) noexcept
+{
+    UINT codePage = FindCodePage(encoding);
+    return (codePage == 0) ? nullptr : Find(codePage);
+}
+
+
+string Transcode(char const* strToConv, std::size_t len, NativeCodec const& to, NativeCodec const& from)
+{
+    string converted;
+    TranscodeAppend(strToConv, len, to, from, converted);
+    return converted;
+}
+
+string Transcode(wchar_t const* strToConv, std::size_t len, NativeCodec const& to)
+{
+    string converted;
+    TranscodeAppend(strToConv, len, to, converted);
+    return converted;
+}
+
+void TranscodeAppend(char const* strToConv, std::size_t len, NativeCodec const& to, NativeCodec const& from,
+    string& converted)
+{
+    assert(strToConv != nullptr);
+
+    // Nothing to convert, only to check.
+    if (to.IsUtf8() && from.IsUtf8() && utils::IsValidUtf8(strToConv, len))
+    {
+        converted.append(strToConv, len);
+        return;
+    }
+
+    unsigned char const* s = reinterpret_cast<unsigned char const*>(strToConv);
+    bool const allAscii = from.IsAsciiIdentity() && to.IsAsciiIdentity();
+
+    converted.reserve(converted.size() + len);
+
+    std::size_t i = 0;
+    while (i < len)
+    {
+        // Runs of ASCII convert to themselves.
+        std::size_t run = allAscii ? utils::AsciiPrefixLength(strToConv + i, len - i) : 0;
+        converted.append(strToConv + i, run);
+        i += run;
+
+        if (i == len)
+        {
+            break;
+        }
+
+        char32_t cp;
+        if (from.IsUtf8())
+        {
+            cp = DecodeUtf8(s, len, i);
+        }
+        else
+        {
+            cp = from.Decode(s[i++]);
+            if (cp == NativeCodec::unmappedChar)
+            {
+                cp = invalidChar;
+            }
+        }
+
+        if (cp != invalidChar)
+        {
+            Append(converted, cp, to);
+        }
+    }
+}
+
+void TranscodeAppend(wchar_t const* strToConv, std::size_t len, NativeCodec const& to, string& converted)
+{
+    assert(strToConv != nullptr);
+
+    converted.reserve(converted.size() + len);
+
+    for (std::size_t i = 0; i < len; ++i)
+    {
+        char32_t cp = static_cast<char32_t>(strToConv[i]);
+
+        // UTF-16 surrogate pairs. Unpaired surrogates are skipped.
+        if ((sizeof(wchar_t) == 2) && (cp >= 0xD800) && (cp <= 0xDBFF) && (i + 1 < len))
+        {
+            char32_t low = static_cast<char32_t>(strToConv[i + 1]);
+            if ((low >= 0xDC00) && (low <= 0xDFFF))
+            {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                ++i;
+            }
+        }
+
+        if ((cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF)))
+        {
+            continue;
+        }
+
+        Append(converted, cp, to);
+    }
+}
+
+void TranscodeAppend(char const* strToConv, std::size_t len, NativeCodec const& from, wstring& converted)
+{
+    assert(strToConv != nullptr);
+
+    unsigned char const* s = reinterpret_cast<unsigned char const*>(strToConv);
+
+    // Never more wchar_t than bytes.
+    converted.reserve(converted.size() + len);
+
+    std::size_t i = 0;
+    while (i < len)
+    {
+        if (from.IsAsciiIdentity())
+        {
+            std::size_t run = utils::AsciiPrefixLength(strToConv + i, len - i);
+            AppendAsciiWide(strToConv + i, run, converted);
+            i += run;
+
+            if (i == len)
+            {
+                break;
+            }
+        }
+
+        char32_t cp;
+        if (from.IsUtf8())
+        {
+            cp = DecodeUtf8(s, len, i);
+        }
+        else
+        {
+            cp = from.Decode(s[i++]);
+            if (cp == NativeCodec::unmappedChar)
+            {
+                cp = invalidChar;
+            }
+        }
+
+        if (cp != invalidChar)
+        {
+            AppendWide(converted, cp);
+        }
+    }
+}
+
+} // namespace ms_windows
+}}}
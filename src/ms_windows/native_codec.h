@@ -0,0 +1,128 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef NATIVE_CODEC_H
+#define NATIVE_CODEC_H
+
+// Native converters for UTF-8 and the single-byte code pages in
+// single_byte_tables.h (cp850, cp1252, iso8859-x, koi8, ...).
+//
+// Converting between these doesn't need ICU: single-byte code pages decode
+// through a 256-entry table, and encode through a two-level table derived
+// from it (one 256-byte page per 256 code points actually used). Runs of
+// ASCII are copied straight through (see utils/text_validation.h).
+//
+// As with ICU (with Boost Locale's default settings), invalid input and
+// characters that the target encoding doesn't have are skipped.
+
+#include "win_exception.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace ms_windows {
+
+// Thread safety: Immutable after construction, can be shared.
+class NativeCodec
+{
+public:
+    // Returns nullptr if there's no native codec for codePage.
+    static NativeCodec const* Find(UINT codePage) noexcept;
+    // Same as above, with an encoding name, e.g., "cp850", "UTF-8".
+    static NativeCodec const* Find(char const* encoding) noexcept;
+
+    UINT GetCodePage() const { return codePage; }
+    bool IsUtf8() const { return toUnicode == nullptr; }
+    // Bytes 0x00 - 0x7F are the same as in ASCII. This is not the case
+    // for some IBM code pages, where ICU swaps a few control chars.
+    bool IsAsciiIdentity() const { return asciiIdentity; }
+
+    static constexpr char32_t unmappedChar = 0xFFFF;
+
+    // Single-byte only. Returns unmappedChar if the byte has no mapping.
+    char32_t Decode(unsigned char c) const { return toUnicode[c]; }
+    // Single-byte only. Returns -1 if the code point has no mapping.
+    int Encode(char32_t cp) const
+    {
+        if (cp > 0xFFFF)
+        {
+            return -1;
+        }
+
+        std::uint8_t b = pages[(pageIndex[cp >> 8] << 8) | (cp & 0xFF)];
+        // Only U+0000 encodes to 0.
+        return ((b == 0) && (cp != 0)) ? -1 : b;
+    }
+private:
+    NativeCodec(UINT codePage, std::uint16_t const* toUnicode);
+
+    static std::vector<NativeCodec> BuildAll();
+
+    UINT codePage;
+    std::uint16_t const* toUnicode;
+    bool asciiIdentity = true;
+    // Index of the encode page for each block of 256 code points (BMP
+    // only), and the pages themselves. Page 0 is all zeros.
+    std::uint8_t pageIndex[256];
+    std::vector<std::uint8_t> pages;
+};
+
+std::string Transcode(char const* strToConv, std::size_t len, NativeCodec const& to, NativeCodec const& from);
+// wchar_t is taken to be UTF-16/UTF-32, according to its size.
+std::string Transcode(wchar_t const* strToConv, std::size_t len, NativeCodec const& to);
+
+// Same as above, appending to converted.
+void TranscodeAppend(char const* strToConv, std::size_t len, NativeCodec const& to, NativeCodec const& from,
+    std::string& converted);
+void TranscodeAppend(wchar_t const* strToConv, std::size_t len, NativeCodec const& to, std::string& converted);
+
+// Appends ASCII text to converted, as wchar_t. Much faster than
+// std::wstring::append() with a pair of char iterators.
+inline void AppendAsciiWide(char const* strToConv, std::size_t len, std::wstring& converted)
+{
+    std::size_t start = converted.size();
+    converted.resize(start + len);
+
+    wchar_t* out = &converted[0] + start;
+    for (std::size_t i = 0; i < len; ++i)
+    {
+        out[i] = static_cast<wchar_t>(strToConv[i]);
+    }
+}
+
+// Decodes straight to wchar_t (UTF-16/UTF-32, according to its size),
+// appending to converted.
+void TranscodeAppend(char const* strToConv, std::size_t len, NativeCodec const& from, std::wstring& converted);
+
+} // namespace ms_windows
+}}}
+
+#endif // NATIVE_CODEC_H
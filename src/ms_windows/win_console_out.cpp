@@ -27,6 +27,10 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "win_console_out.h"
+#include "code_page.h"
+#include "encoding_converter.h"
+#include "native_codec.h"
+#include "utils/text_validation.h"
 #include "win_exception.h"
 
 #pragma GCC diagnostic push
@@ -34,13 +38,19 @@
 #include "boost/locale.hpp"
 using boost::locale::conv::between;
 using boost::locale::conv::from_utf;
+using boost::locale::conv::to_utf;
 #pragma GCC diagnostic pop
+#include "boost/config.hpp"
+
+#ifdef _WIN32
+#include "windows.h"
+#endif
 
 #include <cassert>
-// TODO: Use cbegin()/cend() when it becomes available (C++14)
-#include <iterator>
-using std::begin;
-using std::end;
+#include <cstddef>
+#include <cstring>
+#include <locale>
+#include <memory>
 #include <string>
 using std::string;
 
@@ -54,68 +64,140 @@ namespace ms_windows {
 // In the end, I settled for this solution.
 
 // Converts strToConv from the encoding encFrom to encTo.
-// TODO: Add template parameter to allow for std::wstring return type?
+// ASCII text is just copied, if both encodings are ASCII-compatible. UTF-8
+// and single-byte code pages are converted natively; everything else goes
+// through Boost Locale/ICU.
+// These append to a caller-provided buffer, and convert directly between
+// the source and the destination, be it narrow or wide.
+void ConvertText(char const* strToConv, std::size_t len, string const& encTo, string const& encFrom,
+    string& converted)
+{
+    assert(strToConv != nullptr);
+
+    if (utils::IsAscii(strToConv, len) && IsAsciiCompatible(encTo.c_str()) &&
+        IsAsciiCompatible(encFrom.c_str()))
+    {
+        converted.append(strToConv, len);
+        return;
+    }
+
+    NativeCodec const* to = NativeCodec::Find(encTo.c_str());
+    NativeCodec const* from = NativeCodec::Find(encFrom.c_str());
+
+    if ((to != nullptr) && (from != nullptr))
+    {
+        TranscodeAppend(strToConv, len, *to, *from, converted);
+        return;
+    }
+
+    converted += between(strToConv, strToConv + len, encTo, encFrom);
+}
+
+void ConvertText(wchar_t const* strToConv, std::size_t len, string const& encTo, string const&,
+    string& converted)
+{
+    assert(strToConv != nullptr);
+
+    if (utils::IsAscii(strToConv, len) && IsAsciiCompatible(encTo.c_str()))
+    {
+        converted.append(strToConv, strToConv + len);
+        return;
+    }
+
+    NativeCodec const* to = NativeCodec::Find(encTo.c_str());
+
+    if (to != nullptr)
+    {
+        TranscodeAppend(strToConv, len, *to, converted);
+        return;
+    }
+
+    converted += from_utf(strToConv, strToConv + len, encTo);
+}
+
+// Decodes from encFrom to UTF-16/UTF-32, according to the size of wchar_t.
+void ConvertText(char const* strToConv, std::size_t len, string const&, string const& encFrom,
+    std::wstring& converted)
+{
+    assert(strToConv != nullptr);
+
+    if (utils::IsAscii(strToConv, len) && IsAsciiCompatible(encFrom.c_str()))
+    {
+        AppendAsciiWide(strToConv, len, converted);
+        return;
+    }
+
+    NativeCodec const* from = NativeCodec::Find(encFrom.c_str());
+
+    if (from != nullptr)
+    {
+        TranscodeAppend(strToConv, len, *from, converted);
+        return;
+    }
+
+    converted += to_utf<wchar_t>(strToConv, strToConv + len, encFrom);
+}
+
+// Nothing to convert.
+void ConvertText(wchar_t const* strToConv, std::size_t len, string const&, string const&,
+    std::wstring& converted)
+{
+    assert(strToConv != nullptr);
+
+    converted.append(strToConv, len);
+}
+
+// These return a new string.
 string ConvertText(char const* strToConv, string const& encTo, string const& encFrom)
 {
     assert(strToConv != nullptr);
-    return between(strToConv, encTo, encFrom);
+
+    string converted;
+    ConvertText(strToConv, std::char_traits<char>::length(strToConv), encTo, encFrom, converted);
+    return converted;
 }
 
 // Onverload of the previous function.
 // The wchar_t overload ignores encFrom, but I kept it in the interface so it can be
 // seamlessly called from ConvertOutput.
-// TODO: Add template parameter to allow for std::wstring return type?
-string ConvertText(wchar_t const* strToConv, string const& encTo, string const&)
+string ConvertText(wchar_t const* strToConv, string const& encTo, string const& encFrom)
 {
     assert(strToConv != nullptr);
-    return from_utf(strToConv, encTo);
+
+    string converted;
+    ConvertText(strToConv, std::char_traits<wchar_t>::length(strToConv), encTo, encFrom, converted);
+    return converted;
 }
 
-// Copied from Boost Locale, with a few trivial changes
+// Copied from Boost Locale, with a few trivial changes.
+// Names are normalized: lower case, letters and digits only.
 struct windows_encoding
 {
-    windows_encoding() : name(nullptr), codepage(0) {}
-    windows_encoding(char const* n, unsigned int cp) : name(n), codepage(cp) {}
     char const *name;
-    unsigned int codepage = 0;
+    unsigned int codepage;
 };
 
-bool operator==(windows_encoding const &l, windows_encoding const &r)
+namespace
 {
-    return l.codepage == r.codepage;
-}
 
-windows_encoding const all_windows_encodings[] =
+// One entry per code page, sorted by code page. The name is the one we
+// hand to the converters.
+constexpr windows_encoding all_windows_encodings[] =
 {
     { "cp850",      850 },
     { "cp858",      858 },
     { "cp874",      874 },
-//  { "windows874", 874 },
     { "cp932",      932 },
-//  { "shiftjis",   932 },
-//  { "sjis",       932 },
-//  { "windows932", 932 },
     { "cp936",      936 },
-//  { "gbk",        936 },
-//  { "ms936",      936 },
-//  { "windows936", 936 },
     { "big5",       950 },
     { "cp1250",     1250 },
-//  { "windows1250",1250 },
     { "cp1251",     1251 },
-//  { "windows1251",1251 },
     { "cp1252",     1252 },
-//  { "windows1252",1252 },
     { "cp1253",     1253 },
-//  { "windows1253",1253 },
     { "cp1254",     1254 },
-//  { "windows1254",1254 },
     { "cp1255",     1255 },
-//  { "windows1255",1255 },
     { "cp1256",     1256 },
-//  { "windows1256",1256 },
     { "cp1257",     1257 },
-//  { "windows1257",1257 },
     { "usascii",    20127 },
     { "koi8r",      20866 },
     { "eucjp",      20932 },
@@ -139,25 +221,239 @@ windows_encoding const all_windows_encodings[] =
     { "utf8",       65001 },
 };
 
+// Every name we know, including aliases, sorted by name.
+constexpr windows_encoding all_windows_encoding_names[] =
+{
+    { "big5",       950 },
+    { "cp1250",     1250 },
+    { "cp1251",     1251 },
+    { "cp1252",     1252 },
+    { "cp1253",     1253 },
+    { "cp1254",     1254 },
+    { "cp1255",     1255 },
+    { "cp1256",     1256 },
+    { "cp1257",     1257 },
+    { "cp850",      850 },
+    { "cp858",      858 },
+    { "cp874",      874 },
+    { "cp932",      932 },
+    { "cp936",      936 },
+    { "eucjp",      20932 },
+    { "euckr",      51949 },
+    { "gb18030",    54936 },
+    { "gb2312",     20936 },
+    { "gbk",        936 },
+    { "iso2022jp",  50220 },
+    { "iso2022kr",  50225 },
+    { "iso88591",   28591 },
+    { "iso885913",  28603 },
+    { "iso885915",  28605 },
+    { "iso88592",   28592 },
+    { "iso88593",   28593 },
+    { "iso88594",   28594 },
+    { "iso88595",   28595 },
+    { "iso88596",   28596 },
+    { "iso88597",   28597 },
+    { "iso88598",   28598 },
+    { "iso88599",   28599 },
+    { "koi8r",      20866 },
+    { "koi8u",      21866 },
+    { "ms936",      936 },
+    { "shiftjis",   932 },
+    { "sjis",       932 },
+    { "usascii",    20127 },
+    { "utf8",       65001 },
+    { "windows1250",1250 },
+    { "windows1251",1251 },
+    { "windows1252",1252 },
+    { "windows1253",1253 },
+    { "windows1254",1254 },
+    { "windows1255",1255 },
+    { "windows1256",1256 },
+    { "windows1257",1257 },
+    { "windows874", 874 },
+    { "windows932", 932 },
+    { "windows936", 936 },
+};
+
+constexpr std::size_t encodingCount = sizeof(all_windows_encodings) / sizeof(all_windows_encodings[0]);
+constexpr std::size_t encodingNameCount =
+    sizeof(all_windows_encoding_names) / sizeof(all_windows_encoding_names[0]);
+
+// Longer than any name in the table.
+constexpr std::size_t maxEncodingNameLength = 16;
+
+constexpr int CompareNames(char const* l, char const* r)
+{
+    return (*l != *r) ? ((*l < *r) ? -1 : 1) : ((*l == '\0') ? 0 : CompareNames(l + 1, r + 1));
+}
+
+constexpr bool IsSortedByCodePage(windows_encoding const* e, std::size_t n)
+{
+    return (n < 2) || ((e[0].codepage < e[1].codepage) && IsSortedByCodePage(e + 1, n - 1));
+}
+
+constexpr bool IsSortedByName(windows_encoding const* e, std::size_t n)
+{
+    return (n < 2) || ((CompareNames(e[0].name, e[1].name) < 0) && IsSortedByName(e + 1, n - 1));
+}
+
+static_assert(IsSortedByCodePage(all_windows_encodings, encodingCount),
+    "all_windows_encodings must be sorted by code page, with no duplicates");
+static_assert(IsSortedByName(all_windows_encoding_names, encodingNameCount),
+    "all_windows_encoding_names must be sorted by name, with no duplicates");
+
+// Binary search, with no branches besides the loop. The compiler turns
+// the ternary into a conditional move. Returns the last entry not greater
+// than the one we're looking for, or the first entry.
+template <typename Less>
+windows_encoding const* LowerBoundBranchless(windows_encoding const* base, std::size_t n, Less less)
+{
+    while (n > 1)
+    {
+        std::size_t half = n / 2;
+        base = less(base[half]) ? base : base + half;
+        n -= half;
+    }
+    return base;
+}
+
+// Kept out of the lookup functions, so they don't pay for building the exception.
+[[noreturn]] BOOST_NOINLINE void ThrowEncodingNotFound(UINT codePage)
+{
+    BOOST_THROW_EXCEPTION(EncodingNotFoundException()
+        << error_message("Could not find encoding for code page") << error_win_uint(codePage));
+}
+
+[[noreturn]] BOOST_NOINLINE void ThrowCodePageNotFound(char const* encoding)
+{
+    BOOST_THROW_EXCEPTION(EncodingNotFoundException()
+        << error_message("Could not find code page for encoding") << error_encoding(encoding));
+}
+
+} // unnamed namespace
+
+// Returns the encoding's name, or nullptr if there's no encoding for codePage.
+char const* FindEncoding(UINT codePage) noexcept
+{
+    windows_encoding const* e = LowerBoundBranchless(all_windows_encodings, encodingCount,
+        [codePage](windows_encoding const& we) { return codePage < we.codepage; });
+
+    return (e->codepage == codePage) ? e->name : nullptr;
+}
+
+// Returns the code page for encoding, or 0 if we don't know it. Accepts
+// aliases and non-normalized names, e.g., "Windows-1252", "Shift_JIS".
+UINT FindCodePage(char const* encoding) noexcept
+{
+    assert(encoding != nullptr);
+
+    char normalized[maxEncodingNameLength + 1];
+    std::size_t len = 0;
+
+    for (; *encoding != '\0'; ++encoding)
+    {
+        char c = *encoding;
+        if ((c >= 'A') && (c <= 'Z'))
+        {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+        else if (!(((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9'))))
+        {
+            continue;
+        }
+
+        if (len == maxEncodingNameLength)
+        {
+            return 0;
+        }
+        normalized[len++] = c;
+    }
+    normalized[len] = '\0';
+
+    windows_encoding const* e = LowerBoundBranchless(all_windows_encoding_names, encodingNameCount,
+        [&normalized](windows_encoding const& we) { return std::strcmp(normalized, we.name) < 0; });
+
+    return (std::strcmp(e->name, normalized) == 0) ? e->codepage : 0;
+}
+
+// Every encoding we know has ASCII as a subset, i.e., ASCII text needs no
+// conversion, to or from it. We don't assume this for any other encoding
+// (e.g., UTF-16).
+bool IsAsciiCompatible(char const* encoding) noexcept
+{
+    return (FindCodePage(encoding) != 0);
+}
+
 // Retrieves the textual representation of the encoding
 // associated with a code page. E.g., GetEncoding(850) returns "cp850".
 string GetEncoding(UINT codePage)
 {
-    windows_encoding ref;
-    ref.codepage = codePage;
-
-    windows_encoding const *b = begin(all_windows_encodings);
-    windows_encoding const *e = end(all_windows_encodings);
-    windows_encoding const *ptr = std::find(b, e, ref);
+    char const* name = FindEncoding(codePage);
 
     // TODO: Should we really throw an exception here, or just return a default encoding?
-    if (ptr == e)
+    if (name == nullptr)
+    {
+        ThrowEncodingNotFound(codePage);
+    }
+
+    return name;
+}
+
+// The reverse of GetEncoding(). E.g., GetCodePage("windows-1252") returns 1252.
+UINT GetCodePage(char const* encoding)
+{
+    UINT codePage = FindCodePage(encoding);
+
+    if (codePage == 0)
+    {
+        ThrowCodePageNotFound(encoding);
+    }
+
+    return codePage;
+}
+
+// The only Windows-specific part of the conversion. Elsewhere, we assume
+// the console is UTF-8, which is what terminal emulators use nowadays.
+UINT GetConsoleCodePage()
+{
+#if defined(PCBLUESY_UNIT_TEST)
+    // When we're building for unit tests, we force the
+    // console code page
+    return 850;
+#elif defined(_WIN32)
+    return GetConsoleOutputCP();
+#else
+    return 65001;
+#endif
+}
+
+// Each thread gets its own converter, created on first use, and recreated
+// only if the console's code page changes. The locale's encoding (the source
+// encoding for char strings) is retrieved only once, as generating a locale
+// is expensive.
+// Converters are shared, so that anyone holding on to one (e.g., a
+// ConvertingStreamBuf) isn't affected when it's replaced.
+std::shared_ptr<EncodingConverter> const& GetConsoleConverter(UINT codePage)
+{
+    static string const localeEnc =
+        std::use_facet<boost::locale::info>(boost::locale::generator{}("")).encoding();
+
+    thread_local std::shared_ptr<EncodingConverter> conv;
+    thread_local UINT convCodePage = 0;
+
+    if (!conv || (convCodePage != codePage))
     {
-        BOOST_THROW_EXCEPTION(EncodingNotFoundException()
-            << error_message("Could not find encoding for code page") << error_win_uint(codePage));
+        conv = std::make_shared<EncodingConverter>(GetEncoding(codePage), localeEnc);
+        convCodePage = codePage;
     }
 
-    return ptr->name;
+    return conv;
+}
+
+std::shared_ptr<EncodingConverter> const& GetConsoleConverter()
+{
+    return GetConsoleConverter(GetConsoleCodePage());
 }
 
 } // namespace ms_windows
@@ -72,7 +72,6 @@ using DefaultCharT = char;
 
 // Converts a string for console output, according to the console's
 // code page.
-// TODO: Consider std::wstring return type?
 template <typename CharT>
 std::string ConvertOutput(CharT const* s);
 
@@ -98,6 +97,26 @@ std::string ConvertOutput(std::basic_string<CharT> const& s);
 template <typename CharT = DefaultCharT, typename T = void>
 std::string ConvertOutput(T const& t);
 
+// Same as ConvertOutput(), returning StringT, which can be std::string (in the
+// console's code page, as above) or std::wstring (UTF-16/UTF-32, according to
+// the size of wchar_t, e.g., for WriteConsoleW()). E.g.:
+// std::wstring ws = ConvertOutputTo<std::wstring>(s);
+// Each conversion goes straight from the source to the destination, with no
+// intermediate string; wchar_t to std::wstring is just a copy.
+template <typename StringT, typename CharT>
+StringT ConvertOutputTo(CharT const* s);
+
+template <typename StringT, typename CharT>
+StringT ConvertOutputTo(std::basic_string<CharT> const& s);
+
+// These append to a caller-provided std::string or std::wstring, so its
+// capacity can be reused across calls.
+template <typename CharT, typename OutCharT>
+void ConvertOutputTo(CharT const* s, std::basic_string<OutCharT>& converted);
+
+template <typename CharT, typename OutCharT>
+void ConvertOutputTo(std::basic_string<CharT> const& s, std::basic_string<OutCharT>& converted);
+
 } // namespace ms_windows
 }}}
 
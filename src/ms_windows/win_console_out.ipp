@@ -33,16 +33,14 @@
 #include "win_console_out.h"
 #endif
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
-#include "boost/locale.hpp"
-#pragma GCC diagnostic pop
-
-#include "windows.h"
+#include "code_page.h"
+#include "encoding_converter.h"
+#include "win_exception.h"
 
 #include <cassert>
-#include <locale>
+#include <cstddef>
 #include <sstream>
+#include <string>
 
 
 namespace pt { namespace pcaetano { namespace bluesy {
@@ -52,7 +50,28 @@ namespace ms_windows {
 // This section contains auxiliary functions.
 std::string ConvertText(char const* strToConv, std::string const& encTo, std::string const& encFrom);
 std::string ConvertText(wchar_t const* strToConv, std::string const& encTo, std::string const&);
-std::string GetEncoding(UINT codePage);
+
+// These append to converted. Wide output is UTF-16/UTF-32, according to the
+// size of wchar_t, so encTo is ignored; wchar_t input ignores encFrom.
+void ConvertText(char const* strToConv, std::size_t len, std::string const& encTo, std::string const& encFrom,
+    std::string& converted);
+void ConvertText(wchar_t const* strToConv, std::size_t len, std::string const& encTo, std::string const& encFrom,
+    std::string& converted);
+void ConvertText(char const* strToConv, std::size_t len, std::string const& encTo, std::string const& encFrom,
+    std::wstring& converted);
+void ConvertText(wchar_t const* strToConv, std::size_t len, std::string const& encTo, std::string const& encFrom,
+    std::wstring& converted);
+
+// Same as ConvertText(), returning StringT - std::string or std::wstring.
+template <typename StringT, typename CharT>
+StringT ConvertTextTo(CharT const* strToConv, std::string const& encTo, std::string const& encFrom)
+{
+    assert(strToConv != nullptr);
+
+    StringT converted;
+    ConvertText(strToConv, std::char_traits<CharT>::length(strToConv), encTo, encFrom, converted);
+    return converted;
+}
 // -----------------------------------------------------------------------------
 
 
@@ -62,17 +81,14 @@ std::string ConvertOutput(CharT const* s)
     assert(s != nullptr);
 
 #ifndef PCBLUESY_UNIT_TEST
-    std::string enc = GetEncoding(GetConsoleOutputCP());
+    UINT codePage = GetConsoleCodePage();
 #else
     // When we're building for unit tests, we force the
     // console code page
-    std::string enc = GetEncoding(850);
+    UINT codePage = 850;
 #endif
 
-    boost::locale::generator gen;
-    std::locale loc = gen("");
-
-    return ConvertText(s, enc, std::use_facet<boost::locale::info>(loc).encoding());
+    return GetConsoleConverter(codePage)->Convert(s);
 }
 
 template <typename CharT>
@@ -82,7 +98,7 @@ std::string ConvertOutput(std::basic_string<CharT> const& s)
 }
 
 
-template <typename CharT = DefaultCharT, typename T = void>
+template <typename CharT, typename T>
 std::string ConvertOutput(T const& t)
 {
     std::basic_stringstream<CharT> ss;
@@ -90,6 +106,41 @@ std::string ConvertOutput(T const& t)
     return ConvertOutput(ss.str());
 }
 
+
+template <typename CharT, typename OutCharT>
+void ConvertOutputTo(CharT const* s, std::basic_string<OutCharT>& converted)
+{
+    assert(s != nullptr);
+
+#ifndef PCBLUESY_UNIT_TEST
+    UINT codePage = GetConsoleCodePage();
+#else
+    UINT codePage = 850;
+#endif
+
+    GetConsoleConverter(codePage)->ConvertAppend(s, std::char_traits<CharT>::length(s), converted);
+}
+
+template <typename CharT, typename OutCharT>
+void ConvertOutputTo(std::basic_string<CharT> const& s, std::basic_string<OutCharT>& converted)
+{
+    ConvertOutputTo(s.c_str(), converted);
+}
+
+template <typename StringT, typename CharT>
+StringT ConvertOutputTo(CharT const* s)
+{
+    StringT converted;
+    ConvertOutputTo(s, converted);
+    return converted;
+}
+
+template <typename StringT, typename CharT>
+StringT ConvertOutputTo(std::basic_string<CharT> const& s)
+{
+    return ConvertOutputTo<StringT>(s.c_str());
+}
+
 } // namespace ms_windows
 }}}
 
@@ -31,6 +31,8 @@
 
 #include "base/exception.h"
 
+#include <string>
+
 namespace pt { namespace pcaetano { namespace bluesy {
 namespace ms_windows {
 
@@ -39,9 +41,11 @@ using error_message = base::error_message;
 // TODO: Review this. I don't feel like #including windows.h just because of this.
 using UINT = unsigned int;
 using error_win_uint = boost::error_info<struct tag_error_id, UINT>;
+using error_encoding = boost::error_info<struct tag_error_encoding, std::string>;
 
 struct MSWinException : virtual base::PCBBaseException { };
 struct EncodingNotFoundException : virtual MSWinException { };
+struct EncodingConversionException : virtual MSWinException { };
 
 
 
@@ -0,0 +1,201 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CASE_INSENSITIVE_MATCHER_H
+#define CASE_INSENSITIVE_MATCHER_H
+
+// Case-insensitive line matching policy for FileLineReader.
+//
+// When both the line and the match are ASCII (the usual case for IDs, error
+// codes, etc.), we search without allocating, folding case 16 bytes at a time
+// with SSE2, if available.
+// If either one has non-ASCII chars, we assume UTF-8 and fall back on full case
+// folding with Boost Locale (and, thus, ICU), which allocates. This requires
+// linking with Boost Locale.
+
+#include "utils/text_validation.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
+#include <boost/locale.hpp>
+#pragma GCC diagnostic pop
+#include <boost/utility/string_ref.hpp>
+
+#include <cstddef>
+#include <locale>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PCBLUESY_CIM_HAVE_SSE2
+#endif
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+namespace detail
+{
+
+inline char FoldAscii(char c)
+{
+    return ((c >= 'A') && (c <= 'Z')) ? static_cast<char>(c | 0x20) : c;
+}
+
+#ifdef PCBLUESY_CIM_HAVE_SSE2
+// Lowercases the ASCII letters in 16 bytes. Bytes >= 0x80 are negative, so
+// they're never taken for upper case letters.
+inline __m128i FoldAscii(__m128i v)
+{
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+        _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+// Both s1 and s2 have at least len chars, all of them ASCII.
+inline bool EqualsFoldedAscii(char const* s1, char const* s2, std::size_t len)
+{
+    std::size_t i = 0;
+#ifdef PCBLUESY_CIM_HAVE_SSE2
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v1 = FoldAscii(_mm_loadu_si128(reinterpret_cast<__m128i const*>(s1 + i)));
+        __m128i v2 = FoldAscii(_mm_loadu_si128(reinterpret_cast<__m128i const*>(s2 + i)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v1, v2)) != 0xFFFF)
+        {
+            return false;
+        }
+    }
+#endif
+    for (; i < len; ++i)
+    {
+        if (FoldAscii(s1[i]) != FoldAscii(s2[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Case-insensitive search, for ASCII only. We look for the first and last
+// chars of match, and only compare the whole match where both are in place.
+inline bool FindFoldedAscii(boost::string_ref line, boost::string_ref match)
+{
+    std::size_t const n = match.size();
+
+    if (n == 0)
+    {
+        return true;
+    }
+    if (n > line.size())
+    {
+        return false;
+    }
+
+    char const* l = line.data();
+    char const first = FoldAscii(match[0]);
+    char const last = FoldAscii(match[n - 1]);
+    std::size_t const positions = line.size() - n + 1;
+    std::size_t i = 0;
+
+#ifdef PCBLUESY_CIM_HAVE_SSE2
+    __m128i const vfirst = _mm_set1_epi8(first);
+    __m128i const vlast = _mm_set1_epi8(last);
+
+    for (; i + 16 <= positions; i += 16)
+    {
+        __m128i bf = FoldAscii(_mm_loadu_si128(reinterpret_cast<__m128i const*>(l + i)));
+        __m128i bl = FoldAscii(_mm_loadu_si128(reinterpret_cast<__m128i const*>(l + i + n - 1)));
+        unsigned int candidates = static_cast<unsigned int>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(bf, vfirst), _mm_cmpeq_epi8(bl, vlast))));
+
+        while (candidates != 0)
+        {
+            unsigned int bit = static_cast<unsigned int>(__builtin_ctz(candidates));
+            if (EqualsFoldedAscii(l + i + bit + 1, match.data() + 1, (n > 2) ? n - 2 : 0))
+            {
+                return true;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+#endif
+
+    for (; i < positions; ++i)
+    {
+        if ((FoldAscii(l[i]) == first) && (FoldAscii(l[i + n - 1]) == last) &&
+            EqualsFoldedAscii(l + i + 1, match.data() + 1, (n > 2) ? n - 2 : 0))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Created once, on first use. Generating a locale is expensive.
+inline std::locale const& CaseFoldingLocale()
+{
+    static std::locale const loc = boost::locale::generator{}("en_US.UTF-8");
+    return loc;
+}
+
+} // namespace detail
+
+
+// Line matching policy, case-insensitive. Can be used wherever SimpleLineMatcher
+// can, including line pipelines.
+struct CaseInsensitiveLineMatcher
+{
+    bool LineMatches(std::string const& line, std::string const& match) const
+    {
+        return LineMatches(boost::string_ref{line}, boost::string_ref{match});
+    }
+
+    bool LineMatches(boost::string_ref line, boost::string_ref match) const
+    {
+        if (IsAscii(line) && IsAscii(match))
+        {
+            return detail::FindFoldedAscii(line, match);
+        }
+
+        // Full case folding may change the length of the strings (e.g., "ß" -> "ss"),
+        // so we fold both whole strings, instead of comparing them char by char.
+        std::locale const& loc = detail::CaseFoldingLocale();
+        std::string folded_line = boost::locale::fold_case(line.begin(), line.end(), loc);
+        std::string folded_match = boost::locale::fold_case(match.begin(), match.end(), loc);
+
+        return (folded_line.find(folded_match) != std::string::npos);
+    }
+};
+
+} // namespace utils
+}}}
+
+#endif // CASE_INSENSITIVE_MATCHER_H
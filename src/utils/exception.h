@@ -37,6 +37,9 @@ using error_message = base::error_message;
 
 struct UtilsException : virtual base::PCBBaseException { };
 struct FileOpenException : virtual UtilsException { };
+struct FileReadException : virtual UtilsException { };
+struct FileWriteException : virtual UtilsException { };
+struct SketchException : virtual UtilsException { };
 
 } // namespace utils
 }}}
@@ -0,0 +1,622 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef EXTERNAL_SORT_H
+#define EXTERNAL_SORT_H
+
+// Sorts the lines of a file larger than memory, by a key extracted from each
+// line (see LineKey), like sort(1), but in-process.
+//
+// Lines are read with a FileLineReader into runs that fit the memory limit.
+// Each run is sorted and spilled to a temporary file, while the next one is
+// being read; with more than one thread, several runs are sorted at once.
+// The runs are then merged, in a single pass, with a read-ahead buffer per
+// run, into the output file. If the whole file fits in one run, nothing is
+// spilled.
+//
+// Keys are compared as bytes. With a key width (SetKeyWidth()), only the
+// first width bytes of each key count, and runs are sorted with an LSD radix
+// sort over them (skipping the positions where all keys have the same byte,
+// e.g., the date in a day's log), which is always stable. E.g., to sort a log
+// by its "[2014-01-01 00:00:00.000]" prefix, use LineKey::Whole() with a key
+// width of 25. Otherwise, runs are sorted by comparison, stable or not
+// (SetStable()). The merge takes equal keys in input order, so a stable sort
+// stays stable.
+//
+// Run files are front coded: each line is stored as the length it shares
+// with the previous line, plus the rest. Sorted lines share long prefixes
+// (timestamps, keys), so runs usually take a fraction of the input's size,
+// with no compression library, and no cost to decode.
+//
+// Lines with no key sort as if their key was empty, i.e., first. Every output
+// line ends with '\n', including the last.
+
+#include "base/temp_name.h"
+#include "utils/exception.h"
+#include "utils/file_line_reader.h"
+#include "utils/file_line_writer.h"
+#include "utils/line_aggregator.h"
+#include "utils/varint.h"
+
+#include <boost/utility/string_ref.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+struct ExternalSortStats
+{
+    unsigned long long lines = 0;
+    // Spilled runs; 0 if the whole file was sorted in memory.
+    std::size_t runs = 0;
+    unsigned long long input_bytes = 0;
+    unsigned long long spilled_bytes = 0;
+};
+
+
+namespace detail
+{
+
+// Compares keys as bytes, up to width (0 means the whole key).
+inline bool SortKeyLess(boost::string_ref l, boost::string_ref r, std::size_t width)
+{
+    if (width > 0)
+    {
+        l = l.substr(0, width);
+        r = r.substr(0, width);
+    }
+
+    return l < r;
+}
+
+
+// Lines in memory, and where their keys are.
+class SortRun
+{
+public:
+    SortRun(LineKey const& key, std::size_t key_width) : key_{&key}, key_width_{key_width} { }
+
+    void Reserve(std::size_t bytes) { text_.reserve(bytes); }
+    void Add(boost::string_ref line);
+    bool IsEmpty() const { return records_.empty(); }
+    // Roughly - the lines, plus what we keep per line.
+    std::size_t GetMemory() const
+    { return text_.size() + records_.size() * (sizeof(Record) + sizeof(std::uint32_t) * 2 + key_width_); }
+
+    void Sort(bool stable);
+
+    // Calls f(boost::string_ref line) for each line, in sorted order.
+    template <typename Fn>
+    void ForEachLine(Fn f) const
+    {
+        for (auto i : order_)
+        {
+            f(boost::string_ref{text_.data() + records_[i].offset, records_[i].length});
+        }
+    }
+private:
+    struct Record
+    {
+        std::uint32_t offset;
+        std::uint32_t length;
+        std::uint32_t key_offset;
+        std::uint32_t key_length;
+    };
+
+    boost::string_ref KeyOf(std::uint32_t i) const
+    { return boost::string_ref{text_.data() + records_[i].key_offset, records_[i].key_length}; }
+
+    void RadixSort();
+
+    LineKey const* key_;
+    std::size_t key_width_;
+    std::string text_;
+    std::vector<Record> records_;
+    // With a key width, the first key_width_ bytes of each key, zero padded.
+    std::vector<unsigned char> keys_;
+    std::vector<std::uint32_t> order_;
+};
+
+
+inline void SortRun::Add(boost::string_ref line)
+{
+    boost::string_ref key;
+    if (!key_->Extract(line, key))
+    {
+        key = boost::string_ref{line.data(), 0};
+    }
+
+    Record r;
+    r.offset = static_cast<std::uint32_t>(text_.size());
+    r.length = static_cast<std::uint32_t>(line.size());
+    r.key_offset = r.offset + static_cast<std::uint32_t>(key.data() - line.data());
+    r.key_length = static_cast<std::uint32_t>(key.size());
+
+    text_.append(line.data(), line.size());
+    records_.push_back(r);
+
+    if (key_width_ > 0)
+    {
+        std::size_t n = std::min(key.size(), key_width_);
+        keys_.insert(keys_.end(), key.data(), key.data() + n);
+        keys_.insert(keys_.end(), key_width_ - n, 0);
+    }
+}
+
+
+inline void SortRun::Sort(bool stable)
+{
+    order_.resize(records_.size());
+    for (std::uint32_t i = 0; i < order_.size(); ++i)
+    {
+        order_[i] = i;
+    }
+
+    if (key_width_ > 0)
+    {
+        RadixSort();
+        return;
+    }
+
+    auto less = [this](std::uint32_t l, std::uint32_t r) { return KeyOf(l) < KeyOf(r); };
+    if (stable)
+    {
+        std::stable_sort(order_.begin(), order_.end(), less);
+    }
+    else
+    {
+        std::sort(order_.begin(), order_.end(), less);
+    }
+}
+
+
+// LSD: a stable counting sort per key position, last to first.
+inline void SortRun::RadixSort()
+{
+    std::size_t const n = order_.size();
+    std::size_t const w = key_width_;
+    std::vector<std::uint32_t> sorted(n);
+
+    for (std::size_t p = w; p-- > 0; )
+    {
+        std::size_t counts[256] = {};
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            ++counts[keys_[i * w + p]];
+        }
+
+        // All the same - this position doesn't change the order.
+        if (counts[keys_[p]] == n)
+        {
+            continue;
+        }
+
+        std::size_t pos = 0;
+        for (auto& c : counts)
+        {
+            std::size_t count = c;
+            c = pos;
+            pos += count;
+        }
+
+        for (auto i : order_)
+        {
+            sorted[counts[keys_[i * w + p]]++] = i;
+        }
+        order_.swap(sorted);
+    }
+}
+
+
+// Run file. Each line is a varint with the length it shares with the
+// previous line, a varint with the length of the rest, and the rest.
+inline unsigned long long SpillRun(SortRun run, std::string const& file_name, bool stable)
+{
+    run.Sort(stable);
+
+    FileLineWriter out{file_name};
+    std::string prev;
+    std::string header;
+
+    run.ForEachLine([&](boost::string_ref line)
+    {
+        std::size_t shared = 0;
+        std::size_t max = std::min(prev.size(), line.size());
+        while ((shared < max) && (prev[shared] == line[shared]))
+        {
+            ++shared;
+        }
+
+        header.clear();
+        AppendVarint(header, shared);
+        AppendVarint(header, line.size() - shared);
+        out.Write(header);
+        out.Write(line.substr(shared));
+
+        prev.assign(line.data(), line.size());
+    });
+
+    unsigned long long bytes = out.GetBytesWritten();
+    out.Close();
+    return bytes;
+}
+
+
+// Reads a run file back, through a buffer of its own.
+class RunReader
+{
+public:
+    RunReader(std::string const& file_name, std::size_t buffer_size) :
+        file_name_{file_name}, in_{file_name, std::ios_base::in | std::ios_base::binary}, buffer_(buffer_size)
+    {
+        if (!in_)
+        {
+            BOOST_THROW_EXCEPTION(FileOpenException() << error_message("Error opening file " + file_name));
+        }
+    }
+
+    // Decodes the next line. Returns false at the end of the run.
+    bool Next();
+    std::string const& GetLine() const { return line_; }
+private:
+    // Makes sure there are need bytes in the buffer, unless the file ends
+    // first. Returns how many there are.
+    std::size_t Fill(std::size_t need);
+    std::uint64_t ReadLength();
+
+    void ThrowCorrupt() const
+    {
+        BOOST_THROW_EXCEPTION(FileReadException() << error_message("Invalid run file " + file_name_));
+    }
+
+    std::string file_name_;
+    std::ifstream in_;
+    std::vector<char> buffer_;
+    std::size_t begin_ = 0;
+    std::size_t end_ = 0;
+    std::string line_;
+};
+
+
+inline bool RunReader::Next()
+{
+    // Two varints, at most.
+    if (Fill(20) == 0)
+    {
+        return false;
+    }
+
+    std::uint64_t shared = ReadLength();
+    std::uint64_t rest = ReadLength();
+
+    if ((shared > line_.size()) || (Fill(static_cast<std::size_t>(rest)) < rest))
+    {
+        ThrowCorrupt();
+    }
+
+    line_.resize(static_cast<std::size_t>(shared));
+    line_.append(buffer_.data() + begin_, static_cast<std::size_t>(rest));
+    begin_ += static_cast<std::size_t>(rest);
+    return true;
+}
+
+inline std::size_t RunReader::Fill(std::size_t need)
+{
+    if (end_ - begin_ < need)
+    {
+        // Keep what we have, at the start, and read as much as fits after it.
+        std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+
+        if (buffer_.size() < need)
+        {
+            buffer_.resize(need);
+        }
+
+        in_.read(buffer_.data() + end_, static_cast<std::streamsize>(buffer_.size() - end_));
+        end_ += static_cast<std::size_t>(in_.gcount());
+
+        if (in_.bad())
+        {
+            BOOST_THROW_EXCEPTION(FileReadException() << error_message("Error reading file " + file_name_));
+        }
+    }
+
+    return end_ - begin_;
+}
+
+inline std::uint64_t RunReader::ReadLength()
+{
+    unsigned char const* p = reinterpret_cast<unsigned char const*>(buffer_.data() + begin_);
+    unsigned char const* start = p;
+    std::uint64_t v = 0;
+
+    if (!ReadVarint(p, reinterpret_cast<unsigned char const*>(buffer_.data() + end_), v))
+    {
+        ThrowCorrupt();
+    }
+
+    begin_ += static_cast<std::size_t>(p - start);
+    return v;
+}
+
+
+// Removes the run files when the sort is done, one way or another. The names
+// are unique to the sort, so sorts that share a prefix (in this process, or
+// in others) don't write over each other's runs.
+class RunFiles
+{
+public:
+    explicit RunFiles(std::string prefix) : prefix_{std::move(prefix)} { }
+    ~RunFiles()
+    {
+        for (auto const& f : files_)
+        {
+            std::remove(f.c_str());
+        }
+    }
+
+    RunFiles(RunFiles const&) = delete;
+    RunFiles& operator=(RunFiles const&) = delete;
+
+    std::string Add()
+    {
+        files_.push_back(base::UniqueTempName(prefix_));
+        return files_.back();
+    }
+
+    std::vector<std::string> const& GetFiles() const { return files_; }
+private:
+    std::string prefix_;
+    std::vector<std::string> files_;
+};
+
+} // namespace detail
+
+
+// Thread safety: Sort() is const, and can be called concurrently, for
+// different output files.
+class ExternalSorter
+{
+public:
+    static constexpr std::size_t kDefaultMemoryLimit = 256 * 1024 * 1024;
+
+    explicit ExternalSorter(LineKey key = LineKey::Whole()) : key_{std::move(key)} { }
+
+    // Memory for the runs being read and sorted, together. The merge uses as
+    // much for its read-ahead buffers, and each run takes one.
+    void SetMemoryLimit(std::size_t bytes)
+    {
+        assert(bytes > 0);
+        memory_limit_ = bytes;
+    }
+
+    // Only the first width bytes of each key count, and runs are radix
+    // sorted. 0 (the default) means the whole key, compared.
+    void SetKeyWidth(std::size_t width) { key_width_ = width; }
+
+    // Keep the input order of lines with equal keys. Always the case with a
+    // key width.
+    void SetStable(bool stable) { stable_ = stable; }
+
+    // 0 (the default) means one thread per core.
+    void SetThreadCount(unsigned threads) { thread_count_ = threads; }
+
+    // Run files are named after the output file, by default, followed by
+    // ".run" and a suffix unique to each run.
+    void SetTempPrefix(std::string prefix) { temp_prefix_ = std::move(prefix); }
+
+    // Throws FileOpenException/FileReadException/FileWriteException.
+    ExternalSortStats Sort(std::string const& in_file, std::string const& out_file) const;
+private:
+    void Merge(std::vector<std::string> const& runs, std::string const& out_file) const;
+
+    LineKey key_;
+    std::size_t memory_limit_ = kDefaultMemoryLimit;
+    std::size_t key_width_ = 0;
+    bool stable_ = false;
+    unsigned thread_count_ = 0;
+    std::string temp_prefix_;
+};
+
+
+inline ExternalSortStats ExternalSorter::Sort(std::string const& in_file, std::string const& out_file) const
+{
+    ExternalSortStats stats;
+    FileLineReader<SimpleLineMatcher, NoLineCounter> flr{in_file};
+
+    unsigned threads = (thread_count_ > 0) ? thread_count_ : std::max(std::thread::hardware_concurrency(), 1u);
+    // While threads runs are being sorted, another one is being read. Run
+    // offsets are 32 bits.
+    std::size_t run_memory = std::min<std::size_t>(memory_limit_ / (threads + 1), 0x7FFFFFFF);
+    run_memory = std::max<std::size_t>(run_memory, 1);
+
+    detail::RunFiles run_files{(temp_prefix_.empty() ? out_file : temp_prefix_) + ".run"};
+    std::deque<std::future<unsigned long long>> pending;
+    bool more = true;
+
+    while (more)
+    {
+        detail::SortRun run{key_, key_width_};
+        // Most lines are short, so the text is most of a run.
+        run.Reserve(std::min<std::size_t>(run_memory, static_cast<std::size_t>(flr.GetFileSize())));
+
+        while ((more = flr.ReadLine()))
+        {
+            run.Add(flr.GetCurrentLine());
+            ++stats.lines;
+            stats.input_bytes += flr.GetCurrentLine().size() + 1;
+
+            if (run.GetMemory() >= run_memory)
+            {
+                break;
+            }
+        }
+
+        // It all fit in memory.
+        if (!more && run_files.GetFiles().empty())
+        {
+            run.Sort(stable_);
+
+            FileLineWriter out{out_file};
+            run.ForEachLine([&out](boost::string_ref line) { out.WriteLine(line); });
+            out.Close();
+            return stats;
+        }
+
+        if (run.IsEmpty())
+        {
+            break;
+        }
+
+        if (pending.size() >= threads)
+        {
+            stats.spilled_bytes += pending.front().get();
+            pending.pop_front();
+        }
+
+        std::string run_file = run_files.Add();
+        if (threads == 1)
+        {
+            stats.spilled_bytes += detail::SpillRun(std::move(run), run_file, stable_);
+        }
+        else
+        {
+            pending.push_back(std::async(std::launch::async, &detail::SpillRun,
+                std::move(run), std::move(run_file), stable_));
+        }
+    }
+
+    for (auto& p : pending)
+    {
+        stats.spilled_bytes += p.get();
+    }
+
+    stats.runs = run_files.GetFiles().size();
+    Merge(run_files.GetFiles(), out_file);
+    return stats;
+}
+
+
+// k-way merge, with a heap of runs, by their current line's key. Equal keys
+// come from the earlier run first, which keeps the sort stable.
+inline void ExternalSorter::Merge(std::vector<std::string> const& runs, std::string const& out_file) const
+{
+    struct Cursor
+    {
+        std::unique_ptr<detail::RunReader> reader;
+        boost::string_ref key;
+        std::size_t run;
+    };
+
+    std::size_t buffer_size = std::min<std::size_t>(std::max<std::size_t>(memory_limit_ / (runs.size() + 1),
+        64 * 1024), 16 * 1024 * 1024);
+    std::vector<Cursor> cursors;
+    cursors.reserve(runs.size());
+
+    auto advance = [this](Cursor& c)
+    {
+        if (!c.reader->Next())
+        {
+            return false;
+        }
+
+        if (!key_.Extract(c.reader->GetLine(), c.key))
+        {
+            c.key = boost::string_ref{c.reader->GetLine().data(), 0};
+        }
+        return true;
+    };
+
+    std::vector<std::size_t> heap;
+    for (std::size_t i = 0; i < runs.size(); ++i)
+    {
+        cursors.push_back(Cursor{std::unique_ptr<detail::RunReader>{new detail::RunReader{runs[i], buffer_size}},
+            boost::string_ref{}, i});
+        if (advance(cursors.back()))
+        {
+            heap.push_back(i);
+        }
+    }
+
+    std::size_t const width = key_width_;
+    // std::push_heap() keeps the largest on top, so this is "greater".
+    auto after = [&cursors, width](std::size_t l, std::size_t r)
+    {
+        Cursor const& cl = cursors[l];
+        Cursor const& cr = cursors[r];
+        if (detail::SortKeyLess(cr.key, cl.key, width))
+        {
+            return true;
+        }
+        return !detail::SortKeyLess(cl.key, cr.key, width) && (cr.run < cl.run);
+    };
+    std::make_heap(heap.begin(), heap.end(), after);
+
+    FileLineWriter out{out_file};
+
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), after);
+        Cursor& c = cursors[heap.back()];
+        out.WriteLine(c.reader->GetLine());
+
+        if (advance(c))
+        {
+            std::push_heap(heap.begin(), heap.end(), after);
+        }
+        else
+        {
+            heap.pop_back();
+        }
+    }
+
+    out.Close();
+}
+
+} // namespace utils
+}}}
+
+#endif // EXTERNAL_SORT_H
@@ -0,0 +1,108 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef FILE_CHUNKS_H
+#define FILE_CHUNKS_H
+
+// Splits a file into chunks that begin and end on line boundaries, so that
+// each chunk can be processed on its own (e.g., by a different thread),
+// without any line being split between two of them.
+//
+// Chunks are described by their offset and size in the file, not loaded;
+// each worker should open its own stream and read its chunks with
+// ReadFileChunk().
+
+#include <cassert>
+#include <cstddef>
+#include <ios>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+struct FileChunk
+{
+    std::streamoff offset;
+    std::streamoff size;
+};
+
+
+// Splits the file into chunks of about target_size bytes. Every chunk begins
+// where a line begins, and ends right after a delimiter (except, possibly, the
+// last one). A chunk can be larger than target_size, because we always
+// include the whole line that crosses its end; a line longer than target_size
+// gets a chunk of its own.
+// Only seeks and skips to the next delimiter, so it doesn't read the file.
+// Leaves the reader's position and line count meaningless.
+template <typename Reader>
+std::vector<FileChunk> SplitLineChunks(Reader& flr, std::streamoff target_size)
+{
+    assert(target_size > 0);
+
+    std::streamoff file_size = flr.GetFileSize();
+    std::vector<FileChunk> chunks;
+    std::streamoff begin = 0;
+
+    while (begin < file_size)
+    {
+        std::streamoff end = file_size;
+
+        if ((file_size - begin > target_size) && flr.SeekToLine(begin + target_size))
+        {
+            end = flr.GetCurrentLineOffset();
+        }
+
+        chunks.push_back(FileChunk{begin, end - begin});
+        begin = end;
+    }
+
+    return chunks;
+}
+
+
+// Reads the whole chunk into buf, replacing its contents.
+// Returns false if the file ended before the chunk did.
+inline bool ReadFileChunk(std::istream& in, FileChunk const& chunk, std::string& buf)
+{
+    buf.resize(static_cast<std::size_t>(chunk.size));
+
+    in.clear();
+    in.seekg(chunk.offset);
+    in.read(&buf[0], chunk.size);
+
+    buf.resize(static_cast<std::size_t>(in.gcount()));
+    return (in.gcount() == chunk.size);
+}
+
+} // namespace utils
+}}}
+
+#endif // FILE_CHUNKS_H
@@ -30,11 +30,21 @@
 #define FILE_LINE_READER_H
 
 #include "utils/exception.h"
+#include "utils/line_length.h"
+#include "utils/open_result.h"
+#include "utils/reader_stats.h"
+
+#include <boost/utility/string_ref.hpp>
 
 #include <cassert>
+#include <cerrno>
+#include <cstddef>
 #include <fstream>
+#include <istream>
+#include <limits>
 #include <stdexcept>
 #include <string>
+#include <utility>
 
 namespace pt { namespace pcaetano { namespace bluesy {
 namespace utils
@@ -57,12 +67,19 @@ private:
 
 
 // Line matching policy
+// The string_ref overload is used by line pipelines (see line_pipeline.h),
+// which don't copy lines into std::strings.
 struct SimpleLineMatcher
 {
     bool LineMatches(std::string const& line, std::string const& match) const
     {
         return (line.find(match) != std::string::npos);
     }
+
+    bool LineMatches(boost::string_ref line, boost::string_ref match) const
+    {
+        return (line.find(match) != boost::string_ref::npos);
+    }
 };
 
 
@@ -87,6 +104,10 @@ struct NoLineCounter
 //          probably not the best option.
 
 // Reads a text file, one line at a time. Thread safety: None.
+// The ReaderStats policy (see reader_stats.h) is opt-in; the default,
+// NoReaderStats, has no cost.
+// The LineLength policy (see line_length.h) determines how much memory
+// a line may take; by default, there's no limit.
 // We refer to the last line read, i.e. the line currently in the read buffer as
 // the current line.
 //
@@ -94,8 +115,11 @@ struct NoLineCounter
 // LineCounter have no state, and a data member is a bit of waste (no, not a huge waste).
 // Can this be abused? Probably, but you know - protect against Murphy, not Machavelli.
 template <typename LineMatcher = SimpleLineMatcher,
-    typename LineCounter = SimpleLineCounter<unsigned long>>
-class FileLineReader : private LineMatcher, private LineCounter
+    typename LineCounter = SimpleLineCounter<unsigned long>,
+    typename ReaderStats = NoReaderStats,
+    typename LineLength = UnboundedLineLength>
+class FileLineReader : private LineMatcher, private LineCounter, private ReaderStats,
+    private LineLength
 {
 public:
     // Upon construction, we read no line from the file.
@@ -103,9 +127,9 @@ public:
     // "stream ready to read", however this ctor does not guarantee it.
     FileLineReader() = default;
     FileLineReader(std::string file_name)
-        : in_file_{file_name}, curr_line_{}, file_name_{file_name}
+        : curr_line_{}, file_name_{std::move(file_name)}
     {
-        CheckFileOpen();
+        OpenFile().ThrowIfFailed();
     }
 
 
@@ -116,28 +140,33 @@ public:
     // TODO: Necessary only if we keep the default ctor, otherwise drop it.
     void Open(std::string file_name)
     {
-        assert(!in_file_.is_open());
+        TryOpen(std::move(file_name)).ThrowIfFailed();
+    }
+
+    // Same as Open(), but doesn't throw; see open_result.h. On failure, the
+    // reader stays closed, and may be opened again.
+    OpenResult TryOpen(std::string file_name)
+    {
+        assert(!file_buf_.is_open());
 
-        in_file_.open(file_name);
-        CheckFileOpen();
-        file_name_ = file_name;
+        file_name_ = std::move(file_name);
+        return OpenFile();
     }
 
 
     // Reads the a line from the file, which becomes the current line.
     // Our goal, for now, is to maintain an interface similar to getline().
+    // With SplitLongLines, this may read the next segment of the current line,
+    // instead; the other functions always move on to the next line.
     bool ReadLine()
     {
-        assert(in_file_.is_open());
-
-        bool read_line = getline(in_file_, curr_line_, in_file_.widen('\n'));
+        assert(file_buf_.is_open());
 
-        if (read_line)
-        {
-            LineCounter::Increment();
-        }
+        auto tick = ReaderStats::StartTick();
+        LineReadResult r = LineLength::ReadSegment(in_file_, curr_line_);
+        RecordLineRead(tick, r);
 
-        return read_line;
+        return r.read;
     }
 
 
@@ -149,7 +178,50 @@ public:
     // When we use ReadLine(), we have an easy way to know if we've
     // read the line successfully. However, when we skip lines, we
     // need to know how the reading went.
-    bool WasReadOK() const { return in_file_; }
+    bool WasReadOK() const { return static_cast<bool>(in_file_); }
+
+
+    // A copy of the statistics collected so far. With the default
+    // NoReaderStats policy, all counters are 0.
+    ReaderStatsSnapshot GetStats() const { return ReaderStats::TakeSnapshot(file_buf_); }
+
+
+    // Skips number_lines lines, like SkipNumberLines(), but without reading them
+    // into memory. Since we never read them, the current line is left empty.
+    // Returns how many lines were actually skipped.
+    unsigned long DiscardLines(unsigned long number_lines);
+
+
+    // Random access.
+    // After a seek, line count is no longer accurate, since we don't know how many
+    // lines we've jumped over; counting resumes from where it was.
+
+    // Positions the reader so that the next ReadLine() reads the first line that
+    // begins at, or after, offset. The current line is left empty.
+    // Returns false if there are no lines after offset.
+    bool SeekToLine(std::streamoff offset);
+
+    // Offset, in the file, where the current line begins (for a segment of a
+    // split line, where the segment begins).
+    std::streamoff GetCurrentLineOffset() const { return curr_offset_; }
+
+    // Doesn't change the current position.
+    std::streamoff GetFileSize();
+
+
+    // Maximum line length. Has no effect with the default LineLength policy.
+    void SetMaxLineLength(std::size_t max_line_length)
+    { LineLength::SetMaxLineLength(max_line_length); }
+    std::size_t GetMaxLineLength() const { return LineLength::GetMaxLineLength(); }
+
+    // How many lines exceeded the maximum line length.
+    unsigned long long GetLongLineCount() const { return LineLength::GetLongLineCount(); }
+
+    // Is the current line only part of the line in the file (truncated, or a segment)?
+    bool IsLinePartial() const { return LineLength::IsLinePartial(); }
+
+    // Is the current line a segment, other than the first, of a split line?
+    bool IsLineContinuation() const { return LineLength::IsLineContinuation(); }
 
 
     // Return the current line (const ref or copy)
@@ -224,67 +296,224 @@ public:
     // read a line before comparing.
     using LineMatcher::LineMatches;
     bool LineMatches(std::string const& match) const
-    { return LineMatches(curr_line_, match); }
+    { return CurrentLineMatches(match); }
 
     // Checks if the current line is empty
     bool IsLineEmpty() const { return curr_line_.empty(); }
     std::string GetFileName() const { return file_name_; }
 private:
-    void CheckFileOpen() const
+    // We keep the filebuf ourselves, rather than using an std::ifstream, so
+    // the ReaderStats policy can choose its type.
+    // The filebuf leaves errno as the failed open() set it.
+    OpenResult OpenFile()
+    {
+        errno = 0;
+
+        if (file_buf_.open(file_name_, std::ios_base::in))
+        {
+            in_file_.clear();
+            return OpenResult{};
+        }
+
+        int error_number = errno;
+        in_file_.setstate(std::ios_base::failbit);
+        return OpenResult{error_number, file_name_};
+    }
+
+    void RecordLineRead(typename ReaderStats::StatsTick tick, LineReadResult const& r)
+    {
+        if (r.read)
+        {
+            curr_offset_ = next_offset_ + static_cast<std::streamoff>(r.bytes - r.line_bytes);
+        }
+        next_offset_ += static_cast<std::streamoff>(r.bytes);
+
+        if (r.new_line)
+        {
+            LineCounter::Increment();
+        }
+
+        // Lines skipped by the LineLength policy still count.
+        for (unsigned long i = 0; i < r.skipped_lines; ++i)
+        {
+            LineCounter::Increment();
+        }
+
+        if (r.read || (r.bytes > 0))
+        {
+            ReaderStats::RecordRead(tick, r);
+        }
+        else
+        {
+            ReaderStats::RecordFailedRead(tick);
+        }
+    }
+
+    // If part of the current line is still in the file, move past it.
+    void DiscardRestOfLine()
     {
-        if (!in_file_.is_open())
+        if (LineLength::IsRestOfLinePending())
         {
-            BOOST_THROW_EXCEPTION(FileOpenException() << error_message("Error opening file " + file_name_));
+            auto tick = ReaderStats::StartTick();
+            RecordLineRead(tick, LineLength::DiscardRestOfLine(in_file_));
         }
     }
 
-    std::ifstream in_file_;
+    // Unlike ReadLine(), always moves on to the next line in the file.
+    bool ReadNextLine()
+    {
+        DiscardRestOfLine();
+        return ReadLine();
+    }
+
+    // If the current line is only the beginning of a long line, we also match
+    // the rest of it, straight from the file.
+    bool CurrentLineMatches(std::string const& match) const
+    {
+        auto tick = ReaderStats::StartTick();
+        bool hit = LineMatcher::LineMatches(curr_line_, match);
+
+        if (!hit && LineLength::IsRestOfLinePending())
+        {
+            hit = LineLength::RestOfLineMatches(in_file_, curr_line_,
+                [this, &match](std::string const& chunk) { return LineMatcher::LineMatches(chunk, match); },
+                match.empty() ? 0 : match.size() - 1);
+        }
+
+        ReaderStats::RecordMatch(tick, hit);
+        return hit;
+    }
+
+    typename ReaderStats::FileBufType file_buf_;
+    // Mutable, because matching the rest of a long line reads ahead and then
+    // restores the stream position.
+    mutable std::istream in_file_{&file_buf_};
     std::string curr_line_;
+    std::streamoff curr_offset_ = 0;
+    std::streamoff next_offset_ = 0;
 
     std::string file_name_;
 };
 
 
 
-template <typename LineMatcher, typename LineCounter>
-void FileLineReader<LineMatcher, LineCounter>::SkipNumberLines(unsigned int number_lines)
+template <typename LineMatcher, typename LineCounter, typename ReaderStats, typename LineLength>
+void FileLineReader<LineMatcher, LineCounter, ReaderStats, LineLength>::SkipNumberLines(unsigned int number_lines)
 {
-    while ((number_lines > 0) && ReadLine())
+    while ((number_lines > 0) && ReadNextLine())
     {
         --number_lines;
     }
 }
 
 
-template <typename LineMatcher, typename LineCounter>
-void FileLineReader<LineMatcher, LineCounter>::SkipMatchingLine(std::string const& match)
+template <typename LineMatcher, typename LineCounter, typename ReaderStats, typename LineLength>
+void FileLineReader<LineMatcher, LineCounter, ReaderStats, LineLength>::SkipMatchingLine(std::string const& match)
 {
-    if (ReadLine() && (LineMatches(curr_line_, match)))
+    if (ReadNextLine() && CurrentLineMatches(match))
     {
-        ReadLine();
+        ReadNextLine();
     }
 }
 
 
-template <typename LineMatcher, typename LineCounter>
-void FileLineReader<LineMatcher, LineCounter>::SkipMatchingLines(std::string const& match)
+template <typename LineMatcher, typename LineCounter, typename ReaderStats, typename LineLength>
+void FileLineReader<LineMatcher, LineCounter, ReaderStats, LineLength>::SkipMatchingLines(std::string const& match)
 {
-    while (ReadLine() && LineMatches(curr_line_, match))
+    while (ReadNextLine() && CurrentLineMatches(match))
     {
         ;
     }
 }
 
 
-template <typename LineMatcher, typename LineCounter>
-void FileLineReader<LineMatcher, LineCounter>::SkipLinesUntilMatch(std::string const& match)
+template <typename LineMatcher, typename LineCounter, typename ReaderStats, typename LineLength>
+void FileLineReader<LineMatcher, LineCounter, ReaderStats, LineLength>::SkipLinesUntilMatch(std::string const& match)
 {
-    while (ReadLine() && !LineMatches(curr_line_, match))
+    while (ReadNextLine() && !CurrentLineMatches(match))
     {
         ;
     }
 }
 
+template <typename LineMatcher, typename LineCounter, typename ReaderStats, typename LineLength>
+unsigned long FileLineReader<LineMatcher, LineCounter, ReaderStats, LineLength>::DiscardLines(
+    unsigned long number_lines)
+{
+    assert(file_buf_.is_open());
+
+    DiscardRestOfLine();
+    curr_line_.clear();
+    LineLength::ResetLine();
+
+    unsigned long discarded = 0;
+
+    while (discarded < number_lines)
+    {
+        auto tick = ReaderStats::StartTick();
+        in_file_.ignore(std::numeric_limits<std::streamsize>::max(), in_file_.widen('\n'));
+
+        LineReadResult r;
+        r.bytes = static_cast<std::size_t>(in_file_.gcount());
+        r.new_line = (r.bytes > 0);
+        RecordLineRead(tick, r);
+
+        if (!r.new_line)
+        {
+            // Same as running out of lines on SkipNumberLines().
+            in_file_.setstate(std::ios_base::failbit);
+            break;
+        }
+
+        ++discarded;
+    }
+
+    curr_offset_ = next_offset_;
+    return discarded;
+}
+
+
+template <typename LineMatcher, typename LineCounter, typename ReaderStats, typename LineLength>
+bool FileLineReader<LineMatcher, LineCounter, ReaderStats, LineLength>::SeekToLine(std::streamoff offset)
+{
+    assert(file_buf_.is_open());
+
+    curr_line_.clear();
+    LineLength::ResetLine();
+    in_file_.clear();
+
+    if (offset <= 0)
+    {
+        in_file_.seekg(0);
+        curr_offset_ = next_offset_ = 0;
+        return in_file_.good();
+    }
+
+    // If the previous char is a delimiter, offset is already where a line begins.
+    // Otherwise, we're in the middle of a line, and the next one begins after the
+    // next delimiter. Either way, we only have to skip up to the first delimiter
+    // from offset - 1, and we don't need to read the line into memory.
+    in_file_.seekg(offset - 1);
+    in_file_.ignore(std::numeric_limits<std::streamsize>::max(), in_file_.widen('\n'));
+
+    curr_offset_ = next_offset_ = offset - 1 + in_file_.gcount();
+    return in_file_.good();
+}
+
+
+template <typename LineMatcher, typename LineCounter, typename ReaderStats, typename LineLength>
+std::streamoff FileLineReader<LineMatcher, LineCounter, ReaderStats, LineLength>::GetFileSize()
+{
+    assert(file_buf_.is_open());
+
+    // We go straight to the filebuf, so the stream state is left alone.
+    std::streampos pos = file_buf_.pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+    std::streampos end = file_buf_.pubseekoff(0, std::ios_base::end, std::ios_base::in);
+    file_buf_.pubseekpos(pos, std::ios_base::in);
+
+    return end;
+}
+
 } // namespace utils
 }}}
 
@@ -0,0 +1,623 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef FILE_LINE_WRITER_H
+#define FILE_LINE_WRITER_H
+
+// Writes a text file, one line at a time - FileLineReader's counterpart, for
+// tools that filter lines from one file into another.
+//
+// Lines are copied into a large buffer (1 MiB, by default), which goes to the
+// file in a single write when it fills up, instead of going through an
+// ostream's operator<<, sentry and (with std::endl) a flush per line. Lines
+// are taken as boost::string_ref, so a reader's current line, or a line
+// pipeline's string_ref, goes straight into the buffer.
+//
+// Without background flushing, a line longer than half the buffer isn't
+// copied at all: it's written together with the buffer, by a single writev(),
+// straight from the caller's memory. WriteDirect() does the same for text of
+// any size, for callers that do their own buffering.
+//
+// With background flushing (SetBackgroundFlush()), full buffers are queued
+// and written by a dedicated thread, which writes everything queued in one
+// writev(), so the thread writing lines only waits on the disk when the queue
+// is full. The queue is bounded, so memory use is too: about (queue size + 2)
+// * buffer size.
+//
+// SyncPolicy decides whether the data is also synced to disk (fdatasync()):
+// never, on Close(), or on every Flush().
+//
+// Errors are reported by throwing FileWriteException. Background write
+// errors are reported by the next call that writes, flushes or closes.
+
+#include "utils/exception.h"
+#include "utils/open_result.h"
+
+#include <boost/utility/string_ref.hpp>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+enum class WriteMode { Truncate, Append };
+
+enum class SyncPolicy
+{
+    // Leave it to the OS.
+    None,
+    // Sync once, when the file is closed.
+    OnClose,
+    // Sync on every Flush() (and on Close()).
+    OnFlush
+};
+
+
+namespace detail
+{
+
+struct WriteSegment
+{
+    char const* data;
+    std::size_t size;
+};
+
+// Writes all the segments, in order. Returns 0, or the errno.
+// Modifies segs, to keep track of what's been written.
+inline int WriteSegments(int fd, WriteSegment* segs, std::size_t count)
+{
+#ifdef _WIN32
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        while (segs[i].size > 0)
+        {
+            int n = _write(fd, segs[i].data, static_cast<unsigned>(std::min<std::size_t>(segs[i].size, 1u << 30)));
+            if (n <= 0)
+            {
+                return (n < 0) ? errno : EIO;
+            }
+            segs[i].data += n;
+            segs[i].size -= static_cast<std::size_t>(n);
+        }
+    }
+    return 0;
+#else
+    std::size_t const kMaxSegments = 64;
+    iovec iov[kMaxSegments];
+
+    while (count > 0)
+    {
+        std::size_t n = std::min(count, kMaxSegments);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            iov[i].iov_base = const_cast<char*>(segs[i].data);
+            iov[i].iov_len = segs[i].size;
+        }
+
+        ssize_t written = ::writev(fd, iov, static_cast<int>(n));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return errno;
+        }
+
+        // Partial writes: skip what's done, and go again.
+        std::size_t w = static_cast<std::size_t>(written);
+        while ((count > 0) && (w >= segs[0].size))
+        {
+            w -= segs[0].size;
+            ++segs;
+            --count;
+        }
+        if (count > 0)
+        {
+            segs[0].data += w;
+            segs[0].size -= w;
+        }
+    }
+    return 0;
+#endif
+}
+
+// Returns 0, or the errno.
+inline int SyncFile(int fd)
+{
+#if defined(_WIN32)
+    return (_commit(fd) == 0) ? 0 : errno;
+#elif defined(__APPLE__)
+    return (::fsync(fd) == 0) ? 0 : errno;
+#else
+    return (::fdatasync(fd) == 0) ? 0 : errno;
+#endif
+}
+
+inline int CloseFile(int fd)
+{
+#ifdef _WIN32
+    return (_close(fd) == 0) ? 0 : errno;
+#else
+    return (::close(fd) == 0) ? 0 : errno;
+#endif
+}
+
+} // namespace detail
+
+
+// Thread safety: None (the background flush thread is internal).
+class FileLineWriter
+{
+public:
+    static constexpr std::size_t kDefaultBufferSize = 1024 * 1024;
+
+    FileLineWriter() = default;
+    // Throws FileOpenException if the file can't be opened.
+    explicit FileLineWriter(std::string file_name, WriteMode mode = WriteMode::Truncate)
+    {
+        TryOpen(std::move(file_name), mode).ThrowIfFailed();
+    }
+
+    // Closes the file, but can't report errors; call Close() for that.
+    ~FileLineWriter()
+    {
+        try
+        {
+            Close();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    FileLineWriter(FileLineWriter const&) = delete;
+    FileLineWriter& operator=(FileLineWriter const&) = delete;
+
+    void Open(std::string file_name, WriteMode mode = WriteMode::Truncate)
+    {
+        TryOpen(std::move(file_name), mode).ThrowIfFailed();
+    }
+
+    // Same as Open(), but doesn't throw; see open_result.h.
+    OpenResult TryOpen(std::string file_name, WriteMode mode = WriteMode::Truncate);
+
+    bool IsOpen() const { return fd_ >= 0; }
+    std::string GetFileName() const { return file_name_; }
+
+    // These should be set before the first write.
+    void SetBufferSize(std::size_t size)
+    {
+        assert(size > 0);
+        assert(current_.used == 0);
+        buffer_size_ = size;
+        if (IsOpen())
+        {
+            current_.data.resize(size);
+        }
+    }
+    void SetSyncPolicy(SyncPolicy policy) { sync_policy_ = policy; }
+    // Writes on a background thread, with up to max_queued full buffers
+    // waiting to be written. 0 (the default) means no background thread.
+    void SetBackgroundFlush(std::size_t max_queued)
+    {
+        assert(!flusher_.joinable());
+        max_queued_ = max_queued;
+    }
+
+    // Writes line, followed by '\n'.
+    void WriteLine(boost::string_ref line)
+    {
+        if (line.size() < current_.data.size() - current_.used)
+        {
+            std::memcpy(&current_.data[current_.used], line.data(), line.size());
+            current_.used += line.size();
+            current_.data[current_.used++] = '\n';
+        }
+        else
+        {
+            WriteSlow(line, true);
+        }
+
+        ++lines_;
+        bytes_ += line.size() + 1;
+    }
+
+    // Writes text as is, e.g., a chunk of lines that already have their
+    // delimiters.
+    void Write(boost::string_ref text)
+    {
+        if (text.size() <= current_.data.size() - current_.used)
+        {
+            std::memcpy(&current_.data[current_.used], text.data(), text.size());
+            current_.used += text.size();
+        }
+        else
+        {
+            WriteSlow(text, false);
+        }
+
+        bytes_ += text.size();
+    }
+
+    // Writes text as is, straight from where it is, after everything written
+    // so far; it's never copied into the buffer.
+    void WriteDirect(boost::string_ref text);
+
+    // Everything written so far goes to the file (and, with
+    // SyncPolicy::OnFlush, to the disk).
+    void Flush();
+
+    // Flushes, syncs (unless SyncPolicy::None) and closes the file. The file
+    // is closed even if this throws.
+    void Close();
+
+    unsigned long long GetLineCount() const { return lines_; }
+    // Bytes written by the client, whether they're in the file yet, or not.
+    unsigned long long GetBytesWritten() const { return bytes_; }
+private:
+    struct Buffer
+    {
+        std::vector<char> data;
+        std::size_t used = 0;
+    };
+
+    void WriteSlow(boost::string_ref text, bool new_line);
+    // Hands over current_, full or not, to be written, and gets an empty one.
+    int Submit();
+    // Waits until the background thread has written everything submitted.
+    int WaitIdle();
+    int FlushBuffers();
+    void StopFlusher();
+    void RunFlusher();
+
+    void ThrowIfFailed(int error_number) const
+    {
+        if (error_number != 0)
+        {
+            std::string reason = std::system_category().message(error_number);
+            std::string message = "Error writing file " + file_name_ + ": " + reason;
+            PCBLUESY_THROW(FileWriteException() << error_message(message), 0,
+                "Error writing file %s: %s", file_name_.c_str(), reason.c_str());
+        }
+    }
+
+    std::string file_name_;
+    int fd_ = -1;
+    std::size_t buffer_size_ = kDefaultBufferSize;
+    SyncPolicy sync_policy_ = SyncPolicy::None;
+    std::size_t max_queued_ = 0;
+    Buffer current_;
+    unsigned long long lines_ = 0;
+    unsigned long long bytes_ = 0;
+
+    // Background flushing. Everything below flusher_ is guarded by mutex_.
+    std::thread flusher_;
+    std::mutex mutex_;
+    std::condition_variable work_ready_;
+    std::condition_variable work_done_;
+    std::deque<Buffer> queue_;
+    std::vector<Buffer> free_;
+    bool writing_ = false;
+    bool stopping_ = false;
+    int error_ = 0;
+};
+
+
+inline OpenResult FileLineWriter::TryOpen(std::string file_name, WriteMode mode)
+{
+    assert(!IsOpen());
+
+    file_name_ = std::move(file_name);
+    int flags = O_WRONLY | O_CREAT | ((mode == WriteMode::Append) ? O_APPEND : O_TRUNC);
+#ifdef _WIN32
+    flags |= _O_BINARY;
+    fd_ = _open(file_name_.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+    flags |= O_CLOEXEC;
+    do
+    {
+        fd_ = ::open(file_name_.c_str(), flags, 0666);
+    } while ((fd_ < 0) && (errno == EINTR));
+#endif
+
+    if (fd_ < 0)
+    {
+        return OpenResult{errno, file_name_};
+    }
+
+    current_.data.resize(buffer_size_);
+    current_.used = 0;
+    lines_ = bytes_ = 0;
+    error_ = 0;
+    return OpenResult{};
+}
+
+
+inline void FileLineWriter::Flush()
+{
+    assert(IsOpen());
+
+    int error_number = FlushBuffers();
+    if ((error_number == 0) && (sync_policy_ == SyncPolicy::OnFlush))
+    {
+        error_number = detail::SyncFile(fd_);
+    }
+
+    ThrowIfFailed(error_number);
+}
+
+
+inline void FileLineWriter::Close()
+{
+    if (!IsOpen())
+    {
+        return;
+    }
+
+    int error_number = FlushBuffers();
+    StopFlusher();
+
+    if ((error_number == 0) && (sync_policy_ != SyncPolicy::None))
+    {
+        error_number = detail::SyncFile(fd_);
+    }
+
+    int close_error = detail::CloseFile(fd_);
+    fd_ = -1;
+    current_.used = 0;
+
+    ThrowIfFailed((error_number != 0) ? error_number : close_error);
+}
+
+
+inline void FileLineWriter::WriteSlow(boost::string_ref text, bool new_line)
+{
+    assert(IsOpen());
+
+    // A long line, with no one else touching the file: write it from where
+    // it is, along with what's buffered.
+    if ((max_queued_ == 0) && (text.size() >= buffer_size_ / 2))
+    {
+        detail::WriteSegment segs[3] = {
+            {current_.data.data(), current_.used}, {text.data(), text.size()}, {"\n", new_line ? 1u : 0u}};
+        current_.used = 0;
+        ThrowIfFailed(detail::WriteSegments(fd_, segs, 3));
+        return;
+    }
+
+    while (!text.empty())
+    {
+        std::size_t n = std::min(text.size(), current_.data.size() - current_.used);
+        std::memcpy(&current_.data[current_.used], text.data(), n);
+        current_.used += n;
+        text.remove_prefix(n);
+
+        if (current_.used == current_.data.size())
+        {
+            ThrowIfFailed(Submit());
+        }
+    }
+
+    if (new_line)
+    {
+        // The buffer may be full, e.g., an empty line right after one that
+        // ended at the buffer's end.
+        if (current_.used == current_.data.size())
+        {
+            ThrowIfFailed(Submit());
+        }
+        current_.data[current_.used++] = '\n';
+    }
+}
+
+
+inline void FileLineWriter::WriteDirect(boost::string_ref text)
+{
+    assert(IsOpen());
+
+    // The background thread must be done with what's queued, and current_
+    // handed over, before we write to the file ourselves.
+    if (max_queued_ != 0)
+    {
+        ThrowIfFailed(FlushBuffers());
+    }
+
+    detail::WriteSegment segs[2] = {{current_.data.data(), current_.used}, {text.data(), text.size()}};
+    current_.used = 0;
+    ThrowIfFailed(detail::WriteSegments(fd_, segs, 2));
+
+    bytes_ += text.size();
+}
+
+
+inline int FileLineWriter::Submit()
+{
+    if (current_.used == 0)
+    {
+        return 0;
+    }
+
+    if (max_queued_ == 0)
+    {
+        detail::WriteSegment seg{current_.data.data(), current_.used};
+        current_.used = 0;
+        return detail::WriteSegments(fd_, &seg, 1);
+    }
+
+    std::unique_lock<std::mutex> lock{mutex_};
+
+    if (!flusher_.joinable())
+    {
+        stopping_ = false;
+        flusher_ = std::thread{&FileLineWriter::RunFlusher, this};
+    }
+
+    work_done_.wait(lock, [this] { return (queue_.size() < max_queued_) || (error_ != 0); });
+    if (error_ != 0)
+    {
+        return error_;
+    }
+
+    queue_.push_back(std::move(current_));
+    if (free_.empty())
+    {
+        current_ = Buffer{};
+        current_.data.resize(buffer_size_);
+    }
+    else
+    {
+        current_ = std::move(free_.back());
+        free_.pop_back();
+    }
+    current_.used = 0;
+
+    work_ready_.notify_one();
+    return 0;
+}
+
+
+inline int FileLineWriter::WaitIdle()
+{
+    if (!flusher_.joinable())
+    {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock{mutex_};
+    work_done_.wait(lock, [this] { return (queue_.empty() && !writing_) || (error_ != 0); });
+    return error_;
+}
+
+
+inline int FileLineWriter::FlushBuffers()
+{
+    int error_number = Submit();
+    return (error_number != 0) ? error_number : WaitIdle();
+}
+
+
+inline void FileLineWriter::StopFlusher()
+{
+    if (!flusher_.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stopping_ = true;
+    }
+    work_ready_.notify_one();
+    flusher_.join();
+
+    queue_.clear();
+    free_.clear();
+}
+
+
+// Takes everything queued, and writes it with as few writev()s as possible.
+// After an error, buffers are dropped unwritten, so the client doesn't wait
+// on a file it can no longer write to.
+inline void FileLineWriter::RunFlusher()
+{
+    std::vector<Buffer> batch;
+    std::vector<detail::WriteSegment> segs;
+    std::unique_lock<std::mutex> lock{mutex_};
+
+    for (;;)
+    {
+        work_ready_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+        if (queue_.empty())
+        {
+            return;
+        }
+
+        while (!queue_.empty())
+        {
+            batch.push_back(std::move(queue_.front()));
+            queue_.pop_front();
+        }
+        writing_ = true;
+        bool failed = (error_ != 0);
+        lock.unlock();
+
+        int error_number = 0;
+        if (!failed)
+        {
+            segs.clear();
+            for (auto const& b : batch)
+            {
+                segs.push_back(detail::WriteSegment{b.data.data(), b.used});
+            }
+            error_number = detail::WriteSegments(fd_, segs.data(), segs.size());
+        }
+
+        lock.lock();
+        if (error_number != 0)
+        {
+            error_ = error_number;
+        }
+        for (auto& b : batch)
+        {
+            b.used = 0;
+            free_.push_back(std::move(b));
+        }
+        batch.clear();
+        writing_ = false;
+        work_done_.notify_all();
+    }
+}
+
+} // namespace utils
+}}}
+
+#endif // FILE_LINE_WRITER_H
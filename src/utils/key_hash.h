@@ -0,0 +1,83 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KEY_HASH_H
+#define KEY_HASH_H
+
+// 64-bit hash for short keys (IDs, session IDs, etc.), shared by the line
+// aggregator's hash table and the key sketches. Not cryptographic, and not
+// stable across platforms with different byte orders; it's meant for
+// in-memory tables, and for sketches combined on the same platform.
+
+#include <boost/utility/string_ref.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+// Word at a time, for speed on short keys; then a final mix, so that every
+// bit of the result depends on every bit of the key (sketches use both the
+// low and the high bits).
+inline std::uint64_t HashKey(boost::string_ref key)
+{
+    std::uint64_t const k = 0x9E3779B97F4A7C15ull;
+    std::uint64_t h = key.size() * k;
+    char const* p = key.data();
+    std::size_t len = key.size();
+
+    for (; len >= 8; p += 8, len -= 8)
+    {
+        std::uint64_t w;
+        std::memcpy(&w, p, 8);
+        h = (h ^ w) * k;
+        h ^= h >> 32;
+    }
+
+    if (len > 0)
+    {
+        std::uint64_t w = 0;
+        std::memcpy(&w, p, len);
+        h = (h ^ w) * k;
+    }
+
+    h ^= h >> 30;
+    h *= 0xBF58476D1CE4E5B9ull;
+    h ^= h >> 27;
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 31;
+    return h;
+}
+
+} // namespace utils
+}}}
+
+#endif // KEY_HASH_H
@@ -0,0 +1,799 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KEY_SKETCHES_H
+#define KEY_SKETCHES_H
+
+// Approximate per-key statistics in bounded memory, for when there are too
+// many distinct keys (e.g., session IDs) for an exact map:
+//  - HyperLogLog: how many distinct keys. 2^precision bytes, with a standard
+//      error of about 1.04 / sqrt(2^precision) (0.8% for the default 14).
+//  - CountMinSketch: how many times a key was seen. Never underestimates;
+//      overestimates by at most e * total / width, with probability
+//      1 - e^-depth (98% for the default 4).
+//  - SpaceSaving: the top keys, and their counts. Any key seen more than
+//      total / capacity times is kept; each count overestimates by at most
+//      the error kept with it.
+//
+// All of them can be merged (e.g., per-thread sketches, or daily sketches
+// into a weekly one), and written to/read from a stream. Sketches can only be
+// merged with sketches of the same parameters. The serialized format is in
+// the platform's byte order, like the line index.
+//
+// Keys are hashed with HashKey(); ForEachLineKey() extracts them from a
+// FileLineReader's lines, with a LineKey.
+
+#include "utils/exception.h"
+#include "utils/key_hash.h"
+#include "utils/line_aggregator.h"
+
+#include <boost/utility/string_ref.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+// Calls f(boost::string_ref) with the key of each line read from flr, from
+// its current position to the end of the file. Lines with no key are
+// skipped. Returns how many keys there were.
+template <typename Reader, typename Fn>
+unsigned long long ForEachLineKey(Reader& flr, LineKey const& key, Fn f)
+{
+    unsigned long long keys = 0;
+    boost::string_ref k;
+
+    while (flr.ReadLine())
+    {
+        if (key.Extract(flr.GetCurrentLine(), k))
+        {
+            f(k);
+            ++keys;
+        }
+    }
+
+    return keys;
+}
+
+
+namespace detail
+{
+
+template <typename T>
+void WritePod(std::ostream& out, T const& v)
+{
+    out.write(reinterpret_cast<char const*>(&v), sizeof(v));
+}
+
+template <typename T>
+void ReadPod(std::istream& in, T& v)
+{
+    if (!in.read(reinterpret_cast<char*>(&v), sizeof(v)))
+    {
+        BOOST_THROW_EXCEPTION(FileReadException() << error_message("Truncated sketch"));
+    }
+}
+
+// Sketches read back are bounded by these, and by what's left in the stream,
+// so a corrupt one throws, instead of asking for terabytes.
+std::uint64_t const maxReadCounters = std::uint64_t{1} << 28;
+std::uint64_t const maxReadCapacity = std::uint64_t{1} << 24;
+
+// What's left in in, or the most an std::uint64_t holds, if in can't seek.
+inline std::uint64_t GetRemaining(std::istream& in)
+{
+    std::istream::pos_type pos = in.tellg();
+    if (pos == std::istream::pos_type(-1))
+    {
+        return std::numeric_limits<std::uint64_t>::max();
+    }
+
+    in.seekg(0, std::ios_base::end);
+    std::istream::pos_type end = in.tellg();
+    in.seekg(pos);
+
+    if (!in || (end == std::istream::pos_type(-1)))
+    {
+        BOOST_THROW_EXCEPTION(FileReadException() << error_message("Truncated sketch"));
+    }
+    return static_cast<std::uint64_t>(end - pos);
+}
+
+// Takes bytes from remaining, throwing if there aren't that many.
+inline void TakeRemaining(std::uint64_t& remaining, std::uint64_t bytes)
+{
+    if (bytes > remaining)
+    {
+        BOOST_THROW_EXCEPTION(FileReadException() << error_message("Truncated sketch"));
+    }
+    remaining -= bytes;
+}
+
+inline void ReadMagic(std::istream& in, char const (&magic)[8])
+{
+    char m[8];
+
+    if (!in.read(m, sizeof(m)) || (std::memcmp(m, magic, sizeof(m)) != 0))
+    {
+        BOOST_THROW_EXCEPTION(FileReadException() << error_message("Invalid sketch"));
+    }
+}
+
+inline void ThrowMismatch(char const* sketch)
+{
+    BOOST_THROW_EXCEPTION(SketchException() <<
+        error_message(std::string{"Can't merge "} + sketch + "es with different parameters"));
+}
+
+char const hllMagic[8] = {'P', 'C', 'B', 'S', 'H', 'L', 'L', '1'};
+char const cmsMagic[8] = {'P', 'C', 'B', 'S', 'C', 'M', 'S', '1'};
+char const ssMagic[8] = {'P', 'C', 'B', 'S', 'S', 'P', 'S', '1'};
+
+} // namespace detail
+
+
+// Thread safety: None. Use one per thread, and Merge().
+class HyperLogLog
+{
+public:
+    static unsigned const kMinPrecision = 4;
+    static unsigned const kMaxPrecision = 18;
+    static unsigned const kDefaultPrecision = 14;
+
+    // Throws SketchException if precision is out of range.
+    explicit HyperLogLog(unsigned precision = kDefaultPrecision);
+
+    void Add(boost::string_ref key) { AddHash(HashKey(key)); }
+    void AddHash(std::uint64_t hash);
+
+    double Estimate() const;
+    unsigned GetPrecision() const { return precision_; }
+
+    // Throws SketchException if the precisions differ.
+    void Merge(HyperLogLog const& other);
+
+    void WriteTo(std::ostream& out) const;
+    // Throws FileReadException if in doesn't hold a valid sketch.
+    static HyperLogLog ReadFrom(std::istream& in);
+private:
+    unsigned precision_;
+    std::vector<std::uint8_t> registers_;
+};
+
+
+inline HyperLogLog::HyperLogLog(unsigned precision) : precision_{precision}
+{
+    if ((precision < kMinPrecision) || (precision > kMaxPrecision))
+    {
+        BOOST_THROW_EXCEPTION(SketchException() << error_message("Invalid HyperLogLog precision"));
+    }
+
+    registers_.assign(std::size_t{1} << precision, 0);
+}
+
+inline void HyperLogLog::AddHash(std::uint64_t hash)
+{
+    // The top bits pick the register, the rest give the rank - the position
+    // of the first 1 bit. The sentinel bit caps the rank, when the rest is 0.
+    std::size_t r = static_cast<std::size_t>(hash >> (64 - precision_));
+    std::uint64_t rest = (hash << precision_) | (std::uint64_t{1} << (precision_ - 1));
+    std::uint8_t rank = static_cast<std::uint8_t>(__builtin_clzll(rest) + 1);
+
+    if (rank > registers_[r])
+    {
+        registers_[r] = rank;
+    }
+}
+
+inline double HyperLogLog::Estimate() const
+{
+    double const m = static_cast<double>(registers_.size());
+    double sum = 0;
+    std::size_t zeros = 0;
+
+    for (auto r : registers_)
+    {
+        sum += std::ldexp(1.0, -static_cast<int>(r));
+        zeros += (r == 0) ? 1 : 0;
+    }
+
+    double alpha = (registers_.size() == 16) ? 0.673 : (registers_.size() == 32) ? 0.697 :
+        (registers_.size() == 64) ? 0.709 : 0.7213 / (1 + 1.079 / m);
+    double e = alpha * m * m / sum;
+
+    // Small cardinalities: linear counting is more accurate. With a 64-bit
+    // hash, there's no need for a large range correction.
+    if ((e <= 2.5 * m) && (zeros > 0))
+    {
+        e = m * std::log(m / static_cast<double>(zeros));
+    }
+
+    return e;
+}
+
+inline void HyperLogLog::Merge(HyperLogLog const& other)
+{
+    if (other.precision_ != precision_)
+    {
+        detail::ThrowMismatch("HyperLogLog");
+    }
+
+    for (std::size_t i = 0; i < registers_.size(); ++i)
+    {
+        registers_[i] = std::max(registers_[i], other.registers_[i]);
+    }
+}
+
+inline void HyperLogLog::WriteTo(std::ostream& out) const
+{
+    out.write(detail::hllMagic, sizeof(detail::hllMagic));
+    detail::WritePod(out, static_cast<std::uint32_t>(precision_));
+    out.write(reinterpret_cast<char const*>(registers_.data()), static_cast<std::streamsize>(registers_.size()));
+}
+
+inline HyperLogLog HyperLogLog::ReadFrom(std::istream& in)
+{
+    detail::ReadMagic(in, detail::hllMagic);
+
+    std::uint32_t precision = 0;
+    detail::ReadPod(in, precision);
+    if ((precision < kMinPrecision) || (precision > kMaxPrecision))
+    {
+        BOOST_THROW_EXCEPTION(FileReadException() << error_message("Invalid sketch"));
+    }
+
+    HyperLogLog h{precision};
+    if (!in.read(reinterpret_cast<char*>(h.registers_.data()), static_cast<std::streamsize>(h.registers_.size())))
+    {
+        BOOST_THROW_EXCEPTION(FileReadException() << error_message("Truncated sketch"));
+    }
+
+    return h;
+}
+
+
+// Thread safety: None. Use one per thread, and Merge().
+class CountMinSketch
+{
+public:
+    // Throws SketchException if width or depth is 0.
+    explicit CountMinSketch(std::size_t width = 1 << 16, std::size_t depth = 4);
+
+    void Add(boost::string_ref key, unsigned long long count = 1) { AddHash(HashKey(key), count); }
+    void AddHash(std::uint64_t hash, unsigned long long count = 1);
+
+    unsigned long long Estimate(boost::string_ref key) const { return EstimateHash(HashKey(key)); }
+    unsigned long long EstimateHash(std::uint64_t hash) const;
+
+    // Sum of all the counts added.
+    unsigned long long GetTotal() const { return total_; }
+    std::size_t GetWidth() const { return width_; }
+    std::size_t GetDepth() const { return depth_; }
+
+    // Throws SketchException if the widths or depths differ.
+    void Merge(CountMinSketch const& other);
+
+    void WriteTo(std::ostream& out) const;
+    // Throws FileReadException if in doesn't hold a valid sketch.
+    static CountMinSketch ReadFrom(std::istream& in);
+private:
+    // Each row's column comes from the same hash (Kirsch-Mitzenmacher:
+    // h1 + row * h2), instead of hashing the key depth times.
+    std::size_t Column(std::uint64_t hash, std::size_t row) const
+    {
+        std::uint64_t h1 = hash & 0xFFFFFFFFull;
+        std::uint64_t h2 = (hash >> 32) | 1;
+        return static_cast<std::size_t>((h1 + row * h2) % width_);
+    }
+
+    std::size_t width_;
+    std::size_t depth_;
+    unsigned long long total_ = 0;
+    std::vector<unsigned long long> counters_;
+};
+
+
+inline CountMinSketch::CountMinSketch(std::size_t width, std::size_t depth) : width_{width}, depth_{depth}
+{
+    if ((width == 0) || (depth == 0) || (width > std::numeric_limits<std::size_t>::max() / depth))
+    {
+        BOOST_THROW_EXCEPTION(SketchException() << error_message("Invalid Count-Min sketch size"));
+    }
+
+    counters_.assign(width * depth, 0);
+}
+
+inline void CountMinSketch::AddHash(std::uint64_t hash, unsigned long long count)
+{
+    for (std::size_t row = 0; row < depth_; ++row)
+    {
+        counters_[row * width_ + Column(hash, row)] += count;
+    }
+
+    total_ += count;
+}
+
+inline unsigned long long CountMinSketch::EstimateHash(std::uint64_t hash) const
+{
+    unsigned long long estimate = std::numeric_limits<unsigned long long>::max();
+
+    for (std::size_t row = 0; row < depth_; ++row)
+    {
+        estimate = std::min(estimate, counters_[row * width_ + Column(hash, row)]);
+    }
+
+    return estimate;
+}
+
+inline void CountMinSketch::Merge(CountMinSketch const& other)
+{
+    if ((other.width_ != width_) || (other.depth_ != depth_))
+    {
+        detail::ThrowMismatch("Count-Min sketch");
+    }
+
+    for (std::size_t i = 0; i < counters_.size(); ++i)
+    {
+        counters_[i] += other.counters_[i];
+    }
+
+    total_ += other.total_;
+}
+
+inline void CountMinSketch::WriteTo(std::ostream& out) const
+{
+    out.write(detail::cmsMagic, sizeof(detail::cmsMagic));
+    detail::WritePod(out, static_cast<std::uint64_t>(width_));
+    detail::WritePod(out, static_cast<std::uint64_t>(depth_));
+    detail::WritePod(out, static_cast<std::uint64_t>(total_));
+    out.write(reinterpret_cast<char const*>(counters_.data()),
+        static_cast<std::streamsize>(counters_.size() * sizeof(counters_[0])));
+}
+
+inline CountMinSketch CountMinSketch::ReadFrom(std::istream& in)
+{
+    detail::ReadMagic(in, detail::cmsMagic);
+
+    std::uint64_t width = 0;
+    std::uint64_t depth = 0;
+    std::uint64_t total = 0;
+    detail::ReadPod(in, width);
+    detail::ReadPod(in, depth);
+    detail::ReadPod(in, total);
+
+    // Anything this large is corrupt, not a sketch we wrote.
+    if ((width == 0) || (depth == 0) || (depth > 64) || (width > detail::maxReadCounters / depth))
+    {
+        BOOST_THROW_EXCEPTION(FileReadException() << error_message("Invalid sketch"));
+    }
+    std::uint64_t remaining = detail::GetRemaining(in);
+    detail::TakeRemaining(remaining, width * depth * sizeof(unsigned long long));
+
+    CountMinSketch c{static_cast<std::size_t>(width), static_cast<std::size_t>(depth)};
+    c.total_ = total;
+    if (!in.read(reinterpret_cast<char*>(c.counters_.data()),
+        static_cast<std::streamsize>(c.counters_.size() * sizeof(c.counters_[0]))))
+    {
+        BOOST_THROW_EXCEPTION(FileReadException() << error_message("Truncated sketch"));
+    }
+
+    return c;
+}
+
+
+// The Space-Saving algorithm (Metwally et al.): we keep capacity keys, with
+// their counts; an unknown key replaces the one with the lowest count, and
+// inherits that count (as its error), plus its own.
+// Keys are found through an open addressing table, and the lowest count
+// through a min-heap, so Add() is O(log capacity), and allocates nothing
+// once the key buffers have grown to the longest key.
+// Thread safety: None. Use one per thread, and Merge().
+class SpaceSaving
+{
+public:
+    struct Item
+    {
+        std::string key;
+        // Overestimates the true count by, at most, error.
+        unsigned long long count;
+        unsigned long long error;
+    };
+
+    // Throws SketchException if capacity is 0.
+    explicit SpaceSaving(std::size_t capacity = 1000);
+
+    void Add(boost::string_ref key, unsigned long long count = 1);
+
+    // The (at most) k keys with the highest counts, highest first.
+    std::vector<Item> Top(std::size_t k) const;
+
+    // Sum of all the counts added.
+    unsigned long long GetTotal() const { return total_; }
+    std::size_t GetCapacity() const { return capacity_; }
+    std::size_t GetSize() const { return entries_.size(); }
+
+    // Keeps the capacity keys with the highest combined counts (Agarwal et
+    // al.'s mergeable summaries). A key missing from one side counts as that
+    // side's lowest count, which is the most it could have had there.
+    // Throws SketchException if the capacities differ.
+    void Merge(SpaceSaving const& other);
+
+    void WriteTo(std::ostream& out) const;
+    // Throws FileReadException if in doesn't hold a valid sketch.
+    static SpaceSaving ReadFrom(std::istream& in);
+private:
+    struct Entry
+    {
+        std::string key;
+        std::uint64_t hash;
+        unsigned long long count;
+        unsigned long long error;
+        std::size_t heap_pos;
+    };
+
+    // The lowest count a missing key could have had.
+    unsigned long long GetFloor() const
+    { return (entries_.size() < capacity_) ? 0 : entries_[heap_[0]].count; }
+
+    // Index into entries_ of key, or entries_.size() if it's not there.
+    std::size_t FindEntry(boost::string_ref key, std::uint64_t hash) const;
+    std::size_t FindSlot(boost::string_ref key, std::uint64_t hash) const;
+    void InsertSlot(std::size_t entry);
+    void EraseSlot(std::size_t entry);
+    void SiftDown(std::size_t pos);
+    void SiftUp(std::size_t pos);
+    void Assign(std::vector<Item> items);
+
+    std::size_t capacity_;
+    unsigned long long total_ = 0;
+    std::vector<Entry> entries_;
+    // Min-heap of indexes into entries_, by count.
+    std::vector<std::size_t> heap_;
+    // Index into entries_, plus 1 (so 0 means empty).
+    std::vector<std::size_t> slots_;
+};
+
+
+inline SpaceSaving::SpaceSaving(std::size_t capacity) : capacity_{capacity}
+{
+    if (capacity == 0)
+    {
+        BOOST_THROW_EXCEPTION(SketchException() << error_message("Invalid Space-Saving capacity"));
+    }
+
+    // At most half full.
+    std::size_t slots = 16;
+    while (slots < capacity * 2)
+    {
+        slots *= 2;
+    }
+
+    entries_.reserve(capacity);
+    heap_.reserve(capacity);
+    slots_.assign(slots, 0);
+}
+
+inline void SpaceSaving::Add(boost::string_ref key, unsigned long long count)
+{
+    std::uint64_t hash = HashKey(key);
+    std::size_t e = FindEntry(key, hash);
+    total_ += count;
+
+    if (e != entries_.size())
+    {
+        entries_[e].count += count;
+        SiftDown(entries_[e].heap_pos);
+        return;
+    }
+
+    if (entries_.size() < capacity_)
+    {
+        entries_.push_back(Entry{key.to_string(), hash, count, 0, heap_.size()});
+        heap_.push_back(entries_.size() - 1);
+        InsertSlot(entries_.size() - 1);
+        SiftUp(heap_.size() - 1);
+        return;
+    }
+
+    // Take over the entry with the lowest count. assign() reuses its buffer.
+    e = heap_[0];
+    EraseSlot(e);
+
+    Entry& min = entries_[e];
+    min.key.assign(key.data(), key.size());
+    min.hash = hash;
+    min.error = min.count;
+    min.count += count;
+
+    InsertSlot(e);
+    SiftDown(0);
+}
+
+inline std::vector<SpaceSaving::Item> SpaceSaving::Top(std::size_t k) const
+{
+    std::vector<Item> items;
+    items.reserve(entries_.size());
+
+    for (auto const& e : entries_)
+    {
+        items.push_back(Item{e.key, e.count, e.error});
+    }
+
+    std::sort(items.begin(), items.end(), [](Item const& l, Item const& r)
+        { return (l.count != r.count) ? (l.count > r.count) : (l.key < r.key); });
+
+    if (items.size() > k)
+    {
+        items.resize(k);
+    }
+
+    return items;
+}
+
+inline void SpaceSaving::Merge(SpaceSaving const& other)
+{
+    if (other.capacity_ != capacity_)
+    {
+        detail::ThrowMismatch("Space-Saving sketch");
+    }
+
+    unsigned long long floor = GetFloor();
+    unsigned long long other_floor = other.GetFloor();
+    std::vector<Item> items;
+    items.reserve(entries_.size() + other.entries_.size());
+
+    for (auto const& e : entries_)
+    {
+        std::size_t o = other.FindEntry(e.key, e.hash);
+        bool theirs = (o != other.entries_.size());
+        items.push_back(Item{e.key, e.count + (theirs ? other.entries_[o].count : other_floor),
+            e.error + (theirs ? other.entries_[o].error : other_floor)});
+    }
+
+    for (auto const& o : other.entries_)
+    {
+        if (FindEntry(o.key, o.hash) == entries_.size())
+        {
+            items.push_back(Item{o.key, o.count + floor, o.error + floor});
+        }
+    }
+
+    std::sort(items.begin(), items.end(), [](Item const& l, Item const& r) { return l.count > r.count; });
+    if (items.size() > capacity_)
+    {
+        items.resize(capacity_);
+    }
+
+    unsigned long long total = total_ + other.total_;
+    Assign(std::move(items));
+    total_ = total;
+}
+
+inline void SpaceSaving::WriteTo(std::ostream& out) const
+{
+    out.write(detail::ssMagic, sizeof(detail::ssMagic));
+    detail::WritePod(out, static_cast<std::uint64_t>(capacity_));
+    detail::WritePod(out, static_cast<std::uint64_t>(total_));
+    detail::WritePod(out, static_cast<std::uint64_t>(entries_.size()));
+
+    for (auto const& e : entries_)
+    {
+        detail::WritePod(out, static_cast<std::uint64_t>(e.count));
+        detail::WritePod(out, static_cast<std::uint64_t>(e.error));
+        detail::WritePod(out, static_cast<std::uint32_t>(e.key.size()));
+        out.write(e.key.data(), static_cast<std::streamsize>(e.key.size()));
+    }
+}
+
+inline SpaceSaving SpaceSaving::ReadFrom(std::istream& in)
+{
+    detail::ReadMagic(in, detail::ssMagic);
+
+    std::uint64_t capacity = 0;
+    std::uint64_t total = 0;
+    std::uint64_t size = 0;
+    detail::ReadPod(in, capacity);
+    detail::ReadPod(in, total);
+    detail::ReadPod(in, size);
+
+    // Anything this large is corrupt, not a sketch we wrote.
+    if ((capacity == 0) || (capacity > detail::maxReadCapacity) || (size > capacity))
+    {
+        BOOST_THROW_EXCEPTION(FileReadException() << error_message("Invalid sketch"));
+    }
+    // Each item takes at least its count, error and key length; checked for
+    // all of them before allocating, and then item by item, with its key.
+    std::uint64_t const itemSize = 2 * sizeof(std::uint64_t) + sizeof(std::uint32_t);
+    std::uint64_t remaining = detail::GetRemaining(in);
+    std::uint64_t atLeast = remaining;
+    detail::TakeRemaining(atLeast, size * itemSize);
+
+    std::vector<Item> items(static_cast<std::size_t>(size));
+    for (auto& i : items)
+    {
+        std::uint64_t count = 0;
+        std::uint64_t error = 0;
+        std::uint32_t length = 0;
+        detail::ReadPod(in, count);
+        detail::ReadPod(in, error);
+        detail::ReadPod(in, length);
+
+        i.count = count;
+        i.error = error;
+        detail::TakeRemaining(remaining, itemSize + length);
+        i.key.resize(length);
+        if ((length > 0) && !in.read(&i.key[0], length))
+        {
+            BOOST_THROW_EXCEPTION(FileReadException() << error_message("Truncated sketch"));
+        }
+    }
+
+    SpaceSaving s{static_cast<std::size_t>(capacity)};
+    s.Assign(std::move(items));
+    s.total_ = total;
+    return s;
+}
+
+inline std::size_t SpaceSaving::FindEntry(boost::string_ref key, std::uint64_t hash) const
+{
+    std::size_t s = FindSlot(key, hash);
+    return (slots_[s] == 0) ? entries_.size() : slots_[s] - 1;
+}
+
+// The slot holding key, or the empty slot where it would go.
+inline std::size_t SpaceSaving::FindSlot(boost::string_ref key, std::uint64_t hash) const
+{
+    std::size_t const mask = slots_.size() - 1;
+
+    for (std::size_t s = static_cast<std::size_t>(hash) & mask; ; s = (s + 1) & mask)
+    {
+        if ((slots_[s] == 0) ||
+            ((entries_[slots_[s] - 1].hash == hash) && (entries_[slots_[s] - 1].key == key)))
+        {
+            return s;
+        }
+    }
+}
+
+inline void SpaceSaving::InsertSlot(std::size_t entry)
+{
+    Entry const& e = entries_[entry];
+    slots_[FindSlot(e.key, e.hash)] = entry + 1;
+}
+
+// Backward shift deletion: the entries after the hole, up to the next empty
+// slot, move back if the hole is between them and their home slot. No
+// tombstones, so lookups don't slow down as keys come and go.
+inline void SpaceSaving::EraseSlot(std::size_t entry)
+{
+    std::size_t const mask = slots_.size() - 1;
+    std::size_t hole = FindSlot(entries_[entry].key, entries_[entry].hash);
+
+    for (std::size_t s = (hole + 1) & mask; slots_[s] != 0; s = (s + 1) & mask)
+    {
+        std::size_t home = static_cast<std::size_t>(entries_[slots_[s] - 1].hash) & mask;
+
+        // Is home cyclically outside (hole, s]?
+        bool moves = (hole <= s) ? ((home <= hole) || (home > s)) : ((home <= hole) && (home > s));
+        if (moves)
+        {
+            slots_[hole] = slots_[s];
+            hole = s;
+        }
+    }
+
+    slots_[hole] = 0;
+}
+
+inline void SpaceSaving::SiftDown(std::size_t pos)
+{
+    for (;;)
+    {
+        std::size_t smallest = pos;
+        std::size_t l = 2 * pos + 1;
+        std::size_t r = l + 1;
+
+        if ((l < heap_.size()) && (entries_[heap_[l]].count < entries_[heap_[smallest]].count))
+        {
+            smallest = l;
+        }
+        if ((r < heap_.size()) && (entries_[heap_[r]].count < entries_[heap_[smallest]].count))
+        {
+            smallest = r;
+        }
+        if (smallest == pos)
+        {
+            return;
+        }
+
+        std::swap(heap_[pos], heap_[smallest]);
+        entries_[heap_[pos]].heap_pos = pos;
+        entries_[heap_[smallest]].heap_pos = smallest;
+        pos = smallest;
+    }
+}
+
+inline void SpaceSaving::SiftUp(std::size_t pos)
+{
+    while (pos > 0)
+    {
+        std::size_t parent = (pos - 1) / 2;
+
+        if (entries_[heap_[parent]].count <= entries_[heap_[pos]].count)
+        {
+            return;
+        }
+
+        std::swap(heap_[pos], heap_[parent]);
+        entries_[heap_[pos]].heap_pos = pos;
+        entries_[heap_[parent]].heap_pos = parent;
+        pos = parent;
+    }
+}
+
+// Replaces the contents with items (at most capacity_ of them).
+inline void SpaceSaving::Assign(std::vector<Item> items)
+{
+    entries_.clear();
+    heap_.clear();
+    std::fill(slots_.begin(), slots_.end(), 0);
+    total_ = 0;
+
+    for (auto& i : items)
+    {
+        std::uint64_t hash = HashKey(i.key);
+
+        // A corrupt sketch could repeat a key.
+        if (FindEntry(i.key, hash) != entries_.size())
+        {
+            continue;
+        }
+
+        entries_.push_back(Entry{std::move(i.key), hash, i.count, i.error, heap_.size()});
+        heap_.push_back(entries_.size() - 1);
+        InsertSlot(entries_.size() - 1);
+        SiftUp(heap_.size() - 1);
+        total_ += i.count;
+    }
+}
+
+} // namespace utils
+}}}
+
+#endif // KEY_SKETCHES_H
@@ -0,0 +1,621 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef LINE_AGGREGATOR_H
+#define LINE_AGGREGATOR_H
+
+// Streaming group-by over a file's lines: each line's key is extracted (by
+// field, or by what follows an anchor), and each key gets its line count,
+// first and last timestamps, and a histogram of the time between consecutive
+// lines. E.g., for "[2014-01-01 00:00:00.100] match-1 This is line 1", with
+// LineKey::Field(2), the key is "match-1".
+//
+// This replaces reading into a std::map<std::string, ...>, which allocates a
+// node and a string per key, and compares strings on each level of the tree.
+// Here, groups live in an open addressing hash table (linear probing, with
+// the hash kept in the slot, so probes rarely touch the keys), and the keys
+// are interned, back to back, in a single buffer. Once a key has been seen,
+// adding one of its lines doesn't allocate.
+//
+// For parallel scans, each thread aggregates part of the file into its own
+// LineAggregator, and the partials are merged, in file order, with Merge().
+// AggregateFile() does all of this, over newline-aligned chunks.
+
+#include "utils/exception.h"
+#include "utils/file_chunks.h"
+#include "utils/file_line_reader.h"
+#include "utils/key_hash.h"
+
+#include <boost/utility/string_ref.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <ios>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+// Where a line's key is.
+class LineKey
+{
+public:
+    // The index-th field (0 based), fields being separated by runs of delim.
+    static LineKey Field(std::size_t index, char delim = ' ')
+    { return LineKey{index, std::string{}, delim}; }
+
+    // What follows the first occurrence of anchor, up to the next delim.
+    static LineKey After(std::string anchor, char delim = ' ')
+    { return LineKey{0, std::move(anchor), delim}; }
+
+    // The whole line.
+    static LineKey Whole()
+    { return LineKey{kWholeLine, std::string{}, '\n'}; }
+
+    // Returns false if the line has no key (e.g., too few fields), or if
+    // it's empty.
+    bool Extract(boost::string_ref line, boost::string_ref& key) const;
+private:
+    static std::size_t const kWholeLine = static_cast<std::size_t>(-1);
+
+    LineKey(std::size_t index, std::string anchor, char delim) :
+        index_{index}, anchor_{std::move(anchor)}, delim_{delim} { }
+
+    std::size_t index_;
+    std::string anchor_;
+    char delim_;
+};
+
+
+inline bool LineKey::Extract(boost::string_ref line, boost::string_ref& key) const
+{
+    if (index_ == kWholeLine)
+    {
+        key = line;
+        return !key.empty();
+    }
+
+    std::size_t begin = 0;
+
+    if (!anchor_.empty())
+    {
+        begin = line.find(anchor_);
+        if (begin == boost::string_ref::npos)
+        {
+            return false;
+        }
+        begin += anchor_.size();
+    }
+    else
+    {
+        for (std::size_t field = 0; ; ++field)
+        {
+            while ((begin < line.size()) && (line[begin] == delim_))
+            {
+                ++begin;
+            }
+
+            if (field == index_)
+            {
+                break;
+            }
+
+            while ((begin < line.size()) && (line[begin] != delim_))
+            {
+                ++begin;
+            }
+        }
+    }
+
+    std::size_t end = begin;
+    while ((end < line.size()) && (line[end] != delim_))
+    {
+        ++end;
+    }
+
+    key = line.substr(begin, end - begin);
+    return !key.empty();
+}
+
+
+// Timestamp policy for lines that begin with "[YYYY-MM-DD HH:MM:SS.fff]" (the
+// brackets and fraction are optional). Parse() gets milliseconds since the
+// epoch, with no time zone conversion.
+struct BracketedTimestamp
+{
+    bool Parse(boost::string_ref line, std::int64_t& ms) const;
+};
+
+
+// Timestamp policy for when we only want counts.
+struct NoTimestamp
+{
+    bool Parse(boost::string_ref, std::int64_t&) const { return false; }
+};
+
+
+namespace detail
+{
+
+// Reads exactly n digits.
+inline bool ParseDigits(boost::string_ref s, std::size_t& pos, std::size_t n, int& value)
+{
+    if (s.size() - pos < n)
+    {
+        return false;
+    }
+
+    value = 0;
+    for (std::size_t end = pos + n; pos < end; ++pos)
+    {
+        if ((s[pos] < '0') || (s[pos] > '9'))
+        {
+            return false;
+        }
+        value = value * 10 + (s[pos] - '0');
+    }
+
+    return true;
+}
+
+inline bool ParseChar(boost::string_ref s, std::size_t& pos, char c)
+{
+    if ((pos < s.size()) && (s[pos] == c))
+    {
+        ++pos;
+        return true;
+    }
+
+    return false;
+}
+
+// Days since 1970-01-01, in the proleptic Gregorian calendar (Howard
+// Hinnant's days_from_civil()).
+inline std::int64_t DaysFromCivil(int y, int m, int d)
+{
+    y -= (m <= 2) ? 1 : 0;
+    int const era = ((y >= 0) ? y : y - 399) / 400;
+    int const yoe = y - era * 400;
+    int const doy = (153 * (m + ((m > 2) ? -3 : 9)) + 2) / 5 + d - 1;
+    int const doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return static_cast<std::int64_t>(era) * 146097 + doe - 719468;
+}
+
+} // namespace detail
+
+
+inline bool BracketedTimestamp::Parse(boost::string_ref line, std::int64_t& ms) const
+{
+    std::size_t pos = 0;
+    int y, mo, d, h, mi, s;
+
+    detail::ParseChar(line, pos, '[');
+    if (!detail::ParseDigits(line, pos, 4, y) || !detail::ParseChar(line, pos, '-') ||
+        !detail::ParseDigits(line, pos, 2, mo) || !detail::ParseChar(line, pos, '-') ||
+        !detail::ParseDigits(line, pos, 2, d) ||
+        !(detail::ParseChar(line, pos, ' ') || detail::ParseChar(line, pos, 'T')) ||
+        !detail::ParseDigits(line, pos, 2, h) || !detail::ParseChar(line, pos, ':') ||
+        !detail::ParseDigits(line, pos, 2, mi) || !detail::ParseChar(line, pos, ':') ||
+        !detail::ParseDigits(line, pos, 2, s) ||
+        (mo < 1) || (mo > 12) || (d < 1) || (d > 31))
+    {
+        return false;
+    }
+
+    int frac = 0;
+    if (detail::ParseChar(line, pos, '.') || detail::ParseChar(line, pos, ','))
+    {
+        // Only the first 3 digits matter.
+        int scale = 100;
+        for (; (pos < line.size()) && (line[pos] >= '0') && (line[pos] <= '9'); ++pos)
+        {
+            frac += (line[pos] - '0') * scale;
+            scale /= 10;
+        }
+    }
+
+    ms = ((detail::DaysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + s) * 1000) + frac;
+    return true;
+}
+
+
+// Histogram of the time between consecutive lines of a group: bucket 0 holds
+// deltas of 0 ms (or negative, i.e., lines out of order), and bucket i holds
+// deltas in [2^(i-1), 2^i) ms. The last bucket also holds anything longer.
+std::size_t const kDeltaBuckets = 40;
+
+struct GroupStats
+{
+    unsigned long long lines = 0;
+    // Lines that had a timestamp. Times and deltas only count these.
+    unsigned long long timed_lines = 0;
+    std::int64_t first_ms = 0;
+    std::int64_t last_ms = 0;
+    std::array<unsigned long long, kDeltaBuckets> delta_histogram{};
+
+    void AddDelta(std::int64_t delta)
+    {
+        std::size_t bucket = 0;
+
+        if (delta > 0)
+        {
+            bucket = 64 - static_cast<std::size_t>(__builtin_clzll(static_cast<unsigned long long>(delta)));
+            bucket = std::min(bucket, kDeltaBuckets - 1);
+        }
+
+        ++delta_histogram[bucket];
+    }
+
+    void AddTime(std::int64_t ms)
+    {
+        if (timed_lines == 0)
+        {
+            first_ms = ms;
+        }
+        else
+        {
+            AddDelta(ms - last_ms);
+        }
+
+        last_ms = ms;
+        ++timed_lines;
+    }
+};
+
+
+// Thread safety: None. Use one per thread, and Merge().
+template <typename Timestamp = BracketedTimestamp>
+class BasicLineAggregator
+{
+public:
+    explicit BasicLineAggregator(LineKey key, Timestamp timestamp = Timestamp{}) :
+        key_{std::move(key)}, timestamp_{timestamp} { }
+
+    // Returns false if the line has no key. Those lines are only counted.
+    bool AddLine(boost::string_ref line);
+
+    // Adds every line in text (e.g., a chunk of a file).
+    void AddLines(boost::string_ref text);
+
+    // Adds later's groups to ours. later must have aggregated the lines
+    // that came after ours, so that first/last times and the delta between
+    // our last line and later's first line come out right.
+    void Merge(BasicLineAggregator const& later);
+
+    std::size_t GetGroupCount() const { return groups_.size(); }
+    unsigned long long GetLineCount() const { return lines_; }
+    unsigned long long GetKeylessLineCount() const { return keyless_lines_; }
+
+    // nullptr if there's no such group.
+    GroupStats const* Find(boost::string_ref key) const;
+
+    // Calls f(boost::string_ref key, GroupStats const&) for each group, in
+    // the order their keys were first seen.
+    template <typename Fn>
+    void ForEachGroup(Fn f) const
+    {
+        for (auto const& g : groups_)
+        {
+            f(boost::string_ref{keys_.data() + g.key_offset, g.key_length}, g.stats);
+        }
+    }
+private:
+    struct Group
+    {
+        std::size_t key_offset;
+        std::size_t key_length;
+        GroupStats stats;
+    };
+
+    struct Slot
+    {
+        std::uint64_t hash;
+        // Index into groups_, plus 1 (so 0 means empty).
+        std::size_t group;
+    };
+
+    std::size_t FindSlot(boost::string_ref key, std::uint64_t hash) const;
+    GroupStats& GetGroup(boost::string_ref key);
+    void Grow();
+
+    LineKey key_;
+    Timestamp timestamp_;
+    std::vector<Slot> slots_;
+    std::vector<Group> groups_;
+    std::string keys_;
+    unsigned long long lines_ = 0;
+    unsigned long long keyless_lines_ = 0;
+};
+
+using LineAggregator = BasicLineAggregator<>;
+
+
+template <typename Timestamp>
+bool BasicLineAggregator<Timestamp>::AddLine(boost::string_ref line)
+{
+    ++lines_;
+
+    boost::string_ref key;
+    if (!key_.Extract(line, key))
+    {
+        ++keyless_lines_;
+        return false;
+    }
+
+    GroupStats& g = GetGroup(key);
+    ++g.lines;
+
+    std::int64_t ms = 0;
+    if (timestamp_.Parse(line, ms))
+    {
+        g.AddTime(ms);
+    }
+
+    return true;
+}
+
+
+template <typename Timestamp>
+void BasicLineAggregator<Timestamp>::AddLines(boost::string_ref text)
+{
+    char const* p = text.data();
+    char const* end = p + text.size();
+
+    while (p != end)
+    {
+        char const* nl = static_cast<char const*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        char const* line_end = (nl == nullptr) ? end : nl;
+
+        AddLine(boost::string_ref{p, static_cast<std::size_t>(line_end - p)});
+        p = (nl == nullptr) ? end : nl + 1;
+    }
+}
+
+
+template <typename Timestamp>
+void BasicLineAggregator<Timestamp>::Merge(BasicLineAggregator const& later)
+{
+    lines_ += later.lines_;
+    keyless_lines_ += later.keyless_lines_;
+
+    later.ForEachGroup([this](boost::string_ref key, GroupStats const& theirs)
+    {
+        GroupStats& ours = GetGroup(key);
+
+        if (theirs.timed_lines > 0)
+        {
+            if (ours.timed_lines == 0)
+            {
+                ours.first_ms = theirs.first_ms;
+            }
+            else
+            {
+                ours.AddDelta(theirs.first_ms - ours.last_ms);
+            }
+            ours.last_ms = theirs.last_ms;
+        }
+
+        ours.lines += theirs.lines;
+        ours.timed_lines += theirs.timed_lines;
+        for (std::size_t i = 0; i < kDeltaBuckets; ++i)
+        {
+            ours.delta_histogram[i] += theirs.delta_histogram[i];
+        }
+    });
+}
+
+
+template <typename Timestamp>
+GroupStats const* BasicLineAggregator<Timestamp>::Find(boost::string_ref key) const
+{
+    if (slots_.empty())
+    {
+        return nullptr;
+    }
+
+    std::size_t s = FindSlot(key, HashKey(key));
+    return (slots_[s].group == 0) ? nullptr : &groups_[slots_[s].group - 1].stats;
+}
+
+
+// The slot holding key, or the empty slot where it would go.
+template <typename Timestamp>
+std::size_t BasicLineAggregator<Timestamp>::FindSlot(boost::string_ref key, std::uint64_t hash) const
+{
+    std::size_t const mask = slots_.size() - 1;
+
+    for (std::size_t s = static_cast<std::size_t>(hash) & mask; ; s = (s + 1) & mask)
+    {
+        Slot const& slot = slots_[s];
+
+        if (slot.group == 0)
+        {
+            return s;
+        }
+
+        if (slot.hash == hash)
+        {
+            Group const& g = groups_[slot.group - 1];
+            if ((g.key_length == key.size()) && (std::memcmp(keys_.data() + g.key_offset, key.data(), key.size()) == 0))
+            {
+                return s;
+            }
+        }
+    }
+}
+
+
+template <typename Timestamp>
+GroupStats& BasicLineAggregator<Timestamp>::GetGroup(boost::string_ref key)
+{
+    // At most half full, so probe sequences stay short.
+    if ((groups_.size() + 1) * 2 > slots_.size())
+    {
+        Grow();
+    }
+
+    std::uint64_t hash = HashKey(key);
+    std::size_t s = FindSlot(key, hash);
+
+    if (slots_[s].group == 0)
+    {
+        groups_.push_back(Group{keys_.size(), key.size(), GroupStats{}});
+        keys_.append(key.data(), key.size());
+        slots_[s] = Slot{hash, groups_.size()};
+    }
+
+    return groups_[slots_[s].group - 1].stats;
+}
+
+
+template <typename Timestamp>
+void BasicLineAggregator<Timestamp>::Grow()
+{
+    std::vector<Slot> old;
+    old.swap(slots_);
+    slots_.assign(old.empty() ? 64 : old.size() * 2, Slot{0, 0});
+
+    std::size_t const mask = slots_.size() - 1;
+    for (auto const& slot : old)
+    {
+        if (slot.group != 0)
+        {
+            // Keys are unique, so we only need an empty slot.
+            std::size_t s = static_cast<std::size_t>(slot.hash) & mask;
+            while (slots_[s].group != 0)
+            {
+                s = (s + 1) & mask;
+            }
+            slots_[s] = slot;
+        }
+    }
+}
+
+
+// Aggregates the whole file, using up to thread_count threads (0 means one
+// per core). The file is split into newline-aligned chunks of about
+// chunk_size bytes, and each thread takes a contiguous run of chunks, so the
+// partials can be merged in file order.
+// Throws FileOpenException/FileReadException if the file can't be read.
+template <typename Timestamp = BracketedTimestamp>
+BasicLineAggregator<Timestamp> AggregateFile(std::string const& file_name, LineKey const& key,
+    unsigned thread_count = 0, std::streamoff chunk_size = 4 * 1024 * 1024, Timestamp timestamp = Timestamp{})
+{
+    std::vector<FileChunk> chunks;
+    {
+        FileLineReader<> flr{file_name};
+        chunks = SplitLineChunks(flr, chunk_size);
+    }
+
+    unsigned threads = (thread_count > 0) ? thread_count : std::max(std::thread::hardware_concurrency(), 1u);
+    threads = static_cast<unsigned>(std::max<std::size_t>(std::min<std::size_t>(threads, chunks.size()), 1));
+
+    std::vector<BasicLineAggregator<Timestamp>> partials(threads, BasicLineAggregator<Timestamp>{key, timestamp});
+    std::vector<std::exception_ptr> errors(threads);
+
+    auto run = [&](unsigned t)
+    {
+        try
+        {
+            std::ifstream in{file_name, std::ios_base::in | std::ios_base::binary};
+            if (!in)
+            {
+                BOOST_THROW_EXCEPTION(FileOpenException() << error_message("Error opening file " + file_name));
+            }
+
+            std::string buf;
+            for (std::size_t i = chunks.size() * t / threads; i < chunks.size() * (t + 1) / threads; ++i)
+            {
+                if (!ReadFileChunk(in, chunks[i], buf))
+                {
+                    BOOST_THROW_EXCEPTION(FileReadException() << error_message("Error reading file " + file_name));
+                }
+                partials[t].AddLines(buf);
+            }
+        }
+        catch (...)
+        {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    try
+    {
+        for (unsigned t = 1; t < threads; ++t)
+        {
+            workers.emplace_back(run, t);
+        }
+    }
+    catch (...)
+    {
+        for (auto& w : workers)
+        {
+            w.join();
+        }
+        throw;
+    }
+
+    // This thread takes the first run of chunks.
+    run(0);
+
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+
+    for (auto const& e : errors)
+    {
+        if (e)
+        {
+            std::rethrow_exception(e);
+        }
+    }
+
+    for (unsigned t = 1; t < threads; ++t)
+    {
+        partials[0].Merge(partials[t]);
+    }
+
+    return std::move(partials[0]);
+}
+
+} // namespace utils
+}}}
+
+#endif // LINE_AGGREGATOR_H
@@ -0,0 +1,518 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+// Inverted index over a text file (e.g., a daily log), for files that don't
+// change and are queried over and over: instead of scanning the whole file
+// for each query, we look up the offsets of the lines holding a term, and
+// seek straight to them with FileLineReader::SeekToLine().
+//
+// Terms are tokens - maximal runs of ASCII letters, digits, '_' and '-', and
+// non-ASCII bytes (so UTF-8 words are tokens, too). E.g., "[2014-01-01
+// 00:00:00.100] match-1 This is line 1" has the terms "2014-01-01", "00",
+// "100", "match-1", "This", "is", "line" and "1". Case matters. Tokens longer
+// than kMaxTermLength aren't indexed.
+// The index answers whole term queries. A LineMatches() substring query maps
+// onto a term query when the substring is a term (e.g., "match-1" finds
+// "match-1", but not "match-10").
+//
+// Index file format (the platform's byte order, as for options snapshots):
+//  - Header: magic, source file size and modification time, line count, term
+//      count, and the offsets of the term pool and the postings.
+//  - Dictionary: one fixed size entry per term, sorted by term, so a lookup
+//      is a binary search over the mapped file.
+//  - Term pool: the terms' chars.
+//  - Postings: for each term, the offsets of the lines holding it, in file
+//      order, as deltas from the previous offset, in LEB128 varints. Most
+//      deltas take 1-3 bytes, instead of 8.
+// The index is mapped, not read, so opening it costs the same for any size,
+// and a query only touches its term's dictionary path and postings.
+
+#include "base/temp_name.h"
+#include "utils/exception.h"
+#include "utils/varint.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#pragma GCC diagnostic pop
+#include <boost/utility/string_ref.hpp>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+std::size_t const kMaxTermLength = 64;
+
+
+inline bool IsTermChar(char c)
+{
+    unsigned char uc = static_cast<unsigned char>(c);
+    return ((uc >= 'a') && (uc <= 'z')) || ((uc >= 'A') && (uc <= 'Z')) || ((uc >= '0') && (uc <= '9')) ||
+        (uc == '_') || (uc == '-') || (uc >= 0x80);
+}
+
+// Calls f(boost::string_ref) for each indexable term in line.
+template <typename Fn>
+void ForEachTerm(boost::string_ref line, Fn f)
+{
+    std::size_t const len = line.size();
+    std::size_t i = 0;
+
+    while (i < len)
+    {
+        while ((i < len) && !IsTermChar(line[i]))
+        {
+            ++i;
+        }
+
+        std::size_t begin = i;
+        while ((i < len) && IsTermChar(line[i]))
+        {
+            ++i;
+        }
+
+        if ((i > begin) && (i - begin <= kMaxTermLength))
+        {
+            f(line.substr(begin, i - begin));
+        }
+    }
+}
+
+
+namespace detail
+{
+
+char const lineIndexMagic[8] = {'P', 'C', 'B', 'L', 'I', 'D', 'X', '1'};
+
+struct LineIndexHeader
+{
+    char magic[8];
+    std::uint64_t source_size;
+    std::int64_t source_mod_time;
+    std::uint64_t lines;
+    std::uint64_t terms;
+    std::uint64_t pool_offset;
+    std::uint64_t postings_offset;
+    std::uint64_t reserved;
+};
+
+struct LineIndexEntry
+{
+    std::uint64_t term_offset;
+    std::uint32_t term_length;
+    std::uint32_t lines;
+    std::uint64_t postings_offset;
+    std::uint64_t postings_size;
+};
+
+inline bool GetFileIdentity(std::string const& file_name, std::uint64_t& size, std::int64_t& mod_time)
+{
+    struct stat st;
+
+    if (stat(file_name.c_str(), &st) != 0)
+    {
+        return false;
+    }
+
+    size = static_cast<std::uint64_t>(st.st_size);
+    mod_time = static_cast<std::int64_t>(st.st_mtime);
+    return true;
+}
+
+} // namespace detail
+
+
+// Builds the index of the lines read from a FileLineReader, from its current
+// position to the end of the file, and writes it to index_file. The index is
+// written to a temporary file, unique to this call, and renamed, so a process
+// querying the old index never maps a partial one, and builds of the same
+// index at the same time don't write over each other's.
+// Postings are kept in memory, already encoded, until the index is written;
+// they usually take a fraction of the file's size.
+// Throws FileReadException if the file's size and modification time can't
+// be taken (the index would never match the file), and FileWriteException if
+// the index can't be written.
+template <typename Reader>
+std::uint64_t BuildLineIndex(Reader& flr, std::string const& index_file)
+{
+    struct Postings
+    {
+        std::string encoded;
+        // Offset of the last line added, plus 1 (so 0 means none).
+        std::uint64_t last = 0;
+        std::uint32_t lines = 0;
+    };
+
+    std::unordered_map<std::string, Postings> terms;
+    std::uint64_t lines = 0;
+    // Reused, so looking up a term we already have doesn't allocate.
+    std::string key;
+
+    while (flr.ReadLine())
+    {
+        std::uint64_t offset = static_cast<std::uint64_t>(flr.GetCurrentLineOffset());
+        ++lines;
+
+        ForEachTerm(flr.GetCurrentLine(), [&](boost::string_ref term)
+        {
+            key.assign(term.data(), term.size());
+            Postings& p = terms[key];
+
+            // The same term, more than once in the line.
+            if (p.last == offset + 1)
+            {
+                return;
+            }
+
+            AppendVarint(p.encoded, (p.last == 0) ? offset : offset - (p.last - 1));
+            p.last = offset + 1;
+            ++p.lines;
+        });
+    }
+
+    using TermIt = typename std::unordered_map<std::string, Postings>::const_iterator;
+    std::vector<TermIt> sorted;
+    sorted.reserve(terms.size());
+    for (auto it = terms.cbegin(); it != terms.cend(); ++it)
+    {
+        sorted.push_back(it);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](TermIt l, TermIt r) { return l->first < r->first; });
+
+    detail::LineIndexHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, detail::lineIndexMagic, sizeof(h.magic));
+    if (!detail::GetFileIdentity(flr.GetFileName(), h.source_size, h.source_mod_time))
+    {
+        BOOST_THROW_EXCEPTION(FileReadException() <<
+            error_message("Error getting the size and modification time of file " + flr.GetFileName()));
+    }
+    h.lines = lines;
+    h.terms = sorted.size();
+    h.pool_offset = sizeof(h) + sorted.size() * sizeof(detail::LineIndexEntry);
+    h.postings_offset = h.pool_offset;
+    for (auto const& t : sorted)
+    {
+        h.postings_offset += t->first.size();
+    }
+
+    std::string tmp_name = base::UniqueTempName(index_file);
+    {
+        std::ofstream out{tmp_name, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary};
+        out.write(reinterpret_cast<char const*>(&h), sizeof(h));
+
+        std::uint64_t term_offset = 0;
+        std::uint64_t postings_offset = 0;
+        for (auto const& t : sorted)
+        {
+            detail::LineIndexEntry e;
+            e.term_offset = term_offset;
+            e.term_length = static_cast<std::uint32_t>(t->first.size());
+            e.lines = t->second.lines;
+            e.postings_offset = postings_offset;
+            e.postings_size = t->second.encoded.size();
+            out.write(reinterpret_cast<char const*>(&e), sizeof(e));
+
+            term_offset += e.term_length;
+            postings_offset += e.postings_size;
+        }
+
+        for (auto const& t : sorted)
+        {
+            out.write(t->first.data(), static_cast<std::streamsize>(t->first.size()));
+        }
+
+        for (auto const& t : sorted)
+        {
+            out.write(t->second.encoded.data(), static_cast<std::streamsize>(t->second.encoded.size()));
+        }
+
+        if (!out.flush())
+        {
+            out.close();
+            std::remove(tmp_name.c_str());
+            BOOST_THROW_EXCEPTION(FileWriteException() << error_message("Error writing file " + tmp_name));
+        }
+    }
+
+#ifdef _WIN32
+    // On Windows, rename() won't replace an existing file.
+    std::remove(index_file.c_str());
+#endif
+    if (std::rename(tmp_name.c_str(), index_file.c_str()) != 0)
+    {
+        std::remove(tmp_name.c_str());
+        BOOST_THROW_EXCEPTION(FileWriteException() << error_message("Error writing file " + index_file));
+    }
+
+    return lines;
+}
+
+
+// An index written by BuildLineIndex(), mapped into memory.
+// Thread safety: Queries are const, and can run concurrently.
+class LineIndex
+{
+public:
+    // Throws FileOpenException if the index can't be mapped, and
+    // FileReadException if it's not an index, or it's corrupt.
+    explicit LineIndex(std::string const& index_file);
+
+    // Was the index built from file_name, as it is now (same size and
+    // modification time)?
+    bool IsCurrentFor(std::string const& file_name) const;
+
+    std::uint64_t GetLineCount() const { return header_.lines; }
+    std::uint64_t GetTermCount() const { return header_.terms; }
+
+    // How many lines hold term. Doesn't touch the postings.
+    std::uint64_t CountLines(boost::string_ref term) const;
+
+    // Offsets of the lines holding term, in file order.
+    std::vector<std::streamoff> Find(boost::string_ref term) const;
+
+    // Offsets of the lines holding all the terms, in file order. Rarest
+    // terms first, so the candidates only shrink.
+    std::vector<std::streamoff> FindAll(std::vector<std::string> const& terms) const;
+private:
+    detail::LineIndexEntry const* Lookup(boost::string_ref term) const;
+    void Decode(detail::LineIndexEntry const& e, std::vector<std::streamoff>& out) const;
+    void ThrowCorrupt() const;
+
+    std::string file_name_;
+    boost::interprocess::mapped_region region_;
+    detail::LineIndexHeader header_;
+    unsigned char const* data_ = nullptr;
+    std::size_t size_ = 0;
+    detail::LineIndexEntry const* entries_ = nullptr;
+};
+
+
+inline LineIndex::LineIndex(std::string const& index_file) : file_name_{index_file}
+{
+    namespace bip = boost::interprocess;
+
+    try
+    {
+        bip::file_mapping file{index_file.c_str(), bip::read_only};
+        bip::mapped_region{file, bip::read_only}.swap(region_);
+    }
+    catch (bip::interprocess_exception const&)
+    {
+        BOOST_THROW_EXCEPTION(FileOpenException() << error_message("Error opening file " + index_file));
+    }
+
+    data_ = static_cast<unsigned char const*>(region_.get_address());
+    size_ = region_.get_size();
+
+    if (size_ < sizeof(header_))
+    {
+        ThrowCorrupt();
+    }
+    std::memcpy(&header_, data_, sizeof(header_));
+
+    // Everything a lookup relies on. Postings are checked as they're decoded.
+    std::uint64_t dictionary_end = sizeof(header_) + header_.terms * sizeof(detail::LineIndexEntry);
+    if ((std::memcmp(header_.magic, detail::lineIndexMagic, sizeof(header_.magic)) != 0) ||
+        (header_.terms > size_ / sizeof(detail::LineIndexEntry)) ||
+        (header_.pool_offset != dictionary_end) || (header_.postings_offset < header_.pool_offset) ||
+        (header_.postings_offset > size_))
+    {
+        ThrowCorrupt();
+    }
+
+    // mapped_region's address is page aligned, and so are the entries, after
+    // the header.
+    entries_ = reinterpret_cast<detail::LineIndexEntry const*>(data_ + sizeof(header_));
+
+    for (std::uint64_t i = 0; i < header_.terms; ++i)
+    {
+        if (entries_[i].term_offset + entries_[i].term_length > header_.postings_offset - header_.pool_offset)
+        {
+            ThrowCorrupt();
+        }
+    }
+}
+
+inline bool LineIndex::IsCurrentFor(std::string const& file_name) const
+{
+    std::uint64_t size = 0;
+    std::int64_t mod_time = 0;
+
+    return detail::GetFileIdentity(file_name, size, mod_time) &&
+        (size == header_.source_size) && (mod_time == header_.source_mod_time);
+}
+
+inline std::uint64_t LineIndex::CountLines(boost::string_ref term) const
+{
+    detail::LineIndexEntry const* e = Lookup(term);
+    return (e == nullptr) ? 0 : e->lines;
+}
+
+inline std::vector<std::streamoff> LineIndex::Find(boost::string_ref term) const
+{
+    std::vector<std::streamoff> offsets;
+    detail::LineIndexEntry const* e = Lookup(term);
+
+    if (e != nullptr)
+    {
+        Decode(*e, offsets);
+    }
+
+    return offsets;
+}
+
+inline std::vector<std::streamoff> LineIndex::FindAll(std::vector<std::string> const& terms) const
+{
+    std::vector<detail::LineIndexEntry const*> entries;
+
+    for (auto const& t : terms)
+    {
+        detail::LineIndexEntry const* e = Lookup(t);
+
+        if (e == nullptr)
+        {
+            return std::vector<std::streamoff>{};
+        }
+        entries.push_back(e);
+    }
+
+    std::sort(entries.begin(), entries.end(),
+        [](detail::LineIndexEntry const* l, detail::LineIndexEntry const* r) { return l->lines < r->lines; });
+
+    std::vector<std::streamoff> result;
+    std::vector<std::streamoff> next;
+    std::vector<std::streamoff> both;
+
+    if (!entries.empty())
+    {
+        Decode(*entries[0], result);
+    }
+
+    for (std::size_t i = 1; (i < entries.size()) && !result.empty(); ++i)
+    {
+        next.clear();
+        both.clear();
+        Decode(*entries[i], next);
+        std::set_intersection(result.begin(), result.end(), next.begin(), next.end(), std::back_inserter(both));
+        result.swap(both);
+    }
+
+    return result;
+}
+
+inline detail::LineIndexEntry const* LineIndex::Lookup(boost::string_ref term) const
+{
+    char const* pool = reinterpret_cast<char const*>(data_ + header_.pool_offset);
+    auto termOf = [pool](detail::LineIndexEntry const& e)
+    { return boost::string_ref{pool + e.term_offset, e.term_length}; };
+
+    detail::LineIndexEntry const* end = entries_ + header_.terms;
+    detail::LineIndexEntry const* it = std::lower_bound(entries_, end, term,
+        [&termOf](detail::LineIndexEntry const& e, boost::string_ref t) { return termOf(e) < t; });
+
+    return ((it != end) && (termOf(*it) == term)) ? it : nullptr;
+}
+
+inline void LineIndex::Decode(detail::LineIndexEntry const& e, std::vector<std::streamoff>& out) const
+{
+    std::uint64_t postings_size = size_ - header_.postings_offset;
+
+    if ((e.postings_offset > postings_size) || (e.postings_size > postings_size - e.postings_offset))
+    {
+        ThrowCorrupt();
+    }
+
+    unsigned char const* p = data_ + header_.postings_offset + e.postings_offset;
+    unsigned char const* end = p + e.postings_size;
+    std::uint64_t offset = 0;
+
+    out.reserve(out.size() + e.lines);
+    while (p != end)
+    {
+        std::uint64_t delta = 0;
+
+        if (!ReadVarint(p, end, delta))
+        {
+            ThrowCorrupt();
+        }
+
+        offset += delta;
+        out.push_back(static_cast<std::streamoff>(offset));
+    }
+}
+
+inline void LineIndex::ThrowCorrupt() const
+{
+    BOOST_THROW_EXCEPTION(FileReadException() << error_message("Invalid line index " + file_name_));
+}
+
+
+// Reads the lines at offsets (e.g., from LineIndex::Find()) from flr, writing
+// them to out. Returns how many lines it read.
+template <typename Reader, typename OutputIt>
+std::size_t ReadLinesAt(Reader& flr, std::vector<std::streamoff> const& offsets, OutputIt out)
+{
+    std::size_t read = 0;
+
+    for (auto o : offsets)
+    {
+        if (!flr.SeekToLine(o) || !flr.ReadLine())
+        {
+            break;
+        }
+
+        *out++ = flr.GetCurrentLine();
+        ++read;
+    }
+
+    return read;
+}
+
+} // namespace utils
+}}}
+
+#endif // LINE_INDEX_H
@@ -0,0 +1,369 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef LINE_LENGTH_H
+#define LINE_LENGTH_H
+
+// Line length policies for FileLineReader.
+//
+// UnboundedLineLength is the default, and keeps the original behaviour - the
+// current line grows as much as needed to hold the longest line in the file.
+//
+// BoundedLineLength caps the memory used per reader. No line longer than
+// GetMaxLineLength() is ever held in memory; what happens to longer lines
+// depends on the LongLineAction:
+//  - Truncate: The current line holds the first GetMaxLineLength() chars; the
+//      rest is discarded.
+//  - Split: The line is delivered in segments of, at most, GetMaxLineLength()
+//      chars, one per ReadLine(). Only the first segment counts as a line.
+//  - Skip: The line is skipped, and the next line is read instead. Skipped
+//      lines are still counted, and reported through GetLongLineCount().
+//
+// When a FileLineReader matches a truncated line, or the first segment of a
+// split line, it streams over the rest of the line, chunk by chunk, so the
+// match result reflects the whole line. This assumes LineMatcher looks for match
+// as a substring (as SimpleLineMatcher does); consecutive chunks overlap by
+// match.size() - 1 chars, so a match can't fall through the cracks.
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <string>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+// What a LineLength policy read from the file.
+struct LineReadResult
+{
+    // Did we get a line (or a segment of a line)?
+    bool read = false;
+    // Is it the beginning of a line, i.e., should it be counted?
+    bool new_line = false;
+    // Bytes consumed from the file, including delimiters and skipped lines.
+    std::size_t bytes = 0;
+    // Bytes consumed for the line we got, including the delimiter. The
+    // line begins at bytes - line_bytes from where we started reading.
+    std::size_t line_bytes = 0;
+    // Length of what was placed in the current line.
+    std::size_t length = 0;
+    // Long lines skipped before we got to this one.
+    unsigned long skipped_lines = 0;
+};
+
+
+enum class LongLineAction { Truncate, Split, Skip };
+
+
+// Default line length policy - no limit.
+// Like NoLineCounter, it supplies the whole interface, so FileLineReader
+// doesn't have to care which policy it's using.
+struct UnboundedLineLength
+{
+    void SetMaxLineLength(std::size_t) { }
+    std::size_t GetMaxLineLength() const { return std::numeric_limits<std::size_t>::max(); }
+    unsigned long long GetLongLineCount() const { return 0; }
+
+    bool IsLinePartial() const { return false; }
+    bool IsLineContinuation() const { return false; }
+    bool IsRestOfLinePending() const { return false; }
+
+    LineReadResult ReadSegment(std::istream& in, std::string& line)
+    {
+        LineReadResult r;
+        r.read = r.new_line = static_cast<bool>(getline(in, line, in.widen('\n')));
+
+        if (r.read)
+        {
+            // If we hit EOF, the last line had no delimiter.
+            r.bytes = r.line_bytes = line.size() + (in.eof() ? 0 : 1);
+            r.length = line.size();
+        }
+
+        return r;
+    }
+
+    LineReadResult DiscardRestOfLine(std::istream&) { return LineReadResult{}; }
+    void ResetLine() { }
+
+    template <typename MatchFn>
+    bool RestOfLineMatches(std::istream&, std::string const&, MatchFn, std::size_t) const
+    { return false; }
+};
+
+
+// Thread safety: None. Memory use is bounded by about 3 * GetMaxLineLength()
+// (the chunk buffer, the reader's current line, and the matching window),
+// plus the size of the longest match string.
+template <LongLineAction Action>
+class BoundedLineLength
+{
+public:
+    static constexpr std::size_t kDefaultMaxLineLength = 1024 * 1024;
+
+    // Should be set before the first read.
+    void SetMaxLineLength(std::size_t max_line_length)
+    {
+        assert(max_line_length > 0);
+        assert(!pending_);
+
+        max_line_length_ = max_line_length;
+        chunk_.reset();
+    }
+
+    std::size_t GetMaxLineLength() const { return max_line_length_; }
+
+    // How many lines were longer than GetMaxLineLength(). With
+    // LongLineAction::Skip, this is how many lines were skipped.
+    unsigned long long GetLongLineCount() const { return long_lines_; }
+
+    // The current line is not a whole line - it was truncated, or it's a segment.
+    bool IsLinePartial() const { return partial_; }
+    // The current line is a segment, other than the first, of a split line.
+    bool IsLineContinuation() const { return continuation_; }
+    // Part of the current line is still in the file.
+    bool IsRestOfLinePending() const { return pending_; }
+
+    LineReadResult ReadSegment(std::istream& in, std::string& line);
+
+    // Moves past the rest of the current line, without reading it into memory.
+    LineReadResult DiscardRestOfLine(std::istream& in);
+
+    // Forgets about the current line, e.g., because the stream was repositioned.
+    void ResetLine()
+    {
+        pending_ = partial_ = continuation_ = false;
+        have_line_end_ = false;
+    }
+
+    // Streams over the rest of the current line, calling matches() on each chunk.
+    // The stream position is restored before returning, so this doesn't change
+    // what ReadSegment()/DiscardRestOfLine() will do next.
+    template <typename MatchFn>
+    bool RestOfLineMatches(std::istream& in, std::string const& line, MatchFn matches,
+        std::size_t overlap) const;
+private:
+    struct Chunk
+    {
+        std::size_t stored = 0;
+        std::size_t consumed = 0;
+        bool more = false;
+    };
+
+    bool ReadChunk(std::istream& in, Chunk& c) const;
+    std::size_t SkipToLineEnd(std::istream& in);
+
+    std::size_t max_line_length_ = kDefaultMaxLineLength;
+    unsigned long long long_lines_ = 0;
+    bool pending_ = false;
+    bool partial_ = false;
+    bool continuation_ = false;
+
+    // Scratch space, and what we learned about the current line while
+    // matching it. None of it is observable, hence mutable.
+    mutable std::unique_ptr<char[]> chunk_;
+    mutable std::string window_;
+    mutable std::streampos line_end_;
+    mutable bool have_line_end_ = false;
+};
+
+using TruncateLongLines = BoundedLineLength<LongLineAction::Truncate>;
+using SplitLongLines = BoundedLineLength<LongLineAction::Split>;
+using SkipLongLines = BoundedLineLength<LongLineAction::Skip>;
+
+
+template <LongLineAction Action>
+constexpr std::size_t BoundedLineLength<Action>::kDefaultMaxLineLength;
+
+
+template <LongLineAction Action>
+LineReadResult BoundedLineLength<Action>::ReadSegment(std::istream& in, std::string& line)
+{
+    LineReadResult r;
+
+    // A truncated line leaves its tail in the file until we move on.
+    if (pending_ && (Action != LongLineAction::Split))
+    {
+        r.bytes = DiscardRestOfLine(in).bytes;
+    }
+
+    bool starting = !pending_;
+    Chunk c;
+
+    while (ReadChunk(in, c))
+    {
+        if (c.more && starting)
+        {
+            ++long_lines_;
+
+            if (Action == LongLineAction::Skip)
+            {
+                r.bytes += c.consumed + SkipToLineEnd(in);
+                ++r.skipped_lines;
+                continue;
+            }
+        }
+
+        line.assign(chunk_.get(), c.stored);
+
+        r.read = true;
+        r.new_line = starting;
+        r.bytes += c.consumed;
+        r.line_bytes = c.consumed;
+        r.length = c.stored;
+
+        partial_ = c.more || !starting;
+        continuation_ = !starting;
+        pending_ = c.more;
+        have_line_end_ = false;
+
+        return r;
+    }
+
+    pending_ = partial_ = continuation_ = false;
+    return r;
+}
+
+
+template <LongLineAction Action>
+LineReadResult BoundedLineLength<Action>::DiscardRestOfLine(std::istream& in)
+{
+    LineReadResult r;
+
+    if (pending_)
+    {
+        r.bytes = SkipToLineEnd(in);
+        pending_ = false;
+    }
+
+    return r;
+}
+
+
+template <LongLineAction Action>
+template <typename MatchFn>
+bool BoundedLineLength<Action>::RestOfLineMatches(std::istream& in, std::string const& line,
+    MatchFn matches, std::size_t overlap) const
+{
+    assert(pending_);
+
+    std::streampos resume = in.tellg();
+
+    // window_ holds the tail of what we've already seen, followed by the next chunk.
+    std::size_t keep = std::min(overlap, line.size());
+    window_.assign(line, line.size() - keep, keep);
+
+    bool hit = false;
+    Chunk c;
+
+    while (!hit && ReadChunk(in, c))
+    {
+        window_.append(chunk_.get(), c.stored);
+        hit = matches(window_);
+
+        if (!c.more)
+        {
+            // We found the delimiter, so we can jump straight here when we discard the line.
+            if (c.consumed > c.stored)
+            {
+                line_end_ = in.tellg();
+                have_line_end_ = true;
+            }
+            break;
+        }
+
+        keep = std::min(overlap, window_.size());
+        window_.erase(0, window_.size() - keep);
+    }
+
+    in.clear();
+    in.seekg(resume);
+
+    return hit;
+}
+
+
+// Reads, at most, max_line_length_ chars of the current line into chunk_.
+// Returns false if there was nothing left to read.
+template <LongLineAction Action>
+bool BoundedLineLength<Action>::ReadChunk(std::istream& in, Chunk& c) const
+{
+    if (!chunk_)
+    {
+        chunk_.reset(new char[max_line_length_ + 1]);
+    }
+
+    in.getline(chunk_.get(), static_cast<std::streamsize>(max_line_length_ + 1), in.widen('\n'));
+    std::size_t count = static_cast<std::size_t>(in.gcount());
+
+    // getline() sets failbit when it fills the buffer without finding the
+    // delimiter. Not an error, for us - it just means the line goes on.
+    if (in.fail() && !in.eof())
+    {
+        in.clear(in.rdstate() & ~std::ios_base::failbit);
+        c.stored = c.consumed = count;
+        c.more = true;
+        return true;
+    }
+
+    if (count == 0)
+    {
+        return false;
+    }
+
+    // If we hit EOF, the last line had no delimiter.
+    c.consumed = count;
+    c.stored = in.eof() ? count : count - 1;
+    c.more = false;
+    return true;
+}
+
+
+template <LongLineAction Action>
+std::size_t BoundedLineLength<Action>::SkipToLineEnd(std::istream& in)
+{
+    if (have_line_end_)
+    {
+        std::streampos pos = in.tellg();
+        in.seekg(line_end_);
+        have_line_end_ = false;
+        return static_cast<std::size_t>(line_end_ - pos);
+    }
+
+    in.ignore(std::numeric_limits<std::streamsize>::max(), in.widen('\n'));
+    return static_cast<std::size_t>(in.gcount());
+}
+
+} // namespace utils
+}}}
+
+#endif // LINE_LENGTH_H
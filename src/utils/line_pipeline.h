@@ -0,0 +1,452 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef LINE_PIPELINE_H
+#define LINE_PIPELINE_H
+
+// Lazy pipelines over a FileLineReader.
+//
+// Lines(flr) is a source that yields each line read from flr as a
+// boost::string_ref. Stages are added with operator|:
+//
+// FileLineReader<> flr{"file.txt"};
+// for (auto line : Lines(flr) | SkipUntil("START") | Matching("ERROR") | Take(10))
+//     etc...
+//
+// Each stage is a class template parametrized on the previous stage, so the
+// whole pipeline is one type, with no virtual calls and no type erasure. Pulling
+// a line from the last stage pulls from the previous stages, all the way down
+// to ReadLine(); once inlined, this is the same loop we'd write by hand. No stage
+// allocates or copies lines, except for what a Transform() function does.
+//
+// The string_ref yielded by the source refers to the reader's current line, so
+// it's only valid until the next line is read. Copy it, if you need to keep it.
+//
+// The reader's skip functions map onto stages like this:
+//  - flr.SkipMatchingLine(m)    -> SkipMatchingLine(m)
+//  - flr.SkipMatchingLines(m)   -> DropWhile(LineMatch(m)), or SkipMatchingLines(m)
+//  - flr.SkipLinesUntilMatch(m) -> SkipUntil(m)
+//  - flr.SkipNumberLines(n)     -> Drop(n)
+// If the reader has already been positioned (e.g., by one of its own skip
+// functions), use LinesFromCurrent(flr), which yields the current line first.
+//
+// Stages are input ranges, so they can be used with range-for, or with ForEach(),
+// and a pipeline can only be traversed once.
+
+#include "utils/file_line_reader.h"
+
+#include <boost/utility/string_ref.hpp>
+
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+// Input iterator over a stage. Holds the last value pulled from the stage.
+template <typename Stage>
+class StageIterator
+{
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = typename Stage::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type const*;
+    using reference = value_type const&;
+
+    StageIterator() = default;
+    explicit StageIterator(Stage& stage) : stage_{&stage} { ++*this; }
+
+    reference operator*() const { return value_; }
+    pointer operator->() const { return &value_; }
+
+    StageIterator& operator++()
+    {
+        if (!stage_->Next(value_))
+        {
+            stage_ = nullptr;
+        }
+        return *this;
+    }
+
+    StageIterator operator++(int)
+    {
+        StageIterator prev{*this};
+        ++*this;
+        return prev;
+    }
+
+    bool operator==(StageIterator const& other) const { return stage_ == other.stage_; }
+    bool operator!=(StageIterator const& other) const { return stage_ != other.stage_; }
+private:
+    Stage* stage_ = nullptr;
+    value_type value_{};
+};
+
+
+// Common interface of all stages. Derived must define value_type and
+// bool Next(value_type&), which returns false when there's nothing left.
+template <typename Derived>
+class PipelineStage
+{
+public:
+    StageIterator<Derived> begin() { return StageIterator<Derived>{static_cast<Derived&>(*this)}; }
+    StageIterator<Derived> end() { return StageIterator<Derived>{}; }
+};
+
+
+// Calls fn for each value in the pipeline. Tighter than range-for, since
+// there's no iterator in the way.
+template <typename Stage, typename Fn>
+void ForEach(Stage&& stage, Fn fn)
+{
+    typename std::decay<Stage>::type::value_type v{};
+
+    while (stage.Next(v))
+    {
+        fn(v);
+    }
+}
+
+
+
+// Sources
+
+template <typename Reader>
+class LineSource : public PipelineStage<LineSource<Reader>>
+{
+public:
+    using value_type = boost::string_ref;
+
+    LineSource(Reader& flr, bool from_current) : flr_{&flr}, from_current_{from_current} {}
+
+    bool Next(value_type& line)
+    {
+        if (from_current_)
+        {
+            from_current_ = false;
+            if (!flr_->WasReadOK())
+            {
+                return false;
+            }
+        }
+        else if (!flr_->ReadLine())
+        {
+            return false;
+        }
+
+        line = flr_->GetCurrentLine();
+        return true;
+    }
+private:
+    Reader* flr_;
+    bool from_current_;
+};
+
+// Yields each line read from flr, starting with the next one.
+template <typename Reader>
+LineSource<Reader> Lines(Reader& flr) { return LineSource<Reader>{flr, false}; }
+
+// Yields the current line, then each line read from flr. Use this after one of
+// the reader's skip functions, so the line they stopped on isn't lost.
+template <typename Reader>
+LineSource<Reader> LinesFromCurrent(Reader& flr) { return LineSource<Reader>{flr, true}; }
+
+
+
+// Predicates
+
+// Matches a line using a LineMatcher policy. The matcher must be able to take
+// a boost::string_ref as the line.
+template <typename LineMatcher = SimpleLineMatcher>
+class LineMatchPredicate
+{
+public:
+    LineMatchPredicate(std::string match, LineMatcher matcher)
+        : match_{std::move(match)}, matcher_{std::move(matcher)} {}
+
+    bool operator()(boost::string_ref line) const
+    { return matcher_.LineMatches(line, boost::string_ref{match_}); }
+private:
+    std::string match_;
+    LineMatcher matcher_;
+};
+
+template <typename LineMatcher = SimpleLineMatcher>
+LineMatchPredicate<LineMatcher> LineMatch(std::string match, LineMatcher matcher = LineMatcher{})
+{ return LineMatchPredicate<LineMatcher>{std::move(match), std::move(matcher)}; }
+
+
+template <typename Pred>
+class NotPredicate
+{
+public:
+    explicit NotPredicate(Pred pred) : pred_(std::move(pred)) {}
+
+    template <typename T>
+    bool operator()(T const& v) const { return !pred_(v); }
+private:
+    Pred pred_;
+};
+
+
+
+// Stages, and the adaptors that create them when used with operator|.
+
+template <typename Source, typename Pred>
+class FilterStage : public PipelineStage<FilterStage<Source, Pred>>
+{
+public:
+    using value_type = typename Source::value_type;
+
+    FilterStage(Source src, Pred pred) : src_(std::move(src)), pred_(std::move(pred)) {}
+
+    bool Next(value_type& v)
+    {
+        while (src_.Next(v))
+        {
+            if (pred_(v))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+private:
+    Source src_;
+    Pred pred_;
+};
+
+template <typename Pred>
+struct FilterAdaptor { Pred pred; };
+
+// Only lines for which pred is true get through.
+template <typename Pred>
+FilterAdaptor<Pred> Filter(Pred pred) { return FilterAdaptor<Pred>{std::move(pred)}; }
+
+// Only lines matching match get through.
+template <typename LineMatcher = SimpleLineMatcher>
+FilterAdaptor<LineMatchPredicate<LineMatcher>> Matching(std::string match,
+    LineMatcher matcher = LineMatcher{})
+{ return Filter(LineMatch(std::move(match), std::move(matcher))); }
+
+template <typename Source, typename Pred>
+FilterStage<typename std::decay<Source>::type, Pred> operator|(Source&& src, FilterAdaptor<Pred> a)
+{ return {std::forward<Source>(src), std::move(a.pred)}; }
+
+
+template <typename Source, typename Fn>
+class TransformStage : public PipelineStage<TransformStage<Source, Fn>>
+{
+public:
+    using source_value_type = typename Source::value_type;
+    using value_type = typename std::decay<
+        typename std::result_of<Fn(source_value_type const&)>::type>::type;
+
+    TransformStage(Source src, Fn fn) : src_(std::move(src)), fn_(std::move(fn)) {}
+
+    bool Next(value_type& v)
+    {
+        if (!src_.Next(in_))
+        {
+            return false;
+        }
+
+        v = fn_(in_);
+        return true;
+    }
+private:
+    Source src_;
+    Fn fn_;
+    source_value_type in_{};
+};
+
+template <typename Fn>
+struct TransformAdaptor { Fn fn; };
+
+template <typename Fn>
+TransformAdaptor<Fn> Transform(Fn fn) { return TransformAdaptor<Fn>{std::move(fn)}; }
+
+template <typename Source, typename Fn>
+TransformStage<typename std::decay<Source>::type, Fn> operator|(Source&& src, TransformAdaptor<Fn> a)
+{ return {std::forward<Source>(src), std::move(a.fn)}; }
+
+
+// Stops after count values. Doesn't pull any more from the source after that,
+// so the reader is left on the last line taken.
+template <typename Source>
+class TakeStage : public PipelineStage<TakeStage<Source>>
+{
+public:
+    using value_type = typename Source::value_type;
+
+    TakeStage(Source src, unsigned long count) : src_(std::move(src)), count_{count} {}
+
+    bool Next(value_type& v)
+    {
+        if ((count_ == 0) || !src_.Next(v))
+        {
+            return false;
+        }
+
+        --count_;
+        return true;
+    }
+private:
+    Source src_;
+    unsigned long count_;
+};
+
+struct TakeAdaptor { unsigned long count; };
+
+inline TakeAdaptor Take(unsigned long count) { return TakeAdaptor{count}; }
+
+template <typename Source>
+TakeStage<typename std::decay<Source>::type> operator|(Source&& src, TakeAdaptor a)
+{ return {std::forward<Source>(src), a.count}; }
+
+
+// Drops the first count values.
+template <typename Source>
+class DropStage : public PipelineStage<DropStage<Source>>
+{
+public:
+    using value_type = typename Source::value_type;
+
+    DropStage(Source src, unsigned long count) : src_(std::move(src)), count_{count} {}
+
+    bool Next(value_type& v)
+    {
+        for (; count_ > 0; --count_)
+        {
+            if (!src_.Next(v))
+            {
+                return false;
+            }
+        }
+
+        return src_.Next(v);
+    }
+private:
+    Source src_;
+    unsigned long count_;
+};
+
+struct DropAdaptor { unsigned long count; };
+
+inline DropAdaptor Drop(unsigned long count) { return DropAdaptor{count}; }
+inline DropAdaptor SkipNumberLines(unsigned long count) { return Drop(count); }
+
+template <typename Source>
+DropStage<typename std::decay<Source>::type> operator|(Source&& src, DropAdaptor a)
+{ return {std::forward<Source>(src), a.count}; }
+
+
+// Drops values while pred is true, then lets everything else through.
+// If first_only is set, only the first value is tested.
+template <typename Source, typename Pred>
+class DropWhileStage : public PipelineStage<DropWhileStage<Source, Pred>>
+{
+public:
+    using value_type = typename Source::value_type;
+
+    DropWhileStage(Source src, Pred pred, bool first_only)
+        : src_(std::move(src)), pred_(std::move(pred)), first_only_{first_only} {}
+
+    bool Next(value_type& v)
+    {
+        if (dropping_)
+        {
+            dropping_ = false;
+
+            while (src_.Next(v))
+            {
+                if (!pred_(v))
+                {
+                    return true;
+                }
+
+                if (first_only_)
+                {
+                    break;
+                }
+            }
+
+            if (!first_only_)
+            {
+                return false;
+            }
+        }
+
+        return src_.Next(v);
+    }
+private:
+    Source src_;
+    Pred pred_;
+    bool first_only_;
+    bool dropping_ = true;
+};
+
+template <typename Pred>
+struct DropWhileAdaptor
+{
+    Pred pred;
+    bool first_only;
+};
+
+template <typename Pred>
+DropWhileAdaptor<Pred> DropWhile(Pred pred) { return DropWhileAdaptor<Pred>{std::move(pred), false}; }
+
+template <typename LineMatcher = SimpleLineMatcher>
+DropWhileAdaptor<LineMatchPredicate<LineMatcher>> SkipMatchingLines(std::string match,
+    LineMatcher matcher = LineMatcher{})
+{ return DropWhile(LineMatch(std::move(match), std::move(matcher))); }
+
+template <typename LineMatcher = SimpleLineMatcher>
+DropWhileAdaptor<LineMatchPredicate<LineMatcher>> SkipMatchingLine(std::string match,
+    LineMatcher matcher = LineMatcher{})
+{ return DropWhileAdaptor<LineMatchPredicate<LineMatcher>>{LineMatch(std::move(match), std::move(matcher)), true}; }
+
+// Drops lines until one matches; that one, and all after it, get through.
+template <typename LineMatcher = SimpleLineMatcher>
+DropWhileAdaptor<NotPredicate<LineMatchPredicate<LineMatcher>>> SkipUntil(std::string match,
+    LineMatcher matcher = LineMatcher{})
+{ return DropWhile(NotPredicate<LineMatchPredicate<LineMatcher>>{LineMatch(std::move(match), std::move(matcher))}); }
+
+template <typename Source, typename Pred>
+DropWhileStage<typename std::decay<Source>::type, Pred> operator|(Source&& src, DropWhileAdaptor<Pred> a)
+{ return {std::forward<Source>(src), std::move(a.pred), a.first_only}; }
+
+} // namespace utils
+}}}
+
+#endif // LINE_PIPELINE_H
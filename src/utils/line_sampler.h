@@ -0,0 +1,246 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef LINE_SAMPLER_H
+#define LINE_SAMPLER_H
+
+// Functions that sample lines from a FileLineReader, instead of reading the
+// whole file. All of them write the sampled lines to out, in file order, and
+// return how many lines they sampled.
+//
+// Byte stride and random offset sampling jump between samples with seeks, so
+// their cost depends on the number of samples, not on the size of the file.
+// They are biased towards lines that follow long lines, since we always take
+// the line that begins after the offset we jumped to.
+//
+// Every Nth line and reservoir sampling are exact, but they need to go through
+// the whole file; what they save is reading the lines they don't keep into
+// memory (see FileLineReader::DiscardLines()).
+//
+// All of these leave the reader's line count meaningless.
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <ios>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+// Samples the first line beginning at, or after, each multiple of stride.
+template <typename Reader, typename OutputIt>
+std::size_t SampleByteStride(Reader& flr, std::streamoff stride, OutputIt out)
+{
+    assert(stride > 0);
+
+    std::streamoff file_size = flr.GetFileSize();
+    std::streamoff last_line = -1;
+    std::size_t sampled = 0;
+
+    for (std::streamoff offset = 0; offset < file_size; offset += stride)
+    {
+        if (!flr.SeekToLine(offset) || !flr.ReadLine())
+        {
+            break;
+        }
+
+        // With a stride shorter than the lines, we'd land on the same line again.
+        if (flr.GetCurrentLineOffset() == last_line)
+        {
+            continue;
+        }
+
+        last_line = flr.GetCurrentLineOffset();
+        *out++ = flr.GetCurrentLine();
+        ++sampled;
+    }
+
+    return sampled;
+}
+
+
+// Samples (at most) sample_size lines, beginning at random offsets.
+// Offsets are sorted before we start, so we only seek forward.
+// Offsets that land on a line we've already sampled are dropped, so we may
+// return fewer than sample_size lines.
+template <typename Reader, typename OutputIt, typename URNG>
+std::size_t SampleRandomOffsets(Reader& flr, std::size_t sample_size, URNG& gen, OutputIt out)
+{
+    std::streamoff file_size = flr.GetFileSize();
+
+    if (file_size == 0)
+    {
+        return 0;
+    }
+
+    std::uniform_int_distribution<std::streamoff> dist{0, file_size - 1};
+    std::vector<std::streamoff> offsets(sample_size);
+
+    for (auto& o : offsets)
+    {
+        o = dist(gen);
+    }
+    std::sort(offsets.begin(), offsets.end());
+
+    std::streamoff last_line = -1;
+    std::size_t sampled = 0;
+
+    for (auto o : offsets)
+    {
+        // We're already past o, no need to go back.
+        if (o < last_line)
+        {
+            continue;
+        }
+
+        if (!flr.SeekToLine(o) || !flr.ReadLine())
+        {
+            break;
+        }
+
+        if (flr.GetCurrentLineOffset() == last_line)
+        {
+            continue;
+        }
+
+        last_line = flr.GetCurrentLineOffset();
+        *out++ = flr.GetCurrentLine();
+        ++sampled;
+    }
+
+    return sampled;
+}
+
+
+// Samples the next line, and then every nth line after it.
+template <typename Reader, typename OutputIt>
+std::size_t SampleEveryNthLine(Reader& flr, unsigned long n, OutputIt out)
+{
+    assert(n > 0);
+
+    std::size_t sampled = 0;
+
+    while (flr.ReadLine())
+    {
+        *out++ = flr.GetCurrentLine();
+        ++sampled;
+
+        if (flr.DiscardLines(n - 1) < n - 1)
+        {
+            break;
+        }
+    }
+
+    return sampled;
+}
+
+
+// Uniform sample of sample_size lines, from the current position to the end
+// of the file. Uses Li's Algorithm L, which computes how many lines to skip
+// until the next line that goes into the reservoir, so we only read the lines
+// we keep.
+template <typename Reader, typename OutputIt, typename URNG>
+std::size_t SampleReservoir(Reader& flr, std::size_t sample_size, URNG& gen, OutputIt out)
+{
+    if (sample_size == 0)
+    {
+        return 0;
+    }
+
+    std::vector<std::string> reservoir;
+    reservoir.reserve(sample_size);
+
+    // We also keep the line offsets, to restore the file order at the end.
+    std::vector<std::streamoff> offsets;
+    offsets.reserve(sample_size);
+
+    while ((reservoir.size() < sample_size) && flr.ReadLine())
+    {
+        reservoir.push_back(flr.GetCurrentLine());
+        offsets.push_back(flr.GetCurrentLineOffset());
+    }
+
+    if (reservoir.size() == sample_size)
+    {
+        // uniform_real_distribution's range is [a, b); we need (0, 1).
+        std::uniform_real_distribution<double> unit{std::nextafter(0.0, 1.0), 1.0};
+        std::uniform_int_distribution<std::size_t> slot{0, sample_size - 1};
+        double k = static_cast<double>(sample_size);
+        double w = std::exp(std::log(unit(gen)) / k);
+
+        for (;;)
+        {
+            double skip = std::floor(std::log(unit(gen)) / std::log1p(-w));
+
+            // Anything beyond this would take us past the end of any file.
+            if (skip > static_cast<double>(std::numeric_limits<unsigned long>::max()))
+            {
+                break;
+            }
+
+            unsigned long to_skip = static_cast<unsigned long>(skip);
+            if ((flr.DiscardLines(to_skip) < to_skip) || !flr.ReadLine())
+            {
+                break;
+            }
+
+            std::size_t s = slot(gen);
+            reservoir[s] = flr.GetCurrentLine();
+            offsets[s] = flr.GetCurrentLineOffset();
+
+            w *= std::exp(std::log(unit(gen)) / k);
+        }
+    }
+
+    std::vector<std::size_t> order(reservoir.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(),
+        [&offsets](std::size_t l, std::size_t r) { return offsets[l] < offsets[r]; });
+
+    for (auto i : order)
+    {
+        *out++ = std::move(reservoir[i]);
+    }
+
+    return order.size();
+}
+
+} // namespace utils
+}}}
+
+#endif // LINE_SAMPLER_H
@@ -0,0 +1,94 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef OPEN_RESULT_H
+#define OPEN_RESULT_H
+
+// The result of opening a file, for the non-throwing API (e.g.,
+// FileLineReader::TryOpen()).
+//
+// Failing to open a file is common when we sweep lots of candidate files, and
+// throwing FileOpenException (building its message, and boost::exception's
+// error info) costs far more than the failed open itself. OpenResult holds
+// the errno as a std::error_code, and only formats a message when someone
+// asks for it.
+
+#include "utils/exception.h"
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+// Thread safety: None. Refers to the file name held by whoever opened the
+// file, so it's only valid while that name is.
+class OpenResult
+{
+public:
+    // Success.
+    OpenResult() = default;
+
+    // Failure. An error_number of 0 means the cause is unknown.
+    OpenResult(int error_number, std::string const& file_name)
+        : error_{(error_number != 0) ? error_number : EIO, std::generic_category()},
+          file_name_{&file_name}
+    {
+    }
+
+    bool IsOpen() const { return !error_; }
+    explicit operator bool() const { return IsOpen(); }
+
+    std::error_code GetError() const { return error_; }
+
+    std::string GetMessage() const
+    {
+        return IsOpen() ? std::string{} : "Error opening file " + *file_name_ + ": " + error_.message();
+    }
+
+    // The throwing API. The message goes into a breadcrumb (see
+    // base/breadcrumbs.h), and into an error_message.
+    void ThrowIfFailed() const
+    {
+        if (!IsOpen())
+        {
+            PCBLUESY_THROW(FileOpenException() << error_message(GetMessage()), 0,
+                "Error opening file %s: %s", file_name_->c_str(), error_.message().c_str());
+        }
+    }
+private:
+    std::error_code error_;
+    std::string const* file_name_ = nullptr;
+};
+
+} // namespace utils
+}}}
+
+#endif // OPEN_RESULT_H
@@ -0,0 +1,223 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef READER_STATS_H
+#define READER_STATS_H
+
+// Statistics policies for FileLineReader.
+//
+// NoReaderStats is the default, and compiles down to nothing. SimpleReaderStats
+// keeps counters and I/O vs. matching time splits, which can be exported through
+// FileLineReader::GetStats().
+//
+// If PCBLUESY_FLR_PERF_MARKERS is defined (and <sys/sdt.h> is available),
+// SimpleReaderStats also emits USDT probes (provider "pcbluesy"), which can be
+// traced with perf, bpftrace, systemtap, etc:
+//  - flr_read(bytes, ns): a line was read.
+//  - flr_match(hit, ns): a line was matched.
+
+#include "utils/line_length.h"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PCBLUESY_FLR_HAVE_RDTSC
+#endif
+
+#if defined(PCBLUESY_FLR_PERF_MARKERS)
+#include <sys/sdt.h>
+#define PCBLUESY_FLR_MARKER(name, a, b) DTRACE_PROBE2(pcbluesy, name, a, b)
+#else
+#define PCBLUESY_FLR_MARKER(name, a, b) ((void)0)
+#endif
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+// A copy of the counters, detached from the reader, so it can be exported
+// to whatever metrics system the client uses.
+// Times are in nanoseconds; cycles are TSC cycles (always 0 if the
+// platform has no TSC).
+struct ReaderStatsSnapshot
+{
+    unsigned long long bytes_read = 0;
+    // Buffer refills, i.e., read syscalls on the underlying file.
+    unsigned long long read_calls = 0;
+    unsigned long long lines = 0;
+    unsigned long long matches_tested = 0;
+    unsigned long long matches_hit = 0;
+    // Longest line placed in the current line. With a bounded LineLength
+    // policy, this never exceeds the maximum line length.
+    std::size_t longest_line = 0;
+    unsigned long long io_ns = 0;
+    unsigned long long match_ns = 0;
+    unsigned long long io_cycles = 0;
+    unsigned long long match_cycles = 0;
+};
+
+
+// std::filebuf that counts how many times it had to go to the file.
+// underflow() is the only place where filebuf refills its get area, so
+// each call corresponds to one read on the underlying file.
+class CountingFileBuf : public std::filebuf
+{
+public:
+    unsigned long long GetReadCalls() const { return read_calls_; }
+protected:
+    int_type underflow() override
+    {
+        ++read_calls_;
+        return std::filebuf::underflow();
+    }
+private:
+    unsigned long long read_calls_ = 0;
+};
+
+
+// Default statistics policy - does nothing, and costs nothing.
+// FileLineReader calls StartTick() before each read/match, and hands the
+// result back to the corresponding Record*() function. Since StatsTick
+// is empty and all functions are empty, the compiler removes it all.
+struct NoReaderStats
+{
+    using FileBufType = std::filebuf;
+    struct StatsTick { };
+
+    StatsTick StartTick() const { return StatsTick{}; }
+    void RecordRead(StatsTick, LineReadResult const&) { }
+    void RecordFailedRead(StatsTick) { }
+    void RecordMatch(StatsTick, bool) const { }
+    ReaderStatsSnapshot TakeSnapshot(FileBufType const&) const { return ReaderStatsSnapshot{}; }
+};
+
+
+// Collects the counters described in ReaderStatsSnapshot.
+// Match counters are mutable, because FileLineReader::LineMatches() is const,
+// and recording statistics doesn't change the reader's observable state.
+class SimpleReaderStats
+{
+public:
+    using FileBufType = CountingFileBuf;
+
+    struct StatsTick
+    {
+        std::chrono::steady_clock::time_point time;
+        unsigned long long cycles;
+    };
+
+    StatsTick StartTick() const
+    { return StatsTick{std::chrono::steady_clock::now(), ReadCycles()}; }
+
+    void RecordRead(StatsTick start, LineReadResult const& r)
+    {
+        unsigned long long ns = ElapsedNs(start);
+        io_ns_ += ns;
+        io_cycles_ += ReadCycles() - start.cycles;
+        bytes_read_ += r.bytes;
+        lines_ += (r.new_line ? 1 : 0) + r.skipped_lines;
+
+        if (r.length > longest_line_)
+        {
+            longest_line_ = r.length;
+        }
+
+        PCBLUESY_FLR_MARKER(flr_read, r.bytes, ns);
+    }
+
+    // Reads that failed (usually, EOF) still spent time waiting for I/O.
+    void RecordFailedRead(StatsTick start)
+    {
+        io_ns_ += ElapsedNs(start);
+        io_cycles_ += ReadCycles() - start.cycles;
+    }
+
+    void RecordMatch(StatsTick start, bool hit) const
+    {
+        unsigned long long ns = ElapsedNs(start);
+        match_ns_ += ns;
+        match_cycles_ += ReadCycles() - start.cycles;
+        ++matches_tested_;
+        if (hit)
+        {
+            ++matches_hit_;
+        }
+
+        PCBLUESY_FLR_MARKER(flr_match, hit, ns);
+    }
+
+    ReaderStatsSnapshot TakeSnapshot(FileBufType const& buf) const
+    {
+        ReaderStatsSnapshot s;
+        s.bytes_read = bytes_read_;
+        s.read_calls = buf.GetReadCalls();
+        s.lines = lines_;
+        s.matches_tested = matches_tested_;
+        s.matches_hit = matches_hit_;
+        s.longest_line = longest_line_;
+        s.io_ns = io_ns_;
+        s.match_ns = match_ns_;
+        s.io_cycles = io_cycles_;
+        s.match_cycles = match_cycles_;
+        return s;
+    }
+private:
+    static unsigned long long ElapsedNs(StatsTick start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start.time).count();
+    }
+
+    static unsigned long long ReadCycles()
+    {
+#ifdef PCBLUESY_FLR_HAVE_RDTSC
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    unsigned long long bytes_read_ = 0;
+    unsigned long long lines_ = 0;
+    unsigned long long io_ns_ = 0;
+    unsigned long long io_cycles_ = 0;
+    std::size_t longest_line_ = 0;
+
+    mutable unsigned long long matches_tested_ = 0;
+    mutable unsigned long long matches_hit_ = 0;
+    mutable unsigned long long match_ns_ = 0;
+    mutable unsigned long long match_cycles_ = 0;
+};
+
+} // namespace utils
+}}}
+
+#endif // READER_STATS_H
@@ -0,0 +1,401 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SHARD_SPLITTER_H
+#define SHARD_SPLITTER_H
+
+// Splits a file into N shard files, by the hash of a key extracted from each
+// line (see LineKey), so that all the lines with the same key end up in the
+// same shard. ShardOfKey() tells which shard a key goes to.
+//
+// The file is split into newline-aligned chunks (see file_chunks.h), which
+// worker threads take in turn. Each thread stages its lines in a buffer per
+// shard, and appends a buffer to its shard file when it fills up - one large
+// write, under the shard's lock, straight from the staging buffer (see
+// FileLineWriter::WriteDirect()), as are the partial buffers left at the end.
+// So no line is copied more than once, and no thread waits on another, except
+// to append to the same shard.
+//
+// Lines from the same chunk keep their order in their shard file. Lines from
+// different chunks may be interleaved, a buffer at a time; with a single
+// thread, each shard file keeps the input order.
+//
+// Memory use is about threads * shards * buffer size, plus a chunk per
+// thread. Lines with no key go to the shard of the empty key. Every output
+// line ends with '\n', including the last.
+
+#include "utils/exception.h"
+#include "utils/file_chunks.h"
+#include "utils/file_line_reader.h"
+#include "utils/file_line_writer.h"
+#include "utils/key_hash.h"
+#include "utils/line_aggregator.h"
+
+#include <boost/utility/string_ref.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+// The shard for key, out of shards. Depends on HashKey(), so it's only
+// stable across platforms with the same byte order.
+inline std::size_t ShardOfKey(boost::string_ref key, std::size_t shards)
+{
+    assert(shards > 0);
+    return static_cast<std::size_t>(HashKey(key) % shards);
+}
+
+
+struct ShardSplitStats
+{
+    unsigned long long lines = 0;
+    unsigned long long keyless_lines = 0;
+    unsigned long long bytes_read = 0;
+    std::size_t chunks = 0;
+    unsigned threads = 0;
+    std::vector<unsigned long long> shard_lines;
+};
+
+
+// Thread safety: Split() is const, and can be called concurrently, for
+// different shard files.
+class ShardSplitter
+{
+public:
+    static constexpr std::size_t kDefaultChunkSize = 4 * 1024 * 1024;
+    static constexpr std::size_t kDefaultBufferSize = 128 * 1024;
+
+    explicit ShardSplitter(LineKey key) : key_{std::move(key)} { }
+
+    // 0 (the default) means one thread per core.
+    void SetThreadCount(unsigned threads) { thread_count_ = threads; }
+
+    void SetChunkSize(std::size_t size)
+    {
+        assert(size > 0);
+        chunk_size_ = size;
+    }
+
+    // Staging buffer, per thread and shard.
+    void SetBufferSize(std::size_t size)
+    {
+        assert(size > 0);
+        buffer_size_ = size;
+    }
+
+    // One shard per file; the shard files are truncated.
+    // Throws FileOpenException/FileReadException/FileWriteException.
+    ShardSplitStats Split(std::string const& in_file, std::vector<std::string> const& shard_files) const;
+private:
+    LineKey key_;
+    unsigned thread_count_ = 0;
+    std::size_t chunk_size_ = kDefaultChunkSize;
+    std::size_t buffer_size_ = kDefaultBufferSize;
+};
+
+
+namespace detail
+{
+
+// What the workers share.
+class ShardJob
+{
+public:
+    ShardJob(std::string const& in_file, std::vector<FileChunk> const& chunks, LineKey const& key,
+        std::vector<std::string> const& shard_files, std::size_t buffer_size);
+
+    void Run();
+
+    // Stops all the workers, keeping the first error.
+    void Fail(std::exception_ptr e)
+    {
+        std::lock_guard<std::mutex> lock{error_lock_};
+        if (!error_)
+        {
+            error_ = e;
+        }
+        failed_ = true;
+    }
+
+    std::exception_ptr GetError() const { return error_; }
+
+    // Flushes and closes the shard files. Throws on error.
+    void Close();
+
+    void AddTo(ShardSplitStats& stats) const
+    {
+        stats.lines = lines_;
+        stats.keyless_lines = keyless_lines_;
+        stats.shard_lines.assign(shard_lines_.begin(), shard_lines_.end());
+    }
+private:
+    struct Shard
+    {
+        std::mutex lock;
+        FileLineWriter out;
+        unsigned long long lines = 0;
+    };
+
+    void Append(std::size_t shard, std::string& staged, unsigned long long lines);
+
+    std::string const& in_file_;
+    std::vector<FileChunk> const& chunks_;
+    LineKey const& key_;
+    std::size_t buffer_size_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::atomic<std::size_t> next_chunk_{0};
+    std::atomic<bool> failed_{false};
+    std::atomic<unsigned long long> lines_{0};
+    std::atomic<unsigned long long> keyless_lines_{0};
+    std::vector<unsigned long long> shard_lines_;
+    std::mutex error_lock_;
+    std::exception_ptr error_;
+};
+
+
+inline ShardJob::ShardJob(std::string const& in_file, std::vector<FileChunk> const& chunks, LineKey const& key,
+    std::vector<std::string> const& shard_files, std::size_t buffer_size) :
+    in_file_(in_file), chunks_(chunks), key_(key), buffer_size_{buffer_size}
+{
+    shards_.reserve(shard_files.size());
+
+    for (auto const& f : shard_files)
+    {
+        shards_.emplace_back(new Shard);
+        // Everything goes through WriteDirect(), so the writer's own buffer
+        // is never used.
+        shards_.back()->out.SetBufferSize(1);
+        shards_.back()->out.Open(f);
+    }
+}
+
+
+inline void ShardJob::Run()
+{
+    try
+    {
+        std::ifstream in{in_file_, std::ios_base::in | std::ios_base::binary};
+
+        if (!in)
+        {
+            PCBLUESY_THROW(FileOpenException(), 0, "Error opening file %s", in_file_.c_str());
+        }
+
+        std::string buf;
+        std::vector<std::string> staged(shards_.size());
+        std::vector<unsigned long long> staged_lines(shards_.size());
+        unsigned long long lines = 0;
+        unsigned long long keyless = 0;
+        std::size_t const empty_key_shard = ShardOfKey(boost::string_ref{}, shards_.size());
+
+        for (std::size_t i = next_chunk_++; (i < chunks_.size()) && !failed_; i = next_chunk_++)
+        {
+            if (!ReadFileChunk(in, chunks_[i], buf))
+            {
+                PCBLUESY_THROW(FileReadException(), 0, "Error reading file %s", in_file_.c_str());
+            }
+
+            char const* p = buf.data();
+            char const* end = p + buf.size();
+
+            while (p != end)
+            {
+                char const* nl = static_cast<char const*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+                boost::string_ref line{p, static_cast<std::size_t>(((nl == nullptr) ? end : nl) - p)};
+                p = (nl == nullptr) ? end : nl + 1;
+
+                boost::string_ref key;
+                std::size_t s = empty_key_shard;
+                if (key_.Extract(line, key))
+                {
+                    s = ShardOfKey(key, shards_.size());
+                }
+                else
+                {
+                    ++keyless;
+                }
+
+                std::string& b = staged[s];
+                b.append(line.data(), line.size());
+                b += '\n';
+                ++staged_lines[s];
+                ++lines;
+
+                if (b.size() >= buffer_size_)
+                {
+                    Append(s, b, staged_lines[s]);
+                    staged_lines[s] = 0;
+                }
+            }
+        }
+
+        for (std::size_t s = 0; s < staged.size(); ++s)
+        {
+            Append(s, staged[s], staged_lines[s]);
+        }
+
+        lines_ += lines;
+        keyless_lines_ += keyless;
+    }
+    catch (base::PCBBaseException const& e)
+    {
+        // The breadcrumbs stay with this thread.
+        e.CaptureBreadcrumbs();
+        Fail(std::current_exception());
+    }
+    catch (...)
+    {
+        Fail(std::current_exception());
+    }
+}
+
+
+inline void ShardJob::Append(std::size_t shard, std::string& staged, unsigned long long lines)
+{
+    if (staged.empty())
+    {
+        return;
+    }
+
+    Shard& s = *shards_[shard];
+    {
+        std::lock_guard<std::mutex> lock{s.lock};
+        s.out.WriteDirect(staged);
+        s.lines += lines;
+    }
+
+    // Keeps its capacity, for the next lines.
+    staged.clear();
+}
+
+
+inline void ShardJob::Close()
+{
+    shard_lines_.clear();
+
+    // Close them all, even after an error, and report the first one.
+    std::exception_ptr error;
+    for (auto& s : shards_)
+    {
+        try
+        {
+            s->out.Close();
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+        shard_lines_.push_back(s->lines);
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace detail
+
+
+inline ShardSplitStats ShardSplitter::Split(std::string const& in_file,
+    std::vector<std::string> const& shard_files) const
+{
+    assert(!shard_files.empty());
+
+    ShardSplitStats stats;
+    std::vector<FileChunk> chunks;
+    {
+        FileLineReader<> flr{in_file};
+        stats.bytes_read = static_cast<unsigned long long>(flr.GetFileSize());
+        chunks = SplitLineChunks(flr, static_cast<std::streamoff>(chunk_size_));
+    }
+
+    unsigned threads = (thread_count_ > 0) ? thread_count_ : std::max(std::thread::hardware_concurrency(), 1u);
+    threads = static_cast<unsigned>(std::max<std::size_t>(std::min<std::size_t>(threads, chunks.size()), 1));
+
+    detail::ShardJob job{in_file, chunks, key_, shard_files, buffer_size_};
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+
+    try
+    {
+        for (unsigned i = 1; i < threads; ++i)
+        {
+            workers.emplace_back(&detail::ShardJob::Run, &job);
+        }
+    }
+    catch (...)
+    {
+        // Couldn't start a thread. The ones that did start must be stopped
+        // before we leave, since they're using job.
+        job.Fail(std::current_exception());
+    }
+
+    // This thread works, too.
+    job.Run();
+
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+
+    if (job.GetError())
+    {
+        std::rethrow_exception(job.GetError());
+    }
+
+    job.Close();
+    job.AddTo(stats);
+    stats.chunks = chunks.size();
+    stats.threads = threads;
+    return stats;
+}
+
+} // namespace utils
+}}}
+
+#endif // SHARD_SPLITTER_H
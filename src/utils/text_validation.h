@@ -0,0 +1,192 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef TEXT_VALIDATION_H
+#define TEXT_VALIDATION_H
+
+// Text validation: ASCII and UTF-8.
+//
+// These let callers skip converting text that doesn't need it, e.g., ASCII
+// output to a console whose code page has ASCII as a subset. ASCII is checked
+// with SSE2, if available, 64 bytes per iteration; UTF-8 validation skips
+// runs of ASCII the same way, and validates the rest one sequence at a time.
+// None of these allocate.
+
+#include <boost/utility/string_ref.hpp>
+
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define PCBLUESY_TV_HAVE_SSE2
+#endif
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+// Length of the run of ASCII chars at the beginning of s.
+inline std::size_t AsciiPrefixLength(char const* s, std::size_t len) noexcept
+{
+    std::size_t i = 0;
+
+#ifdef PCBLUESY_TV_HAVE_SSE2
+    for (; i + 16 <= len; i += 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(s + i)));
+        if (mask != 0)
+        {
+            return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned int>(mask)));
+        }
+    }
+#endif
+
+    for (; (i < len) && (static_cast<unsigned char>(s[i]) < 0x80); ++i)
+    {
+        ;
+    }
+
+    return i;
+}
+
+inline bool IsAscii(char const* s, std::size_t len) noexcept
+{
+    std::size_t i = 0;
+
+#ifdef PCBLUESY_TV_HAVE_SSE2
+    // No need to know where the first non-ASCII char is, so we OR 4 blocks
+    // together and test them at once.
+    for (; i + 64 <= len; i += 64)
+    {
+        __m128i const* p = reinterpret_cast<__m128i const*>(s + i);
+        __m128i v = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+            _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+        if (_mm_movemask_epi8(v) != 0)
+        {
+            return false;
+        }
+    }
+#endif
+
+    return (AsciiPrefixLength(s + i, len - i) == len - i);
+}
+
+inline bool IsAscii(boost::string_ref s) noexcept
+{
+    return IsAscii(s.data(), s.size());
+}
+
+inline bool IsAscii(wchar_t const* s, std::size_t len) noexcept
+{
+    for (std::size_t i = 0; i < len; ++i)
+    {
+        if (static_cast<unsigned long>(s[i]) >= 0x80)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// Rejects truncated sequences, bad continuation bytes, overlong forms,
+// surrogates and anything above U+10FFFF.
+inline bool IsValidUtf8(char const* s, std::size_t len) noexcept
+{
+    unsigned char const* u = reinterpret_cast<unsigned char const*>(s);
+    std::size_t i = 0;
+
+    for (;;)
+    {
+        i += AsciiPrefixLength(s + i, len - i);
+
+        if (i == len)
+        {
+            return true;
+        }
+
+        unsigned char c = u[i];
+        std::size_t trail;
+        unsigned long cp;
+        unsigned long min;
+
+        if ((c & 0xE0) == 0xC0)
+        {
+            trail = 1;
+            cp = c & 0x1F;
+            min = 0x80;
+        }
+        else if ((c & 0xF0) == 0xE0)
+        {
+            trail = 2;
+            cp = c & 0x0F;
+            min = 0x800;
+        }
+        else if ((c & 0xF8) == 0xF0)
+        {
+            trail = 3;
+            cp = c & 0x07;
+            min = 0x10000;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (len - i <= trail)
+        {
+            return false;
+        }
+
+        for (std::size_t k = 1; k <= trail; ++k)
+        {
+            if ((u[i + k] & 0xC0) != 0x80)
+            {
+                return false;
+            }
+            cp = (cp << 6) | (u[i + k] & 0x3F);
+        }
+
+        if ((cp < min) || (cp > 0x10FFFF) || ((cp >= 0xD800) && (cp <= 0xDFFF)))
+        {
+            return false;
+        }
+
+        i += trail + 1;
+    }
+}
+
+inline bool IsValidUtf8(boost::string_ref s) noexcept
+{
+    return IsValidUtf8(s.data(), s.size());
+}
+
+} // namespace utils
+}}}
+
+#endif // TEXT_VALIDATION_H
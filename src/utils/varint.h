@@ -0,0 +1,76 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef VARINT_H
+#define VARINT_H
+
+// LEB128 varints: 7 bits per byte, low bits first, with the high bit set on
+// every byte but the last. Small values (e.g., deltas between sorted
+// offsets, or lengths) take 1 or 2 bytes, instead of 8. Used by the line
+// index and the external sort's run files.
+
+#include <cstdint>
+#include <string>
+
+namespace pt { namespace pcaetano { namespace bluesy {
+namespace utils
+{
+
+inline void AppendVarint(std::string& out, std::uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        out += static_cast<char>((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+// Returns false if the varint runs past end, or is too long.
+inline bool ReadVarint(unsigned char const*& p, unsigned char const* end, std::uint64_t& v)
+{
+    v = 0;
+
+    for (unsigned shift = 0; (p != end) && (shift < 64); shift += 7)
+    {
+        unsigned char b = *p++;
+        v |= static_cast<std::uint64_t>(b & 0x7F) << shift;
+
+        if ((b & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace utils
+}}}
+
+#endif // VARINT_H
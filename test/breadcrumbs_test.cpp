@@ -0,0 +1,254 @@
+#include <boost/test/unit_test.hpp>
+
+#include "base/breadcrumbs.h"
+using pt::pcaetano::bluesy::base::Breadcrumb;
+using pt::pcaetano::bluesy::base::BreadcrumbRing;
+using pt::pcaetano::bluesy::base::ThisThreadBreadcrumbs;
+#include "base/exception.h"
+using pt::pcaetano::bluesy::base::PCBBaseException;
+
+#include <exception>
+#include <string>
+#include <thread>
+
+namespace
+{
+
+struct TestException : virtual PCBBaseException { };
+
+void ThrowIt(char const* what)
+{
+    PCBLUESY_THROW(TestException(), 17, "Failed at %s", what);
+}
+
+void RethrowIt()
+{
+    try
+    {
+        ThrowIt("the bottom");
+    }
+    catch (TestException const& e)
+    {
+        PCBLUESY_RETHROW(e, 0, "Passing through, %d", 2);
+    }
+}
+
+std::size_t CountLines(std::string const& s)
+{
+    std::size_t n = 0;
+    for (auto c : s)
+    {
+        n += (c == '\n') ? 1 : 0;
+    }
+    return n;
+}
+
+} // namespace
+
+
+BOOST_AUTO_TEST_SUITE(breadcrumbs)
+
+BOOST_AUTO_TEST_CASE(bc_throw_rethrow)
+{
+    try
+    {
+        RethrowIt();
+        BOOST_FAIL("Nothing thrown");
+    }
+    catch (TestException const& e)
+    {
+        std::string trace = e.what();
+
+        BOOST_REQUIRE_EQUAL(CountLines(trace), 2u);
+        BOOST_REQUIRE_NE(trace.find("[17]: Failed at the bottom\n"), std::string::npos);
+        BOOST_REQUIRE_NE(trace.find("Passing through, 2\n"), std::string::npos);
+        BOOST_REQUIRE_LT(trace.find("Failed at"), trace.find("Passing through"));
+        BOOST_REQUIRE_NE(trace.find("breadcrumbs_test.cpp("), std::string::npos);
+
+        // Already captured.
+        BOOST_REQUIRE_EQUAL(std::string{e.what()}, trace);
+    }
+}
+
+// Other errors in between don't get into the trace.
+BOOST_AUTO_TEST_CASE(bc_chains)
+{
+    try
+    {
+        try
+        {
+            ThrowIt("first");
+        }
+        catch (TestException const& e)
+        {
+            try
+            {
+                ThrowIt("second");
+            }
+            catch (TestException const&)
+            {
+            }
+
+            PCBLUESY_RETHROW(e, 0, "first, again");
+        }
+    }
+    catch (TestException const& e)
+    {
+        std::string trace = e.what();
+
+        BOOST_REQUIRE_EQUAL(CountLines(trace), 2u);
+        BOOST_REQUIRE_EQUAL(trace.find("second"), std::string::npos);
+    }
+}
+
+// Messages are truncated, and the ring doesn't grow.
+BOOST_AUTO_TEST_CASE(bc_bounded)
+{
+    std::string longText(1000, 'x');
+
+    try
+    {
+        try
+        {
+            ThrowIt(longText.c_str());
+        }
+        catch (TestException const& e)
+        {
+            for (std::size_t i = 0; i < BreadcrumbRing::kCapacity; ++i)
+            {
+                try
+                {
+                    PCBLUESY_RETHROW(e, 0, "%s", longText.c_str());
+                }
+                catch (TestException const&)
+                {
+                }
+            }
+            throw;
+        }
+    }
+    catch (TestException const& e)
+    {
+        std::string trace = e.what();
+
+        BOOST_REQUIRE_EQUAL(trace.find("(older breadcrumbs lost)\n"), 0u);
+        BOOST_REQUIRE_EQUAL(CountLines(trace), BreadcrumbRing::kCapacity + 1);
+        BOOST_REQUIRE_EQUAL(trace.find(longText.substr(0, Breadcrumb::kMessageSize)), std::string::npos);
+    }
+}
+
+// The breadcrumbs must be captured before moving to another thread.
+BOOST_AUTO_TEST_CASE(bc_other_thread)
+{
+    std::exception_ptr error;
+    std::uint64_t ringId = 0;
+
+    std::thread t{[&error, &ringId]
+    {
+        ringId = ThisThreadBreadcrumbs().id;
+        try
+        {
+            ThrowIt("worker");
+        }
+        catch (TestException const& e)
+        {
+            e.CaptureBreadcrumbs();
+            error = std::current_exception();
+        }
+    }};
+    t.join();
+
+    BOOST_REQUIRE_NE(ringId, ThisThreadBreadcrumbs().id);
+
+    try
+    {
+        try
+        {
+            std::rethrow_exception(error);
+        }
+        catch (TestException const& e)
+        {
+            PCBLUESY_RETHROW(e, 0, "main");
+        }
+    }
+    catch (TestException const& e)
+    {
+        std::string trace = e.what();
+
+        BOOST_REQUIRE_EQUAL(CountLines(trace), 2u);
+        BOOST_REQUIRE_LT(trace.find("Failed at worker"), trace.find("main"));
+    }
+}
+
+// boost::current_exception() copies the exception itself, not an
+// unknown_exception, and the copy keeps the breadcrumbs.
+BOOST_AUTO_TEST_CASE(bc_boost_current_exception)
+{
+    boost::exception_ptr error;
+
+    try
+    {
+        ThrowIt("copied");
+    }
+    catch (...)
+    {
+        error = boost::current_exception();
+    }
+
+    try
+    {
+        try
+        {
+            boost::rethrow_exception(error);
+        }
+        catch (TestException const& e)
+        {
+            BOOST_REQUIRE(boost::get_error_info<boost::throw_file>(e) != nullptr);
+            PCBLUESY_RETHROW(e, 0, "After the copy");
+        }
+    }
+    catch (TestException const& e)
+    {
+        std::string trace = e.what();
+
+        BOOST_REQUIRE_EQUAL(CountLines(trace), 2u);
+        BOOST_REQUIRE_NE(trace.find("[17]: Failed at copied\n"), std::string::npos);
+        BOOST_REQUIRE_LT(trace.find("Failed at copied"), trace.find("After the copy"));
+    }
+    catch (...)
+    {
+        BOOST_FAIL("Not a TestException");
+    }
+}
+
+// boost::diagnostic_information() shows the trace once, through what().
+BOOST_AUTO_TEST_CASE(bc_diagnostic_information)
+{
+    try
+    {
+        ThrowIt("diagnosed");
+    }
+    catch (TestException const& e)
+    {
+        std::string info = boost::diagnostic_information(e);
+        std::size_t first = info.find("Failed at diagnosed");
+
+        BOOST_REQUIRE_NE(first, std::string::npos);
+        BOOST_REQUIRE_EQUAL(info.find("Failed at diagnosed", first + 1), std::string::npos);
+    }
+}
+
+// Plain BOOST_THROW_EXCEPTION still works as before.
+BOOST_AUTO_TEST_CASE(bc_no_breadcrumbs)
+{
+    try
+    {
+        BOOST_THROW_EXCEPTION(TestException());
+    }
+    catch (TestException const& e)
+    {
+        BOOST_REQUIRE_EQUAL(std::string{e.what()}, std::string{std::exception{}.what()});
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,145 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/test/unit_test.hpp>
+
+#include "ms_windows/bulk_transcoder.h"
+using pt::pcaetano::bluesy::ms_windows::BulkTranscoder;
+using pt::pcaetano::bluesy::ms_windows::BulkTranscodeStats;
+using pt::pcaetano::bluesy::ms_windows::EncodingNotFoundException;
+#include "ms_windows/encoding_converter.h"
+using pt::pcaetano::bluesy::ms_windows::EncodingConverter;
+#include "utils/exception.h"
+using pt::pcaetano::bluesy::utils::FileOpenException;
+
+#include <fstream>
+#include <iterator>
+#include <string>
+using std::string;
+
+namespace
+{
+
+string const inFileName{"bt_test_in.txt"};
+string const outFileName{"bt_test_out.txt"};
+
+void WriteFile(string const& fileName, string const& contents)
+{
+    std::ofstream of{fileName, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary};
+    of << contents;
+}
+
+string ReadFile(string const& fileName)
+{
+    std::ifstream in{fileName, std::ios_base::in | std::ios_base::binary};
+    return string{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+}
+
+// cp850 lines, with and without non-ASCII chars.
+string MakeCp850Log(unsigned int lines)
+{
+    string contents;
+
+    for (unsigned int i = 0; i < lines; ++i)
+    {
+        contents += "2016-03-0" + std::to_string(i % 10) + " linha " + std::to_string(i);
+        contents += (i % 3 == 0) ? " opera\x87\xC6o conclu\xA1" "da\n" : " ok\n";
+    }
+
+    return contents;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(bulk_transcoder)
+
+BOOST_AUTO_TEST_CASE(bt_same_as_converter)
+{
+    string contents = MakeCp850Log(5000);
+    WriteFile(inFileName, contents);
+
+    EncodingConverter conv{"UTF-8", "cp850"};
+    string expected = conv.Convert(contents.data(), contents.size());
+
+    // Small chunks, so every thread gets many of them.
+    BulkTranscoder bt{"UTF-8", "cp850"};
+    bt.SetThreadCount(4);
+    bt.SetChunkSize(1000);
+    BulkTranscodeStats stats = bt.Transcode(inFileName, outFileName);
+
+    BOOST_REQUIRE(ReadFile(outFileName) == expected);
+    BOOST_REQUIRE_EQUAL(stats.bytesRead, contents.size());
+    BOOST_REQUIRE_EQUAL(stats.bytesWritten, expected.size());
+    BOOST_REQUIRE(stats.chunks > 4);
+    BOOST_REQUIRE_EQUAL(stats.threads, 4);
+}
+
+BOOST_AUTO_TEST_CASE(bt_round_trip)
+{
+    string contents = MakeCp850Log(1000);
+    WriteFile(inFileName, contents);
+
+    BulkTranscoder to{"UTF-8", "cp850"};
+    to.SetChunkSize(100);
+    to.Transcode(inFileName, outFileName);
+
+    // Output smaller than the input, with preallocation, must be truncated.
+    BulkTranscoder from{"cp850", "UTF-8"};
+    from.SetChunkSize(100);
+    from.Transcode(outFileName, inFileName);
+
+    BOOST_REQUIRE(ReadFile(inFileName) == contents);
+}
+
+BOOST_AUTO_TEST_CASE(bt_replaces_output)
+{
+    WriteFile(inFileName, "");
+    WriteFile(outFileName, "previous contents\n");
+
+    BulkTranscoder bt{"UTF-8", "cp1252"};
+    BulkTranscodeStats stats = bt.Transcode(inFileName, outFileName);
+
+    BOOST_REQUIRE(ReadFile(outFileName).empty());
+    BOOST_REQUIRE_EQUAL(stats.chunks, 0);
+}
+
+BOOST_AUTO_TEST_CASE(bt_errors)
+{
+    BOOST_REQUIRE_THROW(BulkTranscoder("UTF-8", "no-such-encoding"), EncodingNotFoundException);
+
+    BulkTranscoder bt{"UTF-8", "cp850"};
+    BOOST_REQUIRE_THROW(bt.Transcode("bt_test_no_such_file.txt", outFileName), FileOpenException);
+
+    // The same file, by another name; it must be left alone.
+    string contents = MakeCp850Log(10);
+    WriteFile(inFileName, contents);
+    BOOST_REQUIRE_THROW(bt.Transcode(inFileName, "./" + inFileName), FileOpenException);
+    BOOST_REQUIRE_EQUAL(ReadFile(inFileName), contents);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
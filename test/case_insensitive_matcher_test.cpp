@@ -0,0 +1,96 @@
+#include <boost/test/unit_test.hpp>
+
+#include "utils/case_insensitive_matcher.h"
+using pt::pcaetano::bluesy::utils::CaseInsensitiveLineMatcher;
+#include "utils/file_line_reader.h"
+using pt::pcaetano::bluesy::utils::FileLineReader;
+using pt::pcaetano::bluesy::utils::SimpleLineCounter;
+
+#include <boost/utility/string_ref.hpp>
+
+#include <fstream>
+#include <string>
+
+namespace
+{
+
+std::string const kCaseFileName{"cim_test_file.flr"};
+
+struct CaseFileFixture
+{
+    CaseFileFixture()
+    {
+        std::ofstream of{kCaseFileName, std::ios_base::out | std::ios_base::trunc};
+
+        of << "user=alice status=ok\n";
+        of << "user=BOB status=Error: connection reset by peer\n";
+        of << "utilizador=JOÃO estado=ERRO\n";
+        of << "user=carol status=ok\n";
+    }
+};
+
+} // unnamed namespace
+
+BOOST_FIXTURE_TEST_SUITE(case_insensitive_matcher, CaseFileFixture)
+
+BOOST_AUTO_TEST_CASE(cim_ascii)
+{
+    CaseInsensitiveLineMatcher m;
+
+    BOOST_CHECK(m.LineMatches(std::string{"Error: Disk Full"}, std::string{"error"}));
+    BOOST_CHECK(m.LineMatches(std::string{"error: disk full"}, std::string{"DISK FULL"}));
+    BOOST_CHECK(m.LineMatches(std::string{"abc"}, std::string{""}));
+    BOOST_CHECK(m.LineMatches(std::string{"x"}, std::string{"X"}));
+    BOOST_CHECK(!m.LineMatches(std::string{"error"}, std::string{"errors"}));
+    BOOST_CHECK(!m.LineMatches(std::string{""}, std::string{"a"}));
+    // '@' and '[' are next to 'A' and 'Z', and must not be folded.
+    BOOST_CHECK(!m.LineMatches(std::string{"@["}, std::string{"`{"}));
+}
+
+// Matches in every position of lines longer than a SIMD block, to go through
+// both the vector loop and the scalar tail.
+BOOST_AUTO_TEST_CASE(cim_ascii_long_lines)
+{
+    CaseInsensitiveLineMatcher m;
+    std::string const match{"NeedleInAHaystack"};
+
+    for (std::size_t len = match.size(); len < 80; ++len)
+    {
+        for (std::size_t pos = 0; pos + match.size() <= len; ++pos)
+        {
+            std::string line(len, 'n');
+            line.replace(pos, match.size(), "needleinahaystack");
+
+            BOOST_CHECK(m.LineMatches(boost::string_ref{line}, boost::string_ref{match}));
+
+            line[pos + match.size() / 2] = '#';
+            BOOST_CHECK(!m.LineMatches(boost::string_ref{line}, boost::string_ref{match}));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cim_unicode)
+{
+    CaseInsensitiveLineMatcher m;
+
+    BOOST_CHECK(m.LineMatches(std::string{"utilizador=JOÃO"}, std::string{"joão"}));
+    BOOST_CHECK(m.LineMatches(std::string{"ÉTÉ"}, std::string{"été"}));
+    // Full case folding - "ß" folds to "ss".
+    BOOST_CHECK(m.LineMatches(std::string{"STRASSE"}, std::string{"straße"}));
+    BOOST_CHECK(!m.LineMatches(std::string{"JOAO"}, std::string{"joão"}));
+}
+
+BOOST_AUTO_TEST_CASE(cim_reader)
+{
+    FileLineReader<CaseInsensitiveLineMatcher, SimpleLineCounter<unsigned long>> flr{kCaseFileName};
+
+    flr.SkipLinesUntilMatch("ERROR");
+    BOOST_REQUIRE(flr.WasReadOK());
+    BOOST_CHECK_EQUAL(flr.GetLineCount(), 2);
+    flr.SkipLinesUntilMatch("estado=erro");
+    BOOST_REQUIRE(flr.WasReadOK());
+    BOOST_CHECK_EQUAL(flr.GetLineCount(), 3);
+    BOOST_CHECK(flr.LineMatches("joão"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
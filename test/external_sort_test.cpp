@@ -0,0 +1,233 @@
+#include <boost/test/unit_test.hpp>
+
+#include "utils/external_sort.h"
+using pt::pcaetano::bluesy::utils::ExternalSorter;
+using pt::pcaetano::bluesy::utils::ExternalSortStats;
+using pt::pcaetano::bluesy::utils::LineKey;
+
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <ios>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+std::string const kUnsortedFileName{"es_test_file.flr"};
+std::string const kSortedFileName{"es_test_sorted.flr"};
+
+// Timestamps out of order, and a key with few values, so there are ties.
+std::vector<std::string> MakeLines(unsigned int count)
+{
+    std::vector<std::string> lines;
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<unsigned int> ms{0, 86399999};
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        unsigned int t = ms(gen);
+        char ts[32];
+        std::snprintf(ts, sizeof(ts), "[2014-01-01 %02u:%02u:%02u.%03u]",
+            t / 3600000, t / 60000 % 60, t / 1000 % 60, t % 1000);
+        lines.push_back(std::string{ts} + " match-" + std::to_string(t % 7) + " This is line " + std::to_string(i));
+    }
+
+    return lines;
+}
+
+void WriteLines(std::vector<std::string> const& lines)
+{
+    std::ofstream of{kUnsortedFileName, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary};
+
+    for (auto const& l : lines)
+    {
+        of << l << '\n';
+    }
+}
+
+std::vector<std::string> ReadLines(std::string const& file_name = kSortedFileName)
+{
+    std::ifstream in{file_name, std::ios_base::in | std::ios_base::binary};
+    std::vector<std::string> lines;
+
+    for (std::string l; std::getline(in, l); )
+    {
+        lines.push_back(l);
+    }
+
+    return lines;
+}
+
+// Run files left in the current directory, for sorts with this prefix.
+unsigned int CountRunFiles(std::string const& prefix)
+{
+    unsigned int count = 0;
+#ifndef _WIN32
+    std::string const run_prefix = prefix + ".run";
+    DIR* dir = opendir(".");
+    BOOST_REQUIRE(dir != nullptr);
+
+    while (dirent* e = readdir(dir))
+    {
+        count += (std::string{e->d_name}.compare(0, run_prefix.size(), run_prefix) == 0) ? 1 : 0;
+    }
+    closedir(dir);
+#endif
+    return count;
+}
+
+std::string KeyOf(std::string const& l)
+{
+    std::size_t begin = l.find(" match-") + 1;
+    return l.substr(begin, l.find(' ', begin) - begin);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(external_sort)
+
+BOOST_AUTO_TEST_CASE(sort_in_memory)
+{
+    std::vector<std::string> lines = MakeLines(1000);
+    WriteLines(lines);
+
+    ExternalSortStats stats = ExternalSorter{}.Sort(kUnsortedFileName, kSortedFileName);
+    BOOST_REQUIRE_EQUAL(stats.lines, 1000);
+    BOOST_REQUIRE_EQUAL(stats.runs, 0);
+
+    std::sort(lines.begin(), lines.end());
+    BOOST_REQUIRE(ReadLines() == lines);
+}
+
+BOOST_AUTO_TEST_CASE(sort_spilled_runs)
+{
+    std::vector<std::string> lines = MakeLines(20000);
+    WriteLines(lines);
+
+    for (unsigned int threads = 1; threads <= 3; ++threads)
+    {
+        ExternalSorter sorter;
+        sorter.SetMemoryLimit(64 * 1024);
+        sorter.SetThreadCount(threads);
+
+        ExternalSortStats stats = sorter.Sort(kUnsortedFileName, kSortedFileName);
+        BOOST_REQUIRE(stats.runs > 10);
+        // Front coding pays off on sorted timestamps.
+        BOOST_REQUIRE(stats.spilled_bytes < stats.input_bytes * 3 / 4);
+
+        std::vector<std::string> expected{lines};
+        std::sort(expected.begin(), expected.end());
+        BOOST_REQUIRE(ReadLines() == expected);
+
+        // Run files are gone.
+        BOOST_REQUIRE_EQUAL(CountRunFiles(kSortedFileName), 0u);
+    }
+}
+
+// Sorts sharing a sorter, and so its temp prefix, don't touch each other's runs.
+BOOST_AUTO_TEST_CASE(sort_concurrent)
+{
+    std::vector<std::string> lines = MakeLines(20000);
+    WriteLines(lines);
+    std::vector<std::string> expected{lines};
+    std::sort(expected.begin(), expected.end());
+
+    std::string const prefix{"es_test_shared"};
+    ExternalSorter sorter;
+    sorter.SetMemoryLimit(64 * 1024);
+    sorter.SetThreadCount(2);
+    sorter.SetTempPrefix(prefix);
+
+    unsigned int const sorts = 4;
+    std::vector<std::string> out_files;
+    std::vector<std::size_t> runs(sorts);
+    for (unsigned int i = 0; i < sorts; ++i)
+    {
+        out_files.push_back("es_test_sorted_" + std::to_string(i) + ".flr");
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < sorts; ++i)
+    {
+        threads.emplace_back([&sorter, &out_files, &runs, i]
+        {
+            try
+            {
+                runs[i] = sorter.Sort(kUnsortedFileName, out_files[i]).runs;
+            }
+            catch (...)
+            {
+                // Checked below.
+            }
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    for (unsigned int i = 0; i < sorts; ++i)
+    {
+        BOOST_REQUIRE(runs[i] > 10);
+        BOOST_REQUIRE(ReadLines(out_files[i]) == expected);
+        std::remove(out_files[i].c_str());
+    }
+    BOOST_REQUIRE_EQUAL(CountRunFiles(prefix), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(sort_radix_prefix)
+{
+    std::vector<std::string> lines = MakeLines(20000);
+    WriteLines(lines);
+
+    // By timestamp, which is the first 25 chars.
+    ExternalSorter sorter{LineKey::Whole()};
+    sorter.SetKeyWidth(25);
+    sorter.SetMemoryLimit(128 * 1024);
+    sorter.Sort(kUnsortedFileName, kSortedFileName);
+
+    std::stable_sort(lines.begin(), lines.end(),
+        [](std::string const& l, std::string const& r) { return l.compare(0, 25, r, 0, 25) < 0; });
+    BOOST_REQUIRE(ReadLines() == lines);
+}
+
+BOOST_AUTO_TEST_CASE(sort_stable_by_key)
+{
+    std::vector<std::string> lines = MakeLines(20000);
+    lines.push_back("no key");
+    WriteLines(lines);
+
+    auto by_key = [](std::string const& l, std::string const& r)
+    { return (l.find(" match-") == std::string::npos) ? (r.find(" match-") != std::string::npos) :
+        (r.find(" match-") != std::string::npos) && (KeyOf(l) < KeyOf(r)); };
+    std::stable_sort(lines.begin(), lines.end(), by_key);
+
+    // Both in memory, and merging runs.
+    for (std::size_t memory : {std::size_t{64 * 1024 * 1024}, std::size_t{64 * 1024}})
+    {
+        ExternalSorter sorter{LineKey::Field(2)};
+        sorter.SetStable(true);
+        sorter.SetMemoryLimit(memory);
+        sorter.Sort(kUnsortedFileName, kSortedFileName);
+
+        BOOST_REQUIRE(ReadLines() == lines);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sort_empty_file)
+{
+    WriteLines(std::vector<std::string>{});
+
+    BOOST_REQUIRE_EQUAL(ExternalSorter{}.Sort(kUnsortedFileName, kSortedFileName).lines, 0);
+    BOOST_REQUIRE(ReadLines().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,117 @@
+#include <boost/test/unit_test.hpp>
+
+#include "utils/file_chunks.h"
+using pt::pcaetano::bluesy::utils::FileChunk;
+using pt::pcaetano::bluesy::utils::ReadFileChunk;
+using pt::pcaetano::bluesy::utils::SplitLineChunks;
+#include "utils/file_line_reader.h"
+using pt::pcaetano::bluesy::utils::FileLineReader;
+
+#include <fstream>
+#include <ios>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::string const kChunkFileName{"fc_test_file.flr"};
+
+void WriteFile(std::string const& contents)
+{
+    std::ofstream of{kChunkFileName, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary};
+    of << contents;
+}
+
+// Lines of different lengths, from 1 to 30 chars, including the delimiter.
+std::string MakeContents(unsigned int lines)
+{
+    std::string contents;
+
+    for (unsigned int i = 0; i < lines; ++i)
+    {
+        contents.append(i % 30, static_cast<char>('a' + i % 26));
+        contents += '\n';
+    }
+
+    return contents;
+}
+
+// Checks that the chunks cover the whole file, in order, and only end after
+// a delimiter.
+void CheckChunks(std::vector<FileChunk> const& chunks, std::string const& contents)
+{
+    std::ifstream in{kChunkFileName, std::ios_base::in | std::ios_base::binary};
+    std::string buf;
+    std::string all;
+
+    for (auto const& c : chunks)
+    {
+        BOOST_REQUIRE(c.size > 0);
+        BOOST_REQUIRE_EQUAL(c.offset, static_cast<std::streamoff>(all.size()));
+        BOOST_REQUIRE(ReadFileChunk(in, c, buf));
+        BOOST_REQUIRE(buf.back() == '\n');
+        all += buf;
+    }
+
+    BOOST_REQUIRE(all == contents);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(file_chunks)
+
+BOOST_AUTO_TEST_CASE(fc_line_aligned)
+{
+    std::string contents = MakeContents(1000);
+    WriteFile(contents);
+
+    for (std::streamoff target : {1, 7, 64, 1000, 100000})
+    {
+        FileLineReader<> flr{kChunkFileName};
+        std::vector<FileChunk> chunks = SplitLineChunks(flr, target);
+
+        CheckChunks(chunks, contents);
+
+        // Only the last chunk can be smaller than the target.
+        for (std::size_t i = 0; i + 1 < chunks.size(); ++i)
+        {
+            BOOST_REQUIRE(chunks[i].size >= target);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(fc_long_line)
+{
+    std::string contents = "abc\n" + std::string(500, 'x') + "\nabc\n";
+    WriteFile(contents);
+
+    FileLineReader<> flr{kChunkFileName};
+    std::vector<FileChunk> chunks = SplitLineChunks(flr, 10);
+
+    CheckChunks(chunks, contents);
+    BOOST_REQUIRE_EQUAL(chunks.size(), 2);
+    BOOST_REQUIRE_EQUAL(chunks[0].size, 505);
+}
+
+BOOST_AUTO_TEST_CASE(fc_no_final_delimiter)
+{
+    WriteFile("abc\ndef\nghi");
+
+    FileLineReader<> flr{kChunkFileName};
+    std::vector<FileChunk> chunks = SplitLineChunks(flr, 2);
+
+    BOOST_REQUIRE_EQUAL(chunks.size(), 3);
+    BOOST_REQUIRE_EQUAL(chunks[2].offset, 8);
+    BOOST_REQUIRE_EQUAL(chunks[2].size, 3);
+}
+
+BOOST_AUTO_TEST_CASE(fc_empty_file)
+{
+    WriteFile("");
+
+    FileLineReader<> flr{kChunkFileName};
+    BOOST_REQUIRE(SplitLineChunks(flr, 10).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
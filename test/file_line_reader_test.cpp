@@ -3,16 +3,32 @@
 
 #include "utils/exception.h"
 using pt::pcaetano::bluesy::utils::FileOpenException;
+using pt::pcaetano::bluesy::utils::error_message;
 #include "utils/file_line_reader.h"
 using pt::pcaetano::bluesy::utils::FileLineReader;
-
+using pt::pcaetano::bluesy::utils::SimpleLineMatcher;
+using pt::pcaetano::bluesy::utils::SimpleLineCounter;
+using pt::pcaetano::bluesy::utils::NoReaderStats;
+#include "utils/line_length.h"
+using pt::pcaetano::bluesy::utils::SkipLongLines;
+using pt::pcaetano::bluesy::utils::SplitLongLines;
+using pt::pcaetano::bluesy::utils::TruncateLongLines;
+#include "utils/open_result.h"
+using pt::pcaetano::bluesy::utils::OpenResult;
+#include "utils/reader_stats.h"
+using pt::pcaetano::bluesy::utils::ReaderStatsSnapshot;
+using pt::pcaetano::bluesy::utils::SimpleReaderStats;
+
+#include <algorithm>
 #include <array>
 #include <fstream>
 #include <string>
+#include <system_error>
 
 std::string const kMissingFileName{"missing.flr"};
 std::string const kEmptyFileName{"flr_empty_file.flr"};
 std::string const kFileName{"flr_test_file.flr"};
+std::string const kLongLinesFileName{"flr_long_lines.flr"};
 
 std::array<std::string, 10> const lines =
 {{
@@ -28,6 +44,16 @@ std::array<std::string, 10> const lines =
     "[2014-01-01 00:00:00.900] match-7 This is line 9",
 }};
 
+// For the line length policies. We use a maximum line length of 16.
+std::size_t const kMaxLineLength = 16;
+std::array<std::string, 4> const long_lines =
+{{
+    "short line",
+    "0123456789abcdef0123456789abcdef0123456789 needle",
+    "exactly 16 chars",
+    "last line, which is also too long",
+}};
+
 // Creates two files for testing - an empty file, and a file with the content of the lines array<>
 struct FileFixture
 {
@@ -45,13 +71,17 @@ struct FileFixture
         {
             of << l << '\n';
         }
+
+        // No delimiter on the last line.
+        std::ofstream lf{kLongLinesFileName, std::ios_base::out | std::ios_base::trunc};
+        lf << long_lines[0] << '\n' << long_lines[1] << '\n' << long_lines[2] << '\n' << long_lines[3];
     }
 
     ~FileFixture() {}
 };
 
 // http://stackoverflow.com/questions/15918255/is-it-possible-to-initialize-the-fixture-only-once-and-use-it-in-multiple-test-c?rq=1
-BOOST_GLOBAL_FIXTURE(FileFixture)
+BOOST_GLOBAL_FIXTURE(FileFixture);
 
 BOOST_AUTO_TEST_SUITE(file_line_reader)
 
@@ -72,6 +102,36 @@ BOOST_AUTO_TEST_CASE(flr_file_missing_explicit_open)
     BOOST_REQUIRE_THROW(flr.Open(kMissingFileName), FileOpenException);
 }
 
+BOOST_AUTO_TEST_CASE(flr_file_missing_try_open)
+{
+    FileLineReader<> flr;
+    OpenResult r = flr.TryOpen(kMissingFileName);
+
+    BOOST_REQUIRE(!r);
+    BOOST_REQUIRE(r.GetError() == std::errc::no_such_file_or_directory);
+    BOOST_REQUIRE_NE(r.GetMessage().find(kMissingFileName), std::string::npos);
+    BOOST_REQUIRE_THROW(r.ThrowIfFailed(), FileOpenException);
+
+    try
+    {
+        r.ThrowIfFailed();
+    }
+    catch (FileOpenException const& e)
+    {
+        std::string const* message = boost::get_error_info<error_message>(e);
+        BOOST_REQUIRE(message != nullptr);
+        BOOST_REQUIRE_EQUAL(*message, r.GetMessage());
+        BOOST_REQUIRE_NE(std::string{e.what()}.find(r.GetMessage()), std::string::npos);
+    }
+
+    // The reader can still be used.
+    r = flr.TryOpen(kFileName);
+    BOOST_REQUIRE(r.IsOpen());
+    BOOST_REQUIRE(!r.GetError());
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), lines[0]);
+}
+
 BOOST_AUTO_TEST_CASE(empty_file)
 {
     FileLineReader<> flr{kEmptyFileName};
@@ -194,4 +254,164 @@ BOOST_AUTO_TEST_CASE(skip_number_lines)
     BOOST_REQUIRE_EQUAL(flr.CopyCurrentLine(), lines[7]);
 }
 
+BOOST_AUTO_TEST_CASE(no_stats_by_default)
+{
+    FileLineReader<> flr{kFileName};
+    flr.SkipLinesUntilMatch("match-5");
+
+    ReaderStatsSnapshot stats = flr.GetStats();
+    BOOST_REQUIRE_EQUAL(stats.lines, 0);
+    BOOST_REQUIRE_EQUAL(stats.bytes_read, 0);
+    BOOST_REQUIRE_EQUAL(stats.matches_tested, 0);
+}
+
+using StatsReader = FileLineReader<SimpleLineMatcher, SimpleLineCounter<unsigned long>, SimpleReaderStats>;
+
+BOOST_AUTO_TEST_CASE(stats_read_all)
+{
+    StatsReader flr{kFileName};
+    while (flr.ReadLine())
+    {
+        ;
+    }
+
+    unsigned long long expected_bytes = 0;
+    std::size_t expected_longest = 0;
+    for (auto const& l : lines)
+    {
+        expected_bytes += l.size() + 1;
+        expected_longest = std::max(expected_longest, l.size());
+    }
+
+    ReaderStatsSnapshot stats = flr.GetStats();
+    BOOST_REQUIRE_EQUAL(stats.lines, lines.size());
+    BOOST_REQUIRE_EQUAL(stats.bytes_read, expected_bytes);
+    BOOST_REQUIRE_EQUAL(stats.longest_line, expected_longest);
+    BOOST_REQUIRE(stats.read_calls > 0);
+}
+
+BOOST_AUTO_TEST_CASE(stats_last_line_without_delimiter)
+{
+    std::string const file_name{"flr_test_no_delimiter.flr"};
+    {
+        std::ofstream of{file_name, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary};
+        of << "short\nthe longest line";
+    }
+
+    StatsReader flr{file_name};
+    while (flr.ReadLine())
+    {
+        ;
+    }
+
+    ReaderStatsSnapshot stats = flr.GetStats();
+    BOOST_REQUIRE_EQUAL(stats.lines, 2);
+    BOOST_REQUIRE_EQUAL(stats.bytes_read, 22);
+    BOOST_REQUIRE_EQUAL(stats.longest_line, 16);
+}
+
+BOOST_AUTO_TEST_CASE(stats_matches)
+{
+    StatsReader flr{kFileName};
+    flr.SkipLinesUntilMatch("match-5");
+
+    ReaderStatsSnapshot stats = flr.GetStats();
+    BOOST_REQUIRE_EQUAL(stats.lines, 8);
+    BOOST_REQUIRE_EQUAL(stats.matches_tested, 8);
+    BOOST_REQUIRE_EQUAL(stats.matches_hit, 1);
+
+    BOOST_REQUIRE(flr.LineMatches("This is line 7"));
+    BOOST_REQUIRE_EQUAL(flr.GetStats().matches_hit, 2);
+}
+
+template <typename LineLength>
+using BoundedReader = FileLineReader<SimpleLineMatcher, SimpleLineCounter<unsigned long>,
+    NoReaderStats, LineLength>;
+
+BOOST_AUTO_TEST_CASE(truncate_long_lines)
+{
+    BoundedReader<TruncateLongLines> flr{kLongLinesFileName};
+    flr.SetMaxLineLength(kMaxLineLength);
+
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), long_lines[0]);
+    BOOST_REQUIRE(!flr.IsLinePartial());
+
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), long_lines[1].substr(0, kMaxLineLength));
+    BOOST_REQUIRE(flr.IsLinePartial());
+
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), long_lines[2]);
+    BOOST_REQUIRE(!flr.IsLinePartial());
+
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), long_lines[3].substr(0, kMaxLineLength));
+
+    BOOST_REQUIRE(!flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetLineCount(), long_lines.size());
+    BOOST_REQUIRE_EQUAL(flr.GetLongLineCount(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(split_long_lines)
+{
+    BoundedReader<SplitLongLines> flr{kLongLinesFileName};
+    flr.SetMaxLineLength(kMaxLineLength);
+
+    std::string rebuilt;
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE(!flr.IsLineContinuation());
+    do
+    {
+        BOOST_REQUIRE(flr.GetCurrentLine().size() <= kMaxLineLength);
+        rebuilt += flr.GetCurrentLine();
+    } while (flr.ReadLine() && flr.IsLineContinuation());
+
+    BOOST_REQUIRE_EQUAL(rebuilt, long_lines[1]);
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), long_lines[2]);
+    BOOST_REQUIRE_EQUAL(flr.GetLineCount(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(skip_long_lines)
+{
+    BoundedReader<SkipLongLines> flr{kLongLinesFileName};
+    flr.SetMaxLineLength(kMaxLineLength);
+
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), long_lines[0]);
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), long_lines[2]);
+    BOOST_REQUIRE(!flr.ReadLine());
+
+    BOOST_REQUIRE_EQUAL(flr.GetLineCount(), long_lines.size());
+    BOOST_REQUIRE_EQUAL(flr.GetLongLineCount(), 2);
+}
+
+// The match is beyond the maximum line length, and straddles two chunks.
+BOOST_AUTO_TEST_CASE(truncated_line_matches_whole_line)
+{
+    BoundedReader<TruncateLongLines> flr{kLongLinesFileName};
+    flr.SetMaxLineLength(kMaxLineLength);
+    flr.SkipLinesUntilMatch("9 need");
+
+    BOOST_REQUIRE(flr.WasReadOK());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), long_lines[1].substr(0, kMaxLineLength));
+    BOOST_REQUIRE(flr.LineMatches("needle"));
+    BOOST_REQUIRE_EQUAL(flr.GetLineCount(), 2);
+
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), long_lines[2]);
+}
+
+BOOST_AUTO_TEST_CASE(split_line_skipped_whole)
+{
+    BoundedReader<SplitLongLines> flr{kLongLinesFileName};
+    flr.SetMaxLineLength(kMaxLineLength);
+    flr.SkipLinesUntilMatch("16 chars");
+
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), long_lines[2]);
+    BOOST_REQUIRE_EQUAL(flr.GetLineCount(), 3);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
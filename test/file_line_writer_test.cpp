@@ -0,0 +1,234 @@
+#include <boost/test/unit_test.hpp>
+
+#include "utils/exception.h"
+using pt::pcaetano::bluesy::utils::FileOpenException;
+using pt::pcaetano::bluesy::utils::FileWriteException;
+using pt::pcaetano::bluesy::utils::error_message;
+#include "utils/file_line_reader.h"
+using pt::pcaetano::bluesy::utils::FileLineReader;
+#include "utils/file_line_writer.h"
+using pt::pcaetano::bluesy::utils::FileLineWriter;
+using pt::pcaetano::bluesy::utils::SyncPolicy;
+using pt::pcaetano::bluesy::utils::WriteMode;
+
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+namespace
+{
+
+std::string const kWriterFileName{"flw_test_file.flr"};
+
+std::string ReadAll(std::string const& file_name)
+{
+    std::ifstream in{file_name, std::ios_base::in | std::ios_base::binary};
+    return std::string{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+}
+
+std::string MakeLine(unsigned int i)
+{
+    return "[2014-01-01 00:00:00.000] match-" + std::to_string(i % 10) + " This is line " + std::to_string(i);
+}
+
+// Writes lines, some longer than the buffer, and checks they all made it,
+// in order.
+void WriteAndCheck(FileLineWriter& flw)
+{
+    std::string expected;
+
+    for (unsigned int i = 0; i < 5000; ++i)
+    {
+        std::string l = (i % 1000 == 999) ? std::string(300 + i / 10, 'x') : MakeLine(i);
+        flw.WriteLine(l);
+        expected += l + '\n';
+    }
+    flw.Write("no delimiter");
+    expected += "no delimiter";
+
+    BOOST_REQUIRE_EQUAL(flw.GetLineCount(), 5000);
+    BOOST_REQUIRE_EQUAL(flw.GetBytesWritten(), expected.size());
+
+    flw.Close();
+    BOOST_REQUIRE(!flw.IsOpen());
+    BOOST_REQUIRE(ReadAll(kWriterFileName) == expected);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(file_line_writer)
+
+BOOST_AUTO_TEST_CASE(flw_write_lines)
+{
+    FileLineWriter flw{kWriterFileName};
+    flw.SetBufferSize(256);
+    WriteAndCheck(flw);
+}
+
+BOOST_AUTO_TEST_CASE(flw_background_flush)
+{
+    FileLineWriter flw{kWriterFileName};
+    flw.SetBufferSize(256);
+    flw.SetBackgroundFlush(2);
+    flw.SetSyncPolicy(SyncPolicy::OnClose);
+    WriteAndCheck(flw);
+}
+
+// An empty line right after a line that fills the buffer exactly.
+BOOST_AUTO_TEST_CASE(flw_empty_line_on_full_buffer)
+{
+    for (std::size_t max_queued = 0; max_queued < 2; ++max_queued)
+    {
+        // Set before opening, so the buffer is allocated with this size.
+        FileLineWriter flw;
+        flw.SetBufferSize(8);
+        flw.SetBackgroundFlush(max_queued);
+        flw.Open(kWriterFileName);
+
+        flw.WriteLine("abcdefg");
+        flw.WriteLine("");
+        flw.WriteLine("");
+        flw.Close();
+
+        BOOST_REQUIRE_EQUAL(ReadAll(kWriterFileName), "abcdefg\n\n\n");
+    }
+}
+
+// Direct writes keep their place among buffered ones.
+BOOST_AUTO_TEST_CASE(flw_write_direct)
+{
+    for (std::size_t max_queued = 0; max_queued < 3; max_queued += 2)
+    {
+        FileLineWriter flw{kWriterFileName};
+        flw.SetBufferSize(64);
+        flw.SetBackgroundFlush(max_queued);
+
+        std::string expected;
+        for (unsigned int i = 0; i < 100; ++i)
+        {
+            flw.WriteLine(MakeLine(i));
+            expected += MakeLine(i) + '\n';
+            if (i % 7 == 0)
+            {
+                std::string direct = "direct " + std::to_string(i) + '\n';
+                flw.WriteDirect(direct);
+                expected += direct;
+            }
+        }
+        flw.WriteDirect("");
+
+        BOOST_REQUIRE_EQUAL(flw.GetBytesWritten(), expected.size());
+        flw.Close();
+        BOOST_REQUIRE(ReadAll(kWriterFileName) == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(flw_flush)
+{
+    FileLineWriter flw{kWriterFileName};
+    flw.SetBackgroundFlush(4);
+    flw.SetSyncPolicy(SyncPolicy::OnFlush);
+
+    flw.WriteLine("line 1");
+    BOOST_REQUIRE(ReadAll(kWriterFileName).empty());
+
+    flw.Flush();
+    BOOST_REQUIRE_EQUAL(ReadAll(kWriterFileName), "line 1\n");
+}
+
+BOOST_AUTO_TEST_CASE(flw_append)
+{
+    {
+        FileLineWriter flw{kWriterFileName};
+        flw.WriteLine("line 1");
+    }
+    {
+        FileLineWriter flw{kWriterFileName, WriteMode::Append};
+        flw.WriteLine("line 2");
+    }
+    BOOST_REQUIRE_EQUAL(ReadAll(kWriterFileName), "line 1\nline 2\n");
+
+    FileLineWriter flw{kWriterFileName};
+    flw.Close();
+    BOOST_REQUIRE(ReadAll(kWriterFileName).empty());
+}
+
+BOOST_AUTO_TEST_CASE(flw_copy_from_reader)
+{
+    {
+        std::ofstream of{kWriterFileName, std::ios_base::out | std::ios_base::trunc};
+        for (unsigned int i = 0; i < 100; ++i)
+        {
+            of << MakeLine(i) << '\n';
+        }
+    }
+
+    std::string const copy_name{"flw_test_copy.flr"};
+    FileLineReader<> flr{kWriterFileName};
+    FileLineWriter flw{copy_name};
+
+    while (flr.ReadLine())
+    {
+        if (flr.LineMatches("match-3"))
+        {
+            flw.WriteLine(flr.GetCurrentLine());
+        }
+    }
+    flw.Close();
+
+    std::ostringstream expected;
+    for (unsigned int i = 3; i < 100; i += 10)
+    {
+        expected << MakeLine(i) << '\n';
+    }
+    BOOST_REQUIRE_EQUAL(ReadAll(copy_name), expected.str());
+}
+
+BOOST_AUTO_TEST_CASE(flw_open_fail)
+{
+    BOOST_REQUIRE_THROW(FileLineWriter{"no_such_dir/flw_test_file.flr"}, FileOpenException);
+
+    FileLineWriter flw;
+    BOOST_REQUIRE(!flw.TryOpen("no_such_dir/flw_test_file.flr"));
+    BOOST_REQUIRE(!flw.IsOpen());
+    BOOST_REQUIRE(flw.TryOpen(kWriterFileName));
+}
+
+#ifdef __linux__
+BOOST_AUTO_TEST_CASE(flw_write_error)
+{
+    // Always full.
+    FileLineWriter flw{"/dev/full"};
+    flw.SetBufferSize(64);
+    flw.SetBackgroundFlush(1);
+
+    bool thrown = false;
+    try
+    {
+        for (unsigned int i = 0; i < 100; ++i)
+        {
+            flw.WriteLine(MakeLine(i));
+        }
+        flw.Close();
+    }
+    catch (FileWriteException const& e)
+    {
+        thrown = true;
+        std::string const* message = boost::get_error_info<error_message>(e);
+        BOOST_REQUIRE(message != nullptr);
+        BOOST_REQUIRE_EQUAL(message->find("Error writing file /dev/full: "), 0u);
+    }
+    BOOST_REQUIRE(thrown);
+
+    // The error sticks, but the file still gets closed.
+    if (flw.IsOpen())
+    {
+        BOOST_REQUIRE_THROW(flw.Close(), FileWriteException);
+    }
+    BOOST_REQUIRE(!flw.IsOpen());
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,268 @@
+#include <boost/test/unit_test.hpp>
+
+#include "utils/exception.h"
+using pt::pcaetano::bluesy::utils::FileReadException;
+using pt::pcaetano::bluesy::utils::SketchException;
+#include "utils/file_line_reader.h"
+using pt::pcaetano::bluesy::utils::FileLineReader;
+#include "utils/key_sketches.h"
+using pt::pcaetano::bluesy::utils::CountMinSketch;
+using pt::pcaetano::bluesy::utils::ForEachLineKey;
+using pt::pcaetano::bluesy::utils::HyperLogLog;
+using pt::pcaetano::bluesy::utils::LineKey;
+using pt::pcaetano::bluesy::utils::SpaceSaving;
+
+#include <boost/utility/string_ref.hpp>
+
+#include <cmath>
+#include <fstream>
+#include <ios>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::string const kSketchFileName{"ks_test_file.flr"};
+
+std::string MakeKey(unsigned int i)
+{
+    return "session-" + std::to_string(i);
+}
+
+// Key i is added i times, for i in [1, keys].
+template <typename Fn>
+void AddSkewedKeys(unsigned int keys, Fn add)
+{
+    for (unsigned int i = 1; i <= keys; ++i)
+    {
+        for (unsigned int j = 0; j < i; ++j)
+        {
+            add(MakeKey(i));
+        }
+    }
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(key_sketches)
+
+BOOST_AUTO_TEST_CASE(hll_estimate)
+{
+    HyperLogLog hll;
+
+    BOOST_REQUIRE_EQUAL(hll.Estimate(), 0);
+
+    for (unsigned int i = 0; i < 100; ++i)
+    {
+        // Repeats don't count.
+        hll.Add(MakeKey(i));
+        hll.Add(MakeKey(i));
+    }
+    BOOST_REQUIRE_CLOSE(hll.Estimate(), 100, 3);
+
+    for (unsigned int i = 100; i < 200000; ++i)
+    {
+        hll.Add(MakeKey(i));
+    }
+    BOOST_REQUIRE_CLOSE(hll.Estimate(), 200000, 3);
+}
+
+BOOST_AUTO_TEST_CASE(hll_merge)
+{
+    HyperLogLog a;
+    HyperLogLog b;
+    HyperLogLog both;
+
+    for (unsigned int i = 0; i < 60000; ++i)
+    {
+        // Overlapping halves.
+        (i < 40000 ? a : b).Add(MakeKey(i));
+        if (i >= 20000)
+        {
+            b.Add(MakeKey(i));
+        }
+        both.Add(MakeKey(i));
+    }
+
+    a.Merge(b);
+    BOOST_REQUIRE_EQUAL(a.Estimate(), both.Estimate());
+
+    HyperLogLog small{10};
+    BOOST_REQUIRE_THROW(a.Merge(small), SketchException);
+    BOOST_REQUIRE_THROW(HyperLogLog{30}, SketchException);
+}
+
+BOOST_AUTO_TEST_CASE(count_min_estimate)
+{
+    CountMinSketch cms{1024, 4};
+    AddSkewedKeys(500, [&cms](std::string const& k) { cms.Add(k); });
+
+    BOOST_REQUIRE_EQUAL(cms.GetTotal(), 500 * 501 / 2);
+
+    // Never under; over by at most e * total / width, for 1 - e^-4 (98%) of
+    // the keys.
+    unsigned long long bound = static_cast<unsigned long long>(std::exp(1.0) * cms.GetTotal() / cms.GetWidth());
+    unsigned int within = 0;
+    for (unsigned int i = 1; i <= 500; ++i)
+    {
+        unsigned long long e = cms.Estimate(MakeKey(i));
+        BOOST_REQUIRE(e >= i);
+        within += (e <= i + bound) ? 1 : 0;
+    }
+    BOOST_REQUIRE(within >= 475);
+
+    CountMinSketch other{1024, 4};
+    other.Add(MakeKey(1), 1000);
+    cms.Merge(other);
+    BOOST_REQUIRE(cms.Estimate(MakeKey(1)) >= 1001);
+
+    BOOST_REQUIRE_THROW(cms.Merge(CountMinSketch{512, 4}), SketchException);
+}
+
+BOOST_AUTO_TEST_CASE(space_saving_top)
+{
+    SpaceSaving ss{50};
+    AddSkewedKeys(1000, [&ss](std::string const& k) { ss.Add(k); });
+
+    BOOST_REQUIRE_EQUAL(ss.GetSize(), 50);
+    BOOST_REQUIRE_EQUAL(ss.GetTotal(), 1000 * 1001 / 2);
+
+    // The heaviest keys are well above total / capacity, so they're kept,
+    // and their counts are within their error.
+    std::vector<SpaceSaving::Item> top = ss.Top(10);
+    BOOST_REQUIRE_EQUAL(top.size(), 10);
+    for (unsigned int i = 0; i < 10; ++i)
+    {
+        BOOST_REQUIRE_EQUAL(top[i].key, MakeKey(1000 - i));
+        BOOST_REQUIRE(top[i].count >= 1000 - i);
+        BOOST_REQUIRE(top[i].count - top[i].error <= 1000 - i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(space_saving_merge)
+{
+    SpaceSaving a{20};
+    SpaceSaving b{20};
+
+    // a sees the odd keys, b the even ones, and both see the heavy hitter.
+    AddSkewedKeys(300, [&a, &b](std::string const& k)
+        { ((k.back() - '0') % 2 == 0 ? b : a).Add(k); });
+    a.Add("heavy", 5000);
+    b.Add("heavy", 5000);
+
+    a.Merge(b);
+    BOOST_REQUIRE_EQUAL(a.GetTotal(), 300 * 301 / 2 + 10000);
+    BOOST_REQUIRE(a.GetSize() <= a.GetCapacity());
+
+    std::vector<SpaceSaving::Item> top = a.Top(3);
+    BOOST_REQUIRE_EQUAL(top[0].key, "heavy");
+    BOOST_REQUIRE(top[0].count >= 10000);
+    BOOST_REQUIRE_EQUAL(top[1].key, MakeKey(300));
+    BOOST_REQUIRE_EQUAL(top[2].key, MakeKey(299));
+
+    BOOST_REQUIRE_THROW(a.Merge(SpaceSaving{10}), SketchException);
+}
+
+BOOST_AUTO_TEST_CASE(serialize_sketches)
+{
+    HyperLogLog hll{12};
+    CountMinSketch cms{256, 3};
+    SpaceSaving ss{10};
+    AddSkewedKeys(100, [&](std::string const& k) { hll.Add(k); cms.Add(k); ss.Add(k); });
+
+    std::stringstream s;
+    hll.WriteTo(s);
+    cms.WriteTo(s);
+    ss.WriteTo(s);
+
+    HyperLogLog hll2 = HyperLogLog::ReadFrom(s);
+    CountMinSketch cms2 = CountMinSketch::ReadFrom(s);
+    SpaceSaving ss2 = SpaceSaving::ReadFrom(s);
+
+    BOOST_REQUIRE_EQUAL(hll2.GetPrecision(), 12);
+    BOOST_REQUIRE_EQUAL(hll2.Estimate(), hll.Estimate());
+    BOOST_REQUIRE_EQUAL(cms2.GetTotal(), cms.GetTotal());
+    BOOST_REQUIRE_EQUAL(cms2.Estimate(MakeKey(50)), cms.Estimate(MakeKey(50)));
+    BOOST_REQUIRE_EQUAL(ss2.GetTotal(), ss.GetTotal());
+
+    std::vector<SpaceSaving::Item> t1 = ss.Top(10);
+    std::vector<SpaceSaving::Item> t2 = ss2.Top(10);
+    BOOST_REQUIRE_EQUAL(t1.size(), t2.size());
+    for (std::size_t i = 0; i < t1.size(); ++i)
+    {
+        BOOST_REQUIRE_EQUAL(t1[i].key, t2[i].key);
+        BOOST_REQUIRE_EQUAL(t1[i].count, t2[i].count);
+        BOOST_REQUIRE_EQUAL(t1[i].error, t2[i].error);
+    }
+
+    // A sketch read back can go on counting.
+    ss2.Add(MakeKey(100), 1000);
+    BOOST_REQUIRE_EQUAL(ss2.Top(1)[0].key, MakeKey(100));
+
+    std::stringstream bad{"not a sketch"};
+    BOOST_REQUIRE_THROW(HyperLogLog::ReadFrom(bad), FileReadException);
+    std::stringstream truncated{s.str().substr(0, 20)};
+    BOOST_REQUIRE_THROW(HyperLogLog::ReadFrom(truncated), FileReadException);
+}
+
+// Sizes no sketch we wrote could have throw, instead of being allocated.
+BOOST_AUTO_TEST_CASE(read_corrupt_sizes)
+{
+    auto patch = [](std::string s, std::size_t offset, std::uint64_t value, std::size_t size)
+    {
+        s.replace(offset, size, reinterpret_cast<char const*>(&value), size);
+        return s;
+    };
+
+    std::stringstream cmsOut;
+    CountMinSketch{256, 3}.WriteTo(cmsOut);
+    std::string const cms = cmsOut.str();
+
+    // Width (after the magic), then depth.
+    std::stringstream huge{patch(patch(cms, 8, std::uint64_t{1} << 32, 8), 16, 64, 8)};
+    BOOST_REQUIRE_THROW(CountMinSketch::ReadFrom(huge), FileReadException);
+    std::stringstream truncated{patch(cms, 8, 1 << 20, 8)};
+    BOOST_REQUIRE_THROW(CountMinSketch::ReadFrom(truncated), FileReadException);
+
+    SpaceSaving ss{10};
+    ss.Add("key");
+    std::stringstream ssOut;
+    ss.WriteTo(ssOut);
+    std::string const sss = ssOut.str();
+
+    // Capacity (after the magic), size, and the first key's length.
+    std::stringstream hugeCapacity{patch(sss, 8, std::uint64_t{1} << 32, 8)};
+    BOOST_REQUIRE_THROW(SpaceSaving::ReadFrom(hugeCapacity), FileReadException);
+    std::stringstream hugeSize{patch(patch(sss, 8, 1 << 20, 8), 24, 1 << 20, 8)};
+    BOOST_REQUIRE_THROW(SpaceSaving::ReadFrom(hugeSize), FileReadException);
+    std::stringstream hugeKey{patch(sss, 48, 0x80000000u, 4)};
+    BOOST_REQUIRE_THROW(SpaceSaving::ReadFrom(hugeKey), FileReadException);
+
+    std::stringstream good{sss};
+    BOOST_REQUIRE_EQUAL(SpaceSaving::ReadFrom(good).Top(1)[0].key, "key");
+}
+
+BOOST_AUTO_TEST_CASE(sketch_line_keys)
+{
+    {
+        std::ofstream of{kSketchFileName, std::ios_base::out | std::ios_base::trunc};
+        for (unsigned int i = 0; i < 1000; ++i)
+        {
+            of << "[2014-01-01 00:00:00.000] match-" << (i % 10) << " This is line " << i << '\n';
+        }
+        of << "no key\n";
+    }
+
+    FileLineReader<> flr{kSketchFileName};
+    HyperLogLog hll;
+    SpaceSaving ss{5};
+
+    BOOST_REQUIRE_EQUAL(ForEachLineKey(flr, LineKey::After("] "),
+        [&](boost::string_ref k) { hll.Add(k); ss.Add(k); }), 1000);
+    BOOST_REQUIRE_EQUAL(std::lround(hll.Estimate()), 10);
+    BOOST_REQUIRE_EQUAL(ss.GetTotal(), 1000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,175 @@
+#include <boost/test/unit_test.hpp>
+
+#include "utils/line_aggregator.h"
+using pt::pcaetano::bluesy::utils::AggregateFile;
+using pt::pcaetano::bluesy::utils::BracketedTimestamp;
+using pt::pcaetano::bluesy::utils::GroupStats;
+using pt::pcaetano::bluesy::utils::LineAggregator;
+using pt::pcaetano::bluesy::utils::LineKey;
+
+#include <boost/utility/string_ref.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <ios>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::string const kAggregateFileName{"la_test_file.flr"};
+
+// Line i is at i * 100 ms, and has key match-(i % keys).
+std::string MakeLine(unsigned int i, unsigned int keys)
+{
+    unsigned int ms = i * 100;
+    char ts[32];
+    std::snprintf(ts, sizeof(ts), "[2014-01-01 00:%02u:%02u.%03u]", ms / 60000, ms / 1000 % 60, ms % 1000);
+    return std::string{ts} + " match-" + std::to_string(i % keys) + " This is line " + std::to_string(i);
+}
+
+std::string MakeContents(unsigned int lines, unsigned int keys)
+{
+    std::string contents;
+
+    for (unsigned int i = 0; i < lines; ++i)
+    {
+        contents += MakeLine(i, keys) + '\n';
+    }
+
+    return contents;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(line_aggregator)
+
+BOOST_AUTO_TEST_CASE(line_key)
+{
+    boost::string_ref key;
+    std::string line{"[2014-01-01 00:00:00.100]  match-1 This is line 1"};
+
+    BOOST_REQUIRE(LineKey::Field(2).Extract(line, key));
+    BOOST_REQUIRE_EQUAL(key, "match-1");
+    BOOST_REQUIRE(LineKey::Field(0).Extract(line, key));
+    BOOST_REQUIRE_EQUAL(key, "[2014-01-01");
+    BOOST_REQUIRE(!LineKey::Field(7).Extract(line, key));
+
+    BOOST_REQUIRE(LineKey::After("match-").Extract(line, key));
+    BOOST_REQUIRE_EQUAL(key, "1");
+    BOOST_REQUIRE(LineKey::After("]", ' ').Extract("[x]a b", key));
+    BOOST_REQUIRE_EQUAL(key, "a");
+    BOOST_REQUIRE(!LineKey::After("nomatch").Extract(line, key));
+}
+
+BOOST_AUTO_TEST_CASE(bracketed_timestamp)
+{
+    std::int64_t ms = 0;
+    BracketedTimestamp ts;
+
+    BOOST_REQUIRE(ts.Parse("[1970-01-01 00:00:01.5] x", ms));
+    BOOST_REQUIRE_EQUAL(ms, 1500);
+    BOOST_REQUIRE(ts.Parse("2014-01-01T00:00:00.123456", ms));
+    BOOST_REQUIRE_EQUAL(ms, 1388534400123);
+    BOOST_REQUIRE(!ts.Parse("[2014-13-01 00:00:00]", ms));
+    BOOST_REQUIRE(!ts.Parse("match-1", ms));
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_lines)
+{
+    LineAggregator agg{LineKey::Field(2)};
+
+    agg.AddLines(MakeContents(1000, 7));
+    BOOST_REQUIRE(!agg.AddLine("no key"));
+
+    BOOST_REQUIRE_EQUAL(agg.GetGroupCount(), 7);
+    BOOST_REQUIRE_EQUAL(agg.GetLineCount(), 1001);
+    BOOST_REQUIRE_EQUAL(agg.GetKeylessLineCount(), 1);
+
+    GroupStats const* g = agg.Find("match-3");
+    BOOST_REQUIRE(g != nullptr);
+    BOOST_REQUIRE_EQUAL(g->lines, 143);
+    BOOST_REQUIRE_EQUAL(g->timed_lines, 143);
+    BOOST_REQUIRE_EQUAL(g->last_ms - g->first_ms, 142 * 700);
+    // 700 ms apart, i.e., bucket [512, 1024).
+    BOOST_REQUIRE_EQUAL(g->delta_histogram[10], 142);
+
+    BOOST_REQUIRE(agg.Find("match-7") == nullptr);
+
+    std::vector<std::string> keys;
+    agg.ForEachGroup([&keys](boost::string_ref k, GroupStats const&) { keys.push_back(k.to_string()); });
+    BOOST_REQUIRE_EQUAL(keys.size(), 7);
+    BOOST_REQUIRE_EQUAL(keys[0], "match-0");
+    BOOST_REQUIRE_EQUAL(keys[6], "match-6");
+}
+
+BOOST_AUTO_TEST_CASE(many_groups)
+{
+    // Enough to grow the table a few times.
+    LineAggregator agg{LineKey::Field(2)};
+    agg.AddLines(MakeContents(20000, 5000));
+
+    BOOST_REQUIRE_EQUAL(agg.GetGroupCount(), 5000);
+    for (unsigned int k = 0; k < 5000; k += 499)
+    {
+        GroupStats const* g = agg.Find("match-" + std::to_string(k));
+        BOOST_REQUIRE(g != nullptr);
+        BOOST_REQUIRE_EQUAL(g->lines, 4);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(merge_in_file_order)
+{
+    std::string first = MakeContents(1000, 7);
+    std::string all = MakeContents(2000, 7);
+
+    LineAggregator whole{LineKey::Field(2)};
+    whole.AddLines(all);
+
+    LineAggregator a{LineKey::Field(2)};
+    LineAggregator b{LineKey::Field(2)};
+    a.AddLines(boost::string_ref{all}.substr(0, first.size()));
+    b.AddLines(boost::string_ref{all}.substr(first.size()));
+    a.Merge(b);
+
+    BOOST_REQUIRE_EQUAL(a.GetLineCount(), whole.GetLineCount());
+    whole.ForEachGroup([&a](boost::string_ref k, GroupStats const& w)
+    {
+        GroupStats const* m = a.Find(k);
+        BOOST_REQUIRE(m != nullptr);
+        BOOST_REQUIRE_EQUAL(m->lines, w.lines);
+        BOOST_REQUIRE_EQUAL(m->first_ms, w.first_ms);
+        BOOST_REQUIRE_EQUAL(m->last_ms, w.last_ms);
+        BOOST_REQUIRE(m->delta_histogram == w.delta_histogram);
+    });
+}
+
+BOOST_AUTO_TEST_CASE(aggregate_file_parallel)
+{
+    std::string contents = MakeContents(5000, 13);
+    {
+        std::ofstream of{kAggregateFileName, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary};
+        of << contents;
+    }
+
+    LineAggregator whole{LineKey::Field(2)};
+    whole.AddLines(contents);
+
+    LineAggregator agg = AggregateFile(kAggregateFileName, LineKey::Field(2), 4, 1000);
+
+    BOOST_REQUIRE_EQUAL(agg.GetLineCount(), 5000);
+    BOOST_REQUIRE_EQUAL(agg.GetGroupCount(), 13);
+    whole.ForEachGroup([&agg](boost::string_ref k, GroupStats const& w)
+    {
+        GroupStats const* m = agg.Find(k);
+        BOOST_REQUIRE(m != nullptr);
+        BOOST_REQUIRE_EQUAL(m->lines, w.lines);
+        BOOST_REQUIRE_EQUAL(m->first_ms, w.first_ms);
+        BOOST_REQUIRE_EQUAL(m->last_ms, w.last_ms);
+        BOOST_REQUIRE(m->delta_histogram == w.delta_histogram);
+    });
+}
+
+BOOST_AUTO_TEST_SUITE_END()
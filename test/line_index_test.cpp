@@ -0,0 +1,175 @@
+#include <boost/test/unit_test.hpp>
+
+#include "utils/exception.h"
+using pt::pcaetano::bluesy::utils::FileOpenException;
+using pt::pcaetano::bluesy::utils::FileReadException;
+#include "utils/file_line_reader.h"
+using pt::pcaetano::bluesy::utils::FileLineReader;
+#include "utils/line_index.h"
+using pt::pcaetano::bluesy::utils::BuildLineIndex;
+using pt::pcaetano::bluesy::utils::ForEachTerm;
+using pt::pcaetano::bluesy::utils::LineIndex;
+using pt::pcaetano::bluesy::utils::ReadLinesAt;
+
+#include <boost/utility/string_ref.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <ios>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::string const kIndexedFileName{"li_test_file.flr"};
+std::string const kIndexFileName{"li_test_file.idx"};
+unsigned int const kIndexedLines = 1000;
+
+std::string MakeLine(unsigned int i)
+{
+    return "[2014-01-01] match-" + std::to_string(i % 10) + " This is line " + std::to_string(i) +
+        ((i % 100 == 0) ? " hundred hundred" : "");
+}
+
+struct IndexFileFixture
+{
+    IndexFileFixture()
+    {
+        std::ofstream of{kIndexedFileName, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary};
+
+        for (unsigned int i = 0; i < kIndexedLines; ++i)
+        {
+            std::string l = MakeLine(i);
+            offsets.push_back(static_cast<std::streamoff>(of.tellp()));
+            of << l << '\n';
+        }
+        of.close();
+
+        FileLineReader<> flr{kIndexedFileName};
+        BuildLineIndex(flr, kIndexFileName);
+    }
+
+    ~IndexFileFixture()
+    {
+        std::remove(kIndexFileName.c_str());
+    }
+
+    std::vector<std::streamoff> offsets;
+};
+
+} // unnamed namespace
+
+BOOST_FIXTURE_TEST_SUITE(line_index, IndexFileFixture)
+
+BOOST_AUTO_TEST_CASE(for_each_term)
+{
+    std::vector<std::string> terms;
+    ForEachTerm("[2014-01-01 00:00:00.100] match-1, line_1 " + std::string(70, 'x') + " a",
+        [&terms](boost::string_ref t) { terms.push_back(t.to_string()); });
+
+    std::vector<std::string> expected{"2014-01-01", "00", "00", "00", "100", "match-1", "line_1", "a"};
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(terms.begin(), terms.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(find_term)
+{
+    LineIndex idx{kIndexFileName};
+
+    BOOST_REQUIRE_EQUAL(idx.GetLineCount(), kIndexedLines);
+    BOOST_REQUIRE(idx.IsCurrentFor(kIndexedFileName));
+
+    std::vector<std::streamoff> found = idx.Find("match-3");
+    BOOST_REQUIRE_EQUAL(found.size(), kIndexedLines / 10);
+    BOOST_REQUIRE_EQUAL(idx.CountLines("match-3"), kIndexedLines / 10);
+    for (std::size_t i = 0; i < found.size(); ++i)
+    {
+        BOOST_REQUIRE_EQUAL(found[i], offsets[i * 10 + 3]);
+    }
+
+    // A term repeated in a line is posted once.
+    BOOST_REQUIRE_EQUAL(idx.Find("hundred").size(), kIndexedLines / 100);
+
+    // Every line.
+    BOOST_REQUIRE(idx.Find("This") == offsets);
+
+    // Whole terms only, and case matters.
+    BOOST_REQUIRE(idx.Find("match").empty());
+    BOOST_REQUIRE(idx.Find("this").empty());
+    BOOST_REQUIRE(idx.Find("zzz").empty());
+    BOOST_REQUIRE_EQUAL(idx.CountLines("zzz"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(find_all_terms)
+{
+    LineIndex idx{kIndexFileName};
+
+    std::vector<std::streamoff> found = idx.FindAll({"match-0", "hundred"});
+    BOOST_REQUIRE_EQUAL(found.size(), kIndexedLines / 100);
+    BOOST_REQUIRE_EQUAL(found[1], offsets[100]);
+
+    BOOST_REQUIRE_EQUAL(idx.FindAll({"match-7", "777"}).size(), 1);
+    BOOST_REQUIRE(idx.FindAll({"match-7", "778"}).empty());
+    BOOST_REQUIRE(idx.FindAll({"match-7", "zzz"}).empty());
+}
+
+BOOST_AUTO_TEST_CASE(read_lines_at)
+{
+    LineIndex idx{kIndexFileName};
+    FileLineReader<> flr{kIndexedFileName};
+
+    std::vector<std::string> lines;
+    BOOST_REQUIRE_EQUAL(ReadLinesAt(flr, idx.Find("match-9"), std::back_inserter(lines)), kIndexedLines / 10);
+
+    for (std::size_t i = 0; i < lines.size(); ++i)
+    {
+        BOOST_REQUIRE_EQUAL(lines[i], MakeLine(i * 10 + 9));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stale_index)
+{
+    LineIndex idx{kIndexFileName};
+
+    {
+        std::ofstream of{kIndexedFileName, std::ios_base::out | std::ios_base::app | std::ios_base::binary};
+        of << "one more line\n";
+    }
+
+    BOOST_REQUIRE(!idx.IsCurrentFor(kIndexedFileName));
+}
+
+BOOST_AUTO_TEST_CASE(invalid_index)
+{
+    BOOST_REQUIRE_THROW(LineIndex{"li_no_such_file.idx"}, FileOpenException);
+
+    {
+        std::ofstream of{kIndexFileName, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary};
+        of << std::string(200, 'x');
+    }
+
+    BOOST_REQUIRE_THROW(LineIndex{kIndexFileName}, FileReadException);
+}
+
+#ifndef _WIN32
+// Without the file's size and modification time, the index could never be
+// current, so it isn't written.
+BOOST_AUTO_TEST_CASE(source_removed)
+{
+    std::string const removedFileName{"li_removed_file.flr"};
+    std::string const removedIndexName{"li_removed_file.idx"};
+    {
+        std::ofstream of{removedFileName, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary};
+        of << MakeLine(0) << '\n';
+    }
+
+    FileLineReader<> flr{removedFileName};
+    std::remove(removedFileName.c_str());
+
+    BOOST_REQUIRE_THROW(BuildLineIndex(flr, removedIndexName), FileReadException);
+    BOOST_REQUIRE(!std::ifstream{removedIndexName});
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
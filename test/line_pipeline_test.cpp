@@ -0,0 +1,137 @@
+#include <boost/test/unit_test.hpp>
+
+#include "utils/file_line_reader.h"
+using pt::pcaetano::bluesy::utils::FileLineReader;
+#include "utils/line_pipeline.h"
+using pt::pcaetano::bluesy::utils::Drop;
+using pt::pcaetano::bluesy::utils::DropWhile;
+using pt::pcaetano::bluesy::utils::Filter;
+using pt::pcaetano::bluesy::utils::ForEach;
+using pt::pcaetano::bluesy::utils::Lines;
+using pt::pcaetano::bluesy::utils::LinesFromCurrent;
+using pt::pcaetano::bluesy::utils::Matching;
+using pt::pcaetano::bluesy::utils::SkipMatchingLine;
+using pt::pcaetano::bluesy::utils::SkipMatchingLines;
+using pt::pcaetano::bluesy::utils::SkipUntil;
+using pt::pcaetano::bluesy::utils::Take;
+using pt::pcaetano::bluesy::utils::Transform;
+
+#include <boost/utility/string_ref.hpp>
+
+#include <array>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::string const kPipelineFileName{"lp_test_file.flr"};
+
+std::array<std::string, 6> const pipeline_lines =
+{{
+    "header one",
+    "header two",
+    "data alpha ERROR",
+    "data beta",
+    "data gamma ERROR",
+    "data delta ERROR",
+}};
+
+struct PipelineFileFixture
+{
+    PipelineFileFixture()
+    {
+        std::ofstream of{kPipelineFileName, std::ios_base::out | std::ios_base::trunc};
+
+        for (auto const& l : pipeline_lines)
+        {
+            of << l << '\n';
+        }
+    }
+};
+
+template <typename Stage>
+std::vector<std::string> Collect(Stage&& stage)
+{
+    std::vector<std::string> v;
+    for (auto const& l : stage)
+    {
+        v.push_back(std::string(l.begin(), l.end()));
+    }
+    return v;
+}
+
+} // unnamed namespace
+
+BOOST_FIXTURE_TEST_SUITE(line_pipeline, PipelineFileFixture)
+
+BOOST_AUTO_TEST_CASE(lp_all_lines)
+{
+    FileLineReader<> flr{kPipelineFileName};
+    std::vector<std::string> actual = Collect(Lines(flr));
+
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(actual.begin(), actual.end(), pipeline_lines.begin(), pipeline_lines.end());
+}
+
+BOOST_AUTO_TEST_CASE(lp_filter_take)
+{
+    FileLineReader<> flr{kPipelineFileName};
+    std::vector<std::string> actual = Collect(Lines(flr) | Matching("ERROR") | Take(2));
+    std::vector<std::string> expected{pipeline_lines[2], pipeline_lines[4]};
+
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+    // Take() doesn't read past what it needs.
+    BOOST_REQUIRE_EQUAL(flr.GetLineCount(), 5);
+}
+
+BOOST_AUTO_TEST_CASE(lp_skip_until_transform)
+{
+    FileLineReader<> flr{kPipelineFileName};
+    std::vector<std::size_t> sizes;
+
+    ForEach(Lines(flr) | SkipUntil("beta") | Transform([](boost::string_ref l) { return l.size(); }),
+        [&sizes](std::size_t s) { sizes.push_back(s); });
+
+    std::vector<std::size_t> expected{pipeline_lines[3].size(), pipeline_lines[4].size(),
+        pipeline_lines[5].size()};
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(sizes.begin(), sizes.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(lp_drop_while)
+{
+    FileLineReader<> flr{kPipelineFileName};
+    std::vector<std::string> actual = Collect(Lines(flr) | SkipMatchingLines("header") |
+        DropWhile([](boost::string_ref l) { return l.ends_with("ERROR"); }) | Take(1));
+
+    BOOST_REQUIRE_EQUAL(actual.size(), 1);
+    BOOST_REQUIRE_EQUAL(actual[0], pipeline_lines[3]);
+}
+
+// Same semantics as the FileLineReader skip functions.
+BOOST_AUTO_TEST_CASE(lp_skip_semantics)
+{
+    FileLineReader<> flr1{kPipelineFileName};
+    flr1.SkipMatchingLine("header");
+    FileLineReader<> flr2{kPipelineFileName};
+    BOOST_REQUIRE_EQUAL(Collect(Lines(flr2) | SkipMatchingLine("header") | Take(1))[0], flr1.GetCurrentLine());
+
+    FileLineReader<> flr3{kPipelineFileName};
+    flr3.SkipNumberLines(4);
+    FileLineReader<> flr4{kPipelineFileName};
+    BOOST_REQUIRE_EQUAL(Collect(Lines(flr4) | Drop(3) | Take(1))[0], flr3.GetCurrentLine());
+}
+
+BOOST_AUTO_TEST_CASE(lp_from_current)
+{
+    FileLineReader<> flr{kPipelineFileName};
+    flr.SkipLinesUntilMatch("gamma");
+
+    std::vector<std::string> actual = Collect(LinesFromCurrent(flr) |
+        Filter([](boost::string_ref l) { return l.starts_with("data"); }));
+    std::vector<std::string> expected{pipeline_lines[4], pipeline_lines[5]};
+
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(actual.begin(), actual.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
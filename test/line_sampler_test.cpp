@@ -0,0 +1,140 @@
+#include <boost/test/unit_test.hpp>
+
+#include "utils/file_line_reader.h"
+using pt::pcaetano::bluesy::utils::FileLineReader;
+#include "utils/line_sampler.h"
+using pt::pcaetano::bluesy::utils::SampleByteStride;
+using pt::pcaetano::bluesy::utils::SampleEveryNthLine;
+using pt::pcaetano::bluesy::utils::SampleRandomOffsets;
+using pt::pcaetano::bluesy::utils::SampleReservoir;
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::string const kSampleFileName{"ls_test_file.flr"};
+unsigned int const kSampleLines = 1000;
+
+// Every line has the same length, so we know where each one begins.
+std::string MakeLine(unsigned int i)
+{
+    std::string n = std::to_string(i);
+    return "line " + std::string(4 - n.size(), '0') + n;
+}
+
+std::size_t const kLineSize = MakeLine(0).size() + 1;
+
+struct SampleFileFixture
+{
+    SampleFileFixture()
+    {
+        std::ofstream of{kSampleFileName, std::ios_base::out | std::ios_base::trunc};
+
+        for (unsigned int i = 0; i < kSampleLines; ++i)
+        {
+            of << MakeLine(i) << '\n';
+        }
+    }
+};
+
+bool IsSampleLine(std::string const& l)
+{
+    return (l.size() == kLineSize - 1) && (l.compare(0, 5, "line ") == 0);
+}
+
+} // unnamed namespace
+
+BOOST_FIXTURE_TEST_SUITE(line_sampler, SampleFileFixture)
+
+BOOST_AUTO_TEST_CASE(seek_to_line_resyncs)
+{
+    FileLineReader<> flr{kSampleFileName};
+
+    // Right at the beginning of line 10.
+    BOOST_REQUIRE(flr.SeekToLine(10 * kLineSize));
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), MakeLine(10));
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLineOffset(), 10 * kLineSize);
+
+    // In the middle of line 20, so we get line 21.
+    BOOST_REQUIRE(flr.SeekToLine(20 * kLineSize + 3));
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), MakeLine(21));
+}
+
+BOOST_AUTO_TEST_CASE(discard_lines)
+{
+    FileLineReader<> flr{kSampleFileName};
+
+    BOOST_REQUIRE_EQUAL(flr.DiscardLines(5), 5);
+    BOOST_REQUIRE(flr.ReadLine());
+    BOOST_REQUIRE_EQUAL(flr.GetCurrentLine(), MakeLine(5));
+    BOOST_REQUIRE_EQUAL(flr.GetLineCount(), 6);
+
+    BOOST_REQUIRE_EQUAL(flr.DiscardLines(5000), kSampleLines - 6);
+    BOOST_REQUIRE(!flr.WasReadOK());
+}
+
+BOOST_AUTO_TEST_CASE(sample_byte_stride)
+{
+    FileLineReader<> flr{kSampleFileName};
+    std::vector<std::string> sample;
+
+    BOOST_REQUIRE_EQUAL(SampleByteStride(flr, 100 * kLineSize, std::back_inserter(sample)), 10);
+    for (unsigned int i = 0; i < sample.size(); ++i)
+    {
+        BOOST_REQUIRE_EQUAL(sample[i], MakeLine(i * 100));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sample_every_nth_line)
+{
+    FileLineReader<> flr{kSampleFileName};
+    std::vector<std::string> sample;
+
+    BOOST_REQUIRE_EQUAL(SampleEveryNthLine(flr, 300, std::back_inserter(sample)), 4);
+    BOOST_REQUIRE_EQUAL(sample[3], MakeLine(900));
+}
+
+BOOST_AUTO_TEST_CASE(sample_random_offsets)
+{
+    FileLineReader<> flr{kSampleFileName};
+    std::mt19937 gen{42};
+    std::vector<std::string> sample;
+
+    std::size_t sampled = SampleRandomOffsets(flr, 50, gen, std::back_inserter(sample));
+
+    BOOST_REQUIRE(sampled > 0 && sampled <= 50);
+    BOOST_REQUIRE(std::all_of(sample.begin(), sample.end(), IsSampleLine));
+    BOOST_REQUIRE(std::is_sorted(sample.begin(), sample.end()));
+    BOOST_REQUIRE(std::adjacent_find(sample.begin(), sample.end()) == sample.end());
+}
+
+BOOST_AUTO_TEST_CASE(sample_reservoir)
+{
+    FileLineReader<> flr{kSampleFileName};
+    std::mt19937 gen{42};
+    std::vector<std::string> sample;
+
+    BOOST_REQUIRE_EQUAL(SampleReservoir(flr, 50, gen, std::back_inserter(sample)), 50);
+    BOOST_REQUIRE(std::all_of(sample.begin(), sample.end(), IsSampleLine));
+    BOOST_REQUIRE(std::is_sorted(sample.begin(), sample.end()));
+    BOOST_REQUIRE(std::adjacent_find(sample.begin(), sample.end()) == sample.end());
+}
+
+BOOST_AUTO_TEST_CASE(sample_reservoir_small_file)
+{
+    FileLineReader<> flr{kSampleFileName};
+    std::mt19937 gen{42};
+    std::vector<std::string> sample;
+
+    BOOST_REQUIRE_EQUAL(SampleReservoir(flr, 5000, gen, std::back_inserter(sample)), kSampleLines);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,164 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/test/unit_test.hpp>
+
+#include "ms_windows/code_page.h"
+using pt::pcaetano::bluesy::ms_windows::GetEncoding;
+#include "ms_windows/native_codec.h"
+using pt::pcaetano::bluesy::ms_windows::NativeCodec;
+using pt::pcaetano::bluesy::ms_windows::Transcode;
+#include "ms_windows/win_exception.h"
+using pt::pcaetano::bluesy::ms_windows::UINT;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-local-typedefs"
+#include "boost/locale.hpp"
+using boost::locale::conv::between;
+using boost::locale::conv::from_utf;
+#pragma GCC diagnostic pop
+
+#include <string>
+using std::string;
+using std::wstring;
+
+namespace
+{
+
+UINT const singleByteCodePages[] = {850, 858, 874, 1250, 1251, 1252, 1253, 1254, 1255, 1256, 1257,
+    20127, 20866, 21866, 28591, 28592, 28593, 28594, 28595, 28596, 28597, 28598, 28599, 28603, 28605};
+
+NativeCodec const& Utf8()
+{
+    return *NativeCodec::Find(65001);
+}
+
+string Native(string const& s, NativeCodec const& to, NativeCodec const& from)
+{
+    return Transcode(s.data(), s.size(), to, from);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(native_codec)
+
+BOOST_AUTO_TEST_CASE(nc_find)
+{
+    BOOST_REQUIRE(NativeCodec::Find(850u) != nullptr);
+    BOOST_REQUIRE(NativeCodec::Find(65001u)->IsUtf8());
+    BOOST_REQUIRE(NativeCodec::Find("Windows-1252")->GetCodePage() == 1252);
+    BOOST_REQUIRE(NativeCodec::Find("UTF-8")->IsUtf8());
+
+    // Multibyte, ICU only.
+    BOOST_REQUIRE(NativeCodec::Find(932u) == nullptr);
+    BOOST_REQUIRE(NativeCodec::Find("gb18030") == nullptr);
+    BOOST_REQUIRE(NativeCodec::Find("utf-16") == nullptr);
+}
+
+// The tables come from ICU (see tools/gen_single_byte_tables.cpp); here, we
+// check that every mapped byte survives a round trip through UTF-8, i.e.,
+// that the encode tables are consistent with the decode tables.
+BOOST_AUTO_TEST_CASE(nc_round_trip)
+{
+    for (auto cp : singleByteCodePages)
+    {
+        NativeCodec const* nc = NativeCodec::Find(cp);
+        BOOST_REQUIRE(nc != nullptr);
+        BOOST_REQUIRE(nc->IsAsciiIdentity());
+
+        for (unsigned int b = 0; b < 256; ++b)
+        {
+            string byte(1, static_cast<char>(b));
+            string decoded = Native(byte, Utf8(), *nc);
+
+            if (nc->Decode(static_cast<unsigned char>(b)) == NativeCodec::unmappedChar)
+            {
+                BOOST_REQUIRE(decoded.empty());
+                continue;
+            }
+
+            BOOST_REQUIRE_MESSAGE(Native(decoded, *nc, Utf8()) == byte, GetEncoding(cp) << ", byte " << b);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(nc_text)
+{
+    // Only chars every converter agrees on - ICU and iconv differ on some
+    // control chars and unassigned bytes.
+    string const text{"Olá, isto é um teste. Não há caracteres inválidos; só acentuação. "
+        "Mas também há uma linha bastante mais comprida do que 16 bytes, para o SIMD.\n\tFim."};
+
+    for (auto cp : singleByteCodePages)
+    {
+        NativeCodec const& nc = *NativeCodec::Find(cp);
+        string enc = GetEncoding(cp);
+
+        string encoded = Native(text, nc, Utf8());
+        BOOST_REQUIRE_EQUAL(encoded, between(text, enc, "utf-8"));
+        BOOST_REQUIRE_EQUAL(Native(encoded, Utf8(), nc), between(encoded, "utf-8", enc));
+    }
+
+    // Single-byte to single-byte.
+    string latin1 = between(text, "iso88591", "utf-8");
+    BOOST_REQUIRE_EQUAL(Native(latin1, *NativeCodec::Find(850u), *NativeCodec::Find(28591u)),
+        between(latin1, "cp850", "iso88591"));
+}
+
+BOOST_AUTO_TEST_CASE(nc_invalid_utf8_skipped)
+{
+    NativeCodec const& cp1252 = *NativeCodec::Find(1252u);
+
+    // Truncated, bad continuation, overlong, surrogate, lone continuation.
+    char const* invalid[] = {"a\xC3", "a\xC3(b", "a\xE2\x82(b", "a\xC0\xAF" "b", "a\xED\xA0\x80" "b", "a\x80" "b"};
+
+    for (auto s : invalid)
+    {
+        string actual = Native(s, cp1252, Utf8());
+        BOOST_REQUIRE_EQUAL(actual.substr(0, 1), "a");
+        BOOST_REQUIRE(actual.find_first_not_of("ab(") == string::npos);
+    }
+
+    // No euro sign in iso8859-1.
+    BOOST_REQUIRE_EQUAL(Native("10 €", *NativeCodec::Find(28591u), Utf8()), "10 ");
+}
+
+BOOST_AUTO_TEST_CASE(nc_wide)
+{
+    wstring const text{L"Olá, isto é um teste com € e \U0001F600, e mais uns quantos caracteres."};
+
+    for (auto cp : singleByteCodePages)
+    {
+        string enc = GetEncoding(cp);
+        BOOST_REQUIRE_EQUAL(Transcode(text.data(), text.size(), *NativeCodec::Find(cp)), from_utf(text, enc));
+    }
+
+    BOOST_REQUIRE_EQUAL(Transcode(text.data(), text.size(), Utf8()), from_utf(text, "utf-8"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
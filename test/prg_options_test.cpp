@@ -2,14 +2,23 @@
 
 #include "app_config/prog_options.h"
 using pt::pcaetano::bluesy::config::AppOptions;
+using pt::pcaetano::bluesy::config::OptionSources;
+#include "app_config/reloadable_options.h"
+using pt::pcaetano::bluesy::config::ReloadableAppOptions;
 #include "app_config/appconfigexception.h"
 using pt::pcaetano::bluesy::config::error_message;
 using pt::pcaetano::bluesy::config::ConfigInvalidOption;
+using pt::pcaetano::bluesy::config::ConfigOpenFileError;
 using pt::pcaetano::bluesy::config::ConfigRequiredOptionMissing;
 
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
 
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 using std::cout;
 using std::endl;
@@ -19,6 +28,7 @@ using std::ostream;
 using std::stringstream;
 #include <string>
 using std::string;
+#include <thread>
 #include <vector>
 using std::vector;
 
@@ -37,6 +47,8 @@ public:
     std::string GetOperation() const { return operation; }
     std::vector<std::string> GetList() const { return list; }
     bool WantsValidFieldNr() const { return validateFieldNr; }
+
+    static int validateCalls;
 private:
     friend std::ostream& operator<<(std::ostream& os, TestAppOptions const& obj);
 
@@ -59,8 +71,12 @@ void TestAppOptions::DefineOptions(po::options_description& desc)
     ;
 }
 
+int TestAppOptions::validateCalls = 0;
+
 void TestAppOptions::Validate()
 {
+    ++validateCalls;
+
     if ((operation == "C") || (operation == "P"))
     {
         return;
@@ -184,4 +200,309 @@ BOOST_AUTO_TEST_CASE(po_list)
     BOOST_REQUIRE_EQUAL_COLLECTIONS(actual.cbegin(), actual.cend(), expected.cbegin(), expected.cend());
 }
 
+char const* PO_TEST_CONFIG_FILE = "po_test_config.ini";
+char const* PO_TEST_SNAPSHOT_FILE = "po_test_config.snapshot";
+
+void WriteConfigFile(string const& contents)
+{
+    std::ofstream of{PO_TEST_CONFIG_FILE, std::ios_base::out | std::ios_base::trunc};
+    of << contents;
+}
+
+void SetEnv(char const* name, char const* value)
+{
+#ifdef _WIN32
+    _putenv_s(name, value);
+#else
+    setenv(name, value, 1);
+#endif
+}
+
+void UnsetEnv(char const* name)
+{
+#ifdef _WIN32
+    _putenv_s(name, "");
+#else
+    unsetenv(name);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(po_config_file)
+{
+    WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + "\noper=C\nlist=a\nlist=bc\n");
+    char const* args[] = { "" };
+    int cnt = sizeof(args) / sizeof(*args);
+    OptionSources sources;
+    sources.configFile = PO_TEST_CONFIG_FILE;
+
+    AppOptions<TestAppOptions> ao(cnt, args, PO_TEST_OPTION_HEADER, sources);
+    vector<string> actual = ao.GetOptions().GetList();
+    vector<string> expected{ "a", "bc" };
+
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().GetFileName(), PO_TEST_FILENAME);
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(actual.cbegin(), actual.cend(), expected.cbegin(), expected.cend());
+    BOOST_REQUIRE_EQUAL(ao.UsedSnapshot(), false);
+}
+
+// Command line > environment > config file.
+BOOST_AUTO_TEST_CASE(po_source_precedence)
+{
+    WriteConfigFile("fich=from_file\noper=C\nvalidnc=true\n");
+    SetEnv("PCBTEST_FICH", "from_env");
+    SetEnv("PCBTEST_OPER", "P");
+    SetEnv("PCBTEST_NOT_AN_OPTION", "ignored");
+    char const* args[] = { "", "-f", PO_TEST_FILENAME };
+    int cnt = sizeof(args) / sizeof(*args);
+    OptionSources sources;
+    sources.configFile = PO_TEST_CONFIG_FILE;
+    sources.envPrefix = "PCBTEST_";
+
+    AppOptions<TestAppOptions> ao(cnt, args, PO_TEST_OPTION_HEADER, sources);
+
+    UnsetEnv("PCBTEST_FICH");
+    UnsetEnv("PCBTEST_OPER");
+    UnsetEnv("PCBTEST_NOT_AN_OPTION");
+
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().GetFileName(), PO_TEST_FILENAME);
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().GetOperation(), "P");
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().WantsValidFieldNr(), true);
+}
+
+BOOST_AUTO_TEST_CASE(po_config_file_errors)
+{
+    char const* args[] = { "" };
+    int cnt = sizeof(args) / sizeof(*args);
+    OptionSources sources;
+    sources.configFile = "po_test_no_such_file.ini";
+
+    BOOST_REQUIRE_THROW(AppOptions<TestAppOptions> ao(cnt, args, PO_TEST_OPTION_HEADER, sources),
+        ConfigOpenFileError);
+
+    sources.configFile = PO_TEST_CONFIG_FILE;
+    WriteConfigFile("fich=x\noper=C\nnot_an_option=1\n");
+    BOOST_REQUIRE_THROW(AppOptions<TestAppOptions> ao(cnt, args, PO_TEST_OPTION_HEADER, sources),
+        ConfigInvalidOption);
+
+    // Validate()
+    WriteConfigFile("fich=x\noper=X\n");
+    BOOST_REQUIRE_THROW(AppOptions<TestAppOptions> ao(cnt, args, PO_TEST_OPTION_HEADER, sources),
+        ConfigInvalidOption);
+}
+
+BOOST_AUTO_TEST_CASE(po_config_snapshot)
+{
+    std::remove(PO_TEST_SNAPSHOT_FILE);
+    WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + "\noper=C\nlist=a\n");
+    char const* args[] = { "", "-l", "b" };
+    int cnt = sizeof(args) / sizeof(*args);
+    OptionSources sources;
+    sources.configFile = PO_TEST_CONFIG_FILE;
+    sources.snapshotFile = PO_TEST_SNAPSHOT_FILE;
+
+    {
+        AppOptions<TestAppOptions> ao(cnt, args, PO_TEST_OPTION_HEADER, sources);
+        BOOST_REQUIRE_EQUAL(ao.UsedSnapshot(), false);
+    }
+
+    // Nothing changed - no parsing, but the options are still validated.
+    int calls = TestAppOptions::validateCalls;
+    {
+        AppOptions<TestAppOptions> ao(cnt, args, PO_TEST_OPTION_HEADER, sources);
+        vector<string> actual = ao.GetOptions().GetList();
+        vector<string> expected{ "b" };
+
+        BOOST_REQUIRE_EQUAL(ao.UsedSnapshot(), true);
+        BOOST_REQUIRE_EQUAL(TestAppOptions::validateCalls, calls + 1);
+        BOOST_REQUIRE_EQUAL(ao.GetOptions().GetFileName(), PO_TEST_FILENAME);
+        BOOST_REQUIRE_EQUAL(ao.GetOptions().GetOperation(), "C");
+        BOOST_REQUIRE_EQUAL_COLLECTIONS(actual.cbegin(), actual.cend(), expected.cbegin(), expected.cend());
+    }
+
+    // A different command line.
+    {
+        char const* args2[] = { "", "-c" };
+        AppOptions<TestAppOptions> ao(2, args2, PO_TEST_OPTION_HEADER, sources);
+        BOOST_REQUIRE_EQUAL(ao.UsedSnapshot(), false);
+    }
+
+    // A different file, even if the modification time is the same.
+    WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + "\noper=P\nlist=a\n");
+    {
+        AppOptions<TestAppOptions> ao(cnt, args, PO_TEST_OPTION_HEADER, sources);
+        BOOST_REQUIRE_EQUAL(ao.UsedSnapshot(), false);
+        BOOST_REQUIRE_EQUAL(ao.GetOptions().GetOperation(), "P");
+    }
+
+    // A corrupt snapshot is just ignored.
+    {
+        std::ofstream of{PO_TEST_SNAPSHOT_FILE, std::ios_base::out | std::ios_base::trunc};
+        of << "PCBOPTS1garbage";
+    }
+    {
+        AppOptions<TestAppOptions> ao(cnt, args, PO_TEST_OPTION_HEADER, sources);
+        BOOST_REQUIRE_EQUAL(ao.UsedSnapshot(), false);
+        BOOST_REQUIRE_EQUAL(ao.GetOptions().GetOperation(), "P");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(po_reload)
+{
+    WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + "\noper=C\n");
+    char const* args[] = { "", "-l", "a" };
+    int cnt = sizeof(args) / sizeof(*args);
+    OptionSources sources;
+    sources.configFile = PO_TEST_CONFIG_FILE;
+
+    ReloadableAppOptions<TestAppOptions> rao(cnt, args, PO_TEST_OPTION_HEADER, sources);
+    auto before = rao.GetOptions();
+
+    BOOST_REQUIRE_EQUAL(before->GetOperation(), "C");
+    BOOST_REQUIRE_EQUAL(rao.ReloadIfChanged(), false);
+
+    // The size changes, so we don't depend on the modification time's resolution.
+    WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + "\noper=P\nvalidnc=true\n");
+    BOOST_REQUIRE_EQUAL(rao.ReloadIfChanged(), true);
+    BOOST_REQUIRE_EQUAL(rao.ReloadIfChanged(), false);
+    BOOST_REQUIRE_EQUAL(rao.GetReloadCount(), 1u);
+
+    // A snapshot keeps its version.
+    BOOST_REQUIRE_EQUAL(before->GetOperation(), "C");
+    BOOST_REQUIRE_EQUAL(before->WantsValidFieldNr(), false);
+    BOOST_REQUIRE_EQUAL(rao.GetOptions()->GetOperation(), "P");
+    BOOST_REQUIRE_EQUAL(rao.GetOptions()->WantsValidFieldNr(), true);
+    BOOST_REQUIRE_EQUAL(rao.GetOptions()->GetList().size(), 1u);
+
+    // Validate() fails - we keep what we had.
+    WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + "\noper=X\n");
+    BOOST_REQUIRE_THROW(rao.ReloadIfChanged(), ConfigInvalidOption);
+    BOOST_REQUIRE_EQUAL(rao.GetOptions()->GetOperation(), "P");
+    BOOST_REQUIRE_EQUAL(rao.GetReloadCount(), 1u);
+    // The same bad file isn't tried again on every call, only when asked to.
+    BOOST_REQUIRE_EQUAL(rao.ReloadIfChanged(), false);
+    rao.RequestReload();
+    BOOST_REQUIRE_THROW(rao.ReloadIfChanged(), ConfigInvalidOption);
+    BOOST_REQUIRE_EQUAL(rao.ReloadIfChanged(), false);
+
+    WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + "\noper=C\n");
+    rao.RequestReload();
+    BOOST_REQUIRE_EQUAL(rao.ReloadIfChanged(), true);
+    BOOST_REQUIRE_EQUAL(rao.GetOptions()->GetOperation(), "C");
+    BOOST_REQUIRE_EQUAL(rao.GetReloadCount(), 2u);
+
+    // before still holds the first version.
+    BOOST_REQUIRE_EQUAL(rao.GetRetiredCount(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(po_reload_concurrent_readers)
+{
+    WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + "\noper=C\n");
+    char const* args[] = { "" };
+    OptionSources sources;
+    sources.configFile = PO_TEST_CONFIG_FILE;
+
+    ReloadableAppOptions<TestAppOptions> rao(1, args, PO_TEST_OPTION_HEADER, sources);
+    std::atomic<bool> done{false};
+    std::atomic<int> bad{0};
+    vector<std::thread> readers;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        readers.emplace_back([&rao, &done, &bad]
+        {
+            while (!done.load())
+            {
+                auto opts = rao.GetOptions();
+                string oper = opts->GetOperation();
+
+                if (((oper != "C") && (oper != "P")) || (opts->GetFileName() != PO_TEST_FILENAME))
+                {
+                    ++bad;
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < 200; ++i)
+    {
+        WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + ((i % 2 == 0) ? "\noper=P\n" : "\noper=C\n"));
+        rao.Reload();
+    }
+
+    done = true;
+    for (auto& t : readers)
+    {
+        t.join();
+    }
+
+    BOOST_REQUIRE_EQUAL(bad.load(), 0);
+    BOOST_REQUIRE_EQUAL(rao.GetReloadCount(), 200u);
+
+    // Nothing's held any more.
+    BOOST_REQUIRE_EQUAL(rao.ReloadIfChanged(), false);
+    BOOST_REQUIRE_EQUAL(rao.GetRetiredCount(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(po_reload_stalled_reader)
+{
+    WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + "\noper=C\n");
+    char const* args[] = { "" };
+    OptionSources sources;
+    sources.configFile = PO_TEST_CONFIG_FILE;
+
+    ReloadableAppOptions<TestAppOptions> rao(1, args, PO_TEST_OPTION_HEADER, sources);
+    std::atomic<int> paused{-1};
+    std::atomic<int> resume{-1};
+    std::atomic<bool> gotIt{false};
+    std::atomic<bool> release{false};
+    string oper;
+
+    rao.readerPause = [&paused, &resume](int point)
+    {
+        paused = point;
+        while (resume.load() < point)
+        {
+            std::this_thread::yield();
+        }
+    };
+
+    std::thread reader([&rao, &gotIt, &release, &oper]
+    {
+        auto opts = rao.GetOptions();
+        gotIt = true;
+        while (!release.load())
+        {
+            std::this_thread::yield();
+        }
+        oper = opts->GetOperation();
+    });
+
+    // The reader has read the phase, but not incremented its grace counter.
+    while (paused.load() != 0) { std::this_thread::yield(); }
+    WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + "\noper=P\n");
+    rao.Reload();
+
+    // Now it holds the grace counter of a phase the first reload already
+    // waited on, and has loaded the second version.
+    resume = 0;
+    while (paused.load() != 1) { std::this_thread::yield(); }
+    WriteConfigFile("fich=" + string{PO_TEST_FILENAME} + "\noper=C\n");
+    std::thread reloader([&rao] { rao.Reload(); });
+    // Give the second reload time to (wrongly) delete the second version.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    resume = 1;
+    reloader.join();
+
+    while (!gotIt.load()) { std::this_thread::yield(); }
+    // The first version is gone, the second is held by the reader.
+    BOOST_REQUIRE_EQUAL(rao.GetRetiredCount(), 1u);
+    release = true;
+    reader.join();
+    rao.readerPause = nullptr;
+
+    BOOST_REQUIRE_EQUAL(oper, "P");
+    BOOST_REQUIRE_EQUAL(rao.GetOptions()->GetOperation(), "C");
+    BOOST_REQUIRE_EQUAL(rao.ReloadIfChanged(), false);
+    BOOST_REQUIRE_EQUAL(rao.GetRetiredCount(), 0u);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
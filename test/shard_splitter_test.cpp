@@ -0,0 +1,188 @@
+#include <boost/test/unit_test.hpp>
+
+#include "utils/exception.h"
+using pt::pcaetano::bluesy::utils::FileOpenException;
+#include "utils/file_chunks.h"
+using pt::pcaetano::bluesy::utils::FileChunk;
+using pt::pcaetano::bluesy::utils::SplitLineChunks;
+#include "utils/file_line_reader.h"
+using pt::pcaetano::bluesy::utils::FileLineReader;
+#include "utils/shard_splitter.h"
+using pt::pcaetano::bluesy::utils::LineKey;
+using pt::pcaetano::bluesy::utils::ShardOfKey;
+using pt::pcaetano::bluesy::utils::ShardSplitStats;
+using pt::pcaetano::bluesy::utils::ShardSplitter;
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <ios>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::string const kUnsplitFileName{"ss_test_file.flr"};
+unsigned int const kShards = 5;
+
+std::string MakeLine(unsigned int i)
+{
+    return "[2014-01-01 00:00:00.000] match-" + std::to_string(i % 97) + " This is line " + std::to_string(i);
+}
+
+std::vector<std::string> MakeShardFiles()
+{
+    std::vector<std::string> files;
+
+    for (unsigned int s = 0; s < kShards; ++s)
+    {
+        files.push_back("ss_test_shard." + std::to_string(s));
+    }
+
+    return files;
+}
+
+std::vector<std::string> ReadLines(std::string const& file_name)
+{
+    std::ifstream in{file_name, std::ios_base::in | std::ios_base::binary};
+    std::vector<std::string> lines;
+
+    for (std::string l; std::getline(in, l); )
+    {
+        lines.push_back(l);
+    }
+
+    return lines;
+}
+
+struct ShardFileFixture
+{
+    ShardFileFixture()
+    {
+        std::ofstream of{kUnsplitFileName, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary};
+
+        for (unsigned int i = 0; i < 20000; ++i)
+        {
+            of << MakeLine(i) << '\n';
+        }
+        // No key, and no delimiter.
+        of << "no key";
+    }
+
+    ~ShardFileFixture()
+    {
+        for (auto const& f : MakeShardFiles())
+        {
+            std::remove(f.c_str());
+        }
+    }
+};
+
+// Every line is in the right shard, and, with the line number, we can check
+// the order within each chunk.
+void CheckShards(ShardSplitStats const& stats, std::size_t chunk_size, bool whole_order)
+{
+    // Which chunk each line is in.
+    std::vector<std::size_t> chunk_of;
+    {
+        FileLineReader<> flr{kUnsplitFileName};
+        std::vector<FileChunk> chunks = SplitLineChunks(flr, static_cast<std::streamoff>(chunk_size));
+        BOOST_REQUIRE_EQUAL(chunks.size(), stats.chunks);
+
+        FileLineReader<> lines{kUnsplitFileName};
+        std::size_t c = 0;
+        while (lines.ReadLine())
+        {
+            while (lines.GetCurrentLineOffset() >= chunks[c].offset + chunks[c].size)
+            {
+                ++c;
+            }
+            chunk_of.push_back(c);
+        }
+    }
+
+    BOOST_REQUIRE_EQUAL(stats.lines, 20001);
+    BOOST_REQUIRE_EQUAL(stats.keyless_lines, 1);
+    BOOST_REQUIRE_EQUAL(stats.shard_lines.size(), kShards);
+
+    std::vector<std::string> files = MakeShardFiles();
+    unsigned long long total = 0;
+
+    for (unsigned int s = 0; s < kShards; ++s)
+    {
+        std::vector<std::string> lines = ReadLines(files[s]);
+        BOOST_REQUIRE_EQUAL(lines.size(), stats.shard_lines[s]);
+        total += lines.size();
+
+        std::vector<long> last_in_chunk(stats.chunks, -1);
+        long last = -1;
+
+        for (auto const& l : lines)
+        {
+            if (l == "no key")
+            {
+                BOOST_REQUIRE_EQUAL(s, ShardOfKey("", kShards));
+                continue;
+            }
+
+            std::size_t k = l.find("match-");
+            BOOST_REQUIRE_EQUAL(s, ShardOfKey(l.substr(k, l.find(' ', k) - k), kShards));
+
+            long n = std::stol(l.substr(l.rfind(' ') + 1));
+            std::size_t c = chunk_of[static_cast<std::size_t>(n)];
+            BOOST_REQUIRE(n > last_in_chunk[c]);
+            last_in_chunk[c] = n;
+
+            if (whole_order)
+            {
+                BOOST_REQUIRE(n > last);
+                last = n;
+            }
+        }
+    }
+
+    BOOST_REQUIRE_EQUAL(total, 20001);
+}
+
+} // unnamed namespace
+
+BOOST_FIXTURE_TEST_SUITE(shard_splitter, ShardFileFixture)
+
+BOOST_AUTO_TEST_CASE(split_single_thread)
+{
+    ShardSplitter splitter{LineKey::Field(2)};
+    splitter.SetThreadCount(1);
+    splitter.SetChunkSize(64 * 1024);
+    splitter.SetBufferSize(4096);
+
+    ShardSplitStats stats = splitter.Split(kUnsplitFileName, MakeShardFiles());
+    BOOST_REQUIRE_EQUAL(stats.threads, 1);
+    CheckShards(stats, 64 * 1024, true);
+}
+
+BOOST_AUTO_TEST_CASE(split_parallel)
+{
+    ShardSplitter splitter{LineKey::Field(2)};
+    splitter.SetThreadCount(4);
+    splitter.SetChunkSize(64 * 1024);
+    splitter.SetBufferSize(4096);
+
+    ShardSplitStats stats = splitter.Split(kUnsplitFileName, MakeShardFiles());
+    BOOST_REQUIRE_EQUAL(stats.threads, 4);
+    BOOST_REQUIRE(stats.chunks > 4);
+    CheckShards(stats, 64 * 1024, false);
+
+    // Again, over the same shard files.
+    CheckShards(splitter.Split(kUnsplitFileName, MakeShardFiles()), 64 * 1024, false);
+}
+
+BOOST_AUTO_TEST_CASE(split_open_fail)
+{
+    ShardSplitter splitter{LineKey::Field(2)};
+
+    BOOST_REQUIRE_THROW(splitter.Split("ss_no_such_file.flr", MakeShardFiles()), FileOpenException);
+    BOOST_REQUIRE_THROW(splitter.Split(kUnsplitFileName, {"no_such_dir/ss_test_shard.0"}), FileOpenException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
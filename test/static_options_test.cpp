@@ -0,0 +1,180 @@
+#include <boost/test/unit_test.hpp>
+
+#include "app_config/static_options.h"
+using pt::pcaetano::bluesy::config::StaticAppOptions;
+using pt::pcaetano::bluesy::config::StaticOption;
+using pt::pcaetano::bluesy::config::StoreMember;
+#include "app_config/appconfigexception.h"
+using pt::pcaetano::bluesy::config::error_message;
+using pt::pcaetano::bluesy::config::ConfigInvalidOption;
+using pt::pcaetano::bluesy::config::ConfigRequiredOptionMissing;
+
+#include <ostream>
+using std::ostream;
+#include <sstream>
+using std::stringstream;
+#include <string>
+using std::string;
+#include <vector>
+using std::vector;
+
+namespace
+{
+
+char const* SO_TEST_OPTION_HEADER = "Test App Options";
+
+// The same options as prg_options_test's TestAppOptions.
+class StaticTestOptions
+{
+public:
+    void Validate();
+
+    string GetFileName() const { return fileName; }
+    string GetOperation() const { return operation; }
+    vector<string> GetList() const { return list; }
+    bool WantsValidFieldNr() const { return validateFieldNr; }
+    int GetCount() const { return count; }
+private:
+    friend ostream& operator<<(ostream& os, StaticTestOptions const& obj);
+
+    string fileName;
+    bool validateFieldNr = false;
+    string operation;
+    vector<string> list;
+    int count = 10;
+public:
+    using Option = StaticOption<StaticTestOptions>;
+    static constexpr Option options[] =
+    {
+        Option::Help("help", 'h', "Mensagem de ajuda"),
+        Option::Value("fich", 'f', "Ficheiro a processar",
+            &StoreMember<StaticTestOptions, string, &StaticTestOptions::fileName>, true),
+        Option::Switch("validnc", 'c', "Valida nr. de campos por linha e termina",
+            &StoreMember<StaticTestOptions, bool, &StaticTestOptions::validateFieldNr>),
+        Option::Value("oper", 'o', "Operação. C - Oper C; P - Oper P",
+            &StoreMember<StaticTestOptions, string, &StaticTestOptions::operation>, true),
+        Option::MultiToken("list", 'l', "Lista",
+            &StoreMember<StaticTestOptions, vector<string>, &StaticTestOptions::list>),
+        Option::Value("count", '\0', "Quantos",
+            &StoreMember<StaticTestOptions, int, &StaticTestOptions::count>)
+    };
+};
+
+constexpr StaticTestOptions::Option StaticTestOptions::options[];
+
+void StaticTestOptions::Validate()
+{
+    if ((operation == "C") || (operation == "P"))
+    {
+        return;
+    }
+
+    BOOST_THROW_EXCEPTION(ConfigInvalidOption() << error_message("Operacao nao reconhecida: " + operation));
+}
+
+ostream& operator<<(ostream& os, StaticTestOptions const& obj)
+{
+    os << "Ficheiro: " << obj.fileName;
+
+    return os;
+}
+
+using TestOptions = StaticAppOptions<StaticTestOptions>;
+
+} // namespace
+
+
+BOOST_AUTO_TEST_SUITE(static_options)
+
+// Same as po's.
+BOOST_AUTO_TEST_CASE(so_help_no_convert)
+{
+    char const* args[] = { "", "-h" };
+    int cnt = sizeof(args) / sizeof(*args);
+    string expected{SO_TEST_OPTION_HEADER};
+    expected += ":\n  -h [ --help ]         Mensagem de ajuda\n"
+        "  -f [ --fich ] arg     Ficheiro a processar\n"
+        "  -c [ --validnc ]      Valida nr. de campos por linha e termina\n"
+        "  -o [ --oper ] arg     Operação. C - Oper C; P - Oper P\n"
+        "  -l [ --list ] arg     Lista\n"
+        "  --count arg           Quantos\n";
+    stringstream out;
+
+    TestOptions ao(cnt, args, SO_TEST_OPTION_HEADER, out, false);
+
+    BOOST_REQUIRE_EQUAL(out.str(), expected);
+    BOOST_REQUIRE_EQUAL(ao.HaveShownHelp(), true);
+}
+
+BOOST_AUTO_TEST_CASE(so_values)
+{
+    char const* args[] = { "", "-f", "file.ext", "--oper=C", "-c", "-l", "a", "bc", "--count", "-3" };
+    int cnt = sizeof(args) / sizeof(*args);
+
+    BOOST_REQUIRE_THROW(TestOptions ao(cnt, args, SO_TEST_OPTION_HEADER), ConfigInvalidOption);
+
+    args[8] = "--count=-3";
+    TestOptions ao(cnt - 1, args, SO_TEST_OPTION_HEADER);
+    vector<string> actual = ao.GetOptions().GetList();
+    vector<string> expected{ "a", "bc" };
+
+    BOOST_REQUIRE_EQUAL(ao.HaveShownHelp(), false);
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().GetFileName(), "file.ext");
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().GetOperation(), "C");
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().WantsValidFieldNr(), true);
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().GetCount(), -3);
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(actual.cbegin(), actual.cend(), expected.cbegin(), expected.cend());
+
+    stringstream out;
+    out << ao;
+    BOOST_REQUIRE_EQUAL(out.str(), "Ficheiro: file.ext");
+}
+
+BOOST_AUTO_TEST_CASE(so_short_forms)
+{
+    // Grouped switches, with a value for the last one.
+    char const* args[] = { "", "-cffile.ext", "-oP", "-l", "x", "-l", "y" };
+    int cnt = sizeof(args) / sizeof(*args);
+    TestOptions ao(cnt, args, SO_TEST_OPTION_HEADER);
+    vector<string> actual = ao.GetOptions().GetList();
+    vector<string> expected{ "x", "y" };
+
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().GetFileName(), "file.ext");
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().GetOperation(), "P");
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().WantsValidFieldNr(), true);
+    BOOST_REQUIRE_EQUAL(ao.GetOptions().GetCount(), 10);
+    BOOST_REQUIRE_EQUAL_COLLECTIONS(actual.cbegin(), actual.cend(), expected.cbegin(), expected.cend());
+}
+
+BOOST_AUTO_TEST_CASE(so_errors)
+{
+    char const* missing[] = { "", "-f", "x" };
+    BOOST_REQUIRE_THROW(TestOptions ao(3, missing, SO_TEST_OPTION_HEADER), ConfigRequiredOptionMissing);
+
+    char const* unknown[] = { "", "-f", "x", "-o", "C", "--nope" };
+    BOOST_REQUIRE_THROW(TestOptions ao(6, unknown, SO_TEST_OPTION_HEADER), ConfigInvalidOption);
+
+    char const* twice[] = { "", "-f", "x", "-o", "C", "-f", "y" };
+    BOOST_REQUIRE_THROW(TestOptions ao(7, twice, SO_TEST_OPTION_HEADER), ConfigInvalidOption);
+
+    char const* noValue[] = { "", "-o", "C", "-f" };
+    BOOST_REQUIRE_THROW(TestOptions ao(4, noValue, SO_TEST_OPTION_HEADER), ConfigInvalidOption);
+
+    char const* badValue[] = { "", "-f", "x", "-o", "C", "--count", "1x" };
+    BOOST_REQUIRE_THROW(TestOptions ao(7, badValue, SO_TEST_OPTION_HEADER), ConfigInvalidOption);
+
+    char const* stray[] = { "", "-f", "x", "-o", "C", "stray" };
+    BOOST_REQUIRE_THROW(TestOptions ao(6, stray, SO_TEST_OPTION_HEADER), ConfigInvalidOption);
+
+    // Validate()
+    char const* invalid[] = { "", "-f", "x", "-o", "X" };
+    BOOST_REQUIRE_THROW(TestOptions ao(5, invalid, SO_TEST_OPTION_HEADER), ConfigInvalidOption);
+
+    // Asking for help skips all of the above, except unknown options.
+    char const* help[] = { "", "-o", "X", "--help" };
+    stringstream out;
+    TestOptions ao(4, help, SO_TEST_OPTION_HEADER, out, false);
+    BOOST_REQUIRE_EQUAL(ao.HaveShownHelp(), true);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
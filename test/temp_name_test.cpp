@@ -0,0 +1,23 @@
+#include <boost/test/unit_test.hpp>
+
+#include "base/temp_name.h"
+using pt::pcaetano::bluesy::base::UniqueTempName;
+
+#include <string>
+
+
+BOOST_AUTO_TEST_SUITE(temp_name)
+
+BOOST_AUTO_TEST_CASE(tn_unique)
+{
+    std::string first = UniqueTempName("some/dir/file.idx");
+    std::string second = UniqueTempName("some/dir/file.idx");
+
+    BOOST_REQUIRE_NE(first, second);
+    // Same directory.
+    BOOST_REQUIRE_EQUAL(first.find("some/dir/file.idx."), 0u);
+    BOOST_REQUIRE_EQUAL(first.substr(first.size() - 4), ".tmp");
+    BOOST_REQUIRE_EQUAL(first.find('/', 9), std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,70 @@
+#include <boost/test/unit_test.hpp>
+
+#include "utils/text_validation.h"
+using pt::pcaetano::bluesy::utils::AsciiPrefixLength;
+using pt::pcaetano::bluesy::utils::IsAscii;
+using pt::pcaetano::bluesy::utils::IsValidUtf8;
+
+#include <string>
+using std::string;
+using std::wstring;
+
+BOOST_AUTO_TEST_SUITE(text_validation)
+
+BOOST_AUTO_TEST_CASE(tv_ascii)
+{
+    BOOST_CHECK(IsAscii(""));
+    BOOST_CHECK(IsAscii("plain ASCII, with\ttabs and\nnewlines\x7F"));
+    BOOST_CHECK(!IsAscii("não"));
+
+    std::wstring w{L"plain"};
+    BOOST_CHECK(IsAscii(w.data(), w.size()));
+    w = L"não";
+    BOOST_CHECK(!IsAscii(w.data(), w.size()));
+}
+
+// A non-ASCII char in every position of strings long enough to go through
+// all the SIMD loops and the scalar tail.
+BOOST_AUTO_TEST_CASE(tv_ascii_every_position)
+{
+    for (std::size_t len = 1; len < 200; ++len)
+    {
+        string s(len, 'a');
+        BOOST_REQUIRE(IsAscii(s.data(), s.size()));
+        BOOST_REQUIRE_EQUAL(AsciiPrefixLength(s.data(), s.size()), len);
+
+        for (std::size_t pos = 0; pos < len; ++pos)
+        {
+            string t{s};
+            t[pos] = '\xE9';
+            BOOST_REQUIRE(!IsAscii(t.data(), t.size()));
+            BOOST_REQUIRE_EQUAL(AsciiPrefixLength(t.data(), t.size()), pos);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tv_valid_utf8)
+{
+    BOOST_CHECK(IsValidUtf8(""));
+    BOOST_CHECK(IsValidUtf8("plain ASCII"));
+    BOOST_CHECK(IsValidUtf8("Olá, não há problema nenhum com a acentuação, € \xF0\x9F\x98\x80."));
+    BOOST_CHECK(IsValidUtf8("\xEF\xBF\xBF\xF4\x8F\xBF\xBF"));
+
+    // Truncated.
+    BOOST_CHECK(!IsValidUtf8("abc\xC3"));
+    BOOST_CHECK(!IsValidUtf8("abc\xE2\x82"));
+    // Bad continuation.
+    BOOST_CHECK(!IsValidUtf8("a\xC3(b"));
+    // Lone continuation.
+    BOOST_CHECK(!IsValidUtf8("a\x80" "b"));
+    // Overlong.
+    BOOST_CHECK(!IsValidUtf8("\xC0\xAF"));
+    BOOST_CHECK(!IsValidUtf8("\xE0\x80\xAF"));
+    // Surrogate.
+    BOOST_CHECK(!IsValidUtf8("\xED\xA0\x80"));
+    // Above U+10FFFF.
+    BOOST_CHECK(!IsValidUtf8("\xF4\x90\x80\x80"));
+    BOOST_CHECK(!IsValidUtf8("\xF8\x88\x80\x80\x80"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
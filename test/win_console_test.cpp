@@ -32,17 +32,36 @@
 #define PCBLUESY_MSWINDCON_FULLHEADER
 #include "ms_windows/win_console_out.h"
 using pt::pcaetano::bluesy::ms_windows::ConvertOutput;
+using pt::pcaetano::bluesy::ms_windows::ConvertOutputTo;
+using pt::pcaetano::bluesy::ms_windows::ConvertTextTo;
+using pt::pcaetano::bluesy::ms_windows::FindCodePage;
+using pt::pcaetano::bluesy::ms_windows::FindEncoding;
+using pt::pcaetano::bluesy::ms_windows::GetCodePage;
+using pt::pcaetano::bluesy::ms_windows::GetEncoding;
+#include "ms_windows/converted_batch.h"
+using pt::pcaetano::bluesy::ms_windows::ConvertAll;
+using pt::pcaetano::bluesy::ms_windows::ConvertedBatch;
+#include "ms_windows/converting_streambuf.h"
+using pt::pcaetano::bluesy::ms_windows::ConvertingOutput;
+using pt::pcaetano::bluesy::ms_windows::ConvertingStreamBuf;
+#include "ms_windows/encoding_converter.h"
+using pt::pcaetano::bluesy::ms_windows::EncodingConverter;
 #include "ms_windows/win_exception.h"
 using pt::pcaetano::bluesy::ms_windows::EncodingNotFoundException;
+using pt::pcaetano::bluesy::ms_windows::UINT;
 
+#include <memory>
 #include <ostream>
 using std::basic_ostream;
 using std::ostream;
 using std::wostream;
+#include <sstream>
 #include <string>
 using std::basic_string;
 using std::string;
 using std::wstring;
+#include <vector>
+using std::vector;
 
 BOOST_AUTO_TEST_SUITE(mswindows_console)
 
@@ -127,4 +146,245 @@ BOOST_AUTO_TEST_CASE(mswcon_convert_out_operator_wchar)
     BOOST_REQUIRE_EQUAL(expected, actual);
 }
 
+BOOST_AUTO_TEST_CASE(mswcon_converter_reuse)
+{
+    EncodingConverter conv{"cp850", "utf-8"};
+    string expected{expectedC};
+
+    // The converter keeps state between calls; it must be reset each time.
+    for (int i = 0; i < 3; ++i)
+    {
+        BOOST_REQUIRE_EQUAL(expected, conv.Convert(origC));
+        BOOST_REQUIRE_EQUAL(expected, conv.Convert(origW));
+    }
+
+    BOOST_REQUIRE_EQUAL(string{}, conv.Convert(""));
+    BOOST_REQUIRE_EQUAL(string{"abc"}, conv.Convert(L"abc"));
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_converter_long_string)
+{
+    EncodingConverter conv{"utf-16le", "utf-8"};
+    string orig;
+    for (int i = 0; i < 1000; ++i)
+    {
+        orig += origC;
+    }
+
+    // Output is twice the size of the input, for these chars, so it grows.
+    string actual{conv.Convert(orig.c_str(), orig.size())};
+    BOOST_REQUIRE_EQUAL(actual.size(), 1000 * wstring{origW}.size() * 2);
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_converter_skips_invalid)
+{
+    EncodingConverter conv{"cp850", "utf-8"};
+
+    // No cp850 char for the euro sign.
+    BOOST_REQUIRE_EQUAL(string{"10 "}, conv.Convert("10 \u20AC"));
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_converter_unknown_encoding)
+{
+    BOOST_REQUIRE_THROW(EncodingConverter("no-such-encoding", "utf-8"), EncodingNotFoundException);
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_encoding_by_code_page)
+{
+    BOOST_REQUIRE_EQUAL(GetEncoding(850), "cp850");
+    BOOST_REQUIRE_EQUAL(GetEncoding(1252), "cp1252");
+    BOOST_REQUIRE_EQUAL(GetEncoding(28605), "iso885915");
+    BOOST_REQUIRE_EQUAL(GetEncoding(65001), "utf8");
+
+    BOOST_REQUIRE(FindEncoding(0) == nullptr);
+    BOOST_REQUIRE(FindEncoding(851) == nullptr);
+    BOOST_REQUIRE(FindEncoding(70000) == nullptr);
+    BOOST_REQUIRE_THROW(GetEncoding(851), EncodingNotFoundException);
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_code_page_by_encoding)
+{
+    BOOST_REQUIRE_EQUAL(GetCodePage("cp850"), 850u);
+    BOOST_REQUIRE_EQUAL(GetCodePage("windows1252"), 1252u);
+    BOOST_REQUIRE_EQUAL(GetCodePage("Windows-1252"), 1252u);
+    BOOST_REQUIRE_EQUAL(GetCodePage("Shift_JIS"), 932u);
+    BOOST_REQUIRE_EQUAL(GetCodePage("ISO-8859-1"), 28591u);
+    BOOST_REQUIRE_EQUAL(GetCodePage("UTF-8"), 65001u);
+    BOOST_REQUIRE_EQUAL(GetCodePage("big5"), 950u);
+
+    BOOST_REQUIRE_EQUAL(FindCodePage(""), 0u);
+    BOOST_REQUIRE_EQUAL(FindCodePage("cp85"), 0u);
+    BOOST_REQUIRE_EQUAL(FindCodePage("zzz"), 0u);
+    BOOST_REQUIRE_EQUAL(FindCodePage("a-name-much-longer-than-any-encoding"), 0u);
+    BOOST_REQUIRE_THROW(GetCodePage("no-such-encoding"), EncodingNotFoundException);
+}
+
+// Every name must map to a code page whose encoding maps back to the same code page.
+BOOST_AUTO_TEST_CASE(mswcon_encoding_round_trip)
+{
+    char const* names[] = {"cp874", "windows874", "gbk", "ms936", "sjis", "koi8u", "euckr", "gb18030"};
+
+    for (auto n : names)
+    {
+        UINT cp = GetCodePage(n);
+        BOOST_REQUIRE_EQUAL(GetCodePage(GetEncoding(cp).c_str()), cp);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_convert_ascii)
+{
+    string const orig{"Plain ASCII, no conversion needed.\n"};
+
+    BOOST_REQUIRE_EQUAL(orig, ConvertOutput(orig));
+    BOOST_REQUIRE_EQUAL(orig, ConvertOutput(wstring{orig.begin(), orig.end()}));
+
+    EncodingConverter conv{"utf-16le", "utf-8"};
+    BOOST_REQUIRE_EQUAL(conv.Convert("ab"), string("a\0b\0", 4));
+}
+
+// A tiny buffer, so that multibyte chars get split between rounds.
+BOOST_AUTO_TEST_CASE(mswcon_converting_streambuf)
+{
+    std::ostringstream out;
+    auto conv = std::make_shared<EncodingConverter>("cp850", "utf-8");
+
+    {
+        ConvertingStreamBuf csb{out.rdbuf(), conv, 16};
+        ostream os{&csb};
+
+        for (int i = 0; i < 20; ++i)
+        {
+            os << origC << i;
+            if (i % 7 == 0)
+            {
+                os.flush();
+            }
+        }
+    }
+
+    string expected;
+    for (int i = 0; i < 20; ++i)
+    {
+        expected += expectedC + std::to_string(i);
+    }
+
+    BOOST_REQUIRE_EQUAL(expected, out.str());
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_converting_output)
+{
+    std::ostringstream out;
+    // ostringstream::rdbuf() always returns the stringbuf.
+    ostream& os = out;
+    std::streambuf* orig = os.rdbuf();
+
+    {
+        ConvertingOutput co{os};
+        BOOST_REQUIRE(os.rdbuf() != orig);
+        os << origC;
+    }
+
+    BOOST_REQUIRE(os.rdbuf() == orig);
+    BOOST_REQUIRE(out.good());
+    BOOST_REQUIRE_EQUAL(string{expectedC}, out.str());
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_converted_batch)
+{
+    vector<string> orig{"plain", origC, "", "mais um: ção"};
+    ConvertedBatch batch{std::make_shared<EncodingConverter>("cp850", "utf-8")};
+
+    for (int round = 0; round < 2; ++round)
+    {
+        batch.Clear();
+        ConvertAll(orig.begin(), orig.end(), batch);
+        batch.Append(origW);
+
+        BOOST_REQUIRE_EQUAL(batch.Size(), orig.size() + 1);
+
+        string all;
+        for (std::size_t i = 0; i < orig.size(); ++i)
+        {
+            string expected = ConvertOutput(orig[i]);
+            BOOST_REQUIRE_EQUAL(batch[i].to_string(), expected);
+            all += expected;
+        }
+        BOOST_REQUIRE_EQUAL(batch[orig.size()].to_string(), string{expectedC});
+        all += expectedC;
+
+        BOOST_REQUIRE_EQUAL(batch.GetBuffer(), all);
+        BOOST_REQUIRE_EQUAL(batch.GetOffsets().back(), all.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_convert_output_to_wide)
+{
+    wstring expected{origW};
+
+    // char goes straight to wchar_t; wchar_t is just copied.
+    BOOST_REQUIRE(ConvertOutputTo<wstring>(origC) == expected);
+    BOOST_REQUIRE(ConvertOutputTo<wstring>(string{origC}) == expected);
+    BOOST_REQUIRE(ConvertOutputTo<wstring>(origW) == expected);
+
+    // Outside the BMP, i.e., a surrogate pair with 2-byte wchar_t.
+    BOOST_REQUIRE(ConvertOutputTo<wstring>("\xF0\x9F\x98\x80!") == L"\U0001F600!");
+
+    // Narrow is the same as ConvertOutput().
+    BOOST_REQUIRE_EQUAL(ConvertOutputTo<string>(origW), string{expectedC});
+    BOOST_REQUIRE_EQUAL(ConvertOutputTo<string>(wstring{origW}), string{expectedC});
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_convert_output_to_buffer)
+{
+    string narrow{"> "};
+    ConvertOutputTo(origC, narrow);
+    ConvertOutputTo(wstring{L"\n"}, narrow);
+    BOOST_REQUIRE_EQUAL(narrow, "> " + string{expectedC} + "\n");
+
+    wstring wide{L"> "};
+    ConvertOutputTo(origC, wide);
+    ConvertOutputTo(origW, wide);
+    BOOST_REQUIRE(wide == L"> " + wstring{origW} + origW);
+
+    // Cleared buffers keep their capacity.
+    wide.clear();
+    wstring::size_type capacity = wide.capacity();
+    ConvertOutputTo("abc", wide);
+    BOOST_REQUIRE(wide == L"abc");
+    BOOST_REQUIRE_EQUAL(wide.capacity(), capacity);
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_convert_text_to_wide)
+{
+    BOOST_REQUIRE(ConvertTextTo<wstring>(expectedC, "", "cp850") == wstring{origW});
+    BOOST_REQUIRE_EQUAL(ConvertTextTo<string>(origW, "cp850", ""), string{expectedC});
+
+    // Multibyte, through ICU/Boost Locale. "\x82\xA0" is HIRAGANA LETTER A in cp932.
+    BOOST_REQUIRE(ConvertTextTo<wstring>("a\x82\xA0", "", "cp932") == L"a\u3042");
+}
+
+BOOST_AUTO_TEST_CASE(mswcon_converter_to_wide)
+{
+    // cp932 isn't native, so decoding goes through ICU, straight to wchar_t.
+    EncodingConverter sjis{"UTF-8", "cp932"};
+    wstring wide;
+    sjis.ConvertAppend("a\x82\xA0", 3, wide);
+    BOOST_REQUIRE(wide == L"a\u3042");
+
+    // Long enough to make the output grow.
+    string longSjis;
+    for (int i = 0; i < 1000; ++i)
+    {
+        longSjis += "\x82\xA0";
+    }
+    wide.clear();
+    sjis.ConvertAppend(longSjis.data(), longSjis.size(), wide);
+    BOOST_REQUIRE(wide == wstring(1000, L'\u3042'));
+
+    EncodingConverter cp850{"UTF-8", "cp850"};
+    wide.clear();
+    cp850.ConvertAppend(expectedC, sizeof(expectedC) - 1, wide);
+    BOOST_REQUIRE(wide == wstring{origW});
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,175 @@
+// Copyright (c) 2016, Paulo Caetano
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the copyright holder nor the names of any other
+//       contributors may be used to endorse or promote products derived from
+//       this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Generates src/ms_windows/single_byte_tables.h, the decode tables for the
+// single-byte code pages that ms_windows converts natively, i.e., without
+// ICU.
+//
+// The tables are taken from ICU, using the same converter names as
+// all_windows_encodings, except where ICU's converter for that name isn't
+// the Windows code page (e.g., ICU's cp874 is IBM's, with no euro sign).
+// Any byte ICU can't decode into a single BMP code point is left unmapped.
+//
+// ICU's IBM code pages (cp850, cp858) swap a few control chars (0x1A, 0x1C,
+// 0x7F); Windows and iconv don't, and neither do we - bytes 0x00 - 0x7F are
+// always ASCII. Every such override is reported on stderr.
+//
+// Build and run (from the repository's root):
+//   g++ -std=c++11 tools/gen_single_byte_tables.cpp -licuuc -o gen_single_byte_tables
+//   ./gen_single_byte_tables > src/ms_windows/single_byte_tables.h
+
+#include <unicode/ucnv.h>
+#include <unicode/uversion.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+
+struct SingleByteEncoding
+{
+    char const* name;
+    unsigned int codePage;
+    // If null, same as name.
+    char const* icuName;
+};
+
+// Sorted by code page.
+SingleByteEncoding const single_byte_encodings[] =
+{
+    { "cp850",      850,   nullptr },
+    { "cp858",      858,   nullptr },
+    { "cp874",      874,   "windows-874-2000" },
+    { "cp1250",     1250,  nullptr },
+    { "cp1251",     1251,  nullptr },
+    { "cp1252",     1252,  nullptr },
+    { "cp1253",     1253,  nullptr },
+    { "cp1254",     1254,  nullptr },
+    { "cp1255",     1255,  nullptr },
+    { "cp1256",     1256,  nullptr },
+    { "cp1257",     1257,  nullptr },
+    { "usascii",    20127, nullptr },
+    { "koi8r",      20866, nullptr },
+    { "koi8u",      21866, nullptr },
+    { "iso88591",   28591, nullptr },
+    { "iso88592",   28592, nullptr },
+    { "iso88593",   28593, nullptr },
+    { "iso88594",   28594, nullptr },
+    { "iso88595",   28595, nullptr },
+    { "iso88596",   28596, nullptr },
+    { "iso88597",   28597, nullptr },
+    { "iso88598",   28598, nullptr },
+    { "iso88599",   28599, nullptr },
+    { "iso885913",  28603, nullptr },
+    { "iso885915",  28605, nullptr },
+};
+
+unsigned int const unmapped = 0xFFFF;
+
+unsigned int DecodeByte(UConverter* conv, unsigned char byte)
+{
+    UErrorCode err = U_ZERO_ERROR;
+    UChar dest[4];
+    char src = static_cast<char>(byte);
+
+    int32_t len = ucnv_toUChars(conv, dest, 4, &src, 1, &err);
+
+    if (U_FAILURE(err) || (len != 1) || (dest[0] == 0xFFFD) || (dest[0] == unmapped))
+    {
+        return unmapped;
+    }
+    return dest[0];
+}
+
+} // unnamed namespace
+
+int main()
+{
+    std::printf("// Generated by tools/gen_single_byte_tables.cpp, from ICU %s. Do not edit.\n\n", U_ICU_VERSION);
+    std::printf("#ifndef SINGLE_BYTE_TABLES_H\n#define SINGLE_BYTE_TABLES_H\n\n");
+    std::printf("#include <cstdint>\n\n");
+    std::printf("namespace pt { namespace pcaetano { namespace bluesy {\n");
+    std::printf("namespace ms_windows {\nnamespace single_byte_tables {\n\n");
+    std::printf("// Bytes with no mapping decode to this.\n");
+    std::printf("constexpr std::uint16_t unmapped = 0x%04X;\n\n", unmapped);
+
+    for (auto const& sbe : single_byte_encodings)
+    {
+        UErrorCode err = U_ZERO_ERROR;
+        UConverter* conv = ucnv_open((sbe.icuName != nullptr) ? sbe.icuName : sbe.name, &err);
+
+        if (U_FAILURE(err))
+        {
+            std::fprintf(stderr, "Could not open converter for %s: %s\n", sbe.name, u_errorName(err));
+            return EXIT_FAILURE;
+        }
+
+        ucnv_setToUCallBack(conv, UCNV_TO_U_CALLBACK_STOP, nullptr, nullptr, nullptr, &err);
+
+        if (ucnv_getMaxCharSize(conv) != 1)
+        {
+            std::fprintf(stderr, "%s is not a single-byte encoding\n", sbe.name);
+            return EXIT_FAILURE;
+        }
+
+        std::printf("// %s (%s)\n", sbe.name, ucnv_getName(conv, &err));
+        std::printf("constexpr std::uint16_t %s[256] =\n{", sbe.name);
+
+        for (unsigned int b = 0; b < 256; ++b)
+        {
+            unsigned int cp = DecodeByte(conv, static_cast<unsigned char>(b));
+
+            if ((b < 0x80) && (cp != b))
+            {
+                std::fprintf(stderr, "%s: 0x%02X decodes to U+%04X, using U+%04X\n", sbe.name, b, cp, b);
+                cp = b;
+            }
+
+            std::printf("%s0x%04X,", (b % 8 == 0) ? "\n    " : " ", cp);
+        }
+        std::printf("\n};\n\n");
+
+        ucnv_close(conv);
+    }
+
+    std::printf("struct SingleByteTable\n{\n    unsigned int codePage;\n");
+    std::printf("    std::uint16_t const* toUnicode;\n};\n\n");
+    std::printf("// Sorted by code page.\n");
+    std::printf("constexpr SingleByteTable all_tables[] =\n{\n");
+    for (auto const& sbe : single_byte_encodings)
+    {
+        std::printf("    { %u, %s },\n", sbe.codePage, sbe.name);
+    }
+    std::printf("};\n\n");
+
+    std::printf("} // namespace single_byte_tables\n} // namespace ms_windows\n}}}\n\n");
+    std::printf("#endif // SINGLE_BYTE_TABLES_H\n");
+
+    return EXIT_SUCCESS;
+}